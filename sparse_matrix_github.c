@@ -1,1601 +1,13771 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <math.h>
-#include <string.h>
-#define MAX_MATRICES 10
-
-typedef enum{FAILURE, SUCCESS} status_code;
-typedef enum{FALSE, TRUE} boolean;
-typedef enum{SPARSE_VIEW, FULL_VIEW } PrintMode;
-typedef float matrix_entry;
-
-
-typedef struct Sm_Node_Tag    // element node
-{
-    matrix_entry data;
-    int row, col;
-    struct Sm_Node_Tag* right;
-    struct Sm_Node_Tag* down;
-} Sm_Node;
-typedef struct Row_Node_Tag   // row list
-{
-    int row;
-    Sm_Node* rowlist;
-    struct Row_Node_Tag* next;
-} Row_Node;
-typedef struct Col_Node_Tag   // column list
-{
-    int col;
-    Sm_Node* collist;
-    struct Col_Node_Tag* next;
-} Col_Node;
-typedef struct SparseMatrix
-{
-    int rowCount, colCount;
-    Row_Node *rowHead;
-    Col_Node *colHead;
-} SparseMatrix;
-
-typedef struct Named_Matrix_Tag
-{
-    char name;
-    SparseMatrix matrix;
-    boolean isOccupied;
-}NamedMatrix;
-
-NamedMatrix registry[MAX_MATRICES];
-
-
-void initializeMatrix(SparseMatrix* matrix)
-{
-    matrix->rowCount = 0;
-    matrix->colCount = 0;
-    matrix->colHead = NULL;
-    matrix->rowHead = NULL;
-}
-void initializeMatrixWithSize(SparseMatrix* matrix, int rows, int cols)
-{
-    matrix->rowCount = rows;
-    matrix->colCount = cols;
-    matrix->colHead = NULL;
-    matrix->rowHead = NULL;
-}
-Row_Node* createRowNode(int row)
-{
-    Row_Node* nptr;
-    nptr = (Row_Node*)malloc(sizeof(Row_Node));
-    nptr->row = row;
-    nptr->rowlist = NULL;
-    nptr->next = NULL;
-    return nptr;
-}
-Col_Node* createColNode(int col)
-{
-    Col_Node* nptr;
-    nptr = (Col_Node*)malloc(sizeof(Col_Node));
-    nptr->col = col;
-    nptr->collist = NULL;
-    nptr->next = NULL;
-    return nptr;
-}
-Sm_Node* createEleNode(int row, int col, matrix_entry data)
-{
-    Sm_Node* nptr;
-    nptr = (Sm_Node*)malloc(sizeof(Sm_Node));
-    nptr->row = row;
-    nptr->col = col;
-    nptr->data = data;
-    nptr->down = nptr->right = NULL;
-    return nptr;
-}
-status_code insertElement(int row, int col, matrix_entry data, SparseMatrix* matrix)
-{
-    status_code sc = SUCCESS;
-    if(data != 0)
-    {
-        if(row < matrix->rowCount && col < matrix->colCount)
-        {
-            Sm_Node *prevE = NULL, *element, *nptrE;
-
-            Row_Node* prevR = NULL, *rowPos = matrix->rowHead, *nptrR;
-            Col_Node* prevC = NULL, *colPos = matrix->colHead, *nptrC;
-            while(rowPos != NULL && rowPos->row<row) // search row
-            {
-                prevR = rowPos;
-                rowPos = rowPos->next;
-            }
-            while(colPos != NULL && colPos->col<col) // search column
-            {
-                prevC = colPos;
-                colPos = colPos->next;
-            }
-            if(rowPos == NULL || rowPos->row != row)// create row node if not exist
-            {
-                nptrR = createRowNode(row);
-                if(nptrR != NULL)
-                {
-                    nptrR->next = rowPos;
-                    if(prevR != NULL)
-                    {
-                        prevR->next = nptrR;
-                    }
-                    else
-                    {
-                        matrix->rowHead = nptrR;
-                    }
-                    nptrE = createEleNode(row, col, data);//created here  // can check nptrE!=NULL
-
-                    nptrR->rowlist = nptrE;
-                    rowPos = nptrR;
-                }
-                else
-                {
-                    sc = FAILURE;
-                }
-            }
-            else // row node exists
-            { // search if element node exist or not
-                prevE = NULL;
-                element = rowPos->rowlist;
-                while((element != NULL) && (element->col < col))
-                {
-                    prevE = element;
-                    element = element->right;
-                }
-                if(element!=NULL/*update*/ && element->col == col)// element exists // no need to update in column 
-                {
-                    element->data = data;
-                }
-                else // element DNE
-                {// lets dont worry about column, lets just create element node
-                    nptrE = createEleNode(row, col, data);
-                    if(nptrE != NULL)
-                    {
-                        nptrE->right = element;
-                        if(prevE != NULL)
-                        {
-                            prevE->right = nptrE;
-                        }
-                        else
-                        {
-                            rowPos->rowlist = nptrE;
-                        }
-                    }
-                    else
-                    {
-                        sc = FAILURE;
-                    }
-                }
-            }
-
-            if(colPos == NULL || colPos->col != col)// create column node if not exist
-            {
-                nptrC = createColNode(col);
-                if(nptrC != NULL)
-                {   
-                    nptrC->next = colPos;
-                    if(prevC != NULL)
-                    {
-                        prevC->next = nptrC;
-                    }
-                    else
-                    {
-                        matrix->colHead = nptrC;
-                    }
-                    nptrC->collist = nptrE;// element created above 
-                    colPos = nptrC;
-                }
-                else
-                {
-                    sc = FAILURE;
-                }
-            }
-            else // column node exists
-            { // search if element node exist or not
-                prevE = NULL;
-                element = colPos->collist;
-                //searching for correct pos of element
-                while((element != NULL) && (element->row < row))
-                {
-                    prevE = element;
-                    element = element->down;
-                }
-                if(element!=NULL/*update*/ && element->row == row && element->col == col)
-                {//if ele exist, updating value done in row
-                    printf("Unexpected duplication at row = %d, col = %d, data = %f\n", row, col, data);
-                    sc = FAILURE;
-                }
-                else
-                {
-                    // attached it according to row // element created above
-                    nptrE->down = element;
-                    if(prevE != NULL)
-                    {
-                        prevE->down = nptrE;
-                    }
-                    else
-                    {
-                        colPos->collist = nptrE;
-                    }
-                }
-            }
-        }
-        else
-        {
-            printf("Row and column number are out of bounds.");
-            sc = FAILURE;
-        }
-    }
-
-    return sc;
-}
-status_code deleteElement(int row, int col, SparseMatrix* matrix, matrix_entry *dptr)
-{
-    //lets assume insertion done correctly and no error happen
-    status_code sc = SUCCESS;
-    Sm_Node *prevE = NULL, *element, *nptrE;
-
-    Row_Node* prevR = NULL, *rowPos = matrix->rowHead;
-    Col_Node* prevC = NULL, *colPos = matrix->colHead;
-
-    while(rowPos != NULL && rowPos->row<row) // search row
-    {
-        prevR = rowPos;
-        rowPos = rowPos->next;
-    }
-    while(colPos != NULL && colPos->col<col) // search column
-    {
-        prevC = colPos;
-        colPos = colPos->next;
-    }
-
-    if(rowPos != NULL && rowPos->row == row)
-    {
-        prevE = NULL;
-        element = rowPos->rowlist;
-        while((element != NULL) && (element->col < col))
-        {
-            prevE = element;
-            element = element->right;
-        }
-        if(element!=NULL && element->col == col) // row exists
-        {
-            //delete from row
-            if(prevE != NULL)
-            {
-                prevE->right = element->right;
-            }
-            else
-            {
-                rowPos->rowlist = element->right;
-            }
-
-            if(colPos != NULL && colPos->col == col)// just for safety
-            {
-                prevE = NULL;
-                element = colPos->collist;
-                //searching for correct pos of element in column
-                while((element != NULL) && (element->row != row))
-                {
-                    prevE = element;
-                    element = element->down;
-                }
-                if(element != NULL)//just for safety measures//column exists 
-                {
-                    //delete from column
-                    if(prevE != NULL)
-                    {
-                        prevE->down = element->down;
-                    }
-                    else
-                    {
-                        colPos->collist = element->down;
-                    }
-                    *dptr = element->data;
-                    free(element);
-
-                    if(rowPos->rowlist == NULL)
-                    {
-                        if(prevR != NULL)
-                        {
-                            prevR->next = rowPos->next;
-                        }
-                        else
-                        {
-                            matrix->rowHead = rowPos->next;
-                        }
-                        free(rowPos);
-                    }
-                    if(colPos->collist == NULL)
-                    {
-                        if(prevC != NULL)
-                        {
-                            prevC->next = colPos->next;
-                        }
-                        else
-                        {
-                            matrix->colHead = colPos->next;
-                        }
-                        free(colPos);
-                    }
-                }
-                else// col DNE
-                {
-                    sc = FAILURE;
-                }
-            }
-
-        }
-        else// row DNE
-        {
-            sc = FAILURE;
-        }
-    }
-    else
-    {
-        sc = FAILURE;
-    }
-    return sc;
-}
-void printNamedMatrix(const SparseMatrix* matrix, const char name, PrintMode mode)
-{
-    printf("Matrix %c [%d x %d]\n", name, matrix->rowCount, matrix->colCount);
-
-    if (mode == FULL_VIEW) {
-        for (int i = 0; i < matrix->rowCount; i++) {
-            for (int j = 0; j < matrix->colCount; j++) {
-                Sm_Node* element = NULL;
-                Row_Node* row = matrix->rowHead;
-
-                // Find the row
-                while (row && row->row < i) row = row->next;
-                if (row && row->row == i) {
-                    element = row->rowlist;
-                    while (element && element->col < j) element = element->right;
-                }
-
-                if (element && element->col == j)
-                    printf("%6.2f ", element->data);
-                else
-                    printf("%6.2f ", 0.0);
-            }
-            printf("\n");
-        }
-    } else {
-        // SPARSE_VIEW
-        Row_Node* row = matrix->rowHead;
-        while (row) {
-            Sm_Node* element = row->rowlist;
-            while (element) {
-                printf("(%d, %d) -> %.2f\n", element->row, element->col, element->data);
-                element = element->right;
-            }
-            row = row->next;
-        }
-    }
-}
-void clearMatrix(SparseMatrix *sm) 
-{
-    Row_Node* rptr = sm->rowHead;
-    matrix_entry d;
-    while(rptr) 
-    {
-        Sm_Node* sptr = rptr->rowlist;
-        while(sptr) 
-        {
-            deleteElement(sptr->row, sptr->col, sm, &d);
-            sptr = sptr->right;
-        }
-        rptr = rptr->next;
-    }
-}
-boolean search(int row, int col, SparseMatrix* matrix)//if exists true otherwise false
-{
-    boolean exist;
-    Sm_Node *element;
-
-    Row_Node *rowPos = matrix->rowHead;
-    Col_Node *colPos = matrix->colHead;
-
-    while(rowPos != NULL && rowPos->row<row) // search row
-    {
-        rowPos = rowPos->next;
-    }
-    while(colPos != NULL && colPos->col<col) // search column
-    {
-        colPos = colPos->next;
-    }
-    if(rowPos == NULL || rowPos->row != row || colPos == NULL || colPos->col != col)
-    {
-        exist = FALSE;
-    }
-    else
-    {
-        element = rowPos->rowlist;
-        while((element != NULL) && (element->col < col))
-        {
-            element = element->right;
-        }
-        if(element!=NULL && element->col == col && element->row == row)
-        {
-            exist = TRUE;
-        }
-        else
-        {
-            exist = FALSE; 
-        }
-    }
-    return exist;
-}
-status_code transpose(SparseMatrix* matrix)
-{
-    status_code sc = SUCCESS;
-    Sm_Node *element, *temp, *prev;
-
-    Row_Node *prevR = NULL, *rowPos = matrix->rowHead, *nptrColR, *prevColR = NULL, *tempHeadNewRow = NULL;
-    Col_Node *prevC = NULL, *colPos = matrix->colHead, *nptrRowC, *prevRowC = NULL;
-    while(colPos != NULL)
-    {
-        nptrColR = createRowNode(colPos->col);
-        if(nptrColR != NULL)
-        {
-            nptrColR->rowlist = colPos->collist;
-            if(prevColR)
-            {
-                prevColR->next = nptrColR;
-            }
-            else
-            {
-                tempHeadNewRow = nptrColR;
-            }
-            prevColR = nptrColR;
-            prevC = colPos;
-            colPos = colPos->next;
-            free(prevC);
-        }
-        else
-        {
-            sc = FAILURE;
-        }
-    }
-    while(rowPos != NULL)
-    {
-        nptrRowC = createColNode(rowPos->row);
-        if(nptrRowC != NULL)
-        {
-            nptrRowC->collist = rowPos->rowlist;
-            if(prevRowC)
-            {
-                prevRowC->next = nptrRowC;
-            }
-            else
-            {
-                (matrix->colHead) = nptrRowC;
-            }
-            element = rowPos->rowlist;
-            while(element != NULL)
-            {
-                element->row ^= element->col;
-                element->col ^= element->row;
-                element->row ^= element->col;
-                
-                prev = element;
-                element = element->right;
-
-                temp = prev->right;
-                prev->right = prev->down;
-                prev->down = temp;
-            }
-            prevRowC = nptrRowC;
-            prevR = rowPos;
-            rowPos = rowPos->next;
-            free(prevR);
-        }
-        else
-        {
-            sc = FAILURE;
-        }
-    }
-    matrix->rowHead = tempHeadNewRow;
-
-    // swapping rowCount and columnCount
-    matrix->rowCount ^= matrix->colCount;
-    matrix->colCount ^= matrix->rowCount;
-    matrix->rowCount ^= matrix->colCount;
-
-    return sc;
-}
-status_code addMatrix(SparseMatrix* matrix1, SparseMatrix* matrix2, SparseMatrix* result)
-{
-    status_code sc = SUCCESS;
-    Sm_Node *element1, *element2;
-    int sum;
-
-    Row_Node *rowPos1 = matrix1->rowHead, *rowPos2 = matrix2->rowHead;
-
-    initializeMatrix(result);
-
-    if(matrix1->rowHead == NULL) 
-    {
-        result->rowCount = matrix2->rowCount;
-        result->colCount = matrix2->colCount;
-
-        while(rowPos2)
-        {
-            element2 = rowPos2->rowlist;
-            while(element2)
-            {
-                insertElement(element2->row, element2->col, element2->data, result);
-                element2 = element2->right;
-            }
-            rowPos2 = rowPos2->next;
-        }
-        return sc;
-    }
-    else if(matrix2->rowHead == NULL) 
-    {
-        result->rowCount = matrix1->rowCount;
-        result->colCount = matrix1->colCount;
-
-        while(rowPos1)
-        {
-            element1 = rowPos1->rowlist;
-            while(element1)
-            {
-                insertElement(element1->row, element1->col, element1->data, result);
-                element1 = element1->right;
-            }
-            rowPos1 = rowPos1->next;
-        }
-        return sc;
-    }
-    else
-    {
-        if(matrix1->rowCount != matrix2->rowCount || matrix1->colCount != matrix2->colCount)
-        {
-            sc = FAILURE;
-        }
-        else
-        {
-            result->rowCount = matrix1->rowCount;
-            result->colCount = matrix1->colCount;
-
-            while(rowPos1 || rowPos2)
-            {
-                if(!rowPos2 || (rowPos1 && rowPos1->row < rowPos2->row))
-                {
-                    element1 = rowPos1->rowlist;
-                    while(element1 != NULL)
-                    {
-                        insertElement(element1->row, element1->col, element1->data, result);
-                        element1 = element1->right;
-                    }
-                    rowPos1 = rowPos1->next;
-                }
-                else if(!rowPos1 || (rowPos2 && rowPos1->row > rowPos2->row))
-                {
-                    element2 = rowPos2->rowlist;
-                    while(element2 != NULL)
-                    {
-                        insertElement(element2->row, element2->col, element2->data, result);
-                        element2 = element2->right;
-                    }
-                    rowPos2 = rowPos2->next;
-                }
-                else
-                {
-                    element1 = rowPos1->rowlist;
-                    element2 = rowPos2->rowlist;
-                    while(element1 || element2)
-                    {
-                        if(!element2 || (element1 && element1->col < element2->col))
-                        {
-                            insertElement(element1->row, element1->col, element1->data, result);
-                            element1 = element1->right;
-                        }
-                        else if(!element1 || (element2 && element1->col > element2->col))
-                        {
-                            insertElement(element2->row, element2->col, element2->data, result);
-                            element2 = element2->right;
-                        }
-                        else
-                        {
-                            sum = element1->data + element2->data;
-                            if(sum != 0)
-                            {
-                                insertElement(element1->row, element1->col, sum, result);
-                            }
-                            element1 = element1->right;
-                            element2 = element2->right;
-                        }
-                    }
-                    rowPos1 = rowPos1->next;
-                    rowPos2 = rowPos2->next;
-                }
-            }
-        }
-    }
-    return sc;
-}
-status_code subtractMatrix(SparseMatrix* matrix1, SparseMatrix* matrix2, SparseMatrix* result)
-{
-    status_code sc = SUCCESS;
-    SparseMatrix negMatrix2;
-    initializeMatrixWithSize(&negMatrix2, matrix2->rowCount, matrix2->colCount);
-
-    Sm_Node* element;
-    Row_Node* rowPos = matrix2->rowHead;
-    while(rowPos != NULL)
-    {
-        element = rowPos->rowlist;
-        while(element != NULL)
-        {
-            insertElement(element->row, element->col, -element->data, &negMatrix2);
-            element = element->right;
-        }
-        rowPos = rowPos->next;
-    }
-
-    sc = addMatrix(matrix1, &negMatrix2, result);
-
-    clearMatrix(&negMatrix2);
-
-    return sc;
-}
-status_code multiplyMatrix(SparseMatrix* matrix1, SparseMatrix* matrix2, SparseMatrix* result)
-{
-    status_code sc = SUCCESS;
-    Sm_Node *element1, *element2;
-    int product = 0;
-
-    Row_Node *rowPos1 = matrix1->rowHead;
-    Col_Node *colPos2 = matrix2->colHead;
-
-    initializeMatrix(result);
-
-    if(matrix1->rowHead == NULL || matrix2->rowHead == NULL)
-    {
-        sc = SUCCESS;
-    }
-    else
-    {
-        if(matrix1->colCount == matrix2->rowCount)
-        {
-            initializeMatrixWithSize(result, matrix1->rowCount, matrix2->colCount);
-
-            while(rowPos1)
-            {
-                colPos2 = matrix2->colHead;
-                while(colPos2)
-                {
-                    product = 0;
-                    element1 = rowPos1->rowlist;
-                    element2 = colPos2->collist;
-                    while(element1)
-                    {
-                        while(element2 && element2->row < element1->col)
-                        {
-                            element2 = element2->down;
-                        }
-                        if(element2 != NULL && element2->row == element1->col)
-                        {
-                            product = product + element1->data * element2->data;
-                        }
-                        element1 = element1->right;
-                    }
-                    if(product != 0)
-                    {
-                        insertElement(rowPos1->row, colPos2->col, product, result);
-                    }
-                    colPos2 = colPos2->next;
-                }
-                rowPos1 = rowPos1->next;
-            }
-        }
-        else
-        {
-            sc = FAILURE;
-        }
-    }
-    return sc;
-}
-float determinant(SparseMatrix* matrix)
-{
-    float det = 0;
-    if(matrix->rowCount == 1)
-    {
-        if(matrix->rowHead && matrix->rowHead->rowlist)
-        {
-            det = matrix->rowHead->rowlist->data;
-        }
-        else
-        {
-            det = 0;
-        }
-    }
-    else
-    {
-        Row_Node* rowPos = matrix->rowHead;
-        if(rowPos != NULL)
-        {
-            Sm_Node *element1 = rowPos->rowlist;
-            while(element1 != NULL)
-            {
-                SparseMatrix subMatrix;
-                initializeMatrixWithSize(&subMatrix, matrix->rowCount-1, matrix->colCount-1);
-
-                Sm_Node* element2;
-                rowPos = matrix->rowHead;
-                while(rowPos != NULL) 
-                {
-                    element2 = rowPos->rowlist;
-                    if(element2->row != element1->row)
-                    {
-                        while(element2 != NULL) 
-                        {
-                            if(element2->col != element1->col)
-                            {
-                                int newRow, newCol;
-                                if(element2->row > element1->row)
-                                {
-                                    newRow = element2->row - 1;
-                                }
-                                else
-                                {
-                                    newRow = element2->row;
-                                }
-                                if(element2->col > element1->col)
-                                {
-                                    newCol = element2->col - 1;
-                                }
-                                else
-                                {
-                                    newCol = element2->col;
-                                }
-                                insertElement(newRow, newCol, element2->data, &subMatrix);
-                            }
-                            element2 = element2->right;
-                        }
-                    }
-                    rowPos = rowPos->next;
-                }
-
-                det += pow(-1, element1->row + element1->col) * element1->data * determinant(&subMatrix);
-
-                clearMatrix(&subMatrix);
-
-                element1 = element1->right;
-            }
-        }
-    }
-    return det;
-}
-status_code determinantOfMatrix(SparseMatrix* matrix, float* result)
-{
-    status_code sc = SUCCESS;
-
-    if(matrix->rowCount == matrix->colCount)
-    {
-        *result = determinant(matrix);
-    }
-    else
-    {
-        printf("Determinant undefined: Matrix is not square.\n");
-        sc = FAILURE;
-    }
-    return sc;
-}
-
-void scalarMultiplyMatrix(SparseMatrix* matrix, float scalar)
-{
-    Row_Node* rowPos = matrix->rowHead;
-    while(rowPos)
-    {
-        Sm_Node* element = rowPos->rowlist;
-        while(element)
-        {
-            element->data = element->data * scalar;
-            element = element->right;
-        }
-        rowPos = rowPos->next;
-    }
-}
-status_code inverseOfMatrix(SparseMatrix* matrix, SparseMatrix* result)
-{
-    status_code sc = SUCCESS;
-    float det;
-    if(determinantOfMatrix(matrix, &det) == SUCCESS)
-    {
-        if(det == 0)
-        {
-            sc = FAILURE;
-        }
-        else
-        {
-            initializeMatrixWithSize(result, matrix->rowCount, matrix->colCount);
-
-            for(int row = 0; row < matrix->rowCount; row++)
-            {
-                for(int col = 0; col < matrix->colCount; col++)
-                {
-                    SparseMatrix subMatrix;
-                    initializeMatrixWithSize(&subMatrix, matrix->rowCount-1, matrix->colCount-1);
-
-                    Sm_Node* element2;
-                    Row_Node* rowPos = matrix->rowHead;
-                    while(rowPos != NULL) 
-                    {
-                        element2 = rowPos->rowlist;
-                        if(element2->row != row)
-                        {
-                            while(element2 != NULL)
-                            {
-                                if(element2->col != col)
-                                {
-                                    int newRow, newCol;
-                                    if(element2->row > row)
-                                    {
-                                        newRow = element2->row - 1;
-                                    }
-                                    else
-                                    {
-                                        newRow = element2->row;
-                                    }
-                                    if(element2->col > col)
-                                    {
-                                        newCol = element2->col - 1;
-                                    }
-                                    else
-                                    {
-                                        newCol = element2->col;
-                                    }
-                                    insertElement(newRow, newCol, element2->data, &subMatrix);
-                                }
-                                element2 = element2->right;
-                            }
-                        }
-                        rowPos = rowPos->next;
-                    }
-                    float subMatrixDet;
-                    if(determinantOfMatrix(&subMatrix, &subMatrixDet) == SUCCESS)
-                    {
-                        if(subMatrixDet != 0)
-                        {
-                            matrix_entry data = pow(-1, row + col) * subMatrixDet;
-                            insertElement(row, col, data, result);
-                        }
-                    }
-                    else
-                    {
-                        printf("determinant of subMatrix failed");
-                        sc = FAILURE;
-                    }
-                    clearMatrix(&subMatrix);
-                }
-            }
-
-            transpose(result);
-            scalarMultiplyMatrix(result, 1 / det);
-        }
-    }
-    else
-    {
-        printf("Failed to compute inverse.\n");
-        sc = FAILURE;
-    }
-    return sc;
-}
-//supportive functions
-status_code createMatrix()
-{
-    status_code sc = SUCCESS;
-    char name;
-    int rows, cols;
-
-    printf("Enter matrix name (A-J): ");
-    scanf(" %c", &name);
-
-    int index = name - 'A';
-    if(index < 0 || index >= MAX_MATRICES)
-    {
-        printf("Invalid matrix name.\n");
-        sc = FAILURE;
-    }
-    else
-    {
-        if(registry[index].isOccupied)
-        {
-            printf("Matrix %c already exists. Overwriting...\n", name);
-            clearMatrix(&registry[index].matrix);
-        }
-
-        printf("Enter number of rows: ");
-        scanf("%d", &rows);
-        printf("Enter number of columns: ");
-        scanf("%d", &cols);
-
-        initializeMatrixWithSize(&registry[index].matrix, rows, cols);
-        registry[index].name = name;
-        registry[index].isOccupied = TRUE;
-
-        printf("Matrix %c created [%d x %d].\n", name, rows, cols);
-
-        printf("Enter non-zero elements (row col value), or -1 to finish:\n");
-
-        status_code done = FALSE;
-        while(done == FALSE)
-        {
-            int r, c;
-            float val;
-            printf("> ");
-            scanf("%d", &r);
-
-            if(r == -1)
-            {
-                done = TRUE;
-            }
-            else
-            {
-                scanf("%d %f", &c, &val);
-
-                if(r < 0 || r >= rows || c < 0 || c >= cols)
-                {
-                    printf("Invalid row/column. Please try again.\n");
-                }
-                else
-                {
-                    if(insertElement(r, c, val, &registry[index].matrix) != SUCCESS)
-                    {
-                        printf("Insertion failed.\n");
-                    }
-                }
-            }
-        }
-
-        printf("Matrix %c created and initialized.\n", name);
-    }
-    return sc;
-}
-void resizeMatrix(SparseMatrix* matrix, int newRowCount, int newColCount)
-{
-    Row_Node* row = matrix->rowHead;
-    Row_Node* prevRow = NULL;
-
-    while(row)
-    {
-        if(row->row >= newRowCount)
-        {
-            Row_Node* tempRow = row;
-            row = row->next;
-            Sm_Node* sptr = tempRow->rowlist;
-            matrix_entry d;
-            while(sptr) 
-            {
-                deleteElement(sptr->row, sptr->col, matrix, &d);
-                sptr = sptr->right;
-            }
-            if(prevRow)
-            {
-                prevRow->next = row;
-            }
-            else
-            {
-                matrix->rowHead = row;
-            }
-            free(tempRow);
-        }
-        else
-        {
-            Sm_Node* ele = row->rowlist;
-            Sm_Node* prev = NULL;
-            while(ele)
-            {
-                if(ele->col >= newColCount)
-                {
-                    Sm_Node* temp = ele;
-                    ele = ele->right;
-                    if(prev)
-                    {
-                        prev->right = ele;
-                    }
-                    else
-                    {
-                        row->rowlist = ele;
-                    }
-                    free(temp);
-                }
-                else
-                {
-                    prev = ele;
-                    ele = ele->right;
-                }
-            }
-            prevRow = row;
-            row = row->next;
-        }
-    }
-
-    Col_Node* col = matrix->colHead;
-    Col_Node* prevCol = NULL;
-
-    while(col)
-    {
-        if(col->col >= newColCount)
-        {
-            Col_Node* tempCol = col;
-            col = col->next;
-            if(prevCol)
-            {
-                prevCol->next = col;
-            }
-            else
-            {
-                matrix->colHead = col;
-            }
-            free(tempCol);
-        }
-        else//just in case
-        {
-            Sm_Node* ele = col->collist;
-            Sm_Node* prev = NULL;
-            while(ele)
-            {
-                if(ele->row >= newRowCount)
-                {
-                    Sm_Node* temp = ele;
-                    ele = ele->down;
-                    if (prev) prev->down = ele;
-                    else col->collist = ele;
-                    free(temp);
-                }
-                else
-                {
-                    prev = ele;
-                    ele = ele->down;
-                }
-            }
-            prevCol = col;
-            col = col->next;
-        }
-    }
-
-    matrix->rowCount = newRowCount;
-    matrix->colCount = newColCount;
-}
-void resizeMatrixUI()
-{
-    char name;
-    int newRows, newCols;
-
-    printf("Enter matrix name to resize: ");
-    scanf(" %c", &name);
-
-    int index = name - 'A';
-    if(!registry[index].isOccupied)
-    {
-        printf("Matrix %c not found.\n", name);
-    }
-    else
-    {
-        printf("Enter new row count: ");
-        scanf("%d", &newRows);
-        printf("Enter new column count: ");
-        scanf("%d", &newCols);
-
-        resizeMatrix(&registry[index].matrix, newRows, newCols);
-
-        printf("Matrix %c resized to [%d x %d].\n", name, newRows, newCols);
-    }
-}
-void insertElementUI()
-{
-    char name;
-    int row, col;
-    matrix_entry val;
-
-    printf("Enter matrix name to insert into: ");
-    scanf(" %c", &name);
-
-    int index = name - 'A';
-    if(index < 0 || index >= MAX_MATRICES || !registry[index].isOccupied)
-    {
-        printf("Matrix %c does not exist.\n", name);
-    }
-    else
-    {
-        printf("Enter row index (0-based): ");
-        scanf("%d", &row);
-        printf("Enter column index (0-based): ");
-        scanf("%d", &col);
-        printf("Enter value: ");
-        scanf("%f", &val);
-
-        if(insertElement(row, col, val, &registry[index].matrix) == SUCCESS)
-        {
-            printf("Inserted value %.2f at (%d, %d) in matrix %c.\n", val, row, col, name);
-        }
-        else
-        {
-            printf("Failed to insert: Check bounds or memory.\n");
-        }
-    }
-}
-void deleteElementUI()
-{
-    char name;
-    int row, col;
-    float deletedVal;
-
-    printf("Enter matrix name to delete from: ");
-    scanf(" %c", &name);
-
-    int idx = name - 'A';
-    if(idx < 0 || idx >= MAX_MATRICES || !registry[idx].isOccupied)
-    {
-        printf("Matrix %c does not exist.\n", name);
-    }
-    else
-    {
-        printf("Enter row index (0-based): ");
-        scanf("%d", &row);
-        printf("Enter column index (0-based): ");
-        scanf("%d", &col);
-
-        if(deleteElement(row, col, &registry[idx].matrix, &deletedVal) == SUCCESS)
-        {
-            printf("Deleted value %.2f from (%d, %d) in matrix %c.\n", deletedVal, row, col, name);
-        }
-        else
-        {
-            printf("Element not found or failed to delete.\n");
-        }
-    }
-}
-void clearMatrixUI()
-{
-    char name;
-    printf("Enter matrix name to clear: ");
-    scanf(" %c", &name);
-
-    int idx = name - 'A';
-    if(idx < 0 || idx >= MAX_MATRICES || !registry[idx].isOccupied)
-    {
-        printf("Matrix %c does not exist.\n", name);
-    }
-    else
-    {
-        clearMatrix(&registry[idx].matrix);
-        printf("Matrix %c cleared.\n", name);
-    }
-}
-
-void matrixManagementMenu()
-{
-    int choice;
-
-    do
-    {
-        printf("\n===== MATRIX MANAGEMENT =====\n");
-        printf("1. Create Matrix\n");
-        printf("2. Resize Matrix\n");
-        printf("3. Insert/Update Element\n");//should enter non zero element
-        printf("4. Delete Element\n");
-        printf("5. Clear Matrix\n");
-        printf("6. Back to Main Menu\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-
-        switch(choice)
-        {
-            case 1: createMatrix(); break;
-            case 2: resizeMatrixUI(); break;
-            case 3: insertElementUI(); break;
-            case 4: deleteElementUI(); break;
-            case 5: clearMatrixUI(); break;
-            case 6: break;
-            default: printf("Invalid choice.\n"); break;
-        }
-    }while(choice != 6);
-}
-SparseMatrix* getMatrixByName(char name)
-{
-    SparseMatrix* ans = NULL;
-    int idx = name - 'A';
-    if(!(idx < 0 || idx >= MAX_MATRICES || !registry[idx].isOccupied))
-    {
-        ans = &registry[idx].matrix;
-    }
-    return ans;
-}
-void copyMatrix(char destName, SparseMatrix* source)
-{
-    int index = destName - 'A';
-    if(index < 0 || index >= MAX_MATRICES)
-    {
-        printf("Invalid destination name.\n");
-    }
-    else
-    {
-        SparseMatrix *dest = &registry[index].matrix;
-
-        if(registry[index].isOccupied)
-        {
-            printf("Matrix %c already exists. Overwriting...\n", destName);
-            clearMatrix(dest);
-        }
-
-        initializeMatrixWithSize(dest, source->rowCount, source->colCount);
-        registry[index].name = destName;
-        registry[index].isOccupied = TRUE;
-
-        Row_Node* rptr = source->rowHead;
-        while(rptr)
-        {
-            Sm_Node* sptr = rptr->rowlist;
-            while(sptr)
-            {
-                insertElement(sptr->row, sptr->col, sptr->data, dest);
-                sptr = sptr->right;
-            }
-            rptr = rptr->next;
-        }
-
-        printf("Matrix copied to '%c'\n", destName);
-    }
-}
-void executeCommand(const char* input)
-{
-    status_code sc = SUCCESS;
-    char op[20], Aname, Bname;
-    float scalar;
-    int res;
-
-    res = sscanf(input, "%s %c %f", op, &Aname, &scalar);
-    if(res == 3 && strcmp(op, "scalar") == 0)
-    {
-        SparseMatrix* A = getMatrixByName(Aname);
-        if(!A)
-        {
-            printf("Matrix %c does not exist.\n", Aname);
-            sc = FAILURE;
-        }
-        else
-        {
-            scalarMultiplyMatrix(A, scalar);
-            printNamedMatrix(A, Aname, FULL_VIEW);
-        }
-        return;
-    }
-
-    res = sscanf(input, "%s %c %c", op, &Aname, &Bname);
-    if(res == 3)
-    {
-        SparseMatrix *A = getMatrixByName(Aname);
-        SparseMatrix *B = getMatrixByName(Bname);
-        if(!A || !B)
-        {
-            printf("Invalid matrix name(s).\n");
-            sc = FAILURE;
-        }
-        else
-        {
-            SparseMatrix result;
-            initializeMatrixWithSize(&result, A->rowCount, B->colCount);
-
-            if(strcmp(op, "add") == 0)
-            {
-                if (addMatrix(A, B, &result) == SUCCESS)
-                {
-                    printNamedMatrix(&result, 'R', FULL_VIEW);
-                }
-                else
-                {
-                    printf("Addition failed.\n");
-                    sc = FAILURE;
-                }
-            }
-            else if(strcmp(op, "subtract") == 0)
-            {
-                if (subtractMatrix(A, B, &result) == SUCCESS)
-                {
-                    printNamedMatrix(&result, 'R', FULL_VIEW);
-                }
-                else
-                {
-                    printf("Subtraction failed.\n");
-                    sc = FAILURE;
-                }
-            }
-            else if(strcmp(op, "multiply") == 0)
-            {
-                if (multiplyMatrix(A, B, &result) == SUCCESS)
-                {
-                    printNamedMatrix(&result, 'R', FULL_VIEW);
-                }
-                else
-                {
-                    printf("Multiplication failed.\n");
-                    sc = FAILURE;
-                }
-            }
-            else
-            {
-                printf("Unsupported binary operation: %s\n", op);
-                sc = FAILURE;
-            }
-            if(sc == SUCCESS)
-            {
-                char choice, name;
-                status_code sc1 = FAILURE;
-
-                printf("Do you want to save the resultant matrix before deleting? (y/n): ");
-                scanf(" %c", &choice);
-
-                if(choice == 'y' || choice == 'Y')
-                {
-                    while(sc1 == FAILURE)
-                    {
-                        printf("Enter a destination matrix name (A-J): ");
-                        scanf(" %c", &name);
-                        if(name >= 'A' && name <= 'J')
-                        {
-                            copyMatrix(name, &result);
-                            sc1 = SUCCESS;
-                        }
-                        else
-                        {
-                            printf("Invalid matrix name.\n");
-                        }
-                    }
-                }
-            }
-            clearMatrix(&result);
-        }
-        return;
-    }
-
-    res = sscanf(input, "%s %c", op, &Aname);
-    if(res == 2)
-    {
-        SparseMatrix *A = getMatrixByName(Aname);
-        if(!A)
-        {
-            printf("Matrix %c does not exist.\n", Aname);
-        }
-        else
-        {
-            if(strcmp(op, "transpose") == 0)
-            {
-                if(transpose(A) == SUCCESS)
-                {
-                    printNamedMatrix(A, Aname, FULL_VIEW);
-                }
-                else
-                {
-                    printf("Transpose failed.\n");
-                }
-            }
-            else if(strcmp(op, "determinant") == 0)
-            {
-                float det;
-                if(determinantOfMatrix(A, &det) == SUCCESS)
-                {
-                    printf("Determinant of %c = %.2f\n", Aname, det);
-                }
-                else
-                {
-                    printf("Failed to compute determinant.\n");
-                }
-            }
-            else if(strcmp(op, "inverse") == 0)
-            {
-                SparseMatrix inv;
-                initializeMatrix(&inv);
-                if(inverseOfMatrix(A, &inv) == SUCCESS)
-                {
-                    printNamedMatrix(&inv, 'R', FULL_VIEW);
-                }
-                else
-                {
-                    printf("Matrix not invertible.\n");
-                    sc = FAILURE;
-                }
-                if(sc == SUCCESS)
-                {
-                    char choice, name;
-                    status_code sc = FAILURE;
-
-                    printf("Do you want to save the inverse matrix before deleting? (y/n): ");
-                    scanf(" %c", &choice);
-
-                    if(choice == 'y' || choice == 'Y')
-                    {
-                        while(sc == FAILURE)
-                        {
-                            printf("Enter a destination matrix name (A-J): ");
-                            scanf(" %c", &name);
-                            if(name >= 'A' && name <= 'J')
-                            {
-                                copyMatrix(name, &inv);
-                                sc = SUCCESS;
-                            }
-                            else
-                            {
-                                printf("Invalid matrix name.\n");
-                            }
-                        }
-                    }
-                }
-                clearMatrix(&inv);
-            }
-            else
-            {
-                printf("Unsupported unary operation: %s\n", op);
-            }
-        }
-        return;
-    }
-
-    printf("Invalid command format.\n");
-}
-void operationsMenu()
-{
-    char input[100];
-    status_code done = FALSE;
-    while(done == FALSE)
-    {
-        printf("\n===== OPERATION COMMAND MODE =====\n");
-        printf("Type operations like:\n");
-        printf("  add A B\n  transpose A\n  determinant A\n  scalar A 2.5\n  exit\n");
-        printf("> Operation: ");
-
-        fgets(input, sizeof(input), stdin);
-
-        if(strncmp(input, "exit", 4) == 0)
-        {
-            done = TRUE;
-        }
-        else
-        {
-            executeCommand(input);
-        }
-    }
-}
-void displayOptionsMenu() {
-    int choice;
-
-    do
-    {
-        printf("\n===== DISPLAY OPTIONS =====\n");
-        printf("1. List All Matrices\n");
-        printf("2. Print Matrix (Full View)\n");
-        printf("3. Print Matrix (Sparse View)\n");
-        printf("4. Print Dimensions Only\n");
-        printf("5. Back to Main Menu\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-
-        switch(choice)
-        {
-            case 1:
-            {
-                printf("\n=== Matrix Registry ===\n");
-                for(int i = 0; i < MAX_MATRICES; ++i)
-                {
-                    if(registry[i].isOccupied)
-                    {
-                        printf("%c : [%d x %d] \n",
-                            registry[i].name,
-                            registry[i].matrix.rowCount,
-                            registry[i].matrix.colCount
-                        );
-                    }
-                    else
-                    {
-                        printf("%c : (empty)\n", 'A' + i);
-                    }
-                }
-                break;
-            }
-            case 2: //Full View
-            case 3:
-            {
-                char name;
-                int mode = (choice == 2) ? FULL_VIEW : SPARSE_VIEW;
-
-                printf("Enter matrix name to print: ");
-                scanf(" %c", &name);
-
-                int idx = name - 'A';
-                if(idx < 0 || idx >= MAX_MATRICES || !registry[idx].isOccupied)
-                {
-                    printf("Matrix %c does not exist.\n", name);
-                }
-                else
-                {
-                    printNamedMatrix(&registry[idx].matrix, name, mode);
-                }
-                break;
-            }
-            case 4:
-            {
-                char name;
-                printf("Enter matrix name: ");
-                scanf(" %c", &name);
-
-                int idx = name - 'A';
-                if(idx < 0 || idx >= MAX_MATRICES || !registry[idx].isOccupied)
-                {
-                    printf("Matrix %c does not exist.\n", name);
-                }
-                else
-                {
-                    printf("Matrix %c: %d rows x %d columns\n",
-                        name,
-                        registry[idx].matrix.rowCount,
-                        registry[idx].matrix.colCount
-                    );
-                }
-                break;
-            }
-            case 5: break;;
-            default: printf("Invalid choice.\n"); break;
-        }
-    }while(choice != 5);
-}
-void initializeRegistry()
-{
-    for(int i = 0; i < MAX_MATRICES; i++)
-    {
-        registry[i].name = '\0';
-        initializeMatrix(&registry[i].matrix);
-        registry[i].isOccupied = FALSE;
-    }
-}
-void freeAllMatrices()
-{
-    for(int i = 0; i < MAX_MATRICES; i++)
-    {
-        if(registry[i].isOccupied)
-        {
-            clearMatrix(&registry[i].matrix);
-        }
-    }
-}
-int main()
-{
-    initializeRegistry();
-
-    int choice;
-    do
-    {
-        printf("\n===== MATRIX CALCULATOR =====\n");
-        printf("1. Matrix Management\n");
-        printf("2. Matrix Operations\n");
-        printf("3. Display Options\n");
-        printf("4. Exit\n");
-        printf("Enter your choice: ");
-        scanf("%d", &choice);
-
-        switch (choice)
-        {
-            case 1:
-                matrixManagementMenu();
-                break;
-            case 2:
-                operationsMenu();
-                break;
-            case 3:
-                displayOptionsMenu();
-                break;
-            case 4:
-                freeAllMatrices();
-                printf("Exiting Matrix Calculator. Goodbye!\n");
-                break;
-            default:
-                printf("Invalid choice. Please try again.\n");
-        }
-    }while(choice != 4);
-
-    return 0;
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L   // fseeko, ftello and sysconf under -std=c11
+#define _FILE_OFFSET_BITS 64      // 64 bit off_t for chunked files on 32 bit hosts
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <float.h>
+#include <stdatomic.h>
+#ifndef SM_NO_THREADS
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#ifdef SM_USE_MPI
+#include <mpi.h>
+#endif
+#define MAX_MATRICES 10
+
+typedef enum{FAILURE, SUCCESS} status_code;
+typedef enum{FALSE, TRUE} boolean;
+typedef enum{SPARSE_VIEW, FULL_VIEW } PrintMode;
+typedef float matrix_entry;
+
+
+typedef struct Sm_Node_Tag    // element node
+{
+    matrix_entry data;
+    int row, col;
+    struct Sm_Node_Tag* right;
+    struct Sm_Node_Tag* down;
+} Sm_Node;
+typedef struct Row_Node_Tag   // row list
+{
+    int row;
+    Sm_Node* rowlist;
+    struct Row_Node_Tag* next;
+} Row_Node;
+typedef struct Col_Node_Tag   // column list
+{
+    int col;
+    Sm_Node* collist;
+    struct Col_Node_Tag* next;
+} Col_Node;
+typedef struct SparseMatrix
+{
+    int rowCount, colCount;
+    Row_Node *rowHead;
+    Col_Node *colHead;
+    boolean symmetric;   // only the lower triangle (row >= col) is stored
+    unsigned long version;  // renewed by every change, see bumpVersion
+} SparseMatrix;
+
+typedef struct Named_Matrix_Tag
+{
+    char name;
+    SparseMatrix matrix;
+    boolean isOccupied;
+    struct Bsr_Matrix_Tag* blockForm;   // optional BSR copy, dropped when the matrix changes
+    struct Sell_Matrix_Tag* sliceForm;  // optional SELL-C-sigma copy for SpMV, same lifetime
+    _Atomic(struct Shared_Matrix_Tag*) shared;  // published snapshots for concurrent readers
+    struct Maintained_Product_Tag* maintained;  // keeps this matrix equal to a product of two others
+}NamedMatrix;
+
+NamedMatrix registry[MAX_MATRICES];
+
+// instrumentation: per-operation call counts, node allocations and frees, list
+// hops, flops and wall time. Compile with -DSM_NO_PROFILE to remove it. Every
+// thread counts its own operations; the report sums all threads.
+#ifndef SM_NO_PROFILE
+#define SM_PROFILE
+#endif
+#define PROFILE_JSON_ENV "SM_PROFILE_JSON"   // path of the JSON dump written at exit, none when unset
+#define PROFILE_STACK_DEPTH 64
+
+typedef enum{PROF_OTHER, PROF_INSERT, PROF_DELETE, PROF_SEARCH, PROF_CLEAR, PROF_TRANSPOSE, PROF_ADD, PROF_SUBTRACT,
+             PROF_MULTIPLY, PROF_SCALAR, PROF_DETERMINANT, PROF_INVERSE, PROF_RESIZE, PROF_EXPRESSION, PROF_UPDATE,
+             PROF_OP_COUNT} ProfileOp;
+
+typedef struct Profile_Counter_Tag
+{
+    long calls;
+    long nodesAllocated, nodesFreed;
+    long hops;
+    double flops;
+    double seconds;   // inclusive, recursive calls are timed once at the outermost level
+} ProfileCounter;
+
+const char* profileOpNames[PROF_OP_COUNT] = {"other", "insertElement", "deleteElement", "search", "clearMatrix",
+    "transpose", "addMatrix", "subtractMatrix", "multiplyMatrix", "scalarMultiplyMatrix", "determinant",
+    "inverseOfMatrix", "resizeMatrix", "expression", "applyUpdates"};
+
+#ifdef SM_PROFILE
+typedef struct Profile_Mark_Tag
+{
+    ProfileOp op;
+    struct timespec start;
+} ProfileMark;
+
+// every thread counts into its own block, so concurrent kernels never share a
+// counter. The blocks are linked into one list and outlive their threads; the
+// report sums them.
+typedef struct Profile_Thread_Tag
+{
+    ProfileCounter counters[PROF_OP_COUNT];
+    struct Profile_Thread_Tag* next;
+} ProfileThread;
+
+ProfileThread profileFallback;          // end of the list, shared by threads whose block could not be allocated
+_Atomic(ProfileThread*) profileThreads = &profileFallback;
+_Thread_local ProfileThread* profileOwn = NULL;
+_Thread_local ProfileOp profileStack[PROFILE_STACK_DEPTH];
+_Thread_local int profileDepth = 0;
+_Thread_local int profileNesting[PROF_OP_COUNT];
+
+ProfileCounter* threadCounters(void)
+{
+    if(profileOwn == NULL)
+    {
+        ProfileThread* own = (ProfileThread*)calloc(1, sizeof(ProfileThread));
+        if(own)
+        {
+            own->next = atomic_load(&profileThreads);
+            while(!atomic_compare_exchange_weak(&profileThreads, &own->next, own));
+        }
+        profileOwn = own ? own : &profileFallback;
+    }
+    return profileOwn->counters;
+}
+
+ProfileOp profileTop()// counters are charged to the innermost running operation
+{
+    int depth = (profileDepth < PROFILE_STACK_DEPTH) ? profileDepth : PROFILE_STACK_DEPTH;
+    return (depth > 0) ? profileStack[depth - 1] : PROF_OTHER;
+}
+ProfileMark profileBegin(ProfileOp op)
+{
+    ProfileMark mark;
+    mark.op = op;
+    threadCounters()[op].calls++;
+    if(profileNesting[op]++ == 0)
+    {
+        timespec_get(&mark.start, TIME_UTC);
+    }
+    if(profileDepth < PROFILE_STACK_DEPTH)
+    {
+        profileStack[profileDepth] = op;
+    }
+    profileDepth++;
+    return mark;
+}
+void profileEnd(const ProfileMark* mark)
+{
+    profileDepth--;
+    if(--profileNesting[mark->op] == 0)
+    {
+        struct timespec end;
+        timespec_get(&end, TIME_UTC);
+        threadCounters()[mark->op].seconds += (end.tv_sec - mark->start.tv_sec) + (end.tv_nsec - mark->start.tv_nsec) * 1e-9;
+    }
+}
+#define PROFILE_BEGIN(op) ProfileMark profileMark = profileBegin(op)
+#define PROFILE_END() profileEnd(&profileMark)
+#define PROFILE_COUNT(field, n) (threadCounters()[profileTop()].field += (n))
+#else
+#define PROFILE_BEGIN(op)
+#define PROFILE_END()
+#define PROFILE_COUNT(field, n) ((void)(n))
+#endif
+
+// a change gives the matrix a version no matrix has had before, so a version
+// names one state of one matrix for the whole run
+atomic_ulong matrixVersions = 0;
+
+void bumpVersion(SparseMatrix* matrix)
+{
+    matrix->version = atomic_fetch_add(&matrixVersions, 1) + 1;
+}
+void initializeMatrix(SparseMatrix* matrix)
+{
+    matrix->rowCount = 0;
+    matrix->colCount = 0;
+    matrix->colHead = NULL;
+    matrix->rowHead = NULL;
+    matrix->symmetric = FALSE;
+    bumpVersion(matrix);
+}
+void initializeMatrixWithSize(SparseMatrix* matrix, int rows, int cols)
+{
+    matrix->rowCount = rows;
+    matrix->colCount = cols;
+    matrix->colHead = NULL;
+    matrix->rowHead = NULL;
+    matrix->symmetric = FALSE;
+    bumpVersion(matrix);
+}
+void mirrorToLower(const SparseMatrix* matrix, int* row, int* col)// upper entries of a symmetric matrix live at their mirror
+{
+    if(matrix->symmetric && *row < *col)
+    {
+        int temp = *row;
+        *row = *col;
+        *col = temp;
+    }
+}
+Row_Node* createRowNode(int row)
+{
+    Row_Node* nptr;
+    nptr = (Row_Node*)malloc(sizeof(Row_Node));
+    PROFILE_COUNT(nodesAllocated, 1);
+    nptr->row = row;
+    nptr->rowlist = NULL;
+    nptr->next = NULL;
+    return nptr;
+}
+Col_Node* createColNode(int col)
+{
+    Col_Node* nptr;
+    nptr = (Col_Node*)malloc(sizeof(Col_Node));
+    PROFILE_COUNT(nodesAllocated, 1);
+    nptr->col = col;
+    nptr->collist = NULL;
+    nptr->next = NULL;
+    return nptr;
+}
+Sm_Node* createEleNode(int row, int col, matrix_entry data)
+{
+    Sm_Node* nptr;
+    nptr = (Sm_Node*)malloc(sizeof(Sm_Node));
+    PROFILE_COUNT(nodesAllocated, 1);
+    nptr->row = row;
+    nptr->col = col;
+    nptr->data = data;
+    nptr->down = nptr->right = NULL;
+    return nptr;
+}
+status_code insertElement(int row, int col, matrix_entry data, SparseMatrix* matrix)
+{
+    status_code sc = SUCCESS;
+    mirrorToLower(matrix, &row, &col);
+    bumpVersion(matrix);
+    PROFILE_BEGIN(PROF_INSERT);
+    long hops = 0;
+    if(data != 0)
+    {
+        if(row < matrix->rowCount && col < matrix->colCount)
+        {
+            Sm_Node *prevE = NULL, *element, *nptrE;
+
+            Row_Node* prevR = NULL, *rowPos = matrix->rowHead, *nptrR;
+            Col_Node* prevC = NULL, *colPos = matrix->colHead, *nptrC;
+            while(rowPos != NULL && rowPos->row<row) // search row
+            {
+                prevR = rowPos;
+                rowPos = rowPos->next;
+                hops++;
+            }
+            while(colPos != NULL && colPos->col<col) // search column
+            {
+                prevC = colPos;
+                colPos = colPos->next;
+                hops++;
+            }
+            if(rowPos == NULL || rowPos->row != row)// create row node if not exist
+            {
+                nptrR = createRowNode(row);
+                if(nptrR != NULL)
+                {
+                    nptrR->next = rowPos;
+                    if(prevR != NULL)
+                    {
+                        prevR->next = nptrR;
+                    }
+                    else
+                    {
+                        matrix->rowHead = nptrR;
+                    }
+                    nptrE = createEleNode(row, col, data);//created here  // can check nptrE!=NULL
+
+                    nptrR->rowlist = nptrE;
+                    rowPos = nptrR;
+                }
+                else
+                {
+                    sc = FAILURE;
+                }
+            }
+            else // row node exists
+            { // search if element node exist or not
+                prevE = NULL;
+                element = rowPos->rowlist;
+                while((element != NULL) && (element->col < col))
+                {
+                    prevE = element;
+                    element = element->right;
+                    hops++;
+                }
+                if(element!=NULL/*update*/ && element->col == col)// element exists // no need to update in column 
+                {
+                    element->data = data;
+                }
+                else // element DNE
+                {// lets dont worry about column, lets just create element node
+                    nptrE = createEleNode(row, col, data);
+                    if(nptrE != NULL)
+                    {
+                        nptrE->right = element;
+                        if(prevE != NULL)
+                        {
+                            prevE->right = nptrE;
+                        }
+                        else
+                        {
+                            rowPos->rowlist = nptrE;
+                        }
+                    }
+                    else
+                    {
+                        sc = FAILURE;
+                    }
+                }
+            }
+
+            if(colPos == NULL || colPos->col != col)// create column node if not exist
+            {
+                nptrC = createColNode(col);
+                if(nptrC != NULL)
+                {   
+                    nptrC->next = colPos;
+                    if(prevC != NULL)
+                    {
+                        prevC->next = nptrC;
+                    }
+                    else
+                    {
+                        matrix->colHead = nptrC;
+                    }
+                    nptrC->collist = nptrE;// element created above 
+                    colPos = nptrC;
+                }
+                else
+                {
+                    sc = FAILURE;
+                }
+            }
+            else // column node exists
+            { // search if element node exist or not
+                prevE = NULL;
+                element = colPos->collist;
+                //searching for correct pos of element
+                while((element != NULL) && (element->row < row))
+                {
+                    prevE = element;
+                    element = element->down;
+                    hops++;
+                }
+                if(element!=NULL/*update*/ && element->row == row && element->col == col)
+                {//if ele exist, updating value done in row
+                    printf("Unexpected duplication at row = %d, col = %d, data = %f\n", row, col, data);
+                    sc = FAILURE;
+                }
+                else
+                {
+                    // attached it according to row // element created above
+                    nptrE->down = element;
+                    if(prevE != NULL)
+                    {
+                        prevE->down = nptrE;
+                    }
+                    else
+                    {
+                        colPos->collist = nptrE;
+                    }
+                }
+            }
+        }
+        else
+        {
+            printf("Row and column number are out of bounds.");
+            sc = FAILURE;
+        }
+    }
+
+    PROFILE_COUNT(hops, hops);
+    PROFILE_END();
+    return sc;
+}
+status_code deleteElement(int row, int col, SparseMatrix* matrix, matrix_entry *dptr)
+{
+    //lets assume insertion done correctly and no error happen
+    status_code sc = SUCCESS;
+    Sm_Node *prevE = NULL, *element, *nptrE;
+    mirrorToLower(matrix, &row, &col);
+    bumpVersion(matrix);
+    PROFILE_BEGIN(PROF_DELETE);
+    long hops = 0;
+
+    Row_Node* prevR = NULL, *rowPos = matrix->rowHead;
+    Col_Node* prevC = NULL, *colPos = matrix->colHead;
+
+    while(rowPos != NULL && rowPos->row<row) // search row
+    {
+        prevR = rowPos;
+        rowPos = rowPos->next;
+        hops++;
+    }
+    while(colPos != NULL && colPos->col<col) // search column
+    {
+        prevC = colPos;
+        colPos = colPos->next;
+        hops++;
+    }
+
+    if(rowPos != NULL && rowPos->row == row)
+    {
+        prevE = NULL;
+        element = rowPos->rowlist;
+        while((element != NULL) && (element->col < col))
+        {
+            prevE = element;
+            element = element->right;
+            hops++;
+        }
+        if(element!=NULL && element->col == col) // row exists
+        {
+            //delete from row
+            if(prevE != NULL)
+            {
+                prevE->right = element->right;
+            }
+            else
+            {
+                rowPos->rowlist = element->right;
+            }
+
+            if(colPos != NULL && colPos->col == col)// just for safety
+            {
+                prevE = NULL;
+                element = colPos->collist;
+                //searching for correct pos of element in column
+                while((element != NULL) && (element->row != row))
+                {
+                    prevE = element;
+                    element = element->down;
+                    hops++;
+                }
+                if(element != NULL)//just for safety measures//column exists 
+                {
+                    //delete from column
+                    if(prevE != NULL)
+                    {
+                        prevE->down = element->down;
+                    }
+                    else
+                    {
+                        colPos->collist = element->down;
+                    }
+                    *dptr = element->data;
+                    free(element);
+                    PROFILE_COUNT(nodesFreed, 1);
+
+                    if(rowPos->rowlist == NULL)
+                    {
+                        if(prevR != NULL)
+                        {
+                            prevR->next = rowPos->next;
+                        }
+                        else
+                        {
+                            matrix->rowHead = rowPos->next;
+                        }
+                        free(rowPos);
+                        PROFILE_COUNT(nodesFreed, 1);
+                    }
+                    if(colPos->collist == NULL)
+                    {
+                        if(prevC != NULL)
+                        {
+                            prevC->next = colPos->next;
+                        }
+                        else
+                        {
+                            matrix->colHead = colPos->next;
+                        }
+                        free(colPos);
+                        PROFILE_COUNT(nodesFreed, 1);
+                    }
+                }
+                else// col DNE
+                {
+                    sc = FAILURE;
+                }
+            }
+
+        }
+        else// row DNE
+        {
+            sc = FAILURE;
+        }
+    }
+    else
+    {
+        sc = FAILURE;
+    }
+    PROFILE_COUNT(hops, hops);
+    PROFILE_END();
+    return sc;
+}
+void printNamedMatrix(const SparseMatrix* matrix, const char name, PrintMode mode)
+{
+    printf("Matrix %c [%d x %d]%s\n", name, matrix->rowCount, matrix->colCount,
+        matrix->symmetric ? " symmetric, lower triangle stored" : "");
+
+    if (mode == FULL_VIEW) {
+        for (int i = 0; i < matrix->rowCount; i++) {
+            for (int j = 0; j < matrix->colCount; j++) {
+                Sm_Node* element = NULL;
+                Row_Node* row = matrix->rowHead;
+                int r = i, c = j;
+                mirrorToLower(matrix, &r, &c);
+
+                // Find the row
+                while (row && row->row < r) row = row->next;
+                if (row && row->row == r) {
+                    element = row->rowlist;
+                    while (element && element->col < c) element = element->right;
+                }
+
+                if (element && element->col == c)
+                    printf("%6.2f ", element->data);
+                else
+                    printf("%6.2f ", 0.0);
+            }
+            printf("\n");
+        }
+    } else {
+        // SPARSE_VIEW
+        Row_Node* row = matrix->rowHead;
+        while (row) {
+            Sm_Node* element = row->rowlist;
+            while (element) {
+                printf("(%d, %d) -> %.2f\n", element->row, element->col, element->data);
+                element = element->right;
+            }
+            row = row->next;
+        }
+    }
+}
+void clearMatrix(SparseMatrix *sm) 
+{
+    Row_Node* rptr = sm->rowHead;
+    matrix_entry d;
+    PROFILE_BEGIN(PROF_CLEAR);
+    while(rptr) 
+    {
+        Row_Node* nextRow = rptr->next;// deleting the last element frees the row header
+        Sm_Node* sptr = rptr->rowlist;
+        while(sptr) 
+        {
+            Sm_Node* next = sptr->right;
+            deleteElement(sptr->row, sptr->col, sm, &d);
+            sptr = next;
+        }
+        rptr = nextRow;
+    }
+    PROFILE_END();
+}
+// batched updates. The batch is sorted by (row, col, arrival) and merged into
+// every touched row list in one sweep over the row headers, which settles
+// each entry's final value; the nodes that were added or removed are then
+// sorted by (col, row) and merged into the column lists in a second sweep.
+// Operations on the same entry apply in arrival order. Zeros are not stored.
+typedef enum{UPDATE_UPSERT, UPDATE_ACCUMULATE, UPDATE_DELETE} UpdateOp;
+
+typedef struct Matrix_Update_Tag
+{
+    int row, col;
+    matrix_entry value;     // ignored by UPDATE_DELETE
+    UpdateOp op;
+} MatrixUpdate;
+
+typedef struct Sorted_Update_Tag
+{
+    MatrixUpdate update;
+    int arrival;
+} SortedUpdate;
+
+typedef enum{CHANGE_UPDATED, CHANGE_ADDED, CHANGE_REMOVED} ChangeKind;
+
+typedef struct List_Change_Tag
+{
+    Sm_Node* node;
+    ChangeKind kind;
+    matrix_entry value;     // new value of an updated node
+} ListChange;
+
+// nodes created before the lists are touched, so a failed allocation leaves
+// the matrix as it was
+typedef struct Update_Plan_Tag
+{
+    ListChange* changes;    // in (row, col) order
+    int changeCount;
+    Row_Node** rows;        // headers of rows that gain their first entry, in row order
+    int rowCount;
+    Col_Node** cols;        // the same for columns
+    int colCount;
+} UpdatePlan;
+
+int compareIndexes(const void* a, const void* b)
+{
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+int compareUpdates(const void* a, const void* b)
+{
+    const SortedUpdate *x = (const SortedUpdate*)a, *y = (const SortedUpdate*)b;
+    if(x->update.row != y->update.row) return (x->update.row > y->update.row) - (x->update.row < y->update.row);
+    if(x->update.col != y->update.col) return (x->update.col > y->update.col) - (x->update.col < y->update.col);
+    return (x->arrival > y->arrival) - (x->arrival < y->arrival);
+}
+int compareChanges(const void* a, const void* b)
+{
+    const Sm_Node *x = ((const ListChange*)a)->node, *y = ((const ListChange*)b)->node;
+    if(x->col != y->col) return (x->col > y->col) - (x->col < y->col);
+    return (x->row > y->row) - (x->row < y->row);
+}
+void discardUpdatePlan(UpdatePlan* plan)// frees what was created for a batch that is not applied
+{
+    for(int k = 0; k < plan->changeCount; k++)
+    {
+        if(plan->changes[k].kind == CHANGE_ADDED)
+        {
+            free(plan->changes[k].node);
+            PROFILE_COUNT(nodesFreed, 1);
+        }
+    }
+    for(int r = 0; r < plan->rowCount; r++)
+    {
+        free(plan->rows[r]);
+        PROFILE_COUNT(nodesFreed, 1);
+    }
+    for(int c = 0; c < plan->colCount; c++)
+    {
+        free(plan->cols[c]);
+        PROFILE_COUNT(nodesFreed, 1);
+    }
+}
+// read-only row sweep: settles every (row, col) of the sorted batch and creates
+// the element nodes and row headers it adds
+status_code planUpdateRows(const SparseMatrix* matrix, const SortedUpdate* sorted, int count, UpdatePlan* plan)
+{
+    status_code sc = SUCCESS;
+    long hops = 0;
+    Row_Node* rowNode = matrix->rowHead;
+    int k = 0;
+    while(sc == SUCCESS && k < count)
+    {
+        int row = sorted[k].update.row;
+        Sm_Node* element;
+        boolean added = FALSE;
+        while(rowNode && rowNode->row < row)
+        {
+            rowNode = rowNode->next;
+            hops++;
+        }
+        element = (rowNode && rowNode->row == row) ? rowNode->rowlist : NULL;
+        while(sc == SUCCESS && k < count && sorted[k].update.row == row)
+        {
+            int col = sorted[k].update.col;
+            Sm_Node* existing;
+            boolean present;
+            matrix_entry value;
+            ListChange* change = &plan->changes[plan->changeCount];
+            while(element && element->col < col)
+            {
+                element = element->right;
+                hops++;
+            }
+            existing = (element && element->col == col) ? element : NULL;
+            present = (existing != NULL);
+            value = existing ? existing->data : 0;
+            for(; k < count && sorted[k].update.row == row && sorted[k].update.col == col; k++)
+            {
+                const MatrixUpdate* update = &sorted[k].update;
+                value = (update->op == UPDATE_UPSERT) ? update->value
+                      : (update->op == UPDATE_ACCUMULATE) ? value + update->value : 0;
+                present = (update->op != UPDATE_DELETE);
+            }
+            present = present && value != 0;
+            change->value = value;
+            if(existing)
+            {
+                change->node = existing;
+                change->kind = present ? CHANGE_UPDATED : CHANGE_REMOVED;
+                plan->changeCount++;
+            }
+            else if(present)
+            {
+                change->node = createEleNode(row, col, value);
+                change->kind = CHANGE_ADDED;
+                sc = change->node ? SUCCESS : FAILURE;
+                plan->changeCount += (sc == SUCCESS);
+                added = TRUE;
+            }
+        }
+        if(sc == SUCCESS && added && !(rowNode && rowNode->row == row))
+        {
+            plan->rows[plan->rowCount] = createRowNode(row);
+            sc = plan->rows[plan->rowCount] ? SUCCESS : FAILURE;
+            plan->rowCount += (sc == SUCCESS);
+        }
+    }
+    PROFILE_COUNT(hops, hops);
+    return sc;
+}
+// creates the headers of columns that gain their first entry; columns is scratch space
+status_code planUpdateColumns(const SparseMatrix* matrix, UpdatePlan* plan, int* columns)
+{
+    status_code sc = SUCCESS;
+    long hops = 0;
+    Col_Node* colNode = matrix->colHead;
+    int n = 0;
+    for(int k = 0; k < plan->changeCount; k++)
+    {
+        if(plan->changes[k].kind == CHANGE_ADDED)
+        {
+            columns[n++] = plan->changes[k].node->col;
+        }
+    }
+    qsort(columns, n, sizeof(int), compareIndexes);
+    for(int k = 0; sc == SUCCESS && k < n; k++)
+    {
+        while(colNode && colNode->col < columns[k])
+        {
+            colNode = colNode->next;
+            hops++;
+        }
+        if((k == 0 || columns[k] != columns[k-1]) && !(colNode && colNode->col == columns[k]))
+        {
+            plan->cols[plan->colCount] = createColNode(columns[k]);
+            sc = plan->cols[plan->colCount] ? SUCCESS : FAILURE;
+            plan->colCount += (sc == SUCCESS);
+        }
+    }
+    PROFILE_COUNT(hops, hops);
+    return sc;
+}
+// row sweep over the planned changes; nothing is allocated, so it cannot fail
+void mergeUpdateRows(SparseMatrix* matrix, const UpdatePlan* plan)
+{
+    long hops = 0;
+    Row_Node** rowLink = &matrix->rowHead;
+    int k = 0, fresh = 0;
+    while(k < plan->changeCount)
+    {
+        int row = plan->changes[k].node->row;
+        Row_Node* rowNode;
+        Sm_Node** link;
+        while(*rowLink && (*rowLink)->row < row)
+        {
+            rowLink = &(*rowLink)->next;
+            hops++;
+        }
+        if(!(*rowLink && (*rowLink)->row == row))
+        {
+            plan->rows[fresh]->next = *rowLink;
+            *rowLink = plan->rows[fresh++];
+        }
+        rowNode = *rowLink;
+        link = &rowNode->rowlist;
+        for(; k < plan->changeCount && plan->changes[k].node->row == row; k++)
+        {
+            const ListChange* change = &plan->changes[k];
+            while(*link && (*link)->col < change->node->col)
+            {
+                link = &(*link)->right;
+                hops++;
+            }
+            if(change->kind == CHANGE_UPDATED)
+            {
+                change->node->data = change->value;
+            }
+            else if(change->kind == CHANGE_REMOVED)
+            {
+                *link = change->node->right;
+            }
+            else
+            {
+                change->node->right = *link;
+                *link = change->node;
+                link = &change->node->right;
+            }
+        }
+        if(rowNode->rowlist == NULL)
+        {
+            *rowLink = rowNode->next;
+            free(rowNode);
+            PROFILE_COUNT(nodesFreed, 1);
+        }
+    }
+    PROFILE_COUNT(hops, hops);
+}
+// column sweep over the added and removed nodes sorted by (col, row)
+void mergeUpdateColumns(SparseMatrix* matrix, const UpdatePlan* plan, const ListChange* changes, int count)
+{
+    long hops = 0;
+    Col_Node** colLink = &matrix->colHead;
+    int k = 0, fresh = 0;
+    while(k < count)
+    {
+        int col = changes[k].node->col;
+        Col_Node* colNode;
+        Sm_Node** link;
+        while(*colLink && (*colLink)->col < col)
+        {
+            colLink = &(*colLink)->next;
+            hops++;
+        }
+        if(!(*colLink && (*colLink)->col == col))
+        {
+            plan->cols[fresh]->next = *colLink;
+            *colLink = plan->cols[fresh++];
+        }
+        colNode = *colLink;
+        link = &colNode->collist;
+        for(; k < count && changes[k].node->col == col; k++)
+        {
+            Sm_Node* node = changes[k].node;
+            while(*link && (*link)->row < node->row)
+            {
+                link = &(*link)->down;
+                hops++;
+            }
+            if(changes[k].kind == CHANGE_REMOVED)
+            {
+                *link = node->down;
+                free(node);
+                PROFILE_COUNT(nodesFreed, 1);
+            }
+            else
+            {
+                node->down = *link;
+                *link = node;
+                link = &node->down;
+            }
+        }
+        if(colNode->collist == NULL)
+        {
+            *colLink = colNode->next;
+            free(colNode);
+            PROFILE_COUNT(nodesFreed, 1);
+        }
+    }
+    PROFILE_COUNT(hops, hops);
+}
+// applies a whole batch, or nothing if an index is out of bounds or memory runs out
+status_code applyUpdates(SparseMatrix* matrix, const MatrixUpdate* updates, int count)
+{
+    status_code sc = SUCCESS;
+    UpdatePlan plan;
+    int linked = 0;
+    SortedUpdate* sorted = (SortedUpdate*)malloc((count + 1) * sizeof(SortedUpdate));
+    int* columns = (int*)malloc((count + 1) * sizeof(int));
+    plan.changes = (ListChange*)malloc((count + 1) * sizeof(ListChange));
+    plan.rows = (Row_Node**)malloc((count + 1) * sizeof(Row_Node*));
+    plan.cols = (Col_Node**)malloc((count + 1) * sizeof(Col_Node*));
+    plan.changeCount = plan.rowCount = plan.colCount = 0;
+    bumpVersion(matrix);
+    PROFILE_BEGIN(PROF_UPDATE);
+
+    if(!sorted || !columns || !plan.changes || !plan.rows || !plan.cols)
+    {
+        sc = FAILURE;
+    }
+    for(int k = 0; sc == SUCCESS && k < count; k++)
+    {
+        sorted[k].update = updates[k];
+        sorted[k].arrival = k;
+        mirrorToLower(matrix, &sorted[k].update.row, &sorted[k].update.col);
+        if(updates[k].row < 0 || updates[k].row >= matrix->rowCount || updates[k].col < 0 || updates[k].col >= matrix->colCount)
+        {
+            printf("Update %d at (%d, %d) is out of bounds, batch not applied.\n", k, updates[k].row, updates[k].col);
+            sc = FAILURE;
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        qsort(sorted, count, sizeof(SortedUpdate), compareUpdates);
+        sc = planUpdateRows(matrix, sorted, count, &plan);
+        sc = (sc == SUCCESS) ? planUpdateColumns(matrix, &plan, columns) : FAILURE;
+        if(sc == FAILURE)
+        {
+            discardUpdatePlan(&plan);
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        mergeUpdateRows(matrix, &plan);
+        for(int k = 0; k < plan.changeCount; k++)// updated values stay where they are in the columns
+        {
+            if(plan.changes[k].kind != CHANGE_UPDATED)
+            {
+                plan.changes[linked++] = plan.changes[k];
+            }
+        }
+        qsort(plan.changes, linked, sizeof(ListChange), compareChanges);
+        mergeUpdateColumns(matrix, &plan, plan.changes, linked);
+    }
+    free(sorted);
+    free(columns);
+    free(plan.changes);
+    free(plan.rows);
+    free(plan.cols);
+    PROFILE_END();
+    return sc;
+}
+boolean search(int row, int col, SparseMatrix* matrix)//if exists true otherwise false
+{
+    boolean exist;
+    Sm_Node *element;
+
+    Row_Node *rowPos;
+    Col_Node *colPos;
+    mirrorToLower(matrix, &row, &col);
+    rowPos = matrix->rowHead;
+    colPos = matrix->colHead;
+    PROFILE_BEGIN(PROF_SEARCH);
+    long hops = 0;
+
+    while(rowPos != NULL && rowPos->row<row) // search row
+    {
+        rowPos = rowPos->next;
+        hops++;
+    }
+    while(colPos != NULL && colPos->col<col) // search column
+    {
+        colPos = colPos->next;
+        hops++;
+    }
+    if(rowPos == NULL || rowPos->row != row || colPos == NULL || colPos->col != col)
+    {
+        exist = FALSE;
+    }
+    else
+    {
+        element = rowPos->rowlist;
+        while((element != NULL) && (element->col < col))
+        {
+            element = element->right;
+            hops++;
+        }
+        if(element!=NULL && element->col == col && element->row == row)
+        {
+            exist = TRUE;
+        }
+        else
+        {
+            exist = FALSE; 
+        }
+    }
+    PROFILE_COUNT(hops, hops);
+    PROFILE_END();
+    return exist;
+}
+// builds a matrix by appending elements directly at the list tails, without the
+// searches done by insertElement. Every row must receive increasing columns and
+// every column increasing rows.
+typedef struct Matrix_Builder_Tag
+{
+    SparseMatrix* matrix;
+    Row_Node** rowNodes;
+    Sm_Node** rowTails;
+    Col_Node** colNodes;
+    Sm_Node** colTails;
+} MatrixBuilder;
+
+status_code beginMatrixBuilder(MatrixBuilder* builder, SparseMatrix* matrix, int rows, int cols)
+{
+    status_code sc = SUCCESS;
+    initializeMatrixWithSize(matrix, rows, cols);
+    builder->matrix = matrix;
+    builder->rowNodes = (Row_Node**)calloc(rows + 1, sizeof(Row_Node*));
+    builder->rowTails = (Sm_Node**)calloc(rows + 1, sizeof(Sm_Node*));
+    builder->colNodes = (Col_Node**)calloc(cols + 1, sizeof(Col_Node*));
+    builder->colTails = (Sm_Node**)calloc(cols + 1, sizeof(Sm_Node*));
+    if(!builder->rowNodes || !builder->rowTails || !builder->colNodes || !builder->colTails)
+    {
+        free(builder->rowNodes);
+        free(builder->rowTails);
+        free(builder->colNodes);
+        free(builder->colTails);
+        sc = FAILURE;
+    }
+    return sc;
+}
+Sm_Node* appendNode(MatrixBuilder* builder, int row, int col, matrix_entry data)// keeps explicit zeros
+{
+    Sm_Node* nptrE = createEleNode(row, col, data);
+    if(nptrE != NULL)
+    {
+        if(builder->rowNodes[row] == NULL)
+        {
+            builder->rowNodes[row] = createRowNode(row);
+        }
+        if(builder->colNodes[col] == NULL)
+        {
+            builder->colNodes[col] = createColNode(col);
+        }
+        if(builder->rowTails[row])
+        {
+            builder->rowTails[row]->right = nptrE;
+        }
+        else
+        {
+            builder->rowNodes[row]->rowlist = nptrE;
+        }
+        if(builder->colTails[col])
+        {
+            builder->colTails[col]->down = nptrE;
+        }
+        else
+        {
+            builder->colNodes[col]->collist = nptrE;
+        }
+        builder->rowTails[row] = nptrE;
+        builder->colTails[col] = nptrE;
+    }
+    return nptrE;
+}
+status_code appendElement(MatrixBuilder* builder, int row, int col, matrix_entry data)
+{
+    status_code sc = SUCCESS;
+    if(data != 0 && appendNode(builder, row, col, data) == NULL)
+    {
+        sc = FAILURE;
+    }
+    return sc;
+}
+void finishMatrixBuilder(MatrixBuilder* builder)
+{
+    SparseMatrix* matrix = builder->matrix;
+    bumpVersion(matrix);
+    Row_Node* lastR = NULL;
+    Col_Node* lastC = NULL;
+    // headers were created out of order, link them by index
+    for(int i = 0; i < matrix->rowCount; i++)
+    {
+        if(builder->rowNodes[i])
+        {
+            if(lastR) lastR->next = builder->rowNodes[i];
+            else matrix->rowHead = builder->rowNodes[i];
+            lastR = builder->rowNodes[i];
+        }
+    }
+    for(int j = 0; j < matrix->colCount; j++)
+    {
+        if(builder->colNodes[j])
+        {
+            if(lastC) lastC->next = builder->colNodes[j];
+            else matrix->colHead = builder->colNodes[j];
+            lastC = builder->colNodes[j];
+        }
+    }
+    free(builder->rowNodes);
+    free(builder->rowTails);
+    free(builder->colNodes);
+    free(builder->colTails);
+}
+// exact copy, explicit zeros and the symmetric flag included
+status_code cloneMatrix(const SparseMatrix* source, SparseMatrix* copy)
+{
+    MatrixBuilder builder;
+    status_code sc = beginMatrixBuilder(&builder, copy, source->rowCount, source->colCount);
+    if(sc == SUCCESS)
+    {
+        for(Row_Node* rptr = source->rowHead; sc == SUCCESS && rptr; rptr = rptr->next)
+        {
+            for(Sm_Node* sptr = rptr->rowlist; sc == SUCCESS && sptr; sptr = sptr->right)
+            {
+                sc = appendNode(&builder, sptr->row, sptr->col, sptr->data) ? SUCCESS : FAILURE;
+            }
+        }
+        finishMatrixBuilder(&builder);// a partial copy is still well formed
+    }
+    copy->symmetric = source->symmetric;
+    return sc;
+}
+// frees every node in one pass over the rows, for matrices nothing else links into
+void releaseMatrix(SparseMatrix* matrix)
+{
+    Row_Node* rptr = matrix->rowHead;
+    Col_Node* cptr = matrix->colHead;
+    while(rptr)
+    {
+        Row_Node* nextRow = rptr->next;
+        Sm_Node* sptr = rptr->rowlist;
+        while(sptr)
+        {
+            Sm_Node* next = sptr->right;
+            free(sptr);
+            sptr = next;
+        }
+        free(rptr);
+        rptr = nextRow;
+    }
+    while(cptr)
+    {
+        Col_Node* next = cptr->next;
+        free(cptr);
+        cptr = next;
+    }
+    matrix->rowHead = NULL;
+    matrix->colHead = NULL;
+    bumpVersion(matrix);
+}
+
+// read-only access to the rows of op(X), where op is identity or transpose.
+// Rows of X^T are the column lists of X, walked through the down links. Row i
+// of a symmetric X is its stored row (columns <= i) continued by the part of
+// column i below the diagonal, so the missing half is never materialized.
+typedef struct Matrix_View_Tag
+{
+    int rowCount, colCount;
+    boolean transposed, symmetric;
+    Sm_Node** lists;
+    Sm_Node** mirror;   // symmetric only: first element of column i below the diagonal
+} MatrixView;
+
+status_code openMatrixView(MatrixView* view, const SparseMatrix* matrix, boolean transposed)
+{
+    status_code sc = SUCCESS;
+    view->symmetric = matrix->symmetric;
+    view->transposed = transposed && !matrix->symmetric;
+    view->rowCount = transposed ? matrix->colCount : matrix->rowCount;
+    view->colCount = transposed ? matrix->rowCount : matrix->colCount;
+    view->lists = (Sm_Node**)calloc(view->rowCount + 1, sizeof(Sm_Node*));
+    view->mirror = NULL;
+    if(view->symmetric && view->lists)
+    {
+        view->mirror = (Sm_Node**)calloc(view->rowCount + 1, sizeof(Sm_Node*));
+    }
+    if(view->lists == NULL || (view->symmetric && view->mirror == NULL))
+    {
+        free(view->lists);
+        view->lists = NULL;
+        sc = FAILURE;
+    }
+    else if(view->transposed)
+    {
+        for(Col_Node* colPos = matrix->colHead; colPos; colPos = colPos->next)
+        {
+            view->lists[colPos->col] = colPos->collist;
+        }
+    }
+    else
+    {
+        for(Row_Node* rowPos = matrix->rowHead; rowPos; rowPos = rowPos->next)
+        {
+            view->lists[rowPos->row] = rowPos->rowlist;
+        }
+        for(Col_Node* colPos = view->symmetric ? matrix->colHead : NULL; colPos; colPos = colPos->next)
+        {
+            Sm_Node* below = colPos->collist;
+            if(below && below->row == colPos->col)
+            {
+                below = below->down;
+            }
+            view->mirror[colPos->col] = below;
+            if(view->lists[colPos->col] == NULL)
+            {
+                view->lists[colPos->col] = below;
+            }
+        }
+    }
+    return sc;
+}
+void closeMatrixView(MatrixView* view)
+{
+    free(view->lists);
+    free(view->mirror);
+    view->lists = view->mirror = NULL;
+}
+int viewIndex(const MatrixView* view, int row, const Sm_Node* element)// row is the view row being walked
+{
+    int index;
+    if(view->symmetric)
+    {
+        index = (element->row == row) ? element->col : element->row;
+    }
+    else
+    {
+        index = view->transposed ? element->row : element->col;
+    }
+    return index;
+}
+Sm_Node* viewNext(const MatrixView* view, int row, const Sm_Node* element)
+{
+    Sm_Node* next;
+    if(view->symmetric)
+    {
+        if(element->row == row)
+        {
+            next = element->right ? element->right : view->mirror[row];
+        }
+        else
+        {
+            next = element->down;
+        }
+    }
+    else
+    {
+        next = view->transposed ? element->down : element->right;
+    }
+    return next;
+}
+
+// dense scratch row that remembers which positions were touched,
+// so resetting it costs only the touched entries
+typedef struct Sparse_Accumulator_Tag
+{
+    int size, count;
+    matrix_entry* values;
+    char* occupied;
+    int* pattern;
+} SparseAccumulator;
+
+status_code initializeAccumulator(SparseAccumulator* acc, int size)
+{
+    status_code sc = SUCCESS;
+    acc->size = size;
+    acc->count = 0;
+    acc->values = (matrix_entry*)calloc(size + 1, sizeof(matrix_entry));
+    acc->occupied = (char*)calloc(size + 1, sizeof(char));
+    acc->pattern = (int*)malloc((size + 1) * sizeof(int));
+    if(!acc->values || !acc->occupied || !acc->pattern)
+    {
+        sc = FAILURE;
+    }
+    return sc;
+}
+void accumulate(SparseAccumulator* acc, int index, matrix_entry value)
+{
+    if(!acc->occupied[index])
+    {
+        acc->occupied[index] = 1;
+        acc->values[index] = value;
+        acc->pattern[acc->count++] = index;
+    }
+    else
+    {
+        acc->values[index] += value;
+    }
+}
+void sortAccumulator(SparseAccumulator* acc)
+{
+    qsort(acc->pattern, acc->count, sizeof(int), compareIndexes);
+}
+void resetAccumulator(SparseAccumulator* acc)
+{
+    for(int k = 0; k < acc->count; k++)
+    {
+        acc->occupied[acc->pattern[k]] = 0;
+    }
+    acc->count = 0;
+}
+void freeAccumulator(SparseAccumulator* acc)
+{
+    free(acc->values);
+    free(acc->occupied);
+    free(acc->pattern);
+    acc->values = NULL;
+    acc->occupied = NULL;
+    acc->pattern = NULL;
+}
+status_code transpose(SparseMatrix* matrix)
+{
+    status_code sc = SUCCESS;
+    Sm_Node *element, *temp, *prev;
+
+    Row_Node *prevR = NULL, *rowPos = matrix->rowHead, *nptrColR, *prevColR = NULL, *tempHeadNewRow = NULL;
+    Col_Node *prevC = NULL, *colPos = matrix->colHead, *nptrRowC, *prevRowC = NULL;
+    bumpVersion(matrix);
+    if(matrix->symmetric)
+    {
+        return SUCCESS;// A^T = A
+    }
+    PROFILE_BEGIN(PROF_TRANSPOSE);
+    while(colPos != NULL)
+    {
+        nptrColR = createRowNode(colPos->col);
+        if(nptrColR != NULL)
+        {
+            nptrColR->rowlist = colPos->collist;
+            if(prevColR)
+            {
+                prevColR->next = nptrColR;
+            }
+            else
+            {
+                tempHeadNewRow = nptrColR;
+            }
+            prevColR = nptrColR;
+            prevC = colPos;
+            colPos = colPos->next;
+            free(prevC);
+            PROFILE_COUNT(nodesFreed, 1);
+        }
+        else
+        {
+            sc = FAILURE;
+        }
+    }
+    while(rowPos != NULL)
+    {
+        nptrRowC = createColNode(rowPos->row);
+        if(nptrRowC != NULL)
+        {
+            nptrRowC->collist = rowPos->rowlist;
+            if(prevRowC)
+            {
+                prevRowC->next = nptrRowC;
+            }
+            else
+            {
+                (matrix->colHead) = nptrRowC;
+            }
+            element = rowPos->rowlist;
+            while(element != NULL)
+            {
+                element->row ^= element->col;
+                element->col ^= element->row;
+                element->row ^= element->col;
+                
+                prev = element;
+                element = element->right;
+
+                temp = prev->right;
+                prev->right = prev->down;
+                prev->down = temp;
+            }
+            prevRowC = nptrRowC;
+            prevR = rowPos;
+            rowPos = rowPos->next;
+            free(prevR);
+            PROFILE_COUNT(nodesFreed, 1);
+        }
+        else
+        {
+            sc = FAILURE;
+        }
+    }
+    matrix->rowHead = tempHeadNewRow;
+
+    // swapping rowCount and columnCount
+    matrix->rowCount ^= matrix->colCount;
+    matrix->colCount ^= matrix->rowCount;
+    matrix->rowCount ^= matrix->colCount;
+
+    PROFILE_END();
+    return sc;
+}
+// A + B when exactly one operand is symmetric: both are read as full rows
+status_code addMixedSymmetry(const SparseMatrix* matrix1, const SparseMatrix* matrix2, SparseMatrix* result)
+{
+    status_code sc = FAILURE;
+    double flops = 0;
+    MatrixView view1, view2;
+    MatrixBuilder builder;
+    if(matrix1->rowCount == matrix2->rowCount && matrix1->colCount == matrix2->colCount
+        && openMatrixView(&view1, matrix1, FALSE) == SUCCESS)
+    {
+        if(openMatrixView(&view2, matrix2, FALSE) == SUCCESS)
+        {
+            if(beginMatrixBuilder(&builder, result, view1.rowCount, view1.colCount) == SUCCESS)
+            {
+                sc = SUCCESS;
+                for(int i = 0; sc == SUCCESS && i < view1.rowCount; i++)
+                {
+                    Sm_Node *e1 = view1.lists[i], *e2 = view2.lists[i];
+                    while(sc == SUCCESS && (e1 || e2))
+                    {
+                        int c1 = e1 ? viewIndex(&view1, i, e1) : 0, c2 = e2 ? viewIndex(&view2, i, e2) : 0;
+                        int col = (!e2 || (e1 && c1 < c2)) ? c1 : c2;
+                        matrix_entry sum = 0;
+                        if(e1 && c1 == col)
+                        {
+                            sum += e1->data;
+                            e1 = viewNext(&view1, i, e1);
+                        }
+                        if(e2 && c2 == col)
+                        {
+                            sum += e2->data;
+                            e2 = viewNext(&view2, i, e2);
+                        }
+                        flops++;
+                        sc = appendElement(&builder, i, col, sum);
+                    }
+                }
+                finishMatrixBuilder(&builder);
+            }
+            closeMatrixView(&view2);
+        }
+        closeMatrixView(&view1);
+    }
+    PROFILE_COUNT(flops, flops);
+    return sc;
+}
+status_code addMatrix(SparseMatrix* matrix1, SparseMatrix* matrix2, SparseMatrix* result)
+{
+    status_code sc = SUCCESS;
+    Sm_Node *element1, *element2;
+    matrix_entry sum;
+
+    Row_Node *rowPos1 = matrix1->rowHead, *rowPos2 = matrix2->rowHead;
+    PROFILE_BEGIN(PROF_ADD);
+    double flops = 0;
+
+    initializeMatrix(result);
+
+    if(matrix1->symmetric != matrix2->symmetric && matrix1->rowHead && matrix2->rowHead)
+    {
+        sc = addMixedSymmetry(matrix1, matrix2, result);
+    }
+    else if(matrix1->rowHead == NULL) 
+    {
+        result->rowCount = matrix2->rowCount;
+        result->colCount = matrix2->colCount;
+        result->symmetric = matrix2->symmetric;
+
+        while(rowPos2)
+        {
+            element2 = rowPos2->rowlist;
+            while(element2)
+            {
+                insertElement(element2->row, element2->col, element2->data, result);
+                element2 = element2->right;
+            }
+            rowPos2 = rowPos2->next;
+        }
+    }
+    else if(matrix2->rowHead == NULL) 
+    {
+        result->rowCount = matrix1->rowCount;
+        result->colCount = matrix1->colCount;
+        result->symmetric = matrix1->symmetric;
+
+        while(rowPos1)
+        {
+            element1 = rowPos1->rowlist;
+            while(element1)
+            {
+                insertElement(element1->row, element1->col, element1->data, result);
+                element1 = element1->right;
+            }
+            rowPos1 = rowPos1->next;
+        }
+    }
+    else
+    {
+        if(matrix1->rowCount != matrix2->rowCount || matrix1->colCount != matrix2->colCount)
+        {
+            sc = FAILURE;
+        }
+        else
+        {
+            result->rowCount = matrix1->rowCount;
+            result->colCount = matrix1->colCount;
+            result->symmetric = matrix1->symmetric;// both or neither here
+
+            while(rowPos1 || rowPos2)
+            {
+                if(!rowPos2 || (rowPos1 && rowPos1->row < rowPos2->row))
+                {
+                    element1 = rowPos1->rowlist;
+                    while(element1 != NULL)
+                    {
+                        insertElement(element1->row, element1->col, element1->data, result);
+                        element1 = element1->right;
+                    }
+                    rowPos1 = rowPos1->next;
+                }
+                else if(!rowPos1 || (rowPos2 && rowPos1->row > rowPos2->row))
+                {
+                    element2 = rowPos2->rowlist;
+                    while(element2 != NULL)
+                    {
+                        insertElement(element2->row, element2->col, element2->data, result);
+                        element2 = element2->right;
+                    }
+                    rowPos2 = rowPos2->next;
+                }
+                else
+                {
+                    element1 = rowPos1->rowlist;
+                    element2 = rowPos2->rowlist;
+                    while(element1 || element2)
+                    {
+                        if(!element2 || (element1 && element1->col < element2->col))
+                        {
+                            insertElement(element1->row, element1->col, element1->data, result);
+                            element1 = element1->right;
+                        }
+                        else if(!element1 || (element2 && element1->col > element2->col))
+                        {
+                            insertElement(element2->row, element2->col, element2->data, result);
+                            element2 = element2->right;
+                        }
+                        else
+                        {
+                            sum = element1->data + element2->data;
+                            flops++;
+                            if(sum != 0)
+                            {
+                                insertElement(element1->row, element1->col, sum, result);
+                            }
+                            element1 = element1->right;
+                            element2 = element2->right;
+                        }
+                    }
+                    rowPos1 = rowPos1->next;
+                    rowPos2 = rowPos2->next;
+                }
+            }
+        }
+    }
+    PROFILE_COUNT(flops, flops);
+    PROFILE_END();
+    return sc;
+}
+status_code subtractMatrix(SparseMatrix* matrix1, SparseMatrix* matrix2, SparseMatrix* result)
+{
+    status_code sc = SUCCESS;
+    SparseMatrix negMatrix2;
+    PROFILE_BEGIN(PROF_SUBTRACT);
+    initializeMatrixWithSize(&negMatrix2, matrix2->rowCount, matrix2->colCount);
+    negMatrix2.symmetric = matrix2->symmetric;
+
+    Sm_Node* element;
+    Row_Node* rowPos = matrix2->rowHead;
+    while(rowPos != NULL)
+    {
+        element = rowPos->rowlist;
+        while(element != NULL)
+        {
+            insertElement(element->row, element->col, -element->data, &negMatrix2);
+            element = element->right;
+        }
+        rowPos = rowPos->next;
+    }
+
+    sc = addMatrix(matrix1, &negMatrix2, result);
+
+    clearMatrix(&negMatrix2);
+
+    PROFILE_END();
+    return sc;
+}
+// parallel loops. A persistent pool of worker threads, started on first use,
+// runs the ranges of parallelFor. Every thread owns a deque of ranges: it
+// keeps halving the range it holds, pushing the upper halves onto its own
+// deque, and runs the piece once it is at most the grain. An idle thread
+// steals from the top of another thread's deque, where the largest pieces
+// are, so rows of very different cost spread over all threads on their own.
+// SM_NUM_THREADS sets the thread count (the calling thread counts as one);
+// -DSM_NO_THREADS runs every loop serially.
+#define PARALLEL_GRAIN 256
+#define MAX_POOL_THREADS 256
+#define DEQUE_CAPACITY 64      // splitting halves, so a deque holds at most ~32 ranges
+
+typedef void (*RangeBody)(void* context, int begin, int end);
+
+#ifndef SM_NO_THREADS
+typedef struct Range_Task_Tag
+{
+    int begin, end;
+} RangeTask;
+
+typedef struct Work_Deque_Tag
+{
+    pthread_mutex_t lock;
+    int top, bottom;            // thieves take tasks[top], the owner pushes and pops at bottom
+    RangeTask tasks[DEQUE_CAPACITY];
+} WorkDeque;
+
+typedef struct Task_Pool_Tag
+{
+    int threads;                // workers plus the calling thread
+    boolean stopping;
+    pthread_t* workers;
+    WorkDeque* deques;          // deque 0 belongs to the thread that called parallelFor
+    pthread_mutex_t lock;       // guards everything below
+    pthread_cond_t wake;
+    unsigned generation;        // bumped for every loop
+    RangeBody body;
+    void* context;
+    int grain, remaining;       // items of the current loop that have not run yet
+    long loops, steals;
+} TaskPool;
+
+TaskPool pool;
+pthread_mutex_t poolSubmit = PTHREAD_MUTEX_INITIALIZER;   // one loop at a time
+pthread_once_t poolStarted = PTHREAD_ONCE_INIT;
+_Thread_local int poolWorker = -1;                        // deque of the running thread, -1 outside a loop
+
+void pushTask(WorkDeque* deque, int begin, int end)
+{
+    pthread_mutex_lock(&deque->lock);
+    if(deque->bottom == DEQUE_CAPACITY)
+    {
+        memmove(deque->tasks, deque->tasks + deque->top, (deque->bottom - deque->top) * sizeof(RangeTask));
+        deque->bottom -= deque->top;
+        deque->top = 0;
+    }
+    deque->tasks[deque->bottom].begin = begin;
+    deque->tasks[deque->bottom++].end = end;
+    pthread_mutex_unlock(&deque->lock);
+}
+boolean takeTask(WorkDeque* deque, boolean steal, RangeTask* task)
+{
+    boolean found = FALSE;
+    pthread_mutex_lock(&deque->lock);
+    if(deque->bottom > deque->top)
+    {
+        *task = steal ? deque->tasks[deque->top++] : deque->tasks[--deque->bottom];
+        found = TRUE;
+        if(deque->top == deque->bottom)
+        {
+            deque->top = deque->bottom = 0;
+        }
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+void runPoolTasks(int id)// returns once every item of the current loop has run
+{
+    RangeTask task;
+    unsigned seed = 2654435761u * (unsigned)(id + 1);
+    while(TRUE)
+    {
+        boolean found = takeTask(&pool.deques[id], FALSE, &task);
+        for(int attempt = 0; !found && attempt < 2 * pool.threads; attempt++)
+        {
+            int victim;
+            seed = seed * 1103515245u + 12345u;
+            victim = (int)((seed >> 16) % (unsigned)pool.threads);
+            if(victim != id && takeTask(&pool.deques[victim], TRUE, &task))
+            {
+                found = TRUE;
+                pthread_mutex_lock(&pool.lock);
+                pool.steals++;
+                pthread_mutex_unlock(&pool.lock);
+            }
+        }
+        if(found)
+        {
+            while(task.end - task.begin > pool.grain)
+            {
+                int middle = task.begin + (task.end - task.begin) / 2;
+                pushTask(&pool.deques[id], middle, task.end);
+                task.end = middle;
+            }
+            pool.body(pool.context, task.begin, task.end);
+            pthread_mutex_lock(&pool.lock);
+            pool.remaining -= task.end - task.begin;
+            pthread_mutex_unlock(&pool.lock);
+        }
+        else
+        {
+            int remaining;
+            pthread_mutex_lock(&pool.lock);
+            remaining = pool.remaining;
+            pthread_mutex_unlock(&pool.lock);
+            if(remaining == 0)
+            {
+                return;
+            }
+            sched_yield();// the last pieces are running elsewhere
+        }
+    }
+}
+void* poolWorkerMain(void* data)
+{
+    unsigned seen = 0;
+    poolWorker = (int)(intptr_t)data;
+    pthread_mutex_lock(&pool.lock);
+    while(!pool.stopping)
+    {
+        if(pool.generation != seen && pool.remaining > 0)
+        {
+            seen = pool.generation;
+            pthread_mutex_unlock(&pool.lock);
+            runPoolTasks(poolWorker);
+            pthread_mutex_lock(&pool.lock);
+        }
+        else
+        {
+            pthread_cond_wait(&pool.wake, &pool.lock);
+        }
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+void stopPool(void)
+{
+    pthread_mutex_lock(&pool.lock);
+    pool.stopping = TRUE;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+    for(int t = 1; t < pool.threads; t++)
+    {
+        pthread_join(pool.workers[t], NULL);
+    }
+    free(pool.workers);
+    free(pool.deques);
+    pool.threads = 1;
+}
+void startPool(void)
+{
+    const char* env = getenv("SM_NUM_THREADS");
+    int threads = env ? atoi(env) : 1;
+#ifndef _WIN32
+    if(!env)
+    {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#endif
+    threads = (threads < 1) ? 1 : (threads > MAX_POOL_THREADS) ? MAX_POOL_THREADS : threads;
+    pool.threads = 1;
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.wake, NULL);
+    pool.workers = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    pool.deques = (WorkDeque*)calloc(threads, sizeof(WorkDeque));
+    if(!pool.workers || !pool.deques)
+    {
+        return;
+    }
+    for(int t = 0; t < threads; t++)
+    {
+        pthread_mutex_init(&pool.deques[t].lock, NULL);
+    }
+    for(int t = 1; t < threads && pthread_create(&pool.workers[t], NULL, poolWorkerMain, (void*)(intptr_t)t) == 0; t++)
+    {
+        pool.threads = t + 1;
+    }
+    atexit(stopPool);
+}
+#endif
+int poolThreadCount(void)// size of per-thread scratch arrays for parallelFor bodies
+{
+#ifndef SM_NO_THREADS
+    pthread_once(&poolStarted, startPool);
+    return pool.threads;
+#else
+    return 1;
+#endif
+}
+int currentWorker(void)// index of the calling thread's scratch inside a parallelFor body
+{
+#ifndef SM_NO_THREADS
+    return (poolWorker >= 0) ? poolWorker : 0;
+#else
+    return 0;
+#endif
+}
+void printPoolStats()
+{
+#ifndef SM_NO_THREADS
+    int threads = poolThreadCount();
+    pthread_mutex_lock(&pool.lock);
+    printf("Thread pool: %d threads, %ld parallel loops, %ld steals\n", threads, pool.loops, pool.steals);
+    pthread_mutex_unlock(&pool.lock);
+#else
+    printf("Thread pool: compiled out (SM_NO_THREADS), loops run serially\n");
+#endif
+}
+// first failing item seen by each thread, so a loop that can fail reports the
+// same item however its pieces were spread
+int* allocateFailures(void)
+{
+    int threads = poolThreadCount();
+    int* failures = (int*)malloc(threads * sizeof(int));
+    for(int t = 0; failures && t < threads; t++)
+    {
+        failures[t] = INT_MAX;
+    }
+    return failures;
+}
+void noteFailure(int* failures, int item)
+{
+    int worker = currentWorker();
+    if(item < failures[worker])
+    {
+        failures[worker] = item;
+    }
+}
+int firstFailure(const int* failures)// INT_MAX when every item succeeded
+{
+    int first = INT_MAX;
+    for(int t = 0; t < poolThreadCount(); t++)
+    {
+        first = (failures[t] < first) ? failures[t] : first;
+    }
+    return first;
+}
+// runs body over [0, count) in pieces of at most grain items. Short loops,
+// loops started from inside a body and loops started while another thread's
+// loop holds the pool run serially on the calling thread.
+void parallelForGrain(int count, int grain, RangeBody body, void* context)
+{
+#ifndef SM_NO_THREADS
+    grain = (grain < 1) ? 1 : grain;
+    if(count >= 2 * grain && poolWorker < 0 && poolThreadCount() > 1 && pthread_mutex_trylock(&poolSubmit) == 0)
+    {
+        pthread_mutex_lock(&pool.lock);// set before any task is visible to a thread still leaving the last loop
+        pool.body = body;
+        pool.context = context;
+        pool.grain = grain;
+        pool.remaining = count;
+        pool.generation++;
+        pool.loops++;
+        pthread_mutex_unlock(&pool.lock);
+        for(int t = 0; t < pool.threads; t++)// contiguous shares to start with, stealing evens them out
+        {
+            int begin = (int)((long long)count * t / pool.threads), end = (int)((long long)count * (t + 1) / pool.threads);
+            if(end > begin)
+            {
+                pushTask(&pool.deques[t], begin, end);
+            }
+        }
+        pthread_mutex_lock(&pool.lock);
+        pthread_cond_broadcast(&pool.wake);
+        pthread_mutex_unlock(&pool.lock);
+        poolWorker = 0;
+        runPoolTasks(0);
+        poolWorker = -1;
+        pthread_mutex_unlock(&poolSubmit);
+        return;
+    }
+#else
+    (void)grain;
+#endif
+    body(context, 0, count);
+}
+void parallelFor(int count, RangeBody body, void* context)
+{
+    parallelForGrain(count, PARALLEL_GRAIN, body, context);
+}
+// progress of a long running operation, read by other threads while it runs.
+// Kernels report to the Progress of the thread that started them
+// (activeProgress, NULL outside jobs) and stop early once it is cancelled.
+// An operation run as a step of another, like the factorization inside an inverse, only
+// adds flops; its rows belong to the outer operation.
+typedef struct Progress_Tag
+{
+    atomic_long rowsDone, rowsTotal;
+    atomic_llong flopsDone;
+    atomic_int cancelled;
+    int nesting;                    // steps entered by the owning thread
+} Progress;
+
+_Thread_local Progress* activeProgress = NULL;
+
+void beginProgress(Progress* progress, long rows)
+{
+    if(progress && progress->nesting == 0)
+    {
+        atomic_store(&progress->rowsDone, 0);
+        atomic_store(&progress->rowsTotal, rows);
+    }
+}
+void addProgress(Progress* progress, long rows, long long flops)
+{
+    if(progress)
+    {
+        if(progress->nesting == 0 && rows)
+        {
+            atomic_fetch_add(&progress->rowsDone, rows);
+        }
+        atomic_fetch_add(&progress->flopsDone, flops);
+    }
+}
+boolean progressCancelled(const Progress* progress)
+{
+    return (progress && atomic_load(&progress->cancelled)) ? TRUE : FALSE;
+}
+void enterProgressStep(Progress* progress)
+{
+    if(progress)
+    {
+        progress->nesting++;
+    }
+}
+void leaveProgressStep(Progress* progress)
+{
+    if(progress)
+    {
+        progress->nesting--;
+    }
+}
+// SpGEMM strategies. The dense accumulator needs one slot per output column,
+// the hash accumulator one slot per product of the row, and the blocked mode
+// splits the output columns into panels whose dense accumulator fits in cache.
+#define MULTIPLY_CACHE_BYTES (256 * 1024)
+#define MIN_PANEL_WIDTH 64
+#define HASH_MAX_FILL 64   // hash when a mean output row fills under 1/64 of the columns
+
+typedef enum{MULTIPLY_AUTO, MULTIPLY_DENSE, MULTIPLY_HASH, MULTIPLY_BLOCKED} MultiplyStrategy;
+
+typedef struct Multiply_Estimate_Tag
+{
+    double flops;
+    int maxRowFlops;
+    int maxRowOutput;   // upper bound on the nonzeros of one output row
+} MultiplyEstimate;
+
+typedef struct Hash_Accumulator_Tag
+{
+    int capacity, count;   // capacity is a power of two
+    int* keys;             // -1 marks an empty slot
+    matrix_entry* values;
+    int* slots;            // slots filled since the last reset
+} HashAccumulator;
+
+const char* multiplyStrategyName(MultiplyStrategy strategy)
+{
+    const char* names[] = {"auto", "dense", "hash", "blocked"};
+    return names[strategy];
+}
+status_code parseMultiplyStrategy(const char* name, MultiplyStrategy* strategy)
+{
+    status_code sc = FAILURE;
+    for(int s = MULTIPLY_AUTO; s <= MULTIPLY_BLOCKED; s++)
+    {
+        if(strcmp(name, multiplyStrategyName((MultiplyStrategy)s)) == 0)
+        {
+            *strategy = (MultiplyStrategy)s;
+            sc = SUCCESS;
+        }
+    }
+    return sc;
+}
+size_t denseAccumulatorBytes(int size)
+{
+    return (size_t)size * (sizeof(matrix_entry) + sizeof(char) + sizeof(int));
+}
+int hashCapacity(int entries)
+{
+    int capacity = 16;
+    while(capacity < 2 * entries)
+    {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+status_code initializeHashAccumulator(HashAccumulator* acc, int entries)
+{
+    status_code sc = SUCCESS;
+    acc->capacity = hashCapacity(entries);
+    acc->count = 0;
+    acc->keys = (int*)malloc(acc->capacity * sizeof(int));
+    acc->values = (matrix_entry*)malloc(acc->capacity * sizeof(matrix_entry));
+    acc->slots = (int*)malloc(acc->capacity * sizeof(int));
+    if(!acc->keys || !acc->values || !acc->slots)
+    {
+        sc = FAILURE;
+    }
+    else
+    {
+        memset(acc->keys, -1, acc->capacity * sizeof(int));
+    }
+    return sc;
+}
+int hashSlot(const HashAccumulator* acc, int key)// linear probing, stops at the key or an empty slot
+{
+    int slot = (int)(((unsigned)key * 2654435761u) & (unsigned)(acc->capacity - 1));
+    while(acc->keys[slot] != -1 && acc->keys[slot] != key)
+    {
+        slot = (slot + 1) & (acc->capacity - 1);
+    }
+    return slot;
+}
+void hashAccumulate(HashAccumulator* acc, int key, matrix_entry value)
+{
+    int slot = hashSlot(acc, key);
+    if(acc->keys[slot] == -1)
+    {
+        acc->keys[slot] = key;
+        acc->values[slot] = value;
+        acc->slots[acc->count++] = slot;
+    }
+    else
+    {
+        acc->values[slot] += value;
+    }
+}
+void resetHashAccumulator(HashAccumulator* acc)
+{
+    for(int k = 0; k < acc->count; k++)
+    {
+        acc->keys[acc->slots[k]] = -1;
+    }
+    acc->count = 0;
+}
+void freeHashAccumulator(HashAccumulator* acc)
+{
+    free(acc->keys);
+    free(acc->values);
+    free(acc->slots);
+}
+status_code estimateMultiply(const MatrixView* view1, const MatrixView* view2, MultiplyEstimate* estimate)
+{
+    status_code sc = SUCCESS;
+    int* rowLength = (int*)calloc(view2->rowCount + 1, sizeof(int));
+
+    estimate->flops = 0;
+    estimate->maxRowFlops = 0;
+    estimate->maxRowOutput = 0;
+    if(rowLength == NULL)
+    {
+        sc = FAILURE;
+    }
+    else
+    {
+        for(int k = 0; k < view2->rowCount; k++)
+        {
+            for(Sm_Node* e = view2->lists[k]; e; e = viewNext(view2, k, e))
+            {
+                rowLength[k]++;
+            }
+        }
+        for(int i = 0; i < view1->rowCount; i++)
+        {
+            int rowFlops = 0;
+            for(Sm_Node* e = view1->lists[i]; e; e = viewNext(view1, i, e))
+            {
+                rowFlops += rowLength[viewIndex(view1, i, e)];
+            }
+            estimate->flops += rowFlops;
+            if(rowFlops > estimate->maxRowFlops)
+            {
+                estimate->maxRowFlops = rowFlops;
+            }
+        }
+        estimate->maxRowOutput = (estimate->maxRowFlops < view2->colCount) ? estimate->maxRowFlops : view2->colCount;
+        free(rowLength);
+    }
+    return sc;
+}
+// flops / rows bounds the mean output row. When that is a small fraction of
+// the columns the product is sparse, and the hash table, which only ever holds
+// the row's own entries, beats a dense array touched at scattered places.
+MultiplyStrategy chooseMultiplyStrategy(int outputRows, int outputCols, const MultiplyEstimate* estimate)
+{
+    MultiplyStrategy strategy;
+    size_t hashBytes = (size_t)hashCapacity(estimate->maxRowOutput) * (2 * sizeof(int) + sizeof(matrix_entry));
+    double rowOutput = (outputRows > 0) ? estimate->flops / outputRows : 0;
+    boolean hashFits = (hashBytes <= MULTIPLY_CACHE_BYTES);// every output row fits in a small hash table
+    boolean sparse = (rowOutput * HASH_MAX_FILL < outputCols);
+
+    if(denseAccumulatorBytes(outputCols) <= MULTIPLY_CACHE_BYTES && !(sparse && hashFits))
+    {
+        strategy = MULTIPLY_DENSE;
+    }
+    else if(hashFits)
+    {
+        strategy = MULTIPLY_HASH;
+    }
+    else
+    {
+        strategy = MULTIPLY_BLOCKED;
+    }
+    return strategy;
+}
+// rows of the product are computed in parallel. Every thread has its own
+// accumulator and collects its finished rows in a buffer; the rows are then
+// appended to the result in order, which the builder requires. Rows are run in
+// batches of a few pieces per thread and each batch is flushed before the next
+// starts, so the buffers hold one batch rather than the whole product. The
+// blocked strategy runs one such pass per panel of output columns.
+#define PRODUCT_GRAIN_FLOPS 16384   // products per piece of rows handed to a thread
+#define PRODUCT_BATCH_PIECES 8      // pieces per thread buffered before a flush
+
+typedef struct Row_Buffer_Tag
+{
+    status_code sc;
+    SparseAccumulator dense;
+    HashAccumulator hash;
+    int* keys;
+    int count, capacity;
+    int* cols;
+    matrix_entry* values;
+} RowBuffer;
+
+typedef struct Row_Product_Tag
+{
+    const MatrixView* view1;
+    const MatrixView* view2;
+    boolean hashed;
+    int lo, hi;             // output columns of the current panel
+    int first;              // first row of the current batch
+    Sm_Node** cursor;       // first entry of each row of B inside the panel
+    int threads;
+    RowBuffer* buffers;
+    int* rowWorker;         // output row i is rowLength[i] entries at rowStart[i] of buffer rowWorker[i]
+    int* rowStart;
+    int* rowLength;
+    Progress* progress;
+} RowProduct;
+
+void freeRowProduct(RowProduct* product)
+{
+    for(int t = 0; product->buffers && t < product->threads; t++)
+    {
+        freeAccumulator(&product->buffers[t].dense);
+        freeHashAccumulator(&product->buffers[t].hash);
+        free(product->buffers[t].keys);
+        free(product->buffers[t].cols);
+        free(product->buffers[t].values);
+    }
+    free(product->buffers);
+    free(product->rowWorker);
+    free(product->rowStart);
+    free(product->rowLength);
+}
+status_code beginRowProduct(RowProduct* product, const MatrixView* view1, const MatrixView* view2, boolean hashed,
+                            int denseSize, int maxRowOutput)
+{
+    status_code sc = SUCCESS;
+    int rows = view1->rowCount + 1;
+    product->view1 = view1;
+    product->view2 = view2;
+    product->hashed = hashed;
+    product->lo = 0;
+    product->hi = view2->colCount;
+    product->first = 0;
+    product->cursor = view2->lists;
+    product->threads = poolThreadCount();
+    product->progress = activeProgress;
+    product->buffers = (RowBuffer*)calloc(product->threads, sizeof(RowBuffer));
+    product->rowWorker = (int*)malloc(rows * sizeof(int));
+    product->rowStart = (int*)malloc(rows * sizeof(int));
+    product->rowLength = (int*)calloc(rows, sizeof(int));
+    if(!product->buffers || !product->rowWorker || !product->rowStart || !product->rowLength)
+    {
+        sc = FAILURE;
+    }
+    for(int t = 0; sc == SUCCESS && t < product->threads; t++)
+    {
+        RowBuffer* buffer = &product->buffers[t];
+        buffer->sc = SUCCESS;
+        if(hashed)
+        {
+            buffer->keys = (int*)malloc((maxRowOutput + 1) * sizeof(int));
+            sc = (initializeHashAccumulator(&buffer->hash, maxRowOutput) == SUCCESS && buffer->keys) ? SUCCESS : FAILURE;
+        }
+        else
+        {
+            sc = initializeAccumulator(&buffer->dense, denseSize);
+        }
+    }
+    return sc;
+}
+void bufferEntry(RowBuffer* buffer, int col, matrix_entry value)
+{
+    if(buffer->count == buffer->capacity)
+    {
+        int capacity = buffer->capacity ? 2 * buffer->capacity : 1024;
+        int* cols = (int*)realloc(buffer->cols, capacity * sizeof(int));
+        matrix_entry* values = cols ? (matrix_entry*)realloc(buffer->values, capacity * sizeof(matrix_entry)) : NULL;
+        if(cols)
+        {
+            buffer->cols = cols;
+        }
+        if(!values)
+        {
+            buffer->sc = FAILURE;
+            return;
+        }
+        buffer->values = values;
+        buffer->capacity = capacity;
+    }
+    buffer->cols[buffer->count] = col;
+    buffer->values[buffer->count++] = value;
+}
+void productRows(void* context, int begin, int end)
+{
+    RowProduct* product = (RowProduct*)context;
+    const MatrixView* view1 = product->view1;
+    const MatrixView* view2 = product->view2;
+    int worker = currentWorker();
+    RowBuffer* buffer = &product->buffers[worker];
+    long rows = 0;
+    long long flops = 0;
+
+    for(int i = product->first + begin; buffer->sc == SUCCESS && i < product->first + end; i++)
+    {
+        if(progressCancelled(product->progress))
+        {
+            buffer->sc = FAILURE;
+            break;
+        }
+        product->rowWorker[i] = worker;
+        product->rowStart[i] = buffer->count;
+        for(Sm_Node* e1 = view1->lists[i]; e1; e1 = viewNext(view1, i, e1))
+        {
+            int k = viewIndex(view1, i, e1);
+            for(Sm_Node* e2 = product->cursor[k]; e2 && viewIndex(view2, k, e2) < product->hi; e2 = viewNext(view2, k, e2))
+            {
+                flops += 2;
+                if(product->hashed)
+                {
+                    hashAccumulate(&buffer->hash, viewIndex(view2, k, e2), e1->data * e2->data);
+                }
+                else
+                {
+                    accumulate(&buffer->dense, viewIndex(view2, k, e2) - product->lo, e1->data * e2->data);
+                }
+            }
+        }
+        if(product->hashed)
+        {
+            HashAccumulator* acc = &buffer->hash;
+            for(int k = 0; k < acc->count; k++)
+            {
+                buffer->keys[k] = acc->keys[acc->slots[k]];
+            }
+            qsort(buffer->keys, acc->count, sizeof(int), compareIndexes);
+            for(int k = 0; k < acc->count; k++)
+            {
+                bufferEntry(buffer, buffer->keys[k], acc->values[hashSlot(acc, buffer->keys[k])]);
+            }
+            resetHashAccumulator(acc);
+        }
+        else
+        {
+            SparseAccumulator* acc = &buffer->dense;
+            sortAccumulator(acc);
+            for(int k = 0; k < acc->count; k++)
+            {
+                bufferEntry(buffer, product->lo + acc->pattern[k], acc->values[acc->pattern[k]]);
+            }
+            resetAccumulator(acc);
+        }
+        product->rowLength[i] = buffer->count - product->rowStart[i];
+        rows++;
+    }
+    addProgress(product->progress, rows, flops);
+}
+status_code runRowProduct(RowProduct* product, int grain, MatrixBuilder* builder)// one pass over all rows
+{
+    status_code sc = SUCCESS;
+    int rows = product->view1->rowCount;
+    long long batch = (long long)grain * product->threads * PRODUCT_BATCH_PIECES;
+
+    for(int first = 0; sc == SUCCESS && first < rows; first += (int)batch)
+    {
+        int last = (rows - first > batch) ? first + (int)batch : rows;
+        product->first = first;
+        memset(product->rowLength + first, 0, (last - first) * sizeof(int));
+        parallelForGrain(last - first, grain, productRows, product);
+        for(int t = 0; t < product->threads; t++)
+        {
+            if(product->buffers[t].sc == FAILURE)
+            {
+                sc = FAILURE;
+            }
+        }
+        for(int i = first; sc == SUCCESS && i < last; i++)
+        {
+            RowBuffer* buffer = &product->buffers[product->rowWorker[i]];
+            for(int k = product->rowStart[i]; sc == SUCCESS && k < product->rowStart[i] + product->rowLength[i]; k++)
+            {
+                sc = appendElement(builder, i, buffer->cols[k], buffer->values[k]);
+            }
+        }
+        for(int t = 0; t < product->threads; t++)
+        {
+            product->buffers[t].count = 0;
+        }
+    }
+    return sc;
+}
+// panels of output columns are processed one after another; each row of B keeps
+// a cursor at the start of the current panel, so B is still walked only once
+status_code multiplyRows(const MatrixView* view1, const MatrixView* view2, MultiplyStrategy strategy,
+                         const MultiplyEstimate* estimate, MatrixBuilder* builder)
+{
+    status_code sc;
+    RowProduct product;
+    Sm_Node** cursor = NULL;
+    int width = view2->colCount;
+    double rowsPerPiece = (estimate->flops > 0) ? PRODUCT_GRAIN_FLOPS * (double)view1->rowCount / estimate->flops : PARALLEL_GRAIN;
+    int grain = (rowsPerPiece < 1) ? 1 : (rowsPerPiece > PARALLEL_GRAIN) ? PARALLEL_GRAIN : (int)rowsPerPiece;
+
+    if(strategy == MULTIPLY_BLOCKED)
+    {
+        width = (int)(MULTIPLY_CACHE_BYTES / denseAccumulatorBytes(1));
+        if(width < MIN_PANEL_WIDTH)
+        {
+            width = MIN_PANEL_WIDTH;
+        }
+    }
+    beginProgress(activeProgress, (long)view1->rowCount * ((strategy == MULTIPLY_BLOCKED) ? (view2->colCount + width - 1) / width : 1));
+    sc = beginRowProduct(&product, view1, view2, strategy == MULTIPLY_HASH, width, estimate->maxRowOutput);
+    if(sc == SUCCESS && strategy == MULTIPLY_BLOCKED)
+    {
+        cursor = (Sm_Node**)malloc((view2->rowCount + 1) * sizeof(Sm_Node*));
+        if(cursor == NULL)
+        {
+            sc = FAILURE;
+        }
+        else
+        {
+            memcpy(cursor, view2->lists, view2->rowCount * sizeof(Sm_Node*));
+            product.cursor = cursor;
+        }
+    }
+    for(int lo = 0; sc == SUCCESS && lo < view2->colCount; lo += width)
+    {
+        product.lo = lo;
+        product.hi = (strategy == MULTIPLY_BLOCKED) ? lo + width : view2->colCount;
+        for(int k = 0; cursor && k < view2->rowCount; k++)
+        {
+            while(cursor[k] && viewIndex(view2, k, cursor[k]) < lo)
+            {
+                cursor[k] = viewNext(view2, k, cursor[k]);
+            }
+        }
+        sc = runRowProduct(&product, grain, builder);
+    }
+    freeRowProduct(&product);
+    free(cursor);
+    return sc;
+}
+// op(A) * op(B); transposed operands are read through their column lists so
+// neither matrix is modified or copied
+status_code multiplyViews(const MatrixView* view1, const MatrixView* view2, SparseMatrix* result, MultiplyStrategy strategy)
+{
+    status_code sc = SUCCESS;
+    MultiplyEstimate estimate;
+    MatrixBuilder builder;
+    PROFILE_BEGIN(PROF_MULTIPLY);
+
+    initializeMatrix(result);
+    if(view1->colCount != view2->rowCount)
+    {
+        sc = FAILURE;
+    }
+    else if(estimateMultiply(view1, view2, &estimate) == FAILURE
+        || beginMatrixBuilder(&builder, result, view1->rowCount, view2->colCount) == FAILURE)
+    {
+        sc = FAILURE;
+    }
+    else
+    {
+        if(strategy == MULTIPLY_AUTO)
+        {
+            strategy = chooseMultiplyStrategy(view1->rowCount, view2->colCount, &estimate);
+        }
+        PROFILE_COUNT(flops, 2 * estimate.flops);
+        sc = multiplyRows(view1, view2, strategy, &estimate, &builder);
+        finishMatrixBuilder(&builder);
+    }
+    PROFILE_END();
+    return sc;
+}
+status_code multiplyOperands(SparseMatrix* matrix1, boolean transposed1, SparseMatrix* matrix2, boolean transposed2,
+                             SparseMatrix* result, MultiplyStrategy strategy)
+{
+    status_code sc = FAILURE;
+    MatrixView view1, view2;
+
+    initializeMatrix(result);
+    if(openMatrixView(&view1, matrix1, transposed1) == SUCCESS)
+    {
+        if(openMatrixView(&view2, matrix2, transposed2) == SUCCESS)
+        {
+            sc = multiplyViews(&view1, &view2, result, strategy);
+            closeMatrixView(&view2);
+        }
+        closeMatrixView(&view1);
+    }
+    return sc;
+}
+status_code multiplyMatrixWithStrategy(SparseMatrix* matrix1, SparseMatrix* matrix2, SparseMatrix* result, MultiplyStrategy strategy)
+{
+    return multiplyOperands(matrix1, FALSE, matrix2, FALSE, result, strategy);
+}
+status_code multiplyMatrix(SparseMatrix* matrix1, SparseMatrix* matrix2, SparseMatrix* result)
+{
+    return multiplyOperands(matrix1, FALSE, matrix2, FALSE, result, MULTIPLY_AUTO);
+}
+status_code multiplyTransposeMatrix(SparseMatrix* matrix1, SparseMatrix* matrix2, SparseMatrix* result)// A^T * B
+{
+    return multiplyOperands(matrix1, TRUE, matrix2, FALSE, result, MULTIPLY_AUTO);
+}
+status_code multiplyMatrixTranspose(SparseMatrix* matrix1, SparseMatrix* matrix2, SparseMatrix* result)// A * B^T
+{
+    return multiplyOperands(matrix1, FALSE, matrix2, TRUE, result, MULTIPLY_AUTO);
+}
+// products kept current under point updates. C = A * B is computed once; after
+// a batch of updates to A only the rows of C whose row of A was touched can
+// change, and after a batch to B only the columns whose column of B was. Those
+// are recomputed from the updated operands, summing in the same order as
+// multiplyMatrix, and merged into C with one applyUpdates, so the rest of C is
+// never read. Refreshed entries that cancel to zero are removed.
+typedef struct Maintained_Product_Tag
+{
+    SparseMatrix* left;
+    SparseMatrix* right;
+    SparseMatrix* product;
+    boolean stale;          // changed outside the refreshes: the next one recomputes in full
+    int rowsRefreshed, colsRefreshed;   // by the last refresh
+} MaintainedProduct;
+
+typedef struct Update_List_Tag
+{
+    MatrixUpdate* items;
+    int count, capacity;
+} UpdateList;
+
+status_code pushUpdate(UpdateList* list, int row, int col, matrix_entry value, UpdateOp op)
+{
+    status_code sc = SUCCESS;
+    if(list->count == list->capacity)
+    {
+        int capacity = list->capacity ? 2 * list->capacity : 256;
+        MatrixUpdate* items = (MatrixUpdate*)realloc(list->items, capacity * sizeof(MatrixUpdate));
+        if(items == NULL)
+        {
+            sc = FAILURE;
+        }
+        else
+        {
+            list->items = items;
+            list->capacity = capacity;
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        MatrixUpdate* update = &list->items[list->count++];
+        update->row = row;
+        update->col = col;
+        update->value = value;
+        update->op = op;
+    }
+    return sc;
+}
+// distinct rows (or columns) of operand touched by the batch, sorted. An entry
+// of a symmetric operand stands for both of its mirror images.
+int touchedLines(const SparseMatrix* operand, const MatrixUpdate* updates, int count, boolean rows, int* lines)
+{
+    int n = 0, distinct = 0;
+    for(int k = 0; k < count; k++)
+    {
+        lines[n++] = rows ? updates[k].row : updates[k].col;
+        if(operand->symmetric)
+        {
+            lines[n++] = rows ? updates[k].col : updates[k].row;
+        }
+    }
+    qsort(lines, n, sizeof(int), compareIndexes);
+    for(int k = 0; k < n; k++)
+    {
+        if(distinct == 0 || lines[k] != lines[distinct - 1])
+        {
+            lines[distinct++] = lines[k];
+        }
+    }
+    return distinct;
+}
+// recomputes rows (byRows) or columns of the product and lists what differs
+// from the stored ones. Column j of A * B is built from column j of B and the
+// columns of A, so both cases walk rows of views: A, B, C or B^T, A^T, C^T.
+status_code refreshProductLines(const MaintainedProduct* maintained, boolean byRows, const int* lines, int n, UpdateList* list)
+{
+    status_code sc = FAILURE;
+    MatrixView outer, inner, old;
+    SparseAccumulator acc;
+    const SparseMatrix* first = byRows ? maintained->left : maintained->right;
+    const SparseMatrix* second = byRows ? maintained->right : maintained->left;
+
+    if(openMatrixView(&outer, first, !byRows) == SUCCESS)
+    {
+        if(openMatrixView(&inner, second, !byRows) == SUCCESS)
+        {
+            if(openMatrixView(&old, maintained->product, !byRows) == SUCCESS)
+            {
+                sc = initializeAccumulator(&acc, old.colCount);
+                for(int t = 0; sc == SUCCESS && t < n; t++)
+                {
+                    int i = lines[t], p = 0;
+                    Sm_Node* stored = old.lists[i];
+                    for(Sm_Node* e1 = outer.lists[i]; e1; e1 = viewNext(&outer, i, e1))
+                    {
+                        int k = viewIndex(&outer, i, e1);
+                        for(Sm_Node* e2 = inner.lists[k]; e2; e2 = viewNext(&inner, k, e2))
+                        {
+                            accumulate(&acc, viewIndex(&inner, k, e2), e1->data * e2->data);
+                        }
+                    }
+                    sortAccumulator(&acc);
+                    while(sc == SUCCESS && (stored || p < acc.count))// merge the new line with the stored one
+                    {
+                        int oldIndex = stored ? viewIndex(&old, i, stored) : INT_MAX;
+                        int newIndex = (p < acc.count) ? acc.pattern[p] : INT_MAX;
+                        int index = (oldIndex < newIndex) ? oldIndex : newIndex;
+                        matrix_entry value = (newIndex == index) ? acc.values[index] : 0;
+                        if(oldIndex == index ? (value == 0 || stored->data != value) : value != 0)
+                        {
+                            sc = pushUpdate(list, byRows ? i : index, byRows ? index : i, value, (value != 0) ? UPDATE_UPSERT : UPDATE_DELETE);
+                        }
+                        if(oldIndex == index)
+                        {
+                            stored = viewNext(&old, i, stored);
+                        }
+                        if(newIndex == index)
+                        {
+                            p++;
+                        }
+                    }
+                    resetAccumulator(&acc);
+                }
+                freeAccumulator(&acc);
+                closeMatrixView(&old);
+            }
+            closeMatrixView(&inner);
+        }
+        closeMatrixView(&outer);
+    }
+    return sc;
+}
+status_code recomputeMaintainedProduct(MaintainedProduct* maintained)
+{
+    SparseMatrix fresh;
+    status_code sc = multiplyMatrix(maintained->left, maintained->right, &fresh);
+    if(sc == SUCCESS)
+    {
+        releaseMatrix(maintained->product);
+        *maintained->product = fresh;
+        maintained->rowsRefreshed = fresh.rowCount;
+        maintained->colsRefreshed = 0;
+        maintained->stale = FALSE;
+    }
+    else
+    {
+        releaseMatrix(&fresh);
+    }
+    return sc;
+}
+// product receives left * right; whatever it held is released. It must not be
+// one of the operands.
+status_code beginMaintainedProduct(MaintainedProduct* maintained, SparseMatrix* left, SparseMatrix* right, SparseMatrix* product)
+{
+    status_code sc = FAILURE;
+    maintained->left = left;
+    maintained->right = right;
+    maintained->product = product;
+    maintained->stale = TRUE;
+    if(product != left && product != right && left->colCount == right->rowCount)
+    {
+        sc = recomputeMaintainedProduct(maintained);
+    }
+    return sc;
+}
+// brings the product up to date after the batch was applied to operand, which
+// may be either operand or both (A * A)
+status_code refreshMaintainedProduct(MaintainedProduct* maintained, const SparseMatrix* operand, const MatrixUpdate* updates, int count)
+{
+    status_code sc = SUCCESS;
+    UpdateList list = {NULL, 0, 0};
+    int* lines = (int*)malloc((2 * count + 1) * sizeof(int));
+
+    maintained->rowsRefreshed = maintained->colsRefreshed = 0;
+    if(lines == NULL)
+    {
+        sc = FAILURE;
+    }
+    if(sc == SUCCESS && operand == maintained->left)
+    {
+        maintained->rowsRefreshed = touchedLines(operand, updates, count, TRUE, lines);
+        sc = refreshProductLines(maintained, TRUE, lines, maintained->rowsRefreshed, &list);
+    }
+    if(sc == SUCCESS && operand == maintained->right)
+    {
+        maintained->colsRefreshed = touchedLines(operand, updates, count, FALSE, lines);
+        sc = refreshProductLines(maintained, FALSE, lines, maintained->colsRefreshed, &list);
+    }
+    if(sc == SUCCESS)
+    {
+        sc = applyUpdates(maintained->product, list.items, list.count);
+    }
+    free(lines);
+    free(list.items);
+    return sc;
+}
+status_code updateMaintainedProduct(MaintainedProduct* maintained, SparseMatrix* operand, const MatrixUpdate* updates, int count)
+{
+    status_code sc = applyUpdates(operand, updates, count);
+    if(sc == SUCCESS)
+    {
+        sc = refreshMaintainedProduct(maintained, operand, updates, count);
+    }
+    return sc;
+}
+// two-phase products for operands whose pattern stays fixed while the values
+// change. The symbolic phase allocates the output pattern once and records the
+// target node of every product (the scatter map); the numeric phase replays the
+// same walk and only rewrites values. Entries that cancel stay stored as zeros.
+// A plan belongs to the operands it was built from; while their versions are
+// unchanged the numeric phase has nothing to do.
+typedef struct Multiply_Plan_Tag
+{
+    SparseMatrix result;
+    Sm_Node** scatter;
+    long flopCount;
+    const SparseMatrix* operands[2];
+    unsigned long versions[2];   // of the operands when result was last computed, 0 before
+} MultiplyPlan;
+
+typedef struct Add_Plan_Tag
+{
+    SparseMatrix result;
+    Sm_Node** scatter1;   // target of every element of matrix1, in row order
+    Sm_Node** scatter2;
+    int nnz1, nnz2;
+    const SparseMatrix* operands[2];
+    unsigned long versions[2];
+} AddPlan;
+
+void beginPlanOperands(const SparseMatrix** operands, unsigned long* versions, const SparseMatrix* matrix1,
+                       const SparseMatrix* matrix2)
+{
+    operands[0] = matrix1;
+    operands[1] = matrix2;
+    versions[0] = versions[1] = 0;
+}
+// SUCCESS when the numeric phase must run, FAILURE with *current set when the
+// result is already up to date, FAILURE alone when the operands are not the planned ones
+status_code checkPlanOperands(const SparseMatrix* const* operands, const unsigned long* versions,
+                              const SparseMatrix* matrix1, const SparseMatrix* matrix2, boolean* current)
+{
+    status_code sc = SUCCESS;
+    *current = FALSE;
+    if(operands[0] != matrix1 || operands[1] != matrix2)
+    {
+        sc = FAILURE;
+    }
+    else if(versions[0] == matrix1->version && versions[1] == matrix2->version)
+    {
+        *current = TRUE;
+        sc = FAILURE;
+    }
+    return sc;
+}
+
+void freeMultiplyPlan(MultiplyPlan* plan)
+{
+    clearMatrix(&plan->result);
+    free(plan->scatter);
+    plan->scatter = NULL;
+    plan->flopCount = 0;
+}
+status_code symbolicMultiply(SparseMatrix* matrix1, SparseMatrix* matrix2, MultiplyPlan* plan)
+{
+    status_code sc = FAILURE;
+    MatrixView view1, view2;
+    MultiplyEstimate estimate;
+    SparseAccumulator acc;
+    MatrixBuilder builder;
+    Sm_Node** slot = NULL;
+    long f = 0;
+
+    initializeMatrix(&plan->result);
+    plan->scatter = NULL;
+    plan->flopCount = 0;
+    beginPlanOperands(plan->operands, plan->versions, matrix1, matrix2);
+    memset(&acc, 0, sizeof(acc));
+    if(matrix1->colCount == matrix2->rowCount && openMatrixView(&view1, matrix1, FALSE) == SUCCESS)
+    {
+        if(openMatrixView(&view2, matrix2, FALSE) == SUCCESS)
+        {
+            if(estimateMultiply(&view1, &view2, &estimate) == SUCCESS
+                && initializeAccumulator(&acc, view2.colCount) == SUCCESS)
+            {
+                plan->flopCount = (long)estimate.flops;
+                plan->scatter = (Sm_Node**)malloc((plan->flopCount + 1) * sizeof(Sm_Node*));
+                slot = (Sm_Node**)malloc((view2.colCount + 1) * sizeof(Sm_Node*));
+                if(plan->scatter && slot && beginMatrixBuilder(&builder, &plan->result, view1.rowCount, view2.colCount) == SUCCESS)
+                {
+                    sc = SUCCESS;
+                    for(int i = 0; sc == SUCCESS && i < view1.rowCount; i++)
+                    {
+                        for(Sm_Node* e1 = view1.lists[i]; e1; e1 = viewNext(&view1, i, e1))
+                        {
+                            int k = viewIndex(&view1, i, e1);
+                            for(Sm_Node* e2 = view2.lists[k]; e2; e2 = viewNext(&view2, k, e2))
+                            {
+                                accumulate(&acc, viewIndex(&view2, k, e2), 0);
+                            }
+                        }
+                        sortAccumulator(&acc);
+                        for(int k = 0; sc == SUCCESS && k < acc.count; k++)
+                        {
+                            slot[acc.pattern[k]] = appendNode(&builder, i, acc.pattern[k], 0);
+                            sc = slot[acc.pattern[k]] ? SUCCESS : FAILURE;
+                        }
+                        resetAccumulator(&acc);
+                        for(Sm_Node* e1 = view1.lists[i]; sc == SUCCESS && e1; e1 = viewNext(&view1, i, e1))
+                        {
+                            int k = viewIndex(&view1, i, e1);
+                            for(Sm_Node* e2 = view2.lists[k]; e2; e2 = viewNext(&view2, k, e2))
+                            {
+                                plan->scatter[f++] = slot[viewIndex(&view2, k, e2)];
+                            }
+                        }
+                    }
+                    finishMatrixBuilder(&builder);
+                }
+            }
+            freeAccumulator(&acc);
+            free(slot);
+            closeMatrixView(&view2);
+        }
+        closeMatrixView(&view1);
+    }
+    if(sc == FAILURE)
+    {
+        freeMultiplyPlan(plan);
+    }
+    return sc;
+}
+status_code numericMultiply(SparseMatrix* matrix1, SparseMatrix* matrix2, MultiplyPlan* plan)
+{
+    status_code sc = FAILURE;
+    MatrixView view1, view2;
+    boolean current;
+    long f = 0;
+
+    if(checkPlanOperands(plan->operands, plan->versions, matrix1, matrix2, &current) == FAILURE)
+    {
+        sc = current ? SUCCESS : FAILURE;
+    }
+    else if(openMatrixView(&view1, matrix1, FALSE) == SUCCESS)
+    {
+        bumpVersion(&plan->result);
+        for(Row_Node* rowPos = plan->result.rowHead; rowPos; rowPos = rowPos->next)
+        {
+            for(Sm_Node* element = rowPos->rowlist; element; element = element->right)
+            {
+                element->data = 0;
+            }
+        }
+        if(openMatrixView(&view2, matrix2, FALSE) == SUCCESS)
+        {
+            sc = (view1.rowCount == plan->result.rowCount && view1.colCount == view2.rowCount
+                  && view2.colCount == plan->result.colCount) ? SUCCESS : FAILURE;
+            for(int i = 0; sc == SUCCESS && i < view1.rowCount; i++)
+            {
+                for(Sm_Node* e1 = view1.lists[i]; sc == SUCCESS && e1; e1 = viewNext(&view1, i, e1))
+                {
+                    int k = viewIndex(&view1, i, e1);
+                    for(Sm_Node* e2 = view2.lists[k]; sc == SUCCESS && e2; e2 = viewNext(&view2, k, e2))
+                    {
+                        // a target that does not line up means the operand pattern changed
+                        if(f == plan->flopCount || plan->scatter[f]->row != i || plan->scatter[f]->col != viewIndex(&view2, k, e2))
+                        {
+                            sc = FAILURE;
+                        }
+                        else
+                        {
+                            plan->scatter[f++]->data += e1->data * e2->data;
+                        }
+                    }
+                }
+            }
+            if(f != plan->flopCount)
+            {
+                sc = FAILURE;
+            }
+            closeMatrixView(&view2);
+        }
+        closeMatrixView(&view1);
+        plan->versions[0] = (sc == SUCCESS) ? matrix1->version : 0;
+        plan->versions[1] = (sc == SUCCESS) ? matrix2->version : 0;
+    }
+    return sc;
+}
+void freeAddPlan(AddPlan* plan)
+{
+    clearMatrix(&plan->result);
+    free(plan->scatter1);
+    free(plan->scatter2);
+    plan->scatter1 = plan->scatter2 = NULL;
+    plan->nnz1 = plan->nnz2 = 0;
+}
+int countElements(const SparseMatrix* matrix)
+{
+    int count = 0;
+    for(Row_Node* rowPos = matrix->rowHead; rowPos; rowPos = rowPos->next)
+    {
+        for(Sm_Node* element = rowPos->rowlist; element; element = element->right)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+// elements of view row i in index order; a sum of two symmetric operands
+// only needs their lower triangles
+Sm_Node* addWalkNext(const MatrixView* view, int row, const Sm_Node* element, boolean lowerOnly)
+{
+    Sm_Node* next = element ? viewNext(view, row, element) : view->lists[row];
+    if(next && lowerOnly && viewIndex(view, row, next) > row)
+    {
+        next = NULL;
+    }
+    return next;
+}
+status_code symbolicAdd(SparseMatrix* matrix1, SparseMatrix* matrix2, AddPlan* plan)
+{
+    status_code sc = FAILURE;
+    MatrixBuilder builder;
+    MatrixView view1, view2;
+    boolean lowerOnly = matrix1->symmetric && matrix2->symmetric;
+    int k1 = 0, k2 = 0;
+
+    initializeMatrix(&plan->result);
+    plan->nnz1 = plan->nnz2 = 0;
+    plan->scatter1 = plan->scatter2 = NULL;
+    beginPlanOperands(plan->operands, plan->versions, matrix1, matrix2);
+    if(matrix1->rowCount == matrix2->rowCount && matrix1->colCount == matrix2->colCount
+        && openMatrixView(&view1, matrix1, FALSE) == SUCCESS)
+    {
+        if(openMatrixView(&view2, matrix2, FALSE) == SUCCESS)
+        {
+            for(int i = 0; i < view1.rowCount; i++)
+            {
+                for(Sm_Node* e = addWalkNext(&view1, i, NULL, lowerOnly); e; e = addWalkNext(&view1, i, e, lowerOnly))
+                {
+                    plan->nnz1++;
+                }
+                for(Sm_Node* e = addWalkNext(&view2, i, NULL, lowerOnly); e; e = addWalkNext(&view2, i, e, lowerOnly))
+                {
+                    plan->nnz2++;
+                }
+            }
+            plan->scatter1 = (Sm_Node**)malloc((plan->nnz1 + 1) * sizeof(Sm_Node*));
+            plan->scatter2 = (Sm_Node**)malloc((plan->nnz2 + 1) * sizeof(Sm_Node*));
+            if(plan->scatter1 && plan->scatter2
+                && beginMatrixBuilder(&builder, &plan->result, matrix1->rowCount, matrix1->colCount) == SUCCESS)
+            {
+                sc = SUCCESS;
+                for(int i = 0; sc == SUCCESS && i < view1.rowCount; i++)
+                {
+                    Sm_Node *e1 = addWalkNext(&view1, i, NULL, lowerOnly), *e2 = addWalkNext(&view2, i, NULL, lowerOnly), *node;
+                    while(sc == SUCCESS && (e1 || e2))
+                    {
+                        int c1 = e1 ? viewIndex(&view1, i, e1) : 0, c2 = e2 ? viewIndex(&view2, i, e2) : 0;
+                        int col = (!e2 || (e1 && c1 < c2)) ? c1 : c2;
+                        node = appendNode(&builder, i, col, 0);
+                        sc = node ? SUCCESS : FAILURE;
+                        if(e1 && c1 == col)
+                        {
+                            plan->scatter1[k1++] = node;
+                            e1 = addWalkNext(&view1, i, e1, lowerOnly);
+                        }
+                        if(e2 && c2 == col)
+                        {
+                            plan->scatter2[k2++] = node;
+                            e2 = addWalkNext(&view2, i, e2, lowerOnly);
+                        }
+                    }
+                }
+                finishMatrixBuilder(&builder);
+                plan->result.symmetric = lowerOnly;
+            }
+            closeMatrixView(&view2);
+        }
+        closeMatrixView(&view1);
+    }
+    if(sc == FAILURE)
+    {
+        freeAddPlan(plan);
+    }
+    return sc;
+}
+status_code numericAdd(SparseMatrix* matrix1, SparseMatrix* matrix2, AddPlan* plan)
+{
+    status_code sc;
+    const SparseMatrix* operands[2] = {matrix1, matrix2};
+    Sm_Node** scatter[2] = {plan->scatter1, plan->scatter2};
+    int nnz[2] = {plan->nnz1, plan->nnz2};
+    boolean lowerOnly = plan->result.symmetric, current;
+
+    sc = checkPlanOperands(plan->operands, plan->versions, matrix1, matrix2, &current);
+    if(sc == SUCCESS)
+    {
+        bumpVersion(&plan->result);
+        for(int m = 0; m < 2; m++)// targets hit by both operands are reset twice, which is harmless
+        {
+            for(int k = 0; k < nnz[m]; k++)
+            {
+                scatter[m][k]->data = 0;
+            }
+        }
+    }
+    for(int m = 0; !current && sc == SUCCESS && m < 2; m++)
+    {
+        MatrixView view;
+        int k = 0;
+        if(operands[m]->rowCount == plan->result.rowCount && operands[m]->colCount == plan->result.colCount
+            && openMatrixView(&view, operands[m], FALSE) == SUCCESS)
+        {
+            for(int i = 0; sc == SUCCESS && i < view.rowCount; i++)
+            {
+                for(Sm_Node* element = addWalkNext(&view, i, NULL, lowerOnly); sc == SUCCESS && element;
+                    element = addWalkNext(&view, i, element, lowerOnly))
+                {
+                    if(k == nnz[m] || scatter[m][k]->row != i || scatter[m][k]->col != viewIndex(&view, i, element))
+                    {
+                        sc = FAILURE;
+                    }
+                    else
+                    {
+                        scatter[m][k++]->data += element->data;
+                    }
+                }
+            }
+            closeMatrixView(&view);
+        }
+        else
+        {
+            sc = FAILURE;
+        }
+        if(k != nnz[m])
+        {
+            sc = FAILURE;
+        }
+    }
+    if(current)
+    {
+        sc = SUCCESS;
+    }
+    else
+    {
+        plan->versions[0] = (sc == SUCCESS) ? matrix1->version : 0;
+        plan->versions[1] = (sc == SUCCESS) ? matrix2->version : 0;
+    }
+    return sc;
+}
+void multiplyVector(const SparseMatrix* matrix, const double* x, double* y)// y = A * x
+{
+    memset(y, 0, matrix->rowCount * sizeof(double));
+    for(Row_Node* rowPos = matrix->symmetric ? matrix->rowHead : NULL; rowPos; rowPos = rowPos->next)
+    {
+        // each stored off-diagonal a_ij also acts as a_ji, so one pass serves both halves
+        int i = rowPos->row;
+        double sum = 0, xi = x[i];
+        for(Sm_Node* element = rowPos->rowlist; element; element = element->right)
+        {
+            sum += element->data * x[element->col];
+            if(element->col != i)
+            {
+                y[element->col] += element->data * xi;
+            }
+        }
+        y[i] += sum;
+    }
+    for(Row_Node* rowPos = matrix->symmetric ? NULL : matrix->rowHead; rowPos; rowPos = rowPos->next)
+    {
+        double sum = 0;
+        for(Sm_Node* element = rowPos->rowlist; element; element = element->right)
+        {
+            sum += element->data * x[element->col];
+        }
+        y[rowPos->row] = sum;
+    }
+}
+void transposeMultiplyVector(const SparseMatrix* matrix, const double* x, double* y)// y = A^T * x
+{
+    // column j of A is row j of A^T, so each y[j] is a gather down one column list
+    if(matrix->symmetric)
+    {
+        multiplyVector(matrix, x, y);
+        return;
+    }
+    memset(y, 0, matrix->colCount * sizeof(double));
+    for(Col_Node* colPos = matrix->colHead; colPos; colPos = colPos->next)
+    {
+        double sum = 0;
+        for(Sm_Node* element = colPos->collist; element; element = element->down)
+        {
+            sum += element->data * x[element->row];
+        }
+        y[colPos->col] = sum;
+    }
+}
+// Krylov solvers. They only see the matrix through a LinearOperator and the
+// preconditioner through its apply hook, so any storage format can be plugged in.
+#define DEFAULT_SOLVER_TOLERANCE 1e-8
+#define DEFAULT_SOLVER_ITERATIONS 1000
+#define DEFAULT_GMRES_RESTART 30
+
+typedef enum{SOLVER_AUTO, SOLVER_CG, SOLVER_BICGSTAB, SOLVER_GMRES} SolverMethod;
+
+typedef struct Linear_Operator_Tag
+{
+    int n;
+    const void* data;
+    void (*apply)(const void* data, const double* x, double* y);   // y = A * x
+} LinearOperator;
+
+typedef struct Preconditioner_Tag
+{
+    const void* data;
+    void (*apply)(const void* data, const double* r, double* z);   // z = M^-1 * r, NULL for none
+} Preconditioner;
+
+typedef struct Solver_Options_Tag
+{
+    double tolerance;   // on ||b - A x|| / ||b||
+    int maxIterations;
+    int restart;        // GMRES only
+} SolverOptions;
+
+typedef struct Solver_Result_Tag
+{
+    boolean converged;
+    int iterations;
+    double residual;
+    double* residualHistory;   // iterations + 1 entries, owned by the result
+} SolverResult;
+
+void applySparseMatrix(const void* data, const double* x, double* y)
+{
+    multiplyVector((const SparseMatrix*)data, x, y);
+}
+LinearOperator sparseMatrixOperator(const SparseMatrix* matrix)
+{
+    LinearOperator op;
+    op.n = matrix->rowCount;
+    op.data = matrix;
+    op.apply = applySparseMatrix;
+    return op;
+}
+void initializeSolverOptions(SolverOptions* options)
+{
+    options->tolerance = DEFAULT_SOLVER_TOLERANCE;
+    options->maxIterations = DEFAULT_SOLVER_ITERATIONS;
+    options->restart = DEFAULT_GMRES_RESTART;
+}
+void freeSolverResult(SolverResult* result)
+{
+    free(result->residualHistory);
+    result->residualHistory = NULL;
+}
+void applyPreconditioner(const Preconditioner* precond, int n, const double* r, double* z)
+{
+    if(precond && precond->apply)
+    {
+        precond->apply(precond->data, r, z);
+    }
+    else
+    {
+        memcpy(z, r, n * sizeof(double));
+    }
+}
+double dotProduct(int n, const double* x, const double* y)
+{
+    double sum = 0;
+    for(int i = 0; i < n; i++)
+    {
+        sum += x[i] * y[i];
+    }
+    return sum;
+}
+double vectorNorm(int n, const double* x)
+{
+    return sqrt(dotProduct(n, x, x));
+}
+void axpy(int n, double alpha, const double* x, double* y)// y += alpha * x
+{
+    for(int i = 0; i < n; i++)
+    {
+        y[i] += alpha * x[i];
+    }
+}
+// r = b - A x, returns ||b|| (1 for a zero right hand side so residuals stay absolute)
+double initialResidual(const LinearOperator* A, const double* b, const double* x, double* r)
+{
+    double bnorm = vectorNorm(A->n, b);
+    A->apply(A->data, x, r);
+    for(int i = 0; i < A->n; i++)
+    {
+        r[i] = b[i] - r[i];
+    }
+    return (bnorm > 0) ? bnorm : 1;
+}
+status_code beginSolve(const SolverOptions* options, SolverResult* result)
+{
+    result->converged = FALSE;
+    result->iterations = 0;
+    result->residual = 0;
+    result->residualHistory = (double*)malloc((options->maxIterations + 1) * sizeof(double));
+    return result->residualHistory ? SUCCESS : FAILURE;
+}
+void recordResidual(const SolverOptions* options, SolverResult* result, double residual)
+{
+    result->residual = residual;
+    result->residualHistory[result->iterations] = residual;
+    if(residual <= options->tolerance)
+    {
+        result->converged = TRUE;
+    }
+}
+// preconditioned conjugate gradient, for symmetric positive definite A
+status_code solveCG(const LinearOperator* A, const Preconditioner* M, const double* b, double* x,
+                    const SolverOptions* options, SolverResult* result)
+{
+    status_code sc = SUCCESS;
+    int n = A->n;
+    double *r = (double*)malloc(n * sizeof(double)), *z = (double*)malloc(n * sizeof(double));
+    double *p = (double*)malloc(n * sizeof(double)), *Ap = (double*)malloc(n * sizeof(double));
+    double bnorm, rz, rzNew, pAp, alpha;
+
+    if(!r || !z || !p || !Ap || beginSolve(options, result) == FAILURE)
+    {
+        sc = FAILURE;
+    }
+    else
+    {
+        bnorm = initialResidual(A, b, x, r);
+        recordResidual(options, result, vectorNorm(n, r) / bnorm);
+        applyPreconditioner(M, n, r, z);
+        memcpy(p, z, n * sizeof(double));
+        rz = dotProduct(n, r, z);
+        while(!result->converged && result->iterations < options->maxIterations)
+        {
+            A->apply(A->data, p, Ap);
+            pAp = dotProduct(n, p, Ap);
+            if(pAp <= 0)// A is not positive definite along p
+            {
+                printf("CG breakdown: matrix is not positive definite.\n");
+                break;
+            }
+            alpha = rz / pAp;
+            axpy(n, alpha, p, x);
+            axpy(n, -alpha, Ap, r);
+            result->iterations++;
+            recordResidual(options, result, vectorNorm(n, r) / bnorm);
+
+            applyPreconditioner(M, n, r, z);
+            rzNew = dotProduct(n, r, z);
+            for(int i = 0; i < n; i++)
+            {
+                p[i] = z[i] + (rzNew / rz) * p[i];
+            }
+            rz = rzNew;
+        }
+    }
+    free(r);
+    free(z);
+    free(p);
+    free(Ap);
+    return sc;
+}
+// right preconditioned BiCGSTAB for general A. A vanishing rhat . r, rhat . v or
+// omega would divide by zero, so the iteration restarts from the current
+// residual instead; a breakdown straight after a restart ends the solve.
+#define BICGSTAB_BREAKDOWN 1e-14   // relative to the norms of the two vectors
+
+boolean bicgstabBreakdown(int n, const double* x, const double* y, double dot)
+{
+    return (fabs(dot) <= BICGSTAB_BREAKDOWN * vectorNorm(n, x) * vectorNorm(n, y) || !isfinite(dot)) ? TRUE : FALSE;
+}
+status_code solveBiCGSTAB(const LinearOperator* A, const Preconditioner* M, const double* b, double* x,
+                          const SolverOptions* options, SolverResult* result)
+{
+    status_code sc = SUCCESS;
+    int n = A->n;
+    double *r = (double*)calloc(n, sizeof(double)), *rhat = (double*)calloc(n, sizeof(double));
+    double *p = (double*)calloc(n, sizeof(double)), *v = (double*)calloc(n, sizeof(double));
+    double *phat = (double*)calloc(n, sizeof(double)), *s = (double*)calloc(n, sizeof(double));
+    double *shat = (double*)calloc(n, sizeof(double)), *t = (double*)calloc(n, sizeof(double));
+    double bnorm, rho = 1, rhoNew, rhatV, alpha = 1, omega = 1, tt;
+    boolean restarted = FALSE, restart;
+
+    if(!r || !rhat || !p || !v || !phat || !s || !shat || !t || beginSolve(options, result) == FAILURE)
+    {
+        sc = FAILURE;
+    }
+    else
+    {
+        bnorm = initialResidual(A, b, x, r);
+        memcpy(rhat, r, n * sizeof(double));
+        recordResidual(options, result, vectorNorm(n, r) / bnorm);
+        while(!result->converged && result->iterations < options->maxIterations)
+        {
+            rhoNew = dotProduct(n, rhat, r);
+            restart = (omega == 0 || bicgstabBreakdown(n, rhat, r, rhoNew)) ? TRUE : FALSE;
+            if(!restart)
+            {
+                for(int i = 0; i < n; i++)
+                {
+                    p[i] = r[i] + (rhoNew / rho) * (alpha / omega) * (p[i] - omega * v[i]);
+                }
+                applyPreconditioner(M, n, p, phat);
+                A->apply(A->data, phat, v);
+                rhatV = dotProduct(n, rhat, v);
+                restart = bicgstabBreakdown(n, rhat, v, rhatV);
+            }
+            if(restart && restarted)
+            {
+                printf("BiCGSTAB breakdown: no progress after restarting from the residual.\n");
+                break;
+            }
+            if(restart)// shadow residual := residual, directions cleared
+            {
+                memcpy(rhat, r, n * sizeof(double));
+                memset(p, 0, n * sizeof(double));
+                memset(v, 0, n * sizeof(double));
+                rho = alpha = omega = 1;
+                restarted = TRUE;
+                continue;
+            }
+            restarted = FALSE;
+            alpha = rhoNew / rhatV;
+            for(int i = 0; i < n; i++)
+            {
+                s[i] = r[i] - alpha * v[i];
+            }
+            axpy(n, alpha, phat, x);
+            result->iterations++;
+            if(vectorNorm(n, s) / bnorm <= options->tolerance)// converged halfway
+            {
+                recordResidual(options, result, vectorNorm(n, s) / bnorm);
+                break;
+            }
+            applyPreconditioner(M, n, s, shat);
+            A->apply(A->data, shat, t);
+            tt = dotProduct(n, t, t);
+            omega = (tt > 0) ? dotProduct(n, t, s) / tt : 0;
+            axpy(n, omega, shat, x);
+            for(int i = 0; i < n; i++)
+            {
+                r[i] = s[i] - omega * t[i];
+            }
+            recordResidual(options, result, vectorNorm(n, r) / bnorm);
+            rho = rhoNew;
+        }
+    }
+    free(r);
+    free(rhat);
+    free(p);
+    free(v);
+    free(phat);
+    free(s);
+    free(shat);
+    free(t);
+    return sc;
+}
+// restarted GMRES(m) with right preconditioning; the least squares problem is
+// kept triangular with Givens rotations so the residual is known every step
+status_code solveGMRES(const LinearOperator* A, const Preconditioner* M, const double* b, double* x,
+                       const SolverOptions* options, SolverResult* result)
+{
+    status_code sc = SUCCESS;
+    int n = A->n, m = (options->restart > 0) ? options->restart : DEFAULT_GMRES_RESTART;
+    double* V = (double*)malloc((size_t)(m + 1) * n * sizeof(double));
+    double* H = (double*)calloc((size_t)(m + 1) * m, sizeof(double));
+    double *cs = (double*)malloc(m * sizeof(double)), *sn = (double*)malloc(m * sizeof(double));
+    double *g = (double*)malloc((m + 1) * sizeof(double)), *y = (double*)malloc(m * sizeof(double));
+    double *w = (double*)malloc(n * sizeof(double)), *z = (double*)malloc(n * sizeof(double));
+    double bnorm, beta;
+
+    if(!V || !H || !cs || !sn || !g || !y || !w || !z || beginSolve(options, result) == FAILURE)
+    {
+        sc = FAILURE;
+    }
+    else
+    {
+        bnorm = initialResidual(A, b, x, V);
+        beta = vectorNorm(n, V);
+        recordResidual(options, result, beta / bnorm);
+        while(!result->converged && result->iterations < options->maxIterations && beta > 0)
+        {
+            int k = 0;
+            for(int i = 0; i < n; i++)
+            {
+                V[i] /= beta;
+            }
+            memset(g, 0, (m + 1) * sizeof(double));
+            g[0] = beta;
+            while(k < m && !result->converged && result->iterations < options->maxIterations)
+            {
+                double* vk = V + (size_t)k * n;
+                double* vnext = V + (size_t)(k + 1) * n;
+                double h, temp, denom;
+
+                applyPreconditioner(M, n, vk, z);
+                A->apply(A->data, z, w);
+                for(int i = 0; i <= k; i++)// modified Gram-Schmidt
+                {
+                    h = dotProduct(n, w, V + (size_t)i * n);
+                    H[i * m + k] = h;
+                    axpy(n, -h, V + (size_t)i * n, w);
+                }
+                h = vectorNorm(n, w);
+                H[(k + 1) * m + k] = h;
+                for(int i = 0; i < n; i++)
+                {
+                    vnext[i] = (h > 0) ? w[i] / h : 0;
+                }
+                for(int i = 0; i < k; i++)
+                {
+                    temp = cs[i] * H[i * m + k] + sn[i] * H[(i + 1) * m + k];
+                    H[(i + 1) * m + k] = -sn[i] * H[i * m + k] + cs[i] * H[(i + 1) * m + k];
+                    H[i * m + k] = temp;
+                }
+                denom = hypot(H[k * m + k], H[(k + 1) * m + k]);
+                cs[k] = (denom > 0) ? H[k * m + k] / denom : 1;
+                sn[k] = (denom > 0) ? H[(k + 1) * m + k] / denom : 0;
+                H[k * m + k] = denom;
+                H[(k + 1) * m + k] = 0;
+                g[k + 1] = -sn[k] * g[k];
+                g[k] = cs[k] * g[k];
+
+                k++;
+                result->iterations++;
+                recordResidual(options, result, fabs(g[k]) / bnorm);
+                if(h == 0)// lucky breakdown, the Krylov space is exhausted
+                {
+                    break;
+                }
+            }
+            for(int i = k - 1; i >= 0; i--)// back substitution for y
+            {
+                y[i] = g[i];
+                for(int j = i + 1; j < k; j++)
+                {
+                    y[i] -= H[i * m + j] * y[j];
+                }
+                y[i] = (H[i * m + i] != 0) ? y[i] / H[i * m + i] : 0;
+            }
+            memset(w, 0, n * sizeof(double));
+            for(int i = 0; i < k; i++)
+            {
+                axpy(n, y[i], V + (size_t)i * n, w);
+            }
+            applyPreconditioner(M, n, w, z);
+            axpy(n, 1, z, x);
+
+            initialResidual(A, b, x, V);// restart from the true residual
+            beta = vectorNorm(n, V);
+        }
+    }
+    free(V);
+    free(H);
+    free(cs);
+    free(sn);
+    free(g);
+    free(y);
+    free(w);
+    free(z);
+    return sc;
+}
+boolean isSymmetricMatrix(const SparseMatrix* matrix)// row i must equal column i
+{
+    boolean symmetric = (matrix->rowCount == matrix->colCount);
+    if(matrix->symmetric)
+    {
+        return TRUE;
+    }
+    Row_Node* rowPos = matrix->rowHead;
+    Col_Node* colPos = matrix->colHead;
+    while(symmetric && (rowPos || colPos))
+    {
+        if(!rowPos || !colPos || rowPos->row != colPos->col)
+        {
+            symmetric = FALSE;
+        }
+        else
+        {
+            Sm_Node *e1 = rowPos->rowlist, *e2 = colPos->collist;
+            while(symmetric && (e1 || e2))
+            {
+                if(!e1 || !e2 || e1->col != e2->row || e1->data != e2->data)
+                {
+                    symmetric = FALSE;
+                }
+                else
+                {
+                    e1 = e1->right;
+                    e2 = e2->down;
+                }
+            }
+            rowPos = rowPos->next;
+            colPos = colPos->next;
+        }
+    }
+    return symmetric;
+}
+// conversions between full and symmetric (lower triangle) storage
+status_code expandSymmetric(const SparseMatrix* matrix, SparseMatrix* result)
+{
+    MatrixView view;
+    MatrixBuilder builder;
+    status_code sc = openMatrixView(&view, matrix, FALSE);
+    initializeMatrix(result);
+    if(sc == SUCCESS)
+    {
+        sc = beginMatrixBuilder(&builder, result, matrix->rowCount, matrix->colCount);
+        if(sc == SUCCESS)
+        {
+            for(int i = 0; sc == SUCCESS && i < view.rowCount; i++)
+            {
+                for(Sm_Node* element = view.lists[i]; sc == SUCCESS && element; element = viewNext(&view, i, element))
+                {
+                    sc = appendElement(&builder, i, viewIndex(&view, i, element), element->data);
+                }
+            }
+            finishMatrixBuilder(&builder);
+        }
+        closeMatrixView(&view);
+    }
+    return sc;
+}
+status_code packSymmetric(const SparseMatrix* matrix, SparseMatrix* result)
+{
+    MatrixBuilder builder;
+    status_code sc = isSymmetricMatrix(matrix) ? SUCCESS : FAILURE;
+    initializeMatrix(result);
+    if(sc == SUCCESS)
+    {
+        sc = beginMatrixBuilder(&builder, result, matrix->rowCount, matrix->colCount);
+    }
+    if(sc == SUCCESS)
+    {
+        for(Row_Node* rowPos = matrix->rowHead; sc == SUCCESS && rowPos; rowPos = rowPos->next)
+        {
+            for(Sm_Node* element = rowPos->rowlist; sc == SUCCESS && element && element->col <= element->row; element = element->right)
+            {
+                sc = appendElement(&builder, element->row, element->col, element->data);
+            }
+        }
+        finishMatrixBuilder(&builder);
+        result->symmetric = TRUE;
+    }
+    return sc;
+}
+status_code setSymmetricStorage(SparseMatrix* matrix, boolean symmetric)// converts in place
+{
+    status_code sc = SUCCESS;
+    SparseMatrix converted;
+    if(matrix->symmetric != symmetric)
+    {
+        sc = symmetric ? packSymmetric(matrix, &converted) : expandSymmetric(matrix, &converted);
+        if(sc == SUCCESS)
+        {
+            clearMatrix(matrix);
+            *matrix = converted;
+        }
+    }
+    return sc;
+}
+status_code solveLinearSystem(const LinearOperator* A, const Preconditioner* M, SolverMethod method, const double* b,
+                              double* x, const SolverOptions* options, SolverResult* result)
+{
+    status_code sc;
+    switch(method)
+    {
+        case SOLVER_CG: sc = solveCG(A, M, b, x, options, result); break;
+        case SOLVER_BICGSTAB: sc = solveBiCGSTAB(A, M, b, x, options, result); break;
+        default: sc = solveGMRES(A, M, b, x, options, result); break;
+    }
+    return sc;
+}
+
+// preconditioners. Factors are kept in compressed row arrays rather than in
+// the linked lists, since they are applied once or twice per solver iteration.
+#define DEFAULT_JACOBI_BLOCK 4
+
+typedef enum{PRECOND_NONE, PRECOND_JACOBI, PRECOND_BLOCK_JACOBI, PRECOND_ILU0, PRECOND_IC0} PreconditionerKind;
+
+typedef struct Csr_Matrix_Tag
+{
+    int rowCount, colCount;
+    int* rowPtr;
+    int* colIdx;
+    double* values;
+} CsrMatrix;
+
+// rows of a triangular factor grouped into levels: a row only depends on rows
+// of earlier levels, so the rows of one level can be solved concurrently
+typedef struct Level_Schedule_Tag
+{
+    int levelCount;
+    int* levelPtr;  // rows of level l are order[levelPtr[l] .. levelPtr[l+1])
+    int* order;
+} LevelSchedule;
+
+typedef struct Factor_Preconditioner_Tag
+{
+    PreconditionerKind kind;
+    int n, blockSize;
+    double* diagonal;   // inverse diagonal: of A (Jacobi) or of U (ILU(0), IC(0))
+    double* blocks;     // LU factors of the diagonal blocks (block Jacobi)
+    int* pivots;
+    CsrMatrix lower;    // strictly lower part of L, unit diagonal implied for ILU(0)
+    CsrMatrix upper;    // strictly upper part of U, L^T for IC(0)
+    LevelSchedule lowerLevels, upperLevels;
+    double* work;
+} FactorPreconditioner;
+
+void freeCsrMatrix(CsrMatrix* csr)
+{
+    free(csr->rowPtr);
+    free(csr->colIdx);
+    free(csr->values);
+    csr->rowPtr = csr->colIdx = NULL;
+    csr->values = NULL;
+}
+status_code allocateCsrMatrix(CsrMatrix* csr, int rows, int cols, int nnz)
+{
+    csr->rowCount = rows;
+    csr->colCount = cols;
+    csr->rowPtr = (int*)calloc(rows + 1, sizeof(int));
+    csr->colIdx = (int*)malloc((nnz + 1) * sizeof(int));
+    csr->values = (double*)malloc((nnz + 1) * sizeof(double));
+    return (csr->rowPtr && csr->colIdx && csr->values) ? SUCCESS : FAILURE;
+}
+typedef struct Csr_Fill_Tag
+{
+    const MatrixView* view;
+    CsrMatrix* csr;
+} CsrFill;
+
+void countCsrRows(void* context, int begin, int end)// rowPtr[i+1] = length of row i
+{
+    CsrFill* fill = (CsrFill*)context;
+    for(int i = begin; i < end; i++)
+    {
+        int length = 0;
+        for(Sm_Node* element = fill->view->lists[i]; element; element = viewNext(fill->view, i, element))
+        {
+            length++;
+        }
+        fill->csr->rowPtr[i+1] = length;
+    }
+}
+void fillCsrRows(void* context, int begin, int end)
+{
+    CsrFill* fill = (CsrFill*)context;
+    for(int i = begin; i < end; i++)
+    {
+        int k = fill->csr->rowPtr[i];
+        for(Sm_Node* element = fill->view->lists[i]; element; element = viewNext(fill->view, i, element))
+        {
+            fill->csr->colIdx[k] = viewIndex(fill->view, i, element);
+            fill->csr->values[k++] = element->data;
+        }
+    }
+}
+// rows are counted, offset by a prefix sum and then filled, both passes in parallel
+status_code sparseMatrixToCsr(const SparseMatrix* matrix, CsrMatrix* csr)// symmetric matrices come out full
+{
+    MatrixView view;
+    CsrFill fill;
+    int stored = countElements(matrix);
+    status_code sc = allocateCsrMatrix(csr, matrix->rowCount, matrix->colCount, matrix->symmetric ? 2 * stored : stored);
+    if(sc == SUCCESS && openMatrixView(&view, matrix, FALSE) == SUCCESS)
+    {
+        fill.view = &view;
+        fill.csr = csr;
+        parallelFor(matrix->rowCount, countCsrRows, &fill);
+        for(int i = 0; i < matrix->rowCount; i++)
+        {
+            csr->rowPtr[i+1] += csr->rowPtr[i];
+        }
+        parallelFor(matrix->rowCount, fillCsrRows, &fill);
+        closeMatrixView(&view);
+    }
+    else
+    {
+        sc = FAILURE;
+    }
+    return sc;
+}
+// splits a square csr into its strictly lower part, inverse diagonal and strictly upper part
+status_code splitCsr(const CsrMatrix* a, CsrMatrix* lower, double* inverseDiagonal, CsrMatrix* upper)
+{
+    status_code sc;
+    int nnzLower = 0, nnzUpper = 0, kl = 0, ku = 0;
+    for(int i = 0; i < a->rowCount; i++)
+    {
+        for(int k = a->rowPtr[i]; k < a->rowPtr[i+1]; k++)
+        {
+            nnzLower += (a->colIdx[k] < i);
+            nnzUpper += (a->colIdx[k] > i);
+        }
+    }
+    sc = (allocateCsrMatrix(lower, a->rowCount, a->colCount, nnzLower) == SUCCESS
+        && allocateCsrMatrix(upper, a->rowCount, a->colCount, nnzUpper) == SUCCESS) ? SUCCESS : FAILURE;
+    for(int i = 0; sc == SUCCESS && i < a->rowCount; i++)
+    {
+        inverseDiagonal[i] = 0;
+        lower->rowPtr[i] = kl;
+        upper->rowPtr[i] = ku;
+        for(int k = a->rowPtr[i]; k < a->rowPtr[i+1]; k++)
+        {
+            int j = a->colIdx[k];
+            if(j < i)
+            {
+                lower->colIdx[kl] = j;
+                lower->values[kl++] = a->values[k];
+            }
+            else if(j > i)
+            {
+                upper->colIdx[ku] = j;
+                upper->values[ku++] = a->values[k];
+            }
+            else if(a->values[k] != 0)
+            {
+                inverseDiagonal[i] = 1 / a->values[k];
+            }
+        }
+        if(inverseDiagonal[i] == 0)
+        {
+            printf("Zero pivot at row %d.\n", i);
+            sc = FAILURE;
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        lower->rowPtr[a->rowCount] = kl;
+        upper->rowPtr[a->rowCount] = ku;
+    }
+    return sc;
+}
+// out-of-place transpose by counting sort over the column indexes. The rows
+// are cut into one band per thread and each band counts its columns; a prefix
+// sum over (column, band) gives every band its own run inside each output row,
+// so the bands scatter concurrently and rows keep increasing column order.
+typedef struct Csr_Transpose_Tag
+{
+    const CsrMatrix* a;
+    CsrMatrix* t;
+    int bands;
+    int* counts;    // counts[b * colCount + j]: entries of band b in column j, later its next output slot
+} CsrTranspose;
+
+void countTransposeBands(void* context, int begin, int end)
+{
+    CsrTranspose* tr = (CsrTranspose*)context;
+    const CsrMatrix* a = tr->a;
+    for(int b = begin; b < end; b++)
+    {
+        int* count = tr->counts + (size_t)b * a->colCount;
+        int first = (int)((long long)a->rowCount * b / tr->bands), last = (int)((long long)a->rowCount * (b + 1) / tr->bands);
+        for(int k = a->rowPtr[first]; k < a->rowPtr[last]; k++)
+        {
+            count[a->colIdx[k]]++;
+        }
+    }
+}
+void offsetTransposeColumns(void* context, int begin, int end)// band offsets within each column
+{
+    CsrTranspose* tr = (CsrTranspose*)context;
+    int cols = tr->a->colCount;
+    for(int j = begin; j < end; j++)
+    {
+        int sum = 0;
+        for(int b = 0; b < tr->bands; b++)
+        {
+            int count = tr->counts[(size_t)b * cols + j];
+            tr->counts[(size_t)b * cols + j] = sum;
+            sum += count;
+        }
+        tr->t->rowPtr[j + 1] = sum;
+    }
+}
+void placeTransposeColumns(void* context, int begin, int end)// band offsets become output positions
+{
+    CsrTranspose* tr = (CsrTranspose*)context;
+    int cols = tr->a->colCount;
+    for(int b = 0; b < tr->bands; b++)
+    {
+        for(int j = begin; j < end; j++)
+        {
+            tr->counts[(size_t)b * cols + j] += tr->t->rowPtr[j];
+        }
+    }
+}
+void scatterTransposeBands(void* context, int begin, int end)
+{
+    CsrTranspose* tr = (CsrTranspose*)context;
+    const CsrMatrix* a = tr->a;
+    CsrMatrix* t = tr->t;
+    for(int b = begin; b < end; b++)
+    {
+        int* next = tr->counts + (size_t)b * a->colCount;
+        int first = (int)((long long)a->rowCount * b / tr->bands), last = (int)((long long)a->rowCount * (b + 1) / tr->bands);
+        for(int i = first; i < last; i++)
+        {
+            for(int k = a->rowPtr[i]; k < a->rowPtr[i+1]; k++)
+            {
+                int pos = next[a->colIdx[k]]++;
+                t->colIdx[pos] = i;
+                t->values[pos] = a->values[k];
+            }
+        }
+    }
+}
+status_code transposeCsr(const CsrMatrix* a, CsrMatrix* t)
+{
+    CsrTranspose tr;
+    int nnz = a->rowPtr[a->rowCount];
+    status_code sc = allocateCsrMatrix(t, a->colCount, a->rowCount, nnz);
+
+    tr.a = a;
+    tr.t = t;
+    tr.bands = 1 + nnz / (16 * PARALLEL_GRAIN);// a band is worth a thread only with enough entries
+    if(tr.bands > poolThreadCount())
+    {
+        tr.bands = poolThreadCount();
+    }
+    if((long long)tr.bands * a->colCount > 2LL * nnz)// keep the counters within O(nnz) for wide matrices
+    {
+        tr.bands = (a->colCount > 0 && 2LL * nnz / a->colCount > 1) ? (int)(2LL * nnz / a->colCount) : 1;
+    }
+    tr.counts = (int*)calloc((size_t)tr.bands * a->colCount + 1, sizeof(int));
+    if(sc == SUCCESS && tr.counts)
+    {
+        parallelForGrain(tr.bands, 1, countTransposeBands, &tr);
+        parallelFor(a->colCount, offsetTransposeColumns, &tr);
+        for(int j = 0; j < a->colCount; j++)
+        {
+            t->rowPtr[j + 1] += t->rowPtr[j];
+        }
+        parallelFor(a->colCount, placeTransposeColumns, &tr);
+        parallelForGrain(tr.bands, 1, scatterTransposeBands, &tr);
+    }
+    else
+    {
+        sc = FAILURE;
+    }
+    free(tr.counts);
+    return sc;
+}
+// A^T as fresh compressed rows; A is left as it is. The row lists, already in
+// column order, are copied to compressed rows and counting-sorted by column.
+status_code transposeToCsr(const SparseMatrix* matrix, CsrMatrix* t)
+{
+    CsrMatrix a;
+    status_code sc = sparseMatrixToCsr(matrix, &a);
+    t->rowPtr = t->colIdx = NULL;
+    t->values = NULL;
+    sc = (sc == SUCCESS) ? transposeCsr(&a, t) : FAILURE;
+    freeCsrMatrix(&a);
+    return sc;
+}
+// A^T as a fresh list matrix, explicit zeros included; A is left as it is
+status_code transposeMatrix(const SparseMatrix* matrix, SparseMatrix* result)
+{
+    status_code sc;
+    CsrMatrix t = {0, 0, NULL, NULL, NULL};
+    MatrixBuilder builder;
+    PROFILE_BEGIN(PROF_TRANSPOSE);
+
+    if(matrix->symmetric)
+    {
+        sc = cloneMatrix(matrix, result);// A^T = A
+    }
+    else if(transposeToCsr(matrix, &t) == SUCCESS && beginMatrixBuilder(&builder, result, t.rowCount, t.colCount) == SUCCESS)
+    {
+        sc = SUCCESS;
+        for(int i = 0; sc == SUCCESS && i < t.rowCount; i++)
+        {
+            for(int k = t.rowPtr[i]; sc == SUCCESS && k < t.rowPtr[i+1]; k++)
+            {
+                sc = appendNode(&builder, i, t.colIdx[k], (matrix_entry)t.values[k]) ? SUCCESS : FAILURE;
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    else
+    {
+        initializeMatrix(result);
+        sc = FAILURE;
+    }
+    if(sc == FAILURE)
+    {
+        clearMatrix(result);
+    }
+    freeCsrMatrix(&t);
+    PROFILE_END();
+    return sc;
+}
+// level of a row is one more than the deepest row it reads. Lower factors
+// reference earlier rows and are swept forward, upper factors backward. Only
+// entries on that side of the diagonal count, so a full matrix can be given.
+status_code buildLevelSchedule(const CsrMatrix* csr, boolean lower, LevelSchedule* schedule)
+{
+    status_code sc = SUCCESS;
+    int n = csr->rowCount;
+    int* level = (int*)malloc((n + 1) * sizeof(int));
+    schedule->levelCount = 0;
+    schedule->order = (int*)malloc((n + 1) * sizeof(int));
+    schedule->levelPtr = NULL;
+    if(!level || !schedule->order)
+    {
+        sc = FAILURE;
+    }
+    for(int step = 0; sc == SUCCESS && step < n; step++)
+    {
+        int i = lower ? step : n - 1 - step;
+        level[i] = 0;
+        for(int k = csr->rowPtr[i]; k < csr->rowPtr[i+1]; k++)
+        {
+            int j = csr->colIdx[k];
+            if((lower ? j < i : j > i) && level[j] + 1 > level[i])
+            {
+                level[i] = level[j] + 1;
+            }
+        }
+        if(level[i] + 1 > schedule->levelCount)
+        {
+            schedule->levelCount = level[i] + 1;
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        schedule->levelPtr = (int*)calloc(schedule->levelCount + 2, sizeof(int));
+        sc = schedule->levelPtr ? SUCCESS : FAILURE;
+    }
+    if(sc == SUCCESS)// counting sort of the rows by level
+    {
+        for(int i = 0; i < n; i++)
+        {
+            schedule->levelPtr[level[i] + 2]++;
+        }
+        for(int l = 2; l <= schedule->levelCount; l++)
+        {
+            schedule->levelPtr[l] += schedule->levelPtr[l - 1];
+        }
+        for(int i = 0; i < n; i++)
+        {
+            schedule->order[schedule->levelPtr[level[i] + 1]++] = i;
+        }
+    }
+    free(level);
+    return sc;
+}
+void freeLevelSchedule(LevelSchedule* schedule)
+{
+    free(schedule->levelPtr);
+    free(schedule->order);
+    schedule->levelPtr = schedule->order = NULL;
+    schedule->levelCount = 0;
+}
+// ILU(0): Gaussian elimination restricted to the pattern of A (IKJ order).
+// Row i only reads the finished rows named in its lower part, so the rows of
+// one level of the lower pattern are eliminated concurrently.
+#define FACTOR_GRAIN 32
+
+typedef struct Row_Factor_Tag
+{
+    const CsrMatrix* a;
+    CsrMatrix* factor;          // ILU(0) works in place, IC(0) fills the lower factor
+    const int* diag;
+    double* diagonal;
+    double* inverseDiagonal;
+    const int* rows;            // rows of the current level
+    int* pos;                   // n slots per thread, -1 when unused
+    int* failures;
+} RowFactor;
+
+void factorILU0Rows(void* context, int begin, int end)
+{
+    RowFactor* f = (RowFactor*)context;
+    CsrMatrix* a = f->factor;
+    int* pos = f->pos + (size_t)currentWorker() * a->rowCount;
+    for(int step = begin; step < end; step++)
+    {
+        int i = f->rows[step];
+        boolean broken = FALSE;
+        for(int k = a->rowPtr[i]; k < a->rowPtr[i+1]; k++)
+        {
+            pos[a->colIdx[k]] = k;
+        }
+        for(int k = a->rowPtr[i]; !broken && k < a->rowPtr[i+1] && a->colIdx[k] < i; k++)
+        {
+            int r = a->colIdx[k];
+            if(a->values[f->diag[r]] == 0)
+            {
+                noteFailure(f->failures, r);
+                broken = TRUE;
+            }
+            else
+            {
+                a->values[k] /= a->values[f->diag[r]];
+                for(int m = f->diag[r] + 1; m < a->rowPtr[r+1]; m++)
+                {
+                    if(pos[a->colIdx[m]] >= 0)// fill outside the pattern is dropped
+                    {
+                        a->values[pos[a->colIdx[m]]] -= a->values[k] * a->values[m];
+                    }
+                }
+            }
+        }
+        for(int k = a->rowPtr[i]; k < a->rowPtr[i+1]; k++)
+        {
+            pos[a->colIdx[k]] = -1;
+        }
+    }
+}
+status_code factorILU0(CsrMatrix* a)
+{
+    status_code sc = SUCCESS;
+    int n = a->rowCount, threads = poolThreadCount();
+    RowFactor f;
+    LevelSchedule levels;
+    int* pos = (int*)malloc(((size_t)threads * n + 1) * sizeof(int));
+    int* diag = (int*)malloc((n + 1) * sizeof(int));
+    int* failures = allocateFailures();
+
+    levels.levelPtr = levels.order = NULL;
+    if(!pos || !diag || !failures || buildLevelSchedule(a, TRUE, &levels) == FAILURE)
+    {
+        sc = FAILURE;
+    }
+    for(int i = 0; sc == SUCCESS && i < n; i++)
+    {
+        diag[i] = -1;
+        for(int k = a->rowPtr[i]; k < a->rowPtr[i+1]; k++)
+        {
+            if(a->colIdx[k] == i)
+            {
+                diag[i] = k;
+            }
+        }
+        if(diag[i] < 0)
+        {
+            printf("ILU(0) needs a stored diagonal, row %d has none.\n", i);
+            sc = FAILURE;
+        }
+    }
+    for(size_t j = 0; sc == SUCCESS && j < (size_t)threads * n; j++)
+    {
+        pos[j] = -1;
+    }
+    f.factor = a;
+    f.diag = diag;
+    f.pos = pos;
+    f.failures = failures;
+    for(int l = 0; sc == SUCCESS && l < levels.levelCount; l++)
+    {
+        f.rows = levels.order + levels.levelPtr[l];
+        parallelForGrain(levels.levelPtr[l+1] - levels.levelPtr[l], FACTOR_GRAIN, factorILU0Rows, &f);
+        if(firstFailure(failures) != INT_MAX)
+        {
+            printf("Zero pivot at row %d.\n", firstFailure(failures));
+            sc = FAILURE;
+        }
+    }
+    freeLevelSchedule(&levels);
+    free(pos);
+    free(diag);
+    free(failures);
+    return sc;
+}
+// IC(0): L with the pattern of the lower triangle of A, L L^T ~ A. Row i of L
+// is finished left to right, each entry needs the dot of rows i and k of L.
+// Rows land at offsets counted beforehand, so the rows of a level run concurrently.
+void factorIC0Rows(void* context, int begin, int end)
+{
+    RowFactor* f = (RowFactor*)context;
+    const CsrMatrix* a = f->a;
+    CsrMatrix* lower = f->factor;
+    for(int step = begin; step < end; step++)
+    {
+        int i = f->rows[step], kl = lower->rowPtr[i];
+        double aii = 0, sum;
+        for(int k = a->rowPtr[i]; k < a->rowPtr[i+1]; k++)
+        {
+            int r = a->colIdx[k];
+            if(r == i)
+            {
+                aii = a->values[k];
+            }
+            else if(r < i)
+            {
+                // dot of the finished part of row i with row r over columns < r
+                int p = lower->rowPtr[i], q = lower->rowPtr[r];
+                sum = a->values[k];
+                while(p < kl && q < lower->rowPtr[r+1])
+                {
+                    if(lower->colIdx[p] < lower->colIdx[q]) p++;
+                    else if(lower->colIdx[p] > lower->colIdx[q]) q++;
+                    else sum -= lower->values[p++] * lower->values[q++];
+                }
+                lower->colIdx[kl] = r;
+                lower->values[kl++] = sum / f->diagonal[r];
+            }
+        }
+        sum = aii;
+        for(int p = lower->rowPtr[i]; p < kl; p++)
+        {
+            sum -= lower->values[p] * lower->values[p];
+        }
+        if(sum <= 0)
+        {
+            noteFailure(f->failures, i);
+            f->diagonal[i] = 1;// keeps later rows finite until the level ends
+        }
+        else
+        {
+            f->diagonal[i] = sqrt(sum);
+            f->inverseDiagonal[i] = 1 / f->diagonal[i];
+        }
+    }
+}
+status_code factorIC0(const CsrMatrix* a, CsrMatrix* lower, double* inverseDiagonal)
+{
+    status_code sc = SUCCESS;
+    int n = a->rowCount, nnz = 0;
+    RowFactor f;
+    LevelSchedule levels;
+    double* diagonal = (double*)malloc((n + 1) * sizeof(double));
+    int* failures = allocateFailures();
+
+    levels.levelPtr = levels.order = NULL;
+    for(int i = 0; i < n; i++)
+    {
+        for(int k = a->rowPtr[i]; k < a->rowPtr[i+1]; k++)
+        {
+            nnz += (a->colIdx[k] < i);
+        }
+    }
+    if(!diagonal || !failures || allocateCsrMatrix(lower, n, n, nnz) == FAILURE || buildLevelSchedule(a, TRUE, &levels) == FAILURE)
+    {
+        sc = FAILURE;
+    }
+    for(int i = 0; sc == SUCCESS && i < n; i++)
+    {
+        lower->rowPtr[i+1] = lower->rowPtr[i];
+        for(int k = a->rowPtr[i]; k < a->rowPtr[i+1]; k++)
+        {
+            lower->rowPtr[i+1] += (a->colIdx[k] < i);
+        }
+    }
+    f.a = a;
+    f.factor = lower;
+    f.diagonal = diagonal;
+    f.inverseDiagonal = inverseDiagonal;
+    f.failures = failures;
+    for(int l = 0; sc == SUCCESS && l < levels.levelCount; l++)
+    {
+        f.rows = levels.order + levels.levelPtr[l];
+        parallelForGrain(levels.levelPtr[l+1] - levels.levelPtr[l], FACTOR_GRAIN, factorIC0Rows, &f);
+        if(firstFailure(failures) != INT_MAX)
+        {
+            printf("IC(0) breakdown at row %d: matrix is not positive definite enough.\n", firstFailure(failures));
+            sc = FAILURE;
+        }
+    }
+    freeLevelSchedule(&levels);
+    free(diagonal);
+    free(failures);
+    return sc;
+}
+// dense LU with partial pivoting of one bs x bs block, row major
+status_code factorDenseBlock(double* block, int* pivots, int bs)
+{
+    status_code sc = SUCCESS;
+    for(int k = 0; sc == SUCCESS && k < bs; k++)
+    {
+        int p = k;
+        for(int i = k + 1; i < bs; i++)
+        {
+            if(fabs(block[i * bs + k]) > fabs(block[p * bs + k]))
+            {
+                p = i;
+            }
+        }
+        pivots[k] = p;
+        if(block[p * bs + k] == 0)
+        {
+            sc = FAILURE;
+        }
+        else
+        {
+            for(int j = 0; j < bs && p != k; j++)
+            {
+                double temp = block[k * bs + j];
+                block[k * bs + j] = block[p * bs + j];
+                block[p * bs + j] = temp;
+            }
+            for(int i = k + 1; i < bs; i++)
+            {
+                block[i * bs + k] /= block[k * bs + k];
+                for(int j = k + 1; j < bs; j++)
+                {
+                    block[i * bs + j] -= block[i * bs + k] * block[k * bs + j];
+                }
+            }
+        }
+    }
+    return sc;
+}
+void solveDenseBlock(const double* block, const int* pivots, int bs, double* x)// x is overwritten in place
+{
+    for(int k = 0; k < bs; k++)
+    {
+        double temp = x[k];
+        x[k] = x[pivots[k]];
+        x[pivots[k]] = temp;
+    }
+    for(int i = 1; i < bs; i++)
+    {
+        for(int j = 0; j < i; j++)
+        {
+            x[i] -= block[i * bs + j] * x[j];
+        }
+    }
+    for(int i = bs - 1; i >= 0; i--)
+    {
+        for(int j = i + 1; j < bs; j++)
+        {
+            x[i] -= block[i * bs + j] * x[j];
+        }
+        x[i] /= block[i * bs + i];
+    }
+}
+// diagonal blocks are independent and factored concurrently
+typedef struct Block_Factor_Tag
+{
+    const CsrMatrix* a;
+    FactorPreconditioner* precond;
+    int* failures;
+} BlockFactor;
+
+void factorJacobiBlocks(void* context, int begin, int end)
+{
+    BlockFactor* f = (BlockFactor*)context;
+    const CsrMatrix* a = f->a;
+    int bs = f->precond->blockSize, n = a->rowCount;
+    for(int b = begin; b < end; b++)
+    {
+        double* block = f->precond->blocks + (size_t)b * bs * bs;
+        int first = b * bs, size = (first + bs <= n) ? bs : n - first;
+        for(int i = 0; i < bs; i++)
+        {
+            if(i >= size)
+            {
+                block[i * bs + i] = 1;// pads the last block with the identity
+            }
+            else
+            {
+                for(int k = a->rowPtr[first + i]; k < a->rowPtr[first + i + 1]; k++)
+                {
+                    int j = a->colIdx[k] - first;
+                    if(j >= 0 && j < size)
+                    {
+                        block[i * bs + j] = a->values[k];
+                    }
+                }
+            }
+        }
+        if(factorDenseBlock(block, f->precond->pivots + (size_t)b * bs, bs) == FAILURE)
+        {
+            noteFailure(f->failures, b);
+        }
+    }
+}
+status_code buildBlockJacobi(const CsrMatrix* a, FactorPreconditioner* precond)
+{
+    status_code sc = SUCCESS;
+    BlockFactor f;
+    int bs = precond->blockSize, n = a->rowCount;
+    int blockCount = (n + bs - 1) / bs;
+    precond->blocks = (double*)calloc((size_t)blockCount * bs * bs, sizeof(double));
+    precond->pivots = (int*)malloc((size_t)blockCount * bs * sizeof(int));
+    f.a = a;
+    f.precond = precond;
+    f.failures = allocateFailures();
+    if(!precond->blocks || !precond->pivots || !f.failures)
+    {
+        sc = FAILURE;
+    }
+    else
+    {
+        parallelForGrain(blockCount, 1 + PARALLEL_GRAIN / bs, factorJacobiBlocks, &f);
+        if(firstFailure(f.failures) != INT_MAX)
+        {
+            printf("Diagonal block %d is singular.\n", firstFailure(f.failures));
+            sc = FAILURE;
+        }
+    }
+    free(f.failures);
+    return sc;
+}
+void freeFactorPreconditioner(FactorPreconditioner* precond)
+{
+    freeLevelSchedule(&precond->lowerLevels);
+    freeLevelSchedule(&precond->upperLevels);
+    free(precond->diagonal);
+    free(precond->blocks);
+    free(precond->pivots);
+    free(precond->work);
+    freeCsrMatrix(&precond->lower);
+    freeCsrMatrix(&precond->upper);
+    precond->diagonal = precond->blocks = precond->work = NULL;
+    precond->pivots = NULL;
+}
+status_code jacobiDiagonal(const SparseMatrix* matrix, double* inverseDiagonal)// straight from the row lists
+{
+    status_code sc = SUCCESS;
+    for(int i = 0; i < matrix->rowCount; i++)
+    {
+        inverseDiagonal[i] = 0;
+    }
+    for(Row_Node* rptr = matrix->rowHead; rptr; rptr = rptr->next)
+    {
+        Sm_Node* sptr = rptr->rowlist;
+        while(sptr && sptr->col < rptr->row)
+        {
+            sptr = sptr->right;
+        }
+        if(sptr && sptr->col == rptr->row && sptr->data != 0)
+        {
+            inverseDiagonal[rptr->row] = 1.0 / sptr->data;
+        }
+    }
+    for(int i = 0; sc == SUCCESS && i < matrix->rowCount; i++)
+    {
+        if(inverseDiagonal[i] == 0)
+        {
+            printf("Zero pivot at row %d.\n", i);
+            sc = FAILURE;
+        }
+    }
+    return sc;
+}
+status_code buildPreconditioner(const SparseMatrix* matrix, PreconditionerKind kind, int blockSize, FactorPreconditioner* precond)
+{
+    status_code sc;
+    CsrMatrix a;
+    int n = matrix->rowCount;
+
+    memset(precond, 0, sizeof(FactorPreconditioner));
+    precond->kind = kind;
+    precond->n = n;
+    precond->blockSize = (blockSize > 0) ? blockSize : DEFAULT_JACOBI_BLOCK;
+    if(kind != PRECOND_NONE)
+    {
+        precond->diagonal = (double*)malloc((n + 1) * sizeof(double));
+        precond->work = (double*)malloc((n + precond->blockSize) * sizeof(double));
+    }
+
+    sc = (matrix->rowCount == matrix->colCount && (kind == PRECOND_NONE || (precond->diagonal && precond->work))) ? SUCCESS : FAILURE;
+    if(sc == SUCCESS && kind == PRECOND_JACOBI)// only the diagonal is needed, no compressed copy
+    {
+        sc = jacobiDiagonal(matrix, precond->diagonal);
+    }
+    else if(sc == SUCCESS && kind != PRECOND_NONE)
+    {
+        sc = sparseMatrixToCsr(matrix, &a);
+        switch(kind)
+        {
+            case PRECOND_BLOCK_JACOBI:
+                sc = (sc == SUCCESS) ? buildBlockJacobi(&a, precond) : FAILURE;
+                break;
+            case PRECOND_ILU0:
+                sc = (sc == SUCCESS) ? factorILU0(&a) : FAILURE;
+                sc = (sc == SUCCESS) ? splitCsr(&a, &precond->lower, precond->diagonal, &precond->upper) : FAILURE;
+                break;
+            case PRECOND_IC0:
+                sc = (sc == SUCCESS) ? factorIC0(&a, &precond->lower, precond->diagonal) : FAILURE;
+                sc = (sc == SUCCESS) ? transposeCsr(&precond->lower, &precond->upper) : FAILURE;
+                break;
+            default:
+                break;
+        }
+        freeCsrMatrix(&a);
+    }
+    if(sc == SUCCESS && (kind == PRECOND_ILU0 || kind == PRECOND_IC0))
+    {
+        sc = (buildLevelSchedule(&precond->lower, TRUE, &precond->lowerLevels) == SUCCESS
+            && buildLevelSchedule(&precond->upper, FALSE, &precond->upperLevels) == SUCCESS) ? SUCCESS : FAILURE;
+    }
+    if(sc == FAILURE)
+    {
+        freeFactorPreconditioner(precond);
+    }
+    return sc;
+}
+typedef struct Triangular_Solve_Tag
+{
+    const CsrMatrix* factor;
+    const int* rows;
+    const double* inverseDiagonal;  // NULL means unit diagonal
+    const double* b;
+    double* x;
+} TriangularSolve;
+
+void solveTriangularRows(void* context, int begin, int end)
+{
+    TriangularSolve* solve = (TriangularSolve*)context;
+    const CsrMatrix* factor = solve->factor;
+    for(int r = begin; r < end; r++)
+    {
+        int i = solve->rows[r];
+        double sum = solve->b[i];
+        for(int k = factor->rowPtr[i]; k < factor->rowPtr[i+1]; k++)
+        {
+            sum -= factor->values[k] * solve->x[factor->colIdx[k]];
+        }
+        solve->x[i] = solve->inverseDiagonal ? sum * solve->inverseDiagonal[i] : sum;
+    }
+}
+// x = T^-1 b for a strictly triangular factor plus diagonal, one level at a time
+void solveTriangularCsr(const CsrMatrix* factor, const LevelSchedule* schedule, const double* inverseDiagonal,
+                        const double* b, double* x)
+{
+    TriangularSolve solve;
+    solve.factor = factor;
+    solve.inverseDiagonal = inverseDiagonal;
+    solve.b = b;
+    solve.x = x;
+    for(int l = 0; l < schedule->levelCount; l++)
+    {
+        solve.rows = schedule->order + schedule->levelPtr[l];
+        parallelFor(schedule->levelPtr[l+1] - schedule->levelPtr[l], solveTriangularRows, &solve);
+    }
+}
+void applyFactorPreconditioner(const void* data, const double* r, double* z)// z = M^-1 r
+{
+    const FactorPreconditioner* precond = (const FactorPreconditioner*)data;
+    int n = precond->n, bs = precond->blockSize;
+    switch(precond->kind)
+    {
+        case PRECOND_JACOBI:
+            for(int i = 0; i < n; i++)
+            {
+                z[i] = r[i] * precond->diagonal[i];
+            }
+            break;
+        case PRECOND_BLOCK_JACOBI:
+            for(int first = 0; first < n; first += bs)
+            {
+                double* x = precond->work;
+                int size = (first + bs <= n) ? bs : n - first;
+                for(int i = 0; i < bs; i++)
+                {
+                    x[i] = (i < size) ? r[first + i] : 0;
+                }
+                solveDenseBlock(precond->blocks + (size_t)(first / bs) * bs * bs, precond->pivots + first, bs, x);
+                memcpy(z + first, x, size * sizeof(double));
+            }
+            break;
+        case PRECOND_ILU0:
+            solveTriangularCsr(&precond->lower, &precond->lowerLevels, NULL, r, precond->work);
+            solveTriangularCsr(&precond->upper, &precond->upperLevels, precond->diagonal, precond->work, z);
+            break;
+        case PRECOND_IC0:
+            solveTriangularCsr(&precond->lower, &precond->lowerLevels, precond->diagonal, r, precond->work);
+            solveTriangularCsr(&precond->upper, &precond->upperLevels, precond->diagonal, precond->work, z);
+            break;
+        default:
+            memcpy(z, r, n * sizeof(double));
+            break;
+    }
+}
+Preconditioner makePreconditioner(const FactorPreconditioner* precond)
+{
+    Preconditioner hook;
+    hook.data = precond;
+    hook.apply = applyFactorPreconditioner;
+    return hook;
+}
+status_code parsePreconditionerKind(const char* name, PreconditionerKind* kind)
+{
+    const char* names[] = {"none", "jacobi", "bjacobi", "ilu0", "ic0"};
+    status_code sc = FAILURE;
+    for(int k = PRECOND_NONE; k <= PRECOND_IC0; k++)
+    {
+        if(strcmp(name, names[k]) == 0)
+        {
+            *kind = (PreconditionerKind)k;
+            sc = SUCCESS;
+        }
+    }
+    return sc;
+}
+// the factors as a matrix, L\U packed like LAPACK for ILU(0) and L for IC(0)
+void appendCsrRow(MatrixBuilder* builder, const CsrMatrix* csr, int row, status_code* sc)
+{
+    for(int k = csr->rowPtr[row]; *sc == SUCCESS && k < csr->rowPtr[row+1]; k++)
+    {
+        *sc = appendElement(builder, row, csr->colIdx[k], csr->values[k]);
+    }
+}
+status_code preconditionerToMatrix(const FactorPreconditioner* precond, SparseMatrix* result)
+{
+    MatrixBuilder builder;
+    int n = precond->n, bs = precond->blockSize;
+    status_code sc = beginMatrixBuilder(&builder, result, n, n);
+    if(sc == SUCCESS)
+    {
+        for(int i = 0; sc == SUCCESS && i < n; i++)
+        {
+            if(precond->kind == PRECOND_BLOCK_JACOBI)
+            {
+                int first = (i / bs) * bs;
+                const double* block = precond->blocks + (size_t)(i / bs) * bs * bs;
+                for(int j = first; sc == SUCCESS && j < first + bs && j < n; j++)
+                {
+                    sc = appendElement(&builder, i, j, block[(i - first) * bs + (j - first)]);
+                }
+            }
+            else if(precond->kind == PRECOND_JACOBI)
+            {
+                sc = appendElement(&builder, i, i, precond->diagonal[i]);
+            }
+            else
+            {
+                appendCsrRow(&builder, &precond->lower, i, &sc);
+                if(sc == SUCCESS)
+                {
+                    sc = appendElement(&builder, i, i, 1 / precond->diagonal[i]);
+                }
+                if(precond->kind == PRECOND_ILU0)
+                {
+                    appendCsrRow(&builder, &precond->upper, i, &sc);
+                }
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    return sc;
+}
+// orderings. Both work on the graph of A + A^T without the diagonal and
+// return order[new] = old, ready for permuteMatrix.
+typedef enum{ORDER_NATURAL, ORDER_RCM, ORDER_AMD} OrderingMethod;
+
+typedef struct Int_List_Tag
+{
+    int count, capacity;
+    int* items;
+} IntList;
+
+status_code pushInt(IntList* list, int value)
+{
+    status_code sc = SUCCESS;
+    if(list->count == list->capacity)
+    {
+        int capacity = list->capacity ? 2 * list->capacity : 4;
+        int* items = (int*)realloc(list->items, capacity * sizeof(int));
+        if(items)
+        {
+            list->items = items;
+            list->capacity = capacity;
+        }
+        else
+        {
+            sc = FAILURE;
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        list->items[list->count++] = value;
+    }
+    return sc;
+}
+void freeIntList(IntList* list)
+{
+    free(list->items);
+    list->items = NULL;
+    list->count = list->capacity = 0;
+}
+// adjacency of the symmetrized pattern in compressed form, duplicates removed
+status_code buildAdjacency(const SparseMatrix* matrix, int** adjPtr, int** adj)
+{
+    status_code sc;
+    int n = matrix->rowCount, total = 0;
+    int* marker = (int*)malloc((n + 1) * sizeof(int));
+    *adjPtr = (int*)calloc(n + 2, sizeof(int));
+    *adj = NULL;
+    sc = (marker && *adjPtr) ? SUCCESS : FAILURE;
+    for(Row_Node* rowPos = matrix->rowHead; sc == SUCCESS && rowPos; rowPos = rowPos->next)
+    {
+        for(Sm_Node* element = rowPos->rowlist; element; element = element->right)
+        {
+            if(element->row != element->col)
+            {
+                (*adjPtr)[element->row + 1]++;
+                (*adjPtr)[element->col + 1]++;
+            }
+        }
+    }
+    for(int i = 0; sc == SUCCESS && i < n; i++)
+    {
+        (*adjPtr)[i + 1] += (*adjPtr)[i];
+    }
+    if(sc == SUCCESS)
+    {
+        *adj = (int*)malloc(((*adjPtr)[n] + 1) * sizeof(int));
+        sc = *adj ? SUCCESS : FAILURE;
+    }
+    if(sc == SUCCESS)
+    {
+        int* next = marker;// reused as fill cursor, then as duplicate marker
+        memcpy(next, *adjPtr, n * sizeof(int));
+        for(Row_Node* rowPos = matrix->rowHead; rowPos; rowPos = rowPos->next)
+        {
+            for(Sm_Node* element = rowPos->rowlist; element; element = element->right)
+            {
+                if(element->row != element->col)
+                {
+                    (*adj)[next[element->row]++] = element->col;
+                    (*adj)[next[element->col]++] = element->row;
+                }
+            }
+        }
+        for(int i = 0; i < n; i++)
+        {
+            marker[i] = -1;
+        }
+        for(int i = 0; i < n; i++)
+        {
+            int start = total;
+            for(int k = (*adjPtr)[i]; k < (*adjPtr)[i+1]; k++)
+            {
+                if(marker[(*adj)[k]] != i)
+                {
+                    marker[(*adj)[k]] = i;
+                    (*adj)[total++] = (*adj)[k];
+                }
+            }
+            (*adjPtr)[i] = start;
+        }
+        (*adjPtr)[n] = total;
+    }
+    if(sc == FAILURE)
+    {
+        free(*adjPtr);
+        free(*adj);
+        *adjPtr = *adj = NULL;
+    }
+    free(marker);
+    return sc;
+}
+// breadth first search from root over unvisited vertices, appending to queue.
+// Returns the number of vertices reached, level holds the distance of each.
+// level must be -1 for every vertex on entry; resetLevels restores that for
+// the vertices reached, so a search costs its component and not n.
+int bfsLevels(const int* adjPtr, const int* adj, int root, const boolean* done, int* queue, int* level)
+{
+    int head = 0, tail = 0;
+    queue[tail++] = root;
+    level[root] = 0;
+    while(head < tail)
+    {
+        int v = queue[head++];
+        for(int k = adjPtr[v]; k < adjPtr[v+1]; k++)
+        {
+            int w = adj[k];
+            if(!done[w] && level[w] < 0)
+            {
+                level[w] = level[v] + 1;
+                queue[tail++] = w;
+            }
+        }
+    }
+    return tail;
+}
+void resetLevels(const int* queue, int reached, int* level)
+{
+    for(int k = 0; k < reached; k++)
+    {
+        level[queue[k]] = -1;
+    }
+}
+// George-Liu: restart from a minimum degree vertex of the last level until the
+// eccentricity stops growing
+int pseudoPeripheralVertex(const int* adjPtr, const int* adj, int root, const boolean* done, int* queue, int* level)
+{
+    int eccentricity = -1, reached = bfsLevels(adjPtr, adj, root, done, queue, level);
+    while(level[queue[reached - 1]] > eccentricity)
+    {
+        int best = queue[reached - 1];
+        eccentricity = level[best];
+        for(int k = reached - 1; k >= 0 && level[queue[k]] == eccentricity; k--)
+        {
+            int v = queue[k];
+            if(adjPtr[v+1] - adjPtr[v] < adjPtr[best+1] - adjPtr[best])
+            {
+                best = v;
+            }
+        }
+        root = best;
+        resetLevels(queue, reached, level);
+        reached = bfsLevels(adjPtr, adj, root, done, queue, level);
+    }
+    resetLevels(queue, reached, level);
+    return root;
+}
+status_code orderRCM(const int* adjPtr, const int* adj, int n, int* order)
+{
+    status_code sc = SUCCESS;
+    int count = 0;
+    boolean* done = (boolean*)calloc(n + 1, sizeof(boolean));
+    int* queue = (int*)malloc((n + 1) * sizeof(int));
+    int* level = (int*)malloc((n + 1) * sizeof(int));
+    if(!done || !queue || !level)
+    {
+        sc = FAILURE;
+    }
+    for(int i = 0; sc == SUCCESS && i < n; i++)
+    {
+        level[i] = -1;
+    }
+    for(int start = 0; sc == SUCCESS && start < n; start++)// one pass per connected component
+    {
+        if(!done[start])
+        {
+            int head = count;
+            int root = pseudoPeripheralVertex(adjPtr, adj, start, done, queue, level);
+            order[count++] = root;
+            done[root] = TRUE;
+            while(head < count)
+            {
+                int v = order[head++], first = count;
+                for(int k = adjPtr[v]; k < adjPtr[v+1]; k++)
+                {
+                    if(!done[adj[k]])
+                    {
+                        done[adj[k]] = TRUE;
+                        order[count++] = adj[k];
+                    }
+                }
+                for(int a = first + 1; a < count; a++)// neighbours by increasing degree
+                {
+                    int w = order[a], b = a - 1;
+                    while(b >= first && adjPtr[order[b]+1] - adjPtr[order[b]] > adjPtr[w+1] - adjPtr[w])
+                    {
+                        order[b + 1] = order[b];
+                        b--;
+                    }
+                    order[b + 1] = w;
+                }
+            }
+        }
+    }
+    for(int k = 0; sc == SUCCESS && k < n / 2; k++)
+    {
+        int temp = order[k];
+        order[k] = order[n - 1 - k];
+        order[n - 1 - k] = temp;
+    }
+    free(done);
+    free(queue);
+    free(level);
+    return sc;
+}
+// approximate minimum degree on the quotient graph. An eliminated vertex
+// becomes an element whose variable set L_e stands for the clique it created;
+// degrees use the AMD bound |A_i| + |L_p \ i| + sum |L_e \ L_p| instead of
+// exact external degrees.
+typedef enum{AMD_VARIABLE, AMD_ELEMENT, AMD_ABSORBED} AmdState;
+
+typedef struct Amd_Graph_Tag
+{
+    int n;
+    IntList* variables;     // A_i, adjacent uneliminated vertices
+    IntList* elements;      // E_i, adjacent elements
+    IntList* members;       // L_e
+    AmdState* state;
+    int *degree, *head, *next, *prev;   // degree buckets
+    int minDegree;
+    int *marker, *weight, *weightStamp;
+} AmdGraph;
+
+void amdRemove(AmdGraph* g, int v)
+{
+    if(g->prev[v] >= 0) g->next[g->prev[v]] = g->next[v];
+    else g->head[g->degree[v]] = g->next[v];
+    if(g->next[v] >= 0) g->prev[g->next[v]] = g->prev[v];
+}
+void amdInsert(AmdGraph* g, int v, int degree)
+{
+    g->degree[v] = degree;
+    if(degree < g->minDegree)
+    {
+        g->minDegree = degree;
+    }
+    g->prev[v] = -1;
+    g->next[v] = g->head[degree];
+    if(g->head[degree] >= 0) g->prev[g->head[degree]] = v;
+    g->head[degree] = v;
+}
+void amdAbsorb(AmdGraph* g, int e)
+{
+    g->state[e] = AMD_ABSORBED;
+    freeIntList(&g->members[e]);
+}
+status_code amdEliminate(AmdGraph* g, int p, int k)
+{
+    status_code sc = SUCCESS;
+    IntList* lp = &g->members[p];
+    g->state[p] = AMD_ELEMENT;
+    g->marker[p] = p;
+    for(int a = 0; sc == SUCCESS && a < g->variables[p].count; a++)// L_p = A_p + every L_e of E_p
+    {
+        int v = g->variables[p].items[a];
+        if(g->state[v] == AMD_VARIABLE && g->marker[v] != p)
+        {
+            g->marker[v] = p;
+            sc = pushInt(lp, v);
+        }
+    }
+    for(int a = 0; sc == SUCCESS && a < g->elements[p].count; a++)
+    {
+        int e = g->elements[p].items[a];
+        if(g->state[e] == AMD_ELEMENT)
+        {
+            for(int b = 0; sc == SUCCESS && b < g->members[e].count; b++)
+            {
+                int v = g->members[e].items[b];
+                if(g->state[v] == AMD_VARIABLE && g->marker[v] != p)
+                {
+                    g->marker[v] = p;
+                    sc = pushInt(lp, v);
+                }
+            }
+            amdAbsorb(g, e);
+        }
+    }
+    freeIntList(&g->variables[p]);
+    freeIntList(&g->elements[p]);
+    for(int a = 0; sc == SUCCESS && a < lp->count; a++)// weight[e] = |L_e \ L_p|
+    {
+        IntList* ei = &g->elements[lp->items[a]];
+        for(int b = 0; b < ei->count; b++)
+        {
+            int e = ei->items[b];
+            if(g->state[e] == AMD_ELEMENT)
+            {
+                if(g->weightStamp[e] != p)
+                {
+                    g->weightStamp[e] = p;
+                    g->weight[e] = g->members[e].count;
+                }
+                g->weight[e]--;
+            }
+        }
+    }
+    for(int a = 0; sc == SUCCESS && a < lp->count; a++)
+    {
+        int i = lp->items[a], kept = 0, degree;
+        IntList* ai = &g->variables[i];
+        IntList* ei = &g->elements[i];
+        amdRemove(g, i);
+        degree = lp->count - 1;
+        for(int b = 0; b < ei->count; b++)
+        {
+            int e = ei->items[b];
+            if(g->state[e] == AMD_ELEMENT && g->weight[e] == 0)// L_e inside L_p
+            {
+                amdAbsorb(g, e);
+            }
+            if(g->state[e] == AMD_ELEMENT)
+            {
+                ei->items[kept++] = e;
+                degree += g->weight[e];
+            }
+        }
+        ei->count = kept;
+        kept = 0;
+        for(int b = 0; b < ai->count; b++)// edges inside L_p are covered by p
+        {
+            int v = ai->items[b];
+            if(g->state[v] == AMD_VARIABLE && g->marker[v] != p)
+            {
+                ai->items[kept++] = v;
+            }
+        }
+        ai->count = kept;
+        degree += kept;
+        if(degree > g->degree[i] + lp->count - 1)
+        {
+            degree = g->degree[i] + lp->count - 1;
+        }
+        if(degree > g->n - k - 2)
+        {
+            degree = g->n - k - 2;
+        }
+        sc = pushInt(ei, p);
+        amdInsert(g, i, degree);
+    }
+    return sc;
+}
+status_code orderAMD(const int* adjPtr, const int* adj, int n, int* order)
+{
+    status_code sc = SUCCESS;
+    AmdGraph g;
+    g.n = n;
+    g.minDegree = 0;
+    g.variables = (IntList*)calloc(n + 1, sizeof(IntList));
+    g.elements = (IntList*)calloc(n + 1, sizeof(IntList));
+    g.members = (IntList*)calloc(n + 1, sizeof(IntList));
+    g.state = (AmdState*)calloc(n + 1, sizeof(AmdState));
+    g.degree = (int*)malloc((n + 1) * sizeof(int));
+    g.head = (int*)malloc((n + 1) * sizeof(int));
+    g.next = (int*)malloc((n + 1) * sizeof(int));
+    g.prev = (int*)malloc((n + 1) * sizeof(int));
+    g.marker = (int*)malloc((n + 1) * sizeof(int));
+    g.weight = (int*)malloc((n + 1) * sizeof(int));
+    g.weightStamp = (int*)malloc((n + 1) * sizeof(int));
+    if(!g.variables || !g.elements || !g.members || !g.state || !g.degree || !g.head || !g.next
+        || !g.prev || !g.marker || !g.weight || !g.weightStamp)
+    {
+        sc = FAILURE;
+    }
+    for(int i = 0; sc == SUCCESS && i < n; i++)
+    {
+        g.head[i] = g.marker[i] = g.weightStamp[i] = -1;
+    }
+    for(int i = 0; sc == SUCCESS && i < n; i++)
+    {
+        for(int k = adjPtr[i]; sc == SUCCESS && k < adjPtr[i+1]; k++)
+        {
+            sc = pushInt(&g.variables[i], adj[k]);
+        }
+        amdInsert(&g, i, adjPtr[i+1] - adjPtr[i]);
+    }
+    for(int k = 0; sc == SUCCESS && k < n; k++)
+    {
+        int p;
+        while(g.head[g.minDegree] < 0)
+        {
+            g.minDegree++;
+        }
+        p = g.head[g.minDegree];
+        amdRemove(&g, p);
+        order[k] = p;
+        sc = amdEliminate(&g, p, k);
+    }
+    for(int i = 0; g.variables && g.elements && g.members && i < n; i++)
+    {
+        freeIntList(&g.variables[i]);
+        freeIntList(&g.elements[i]);
+        freeIntList(&g.members[i]);
+    }
+    free(g.variables); free(g.elements); free(g.members); free(g.state);
+    free(g.degree); free(g.head); free(g.next); free(g.prev);
+    free(g.marker); free(g.weight); free(g.weightStamp);
+    return sc;
+}
+status_code computeOrdering(const SparseMatrix* matrix, OrderingMethod method, int* order)
+{
+    status_code sc = (matrix->rowCount == matrix->colCount) ? SUCCESS : FAILURE;
+    int *adjPtr = NULL, *adj = NULL;
+    if(sc == SUCCESS && method == ORDER_NATURAL)
+    {
+        for(int i = 0; i < matrix->rowCount; i++)
+        {
+            order[i] = i;
+        }
+    }
+    else if(sc == SUCCESS)
+    {
+        sc = buildAdjacency(matrix, &adjPtr, &adj);
+        if(sc == SUCCESS)
+        {
+            sc = (method == ORDER_RCM) ? orderRCM(adjPtr, adj, matrix->rowCount, order)
+                                       : orderAMD(adjPtr, adj, matrix->rowCount, order);
+        }
+    }
+    free(adjPtr);
+    free(adj);
+    return sc;
+}
+// result(i, j) = matrix(rowOrder[i], colOrder[j]), NULL orders mean identity.
+// Old columns are visited in new column order and scattered into new row
+// buckets, which leaves every bucket sorted by new column for the builder.
+status_code permuteLists(const SparseMatrix* matrix, const int* rowOrder, const int* colOrder, SparseMatrix* result)
+{
+    status_code sc;
+    MatrixBuilder builder;
+    int rows = matrix->rowCount, cols = matrix->colCount, nnz = countElements(matrix);
+    int* newRow = (int*)malloc((rows + 1) * sizeof(int));
+    int* bucketPtr = (int*)calloc(rows + 2, sizeof(int));
+    int* bucketCol = (int*)malloc((nnz + 1) * sizeof(int));
+    matrix_entry* bucketData = (matrix_entry*)malloc((nnz + 1) * sizeof(matrix_entry));
+    Col_Node** oldCols = (Col_Node**)calloc(cols + 1, sizeof(Col_Node*));
+
+    sc = (newRow && bucketPtr && bucketCol && bucketData && oldCols) ? SUCCESS : FAILURE;
+
+    if(sc == SUCCESS)
+    {
+        for(int i = 0; i < rows; i++)
+        {
+            newRow[rowOrder ? rowOrder[i] : i] = i;
+        }
+        for(Col_Node* colPos = matrix->colHead; colPos; colPos = colPos->next)
+        {
+            oldCols[colPos->col] = colPos;
+        }
+        for(Row_Node* rowPos = matrix->rowHead; rowPos; rowPos = rowPos->next)
+        {
+            for(Sm_Node* element = rowPos->rowlist; element; element = element->right)
+            {
+                bucketPtr[newRow[element->row] + 2]++;
+            }
+        }
+        for(int i = 2; i <= rows; i++)
+        {
+            bucketPtr[i] += bucketPtr[i - 1];
+        }
+        for(int j = 0; j < cols; j++)
+        {
+            Col_Node* colPos = oldCols[colOrder ? colOrder[j] : j];
+            for(Sm_Node* element = colPos ? colPos->collist : NULL; element; element = element->down)
+            {
+                int pos = bucketPtr[newRow[element->row] + 1]++;
+                bucketCol[pos] = j;
+                bucketData[pos] = element->data;
+            }
+        }
+        sc = beginMatrixBuilder(&builder, result, rows, cols);
+    }
+    if(sc == SUCCESS)
+    {
+        for(int i = 0; sc == SUCCESS && i < rows; i++)
+        {
+            for(int k = bucketPtr[i]; sc == SUCCESS && k < bucketPtr[i+1]; k++)
+            {
+                sc = (appendNode(&builder, i, bucketCol[k], bucketData[k]) != NULL) ? SUCCESS : FAILURE;
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    free(newRow);
+    free(bucketPtr);
+    free(bucketCol);
+    free(bucketData);
+    free(oldCols);
+    return sc;
+}
+status_code permuteMatrix(const SparseMatrix* matrix, const int* rowOrder, const int* colOrder, SparseMatrix* result)
+{
+    status_code sc;
+    if(matrix->symmetric)// the scatter needs both halves
+    {
+        SparseMatrix full;
+        sc = expandSymmetric(matrix, &full);
+        if(sc == SUCCESS)
+        {
+            sc = permuteLists(&full, rowOrder, colOrder, result);
+        }
+        clearMatrix(&full);
+    }
+    else
+    {
+        sc = permuteLists(matrix, rowOrder, colOrder, result);
+    }
+    return sc;
+}
+status_code symmetricPermute(const SparseMatrix* matrix, const int* order, SparseMatrix* result)// P A P^T
+{
+    status_code sc = permuteMatrix(matrix, order, order, result);
+    if(sc == SUCCESS && matrix->symmetric)
+    {
+        sc = setSymmetricStorage(result, TRUE);
+    }
+    return sc;
+}
+// block compressed rows. Every stored block is a dense blockSize x blockSize
+// tile (row major) at block coordinates (bi, colIdx[k]); the scalar shape is
+// padded up to whole blocks. One column index per block replaces the two
+// pointers and two indexes every Sm_Node carries per value.
+#define MAX_BSR_BLOCK 16
+
+typedef struct Bsr_Matrix_Tag
+{
+    int rowCount, colCount;     // scalar shape
+    int blockSize, blockRows, blockCols;
+    int* rowPtr;                // blocks of block row bi are rowPtr[bi] .. rowPtr[bi+1]
+    int* colIdx;
+    double* values;
+} BsrMatrix;
+
+void freeBsrMatrix(BsrMatrix* bsr)
+{
+    free(bsr->rowPtr);
+    free(bsr->colIdx);
+    free(bsr->values);
+    bsr->rowPtr = bsr->colIdx = NULL;
+    bsr->values = NULL;
+}
+status_code allocateBsrMatrix(BsrMatrix* bsr, int rows, int cols, int blockSize, int blockCount)
+{
+    size_t area = (size_t)blockSize * blockSize;
+    bsr->rowCount = rows;
+    bsr->colCount = cols;
+    bsr->blockSize = blockSize;
+    bsr->blockRows = (rows + blockSize - 1) / blockSize;
+    bsr->blockCols = (cols + blockSize - 1) / blockSize;
+    bsr->rowPtr = (int*)calloc(bsr->blockRows + 1, sizeof(int));
+    bsr->colIdx = (int*)malloc((blockCount + 1) * sizeof(int));
+    bsr->values = (double*)calloc((blockCount + 1) * area, sizeof(double));
+    return (bsr->rowPtr && bsr->colIdx && bsr->values) ? SUCCESS : FAILURE;
+}
+size_t bsrBytes(const BsrMatrix* bsr)
+{
+    int blocks = bsr->rowPtr[bsr->blockRows];
+    return sizeof(BsrMatrix) + (bsr->blockRows + 1) * sizeof(int) + blocks * sizeof(int)
+        + (size_t)blocks * bsr->blockSize * bsr->blockSize * sizeof(double);
+}
+// two sweeps per block row over the scalar rows it covers: the first collects
+// the distinct block columns, the second scatters the values into their tiles
+status_code sparseMatrixToBsr(const SparseMatrix* matrix, int blockSize, BsrMatrix* bsr)
+{
+    status_code sc = (blockSize >= 1 && blockSize <= MAX_BSR_BLOCK) ? SUCCESS : FAILURE;
+    MatrixView view;
+    int blockRows = (sc == SUCCESS) ? (matrix->rowCount + blockSize - 1) / blockSize : 0;
+    int blockCols = (sc == SUCCESS) ? (matrix->colCount + blockSize - 1) / blockSize : 0;
+    int blockCount = 0, k = 0;
+    int* slot = (int*)malloc((blockCols + 1) * sizeof(int));
+    int* touched = (int*)malloc((blockCols + 1) * sizeof(int));
+
+    memset(bsr, 0, sizeof(BsrMatrix));
+    if(sc == SUCCESS && slot && touched && openMatrixView(&view, matrix, FALSE) == SUCCESS)
+    {
+        for(int j = 0; j < blockCols; j++)
+        {
+            slot[j] = -1;
+        }
+        for(int bi = 0; bi < blockRows; bi++)// counting pass
+        {
+            for(int i = bi * blockSize; i < (bi + 1) * blockSize && i < matrix->rowCount; i++)
+            {
+                for(Sm_Node* e = view.lists[i]; e; e = viewNext(&view, i, e))
+                {
+                    int bj = viewIndex(&view, i, e) / blockSize;
+                    if(slot[bj] != bi)
+                    {
+                        slot[bj] = bi;
+                        blockCount++;
+                    }
+                }
+            }
+        }
+        sc = allocateBsrMatrix(bsr, matrix->rowCount, matrix->colCount, blockSize, blockCount);
+        for(int j = 0; j < blockCols; j++)
+        {
+            slot[j] = -1;
+        }
+        for(int bi = 0; sc == SUCCESS && bi < blockRows; bi++)
+        {
+            int count = 0;
+            size_t area = (size_t)blockSize * blockSize;
+            for(int i = bi * blockSize; i < (bi + 1) * blockSize && i < matrix->rowCount; i++)
+            {
+                for(Sm_Node* e = view.lists[i]; e; e = viewNext(&view, i, e))
+                {
+                    int bj = viewIndex(&view, i, e) / blockSize;
+                    if(slot[bj] < 0)
+                    {
+                        slot[bj] = 0;
+                        touched[count++] = bj;
+                    }
+                }
+            }
+            qsort(touched, count, sizeof(int), compareIndexes);
+            for(int t = 0; t < count; t++)
+            {
+                slot[touched[t]] = k + t;
+                bsr->colIdx[k + t] = touched[t];
+            }
+            for(int i = bi * blockSize; i < (bi + 1) * blockSize && i < matrix->rowCount; i++)
+            {
+                for(Sm_Node* e = view.lists[i]; e; e = viewNext(&view, i, e))
+                {
+                    int j = viewIndex(&view, i, e);
+                    bsr->values[slot[j / blockSize] * area + (i % blockSize) * blockSize + j % blockSize] = e->data;
+                }
+            }
+            for(int t = 0; t < count; t++)
+            {
+                slot[touched[t]] = -1;
+            }
+            k += count;
+            bsr->rowPtr[bi + 1] = k;
+        }
+        closeMatrixView(&view);
+    }
+    else
+    {
+        sc = FAILURE;
+    }
+    free(slot);
+    free(touched);
+    if(sc == FAILURE)
+    {
+        freeBsrMatrix(bsr);
+    }
+    return sc;
+}
+status_code bsrToSparseMatrix(const BsrMatrix* bsr, SparseMatrix* result)// zeros inside the tiles are dropped
+{
+    MatrixBuilder builder;
+    int bs = bsr->blockSize;
+    status_code sc = beginMatrixBuilder(&builder, result, bsr->rowCount, bsr->colCount);
+    if(sc == SUCCESS)
+    {
+        for(int i = 0; sc == SUCCESS && i < bsr->rowCount; i++)
+        {
+            int bi = i / bs;
+            for(int k = bsr->rowPtr[bi]; sc == SUCCESS && k < bsr->rowPtr[bi+1]; k++)
+            {
+                const double* row = bsr->values + (size_t)k * bs * bs + (i % bs) * bs;
+                for(int c = 0; sc == SUCCESS && c < bs && bsr->colIdx[k] * bs + c < bsr->colCount; c++)
+                {
+                    sc = appendElement(&builder, i, bsr->colIdx[k] * bs + c, (matrix_entry)row[c]);
+                }
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    return sc;
+}
+// y = A x over padded vectors. The block size is a compile time constant in
+// these kernels, so the tile loops unroll and a block row's partial sums stay
+// in registers.
+#define DEFINE_BSR_KERNEL(B) \
+void bsrKernel##B(const BsrMatrix* a, const double* x, double* y) \
+{ \
+    for(int bi = 0; bi < a->blockRows; bi++) \
+    { \
+        double sum[B] = {0}; \
+        for(int k = a->rowPtr[bi]; k < a->rowPtr[bi+1]; k++) \
+        { \
+            const double* block = a->values + (size_t)k * (B * B); \
+            const double* xb = x + a->colIdx[k] * B; \
+            for(int r = 0; r < B; r++) \
+            { \
+                for(int c = 0; c < B; c++) \
+                { \
+                    sum[r] += block[r * B + c] * xb[c]; \
+                } \
+            } \
+        } \
+        for(int r = 0; r < B; r++) \
+        { \
+            y[bi * B + r] = sum[r]; \
+        } \
+    } \
+}
+DEFINE_BSR_KERNEL(2)
+DEFINE_BSR_KERNEL(3)
+DEFINE_BSR_KERNEL(4)
+DEFINE_BSR_KERNEL(6)
+
+void bsrKernelGeneric(const BsrMatrix* a, const double* x, double* y)
+{
+    int bs = a->blockSize;
+    memset(y, 0, (size_t)a->blockRows * bs * sizeof(double));
+    for(int bi = 0; bi < a->blockRows; bi++)
+    {
+        for(int k = a->rowPtr[bi]; k < a->rowPtr[bi+1]; k++)
+        {
+            const double* block = a->values + (size_t)k * bs * bs;
+            const double* xb = x + a->colIdx[k] * bs;
+            for(int r = 0; r < bs; r++)
+            {
+                for(int c = 0; c < bs; c++)
+                {
+                    y[bi * bs + r] += block[r * bs + c] * xb[c];
+                }
+            }
+        }
+    }
+}
+void bsrKernel(const BsrMatrix* a, const double* x, double* y)
+{
+    switch(a->blockSize)
+    {
+        case 2: bsrKernel2(a, x, y); break;
+        case 3: bsrKernel3(a, x, y); break;
+        case 4: bsrKernel4(a, x, y); break;
+        case 6: bsrKernel6(a, x, y); break;
+        default: bsrKernelGeneric(a, x, y); break;
+    }
+}
+void bsrKernelRagged(const BsrMatrix* a, const double* x, double* y)// edge tiles clipped to the scalar shape
+{
+    int bs = a->blockSize;
+    memset(y, 0, a->rowCount * sizeof(double));
+    for(int bi = 0; bi < a->blockRows; bi++)
+    {
+        int rows = (a->rowCount - bi * bs < bs) ? a->rowCount - bi * bs : bs;
+        for(int k = a->rowPtr[bi]; k < a->rowPtr[bi+1]; k++)
+        {
+            const double* block = a->values + (size_t)k * bs * bs;
+            const double* xb = x + a->colIdx[k] * bs;
+            int cols = (a->colCount - a->colIdx[k] * bs < bs) ? a->colCount - a->colIdx[k] * bs : bs;
+            for(int r = 0; r < rows; r++)
+            {
+                for(int c = 0; c < cols; c++)
+                {
+                    y[bi * bs + r] += block[r * bs + c] * xb[c];
+                }
+            }
+        }
+    }
+}
+void bsrMultiplyVector(const BsrMatrix* a, const double* x, double* y)// y = A * x, needs no workspace
+{
+    int bs = a->blockSize;
+    if(a->rowCount % bs != 0 || a->colCount % bs != 0)// ragged edge blocks reach past the scalar shape
+    {
+        bsrKernelRagged(a, x, y);
+    }
+    else
+    {
+        bsrKernel(a, x, y);
+    }
+}
+void applyBsrMatrix(const void* data, const double* x, double* y)
+{
+    bsrMultiplyVector((const BsrMatrix*)data, x, y);
+}
+LinearOperator bsrOperator(const BsrMatrix* bsr)
+{
+    LinearOperator op;
+    op.n = bsr->rowCount;
+    op.data = bsr;
+    op.apply = applyBsrMatrix;
+    return op;
+}
+status_code appendBsrBlock(BsrMatrix* c, int* capacity, int position, int blockCol, const double* block)
+{
+    status_code sc = SUCCESS;
+    size_t area = (size_t)c->blockSize * c->blockSize;
+    if(position == *capacity)
+    {
+        int grown = 2 * (*capacity) + 16;
+        int* colIdx = (int*)realloc(c->colIdx, grown * sizeof(int));
+        double* values = colIdx ? (double*)realloc(c->values, grown * area * sizeof(double)) : NULL;
+        if(colIdx) c->colIdx = colIdx;
+        if(values) c->values = values;
+        sc = (colIdx && values) ? SUCCESS : FAILURE;
+        *capacity = (sc == SUCCESS) ? grown : *capacity;
+    }
+    if(sc == SUCCESS)
+    {
+        c->colIdx[position] = blockCol;
+        memcpy(c->values + position * area, block, area * sizeof(double));
+    }
+    return sc;
+}
+// C = A * B block by block: Gustavson's row algorithm with dense tiles as the
+// scalars, one accumulator tile per touched block column
+status_code bsrMultiply(const BsrMatrix* a, const BsrMatrix* b, BsrMatrix* c)
+{
+    status_code sc = (a->colCount == b->rowCount && a->blockSize == b->blockSize) ? SUCCESS : FAILURE;
+    int bs = a->blockSize, count = 0, capacity = 0;
+    size_t area = (size_t)bs * bs;
+    int* slot = (int*)malloc((b->blockCols + 1) * sizeof(int));
+    int* touched = (int*)malloc((b->blockCols + 1) * sizeof(int));
+    double* tiles = (double*)malloc(((size_t)b->blockCols + 1) * area * sizeof(double));
+
+    memset(c, 0, sizeof(BsrMatrix));
+    if(sc == SUCCESS)
+    {
+        sc = allocateBsrMatrix(c, a->rowCount, b->colCount, bs, 0);
+    }
+    if(!slot || !touched || !tiles)
+    {
+        sc = FAILURE;
+    }
+    for(int j = 0; sc == SUCCESS && j < b->blockCols; j++)
+    {
+        slot[j] = -1;
+    }
+    for(int bi = 0; sc == SUCCESS && bi < a->blockRows; bi++)
+    {
+        int found = 0;
+        long products = 0;
+        for(int k = a->rowPtr[bi]; k < a->rowPtr[bi+1]; k++)
+        {
+            const double* ablock = a->values + k * area;
+            int bk = a->colIdx[k];
+            products += b->rowPtr[bk+1] - b->rowPtr[bk];
+            for(int m = b->rowPtr[bk]; m < b->rowPtr[bk+1]; m++)
+            {
+                const double* bblock = b->values + m * area;
+                double* tile;
+                int bj = b->colIdx[m];
+                if(slot[bj] < 0)
+                {
+                    slot[bj] = found;
+                    touched[found++] = bj;
+                    memset(tiles + slot[bj] * area, 0, area * sizeof(double));
+                }
+                tile = tiles + slot[bj] * area;
+                for(int r = 0; r < bs; r++)
+                {
+                    for(int q = 0; q < bs; q++)
+                    {
+                        double s = ablock[r * bs + q];
+                        for(int col = 0; col < bs; col++)
+                        {
+                            tile[r * bs + col] += s * bblock[q * bs + col];
+                        }
+                    }
+                }
+            }
+        }
+        qsort(touched, found, sizeof(int), compareIndexes);
+        for(int t = 0; sc == SUCCESS && t < found; t++)
+        {
+            sc = appendBsrBlock(c, &capacity, count++, touched[t], tiles + slot[touched[t]] * area);
+            slot[touched[t]] = -1;
+        }
+        c->rowPtr[bi + 1] = count;
+        PROFILE_COUNT(flops, 2.0 * products * area * bs);// one bs^3 tile product per pair of blocks
+    }
+    free(slot);
+    free(touched);
+    free(tiles);
+    if(sc == FAILURE)
+    {
+        freeBsrMatrix(c);
+    }
+    return sc;
+}
+status_code bsrAdd(const BsrMatrix* a, const BsrMatrix* b, BsrMatrix* c)// merges the sorted block columns of each block row
+{
+    status_code sc = (a->rowCount == b->rowCount && a->colCount == b->colCount && a->blockSize == b->blockSize) ? SUCCESS : FAILURE;
+    int bs = a->blockSize, count = 0, capacity = 0;
+    size_t area = (size_t)bs * bs;
+    double* tile = (double*)malloc((area + 1) * sizeof(double));
+
+    memset(c, 0, sizeof(BsrMatrix));
+    if(sc == SUCCESS)
+    {
+        sc = allocateBsrMatrix(c, a->rowCount, a->colCount, bs, 0);
+    }
+    sc = tile ? sc : FAILURE;
+    for(int bi = 0; sc == SUCCESS && bi < a->blockRows; bi++)
+    {
+        int ka = a->rowPtr[bi], kb = b->rowPtr[bi];
+        while(sc == SUCCESS && (ka < a->rowPtr[bi+1] || kb < b->rowPtr[bi+1]))
+        {
+            boolean takeA = ka < a->rowPtr[bi+1], takeB = kb < b->rowPtr[bi+1];
+            int bj;
+            if(takeA && takeB)
+            {
+                takeA = a->colIdx[ka] <= b->colIdx[kb];
+                takeB = b->colIdx[kb] <= a->colIdx[ka];
+            }
+            bj = takeA ? a->colIdx[ka] : b->colIdx[kb];
+            for(size_t q = 0; q < area; q++)
+            {
+                tile[q] = (takeA ? a->values[ka * area + q] : 0) + (takeB ? b->values[kb * area + q] : 0);
+            }
+            ka += takeA;
+            kb += takeB;
+            sc = appendBsrBlock(c, &capacity, count++, bj, tile);
+        }
+        c->rowPtr[bi + 1] = count;
+    }
+    free(tile);
+    if(sc == FAILURE)
+    {
+        freeBsrMatrix(c);
+    }
+    return sc;
+}
+// sliced ELLPACK (SELL-C-sigma). Rows are sorted by decreasing length inside
+// windows of sigma rows, then every C consecutive sorted rows form a chunk,
+// padded to its longest row and stored column major: entry k of the chunk's
+// row r sits at chunkPtr[c] + k * C + r. Each step of the SpMV loop then reads
+// C contiguous values and column indexes, one per SIMD lane, and the sorting
+// keeps the padding small when row lengths are uneven.
+#define DEFAULT_SELL_CHUNK 8
+#define DEFAULT_SELL_SIGMA 256
+#define MAX_SELL_CHUNK 64
+
+typedef struct Sell_Matrix_Tag
+{
+    int rowCount, colCount;
+    int chunkSize, sigma, chunkCount;
+    int* chunkPtr;      // entries of chunk c are chunkPtr[c] .. chunkPtr[c+1]
+    int* chunkWidth;    // padded row length of each chunk
+    int* rowOrder;      // row stored in slot s (chunk s / C, lane s % C), -1 for padding
+    int* colIdx;
+    double* values;
+} SellMatrix;
+
+typedef struct Sell_Row_Tag
+{
+    int length, row;
+} SellRow;
+
+int compareSellRows(const void* a, const void* b)// longest first, ties by row
+{
+    const SellRow *x = (const SellRow*)a, *y = (const SellRow*)b;
+    return (x->length != y->length) ? y->length - x->length : x->row - y->row;
+}
+void freeSellMatrix(SellMatrix* sell)
+{
+    free(sell->chunkPtr);
+    free(sell->chunkWidth);
+    free(sell->rowOrder);
+    free(sell->colIdx);
+    free(sell->values);
+    sell->chunkPtr = sell->chunkWidth = sell->rowOrder = sell->colIdx = NULL;
+    sell->values = NULL;
+}
+size_t sellBytes(const SellMatrix* sell)
+{
+    size_t entries = sell->chunkPtr[sell->chunkCount];
+    return sizeof(SellMatrix) + (2 * sell->chunkCount + 1) * sizeof(int)
+        + (size_t)sell->chunkCount * sell->chunkSize * sizeof(int) + entries * (sizeof(int) + sizeof(double));
+}
+// sigma is rounded up to a multiple of C so that no chunk straddles two windows
+status_code sparseMatrixToSell(const SparseMatrix* matrix, int chunkSize, int sigma, SellMatrix* sell)
+{
+    status_code sc = (chunkSize >= 1 && chunkSize <= MAX_SELL_CHUNK) ? SUCCESS : FAILURE;
+    MatrixView view;
+    int n = matrix->rowCount, C = chunkSize;
+    SellRow* rows = (SellRow*)malloc((n + 1) * sizeof(SellRow));
+
+    memset(sell, 0, sizeof(SellMatrix));
+    if(sc == SUCCESS && rows && openMatrixView(&view, matrix, FALSE) == SUCCESS)
+    {
+        sigma = (sigma < C) ? C : (sigma + C - 1) / C * C;
+        sell->rowCount = n;
+        sell->colCount = matrix->colCount;
+        sell->chunkSize = C;
+        sell->sigma = sigma;
+        sell->chunkCount = (n + C - 1) / C;
+        for(int i = 0; i < n; i++)
+        {
+            rows[i].row = i;
+            rows[i].length = 0;
+            for(Sm_Node* e = view.lists[i]; e; e = viewNext(&view, i, e))
+            {
+                rows[i].length++;
+            }
+        }
+        for(int w = 0; w < n; w += sigma)
+        {
+            qsort(rows + w, (n - w < sigma) ? n - w : sigma, sizeof(SellRow), compareSellRows);
+        }
+        sell->chunkPtr = (int*)calloc(sell->chunkCount + 1, sizeof(int));
+        sell->chunkWidth = (int*)malloc((sell->chunkCount + 1) * sizeof(int));
+        sell->rowOrder = (int*)malloc(((size_t)sell->chunkCount * C + 1) * sizeof(int));
+        sc = (sell->chunkPtr && sell->chunkWidth && sell->rowOrder) ? SUCCESS : FAILURE;
+        for(int c = 0; sc == SUCCESS && c < sell->chunkCount; c++)
+        {
+            sell->chunkWidth[c] = rows[c * C].length;// the first row of a sorted chunk is its longest
+            sell->chunkPtr[c+1] = sell->chunkPtr[c] + sell->chunkWidth[c] * C;
+            for(int r = 0; r < C; r++)
+            {
+                sell->rowOrder[c * C + r] = (c * C + r < n) ? rows[c * C + r].row : -1;
+            }
+        }
+        if(sc == SUCCESS)
+        {
+            sell->colIdx = (int*)calloc(sell->chunkPtr[sell->chunkCount] + 1, sizeof(int));
+            sell->values = (double*)calloc(sell->chunkPtr[sell->chunkCount] + 1, sizeof(double));
+            sc = (sell->colIdx && sell->values) ? SUCCESS : FAILURE;
+        }
+        for(int s = 0; sc == SUCCESS && s < sell->chunkCount * C; s++)
+        {
+            int i = sell->rowOrder[s], k = 0, lastCol = 0;
+            int base = sell->chunkPtr[s / C] + s % C;
+            if(i >= 0)
+            {
+                for(Sm_Node* e = view.lists[i]; e; e = viewNext(&view, i, e), k++)
+                {
+                    lastCol = viewIndex(&view, i, e);
+                    sell->colIdx[base + k * C] = lastCol;
+                    sell->values[base + k * C] = e->data;
+                }
+            }
+            for(; k < sell->chunkWidth[s / C]; k++)// padding reads an x entry already in cache
+            {
+                sell->colIdx[base + k * C] = lastCol;
+            }
+        }
+        closeMatrixView(&view);
+    }
+    else
+    {
+        sc = FAILURE;
+    }
+    free(rows);
+    if(sc == FAILURE)
+    {
+        freeSellMatrix(sell);
+    }
+    return sc;
+}
+// y = A x on chunks [begin, end). With C fixed at compile time the lane loop
+// is a single vector operation and the C partial sums stay in registers.
+#define DEFINE_SELL_KERNEL(C) \
+void sellKernel##C(const SellMatrix* a, const double* x, double* y, int begin, int end) \
+{ \
+    for(int c = begin; c < end; c++) \
+    { \
+        double sum[C] = {0}; \
+        const int* col = a->colIdx + a->chunkPtr[c]; \
+        const double* val = a->values + a->chunkPtr[c]; \
+        for(int k = 0; k < a->chunkWidth[c]; k++) \
+        { \
+            for(int r = 0; r < C; r++) \
+            { \
+                sum[r] += val[k * C + r] * x[col[k * C + r]]; \
+            } \
+        } \
+        for(int r = 0; r < C; r++) \
+        { \
+            if(a->rowOrder[c * C + r] >= 0) \
+            { \
+                y[a->rowOrder[c * C + r]] = sum[r]; \
+            } \
+        } \
+    } \
+}
+DEFINE_SELL_KERNEL(4)
+DEFINE_SELL_KERNEL(8)
+DEFINE_SELL_KERNEL(16)
+
+void sellKernelGeneric(const SellMatrix* a, const double* x, double* y, int begin, int end)
+{
+    int C = a->chunkSize;
+    for(int c = begin; c < end; c++)
+    {
+        for(int r = 0; r < C; r++)
+        {
+            int row = a->rowOrder[c * C + r];
+            double sum = 0;
+            for(int k = 0; k < a->chunkWidth[c]; k++)
+            {
+                sum += a->values[a->chunkPtr[c] + k * C + r] * x[a->colIdx[a->chunkPtr[c] + k * C + r]];
+            }
+            if(row >= 0)
+            {
+                y[row] = sum;
+            }
+        }
+    }
+}
+typedef struct Sell_Product_Tag
+{
+    const SellMatrix* a;
+    const double* x;
+    double* y;
+} SellProduct;
+
+void sellChunks(void* context, int begin, int end)
+{
+    SellProduct* p = (SellProduct*)context;
+    switch(p->a->chunkSize)
+    {
+        case 4: sellKernel4(p->a, p->x, p->y, begin, end); break;
+        case 8: sellKernel8(p->a, p->x, p->y, begin, end); break;
+        case 16: sellKernel16(p->a, p->x, p->y, begin, end); break;
+        default: sellKernelGeneric(p->a, p->x, p->y, begin, end); break;
+    }
+}
+void sellMultiplyVector(const SellMatrix* a, const double* x, double* y)// y = A * x
+{
+    SellProduct p;
+    p.a = a;
+    p.x = x;
+    p.y = y;
+    parallelFor(a->chunkCount, sellChunks, &p);
+}
+void applySellMatrix(const void* data, const double* x, double* y)
+{
+    sellMultiplyVector((const SellMatrix*)data, x, y);
+}
+LinearOperator sellOperator(const SellMatrix* sell)
+{
+    LinearOperator op;
+    op.n = sell->rowCount;
+    op.data = sell;
+    op.apply = applySellMatrix;
+    return op;
+}
+// concurrent access to registry matrices. A shared matrix publishes immutable
+// snapshots: readers pin the current one without taking a lock, while writers
+// take turns on a mutex, change the live matrix and publish a fresh copy.
+// Replaced snapshots are freed by epochs: a reader announces the global epoch
+// before loading the snapshot pointer, every replacement advances the epoch,
+// and a snapshot retired at epoch R is freed once all announced epochs are at
+// least R. Readers therefore never wait on writers, however long the burst.
+#define MAX_READER_SLOTS 64
+
+typedef struct Matrix_Snapshot_Tag
+{
+    SparseMatrix matrix;            // never changed once published
+    unsigned long version;
+    unsigned long retiredAt;
+    struct Matrix_Snapshot_Tag* nextRetired;
+} MatrixSnapshot;
+
+typedef struct Shared_Matrix_Tag
+{
+    _Atomic(MatrixSnapshot*) current;
+    SparseMatrix* live;             // the registry matrix, changed by one writer at a time
+    MatrixSnapshot* retired;        // guarded by the writer lock
+    unsigned long version;
+    boolean stale;                  // live matrix changed since the last publish
+#ifndef SM_NO_THREADS
+    pthread_mutex_t writer;
+#endif
+} SharedMatrix;
+
+typedef struct Reader_Slot_Tag
+{
+    atomic_ulong epoch;             // announced epoch, 0 while the slot is free
+    char pad[64 - sizeof(atomic_ulong)];   // one slot per cache line
+} ReaderSlot;
+
+atomic_ulong readEpoch = 1;
+ReaderSlot readerSlots[MAX_READER_SLOTS];
+_Thread_local int readerSlot = -1;
+_Thread_local int readerDepth = 0;
+
+void enterReadSection(void)// nested sections share the outer announcement
+{
+    if(readerDepth++ == 0)
+    {
+        unsigned long epoch = atomic_load(&readEpoch);
+        int slot = (int)(((uintptr_t)&readerDepth >> 6) % MAX_READER_SLOTS);
+        while(TRUE)
+        {
+            unsigned long expected = 0;
+            if(atomic_compare_exchange_strong(&readerSlots[slot].epoch, &expected, epoch))
+            {
+                break;
+            }
+            slot = (slot + 1) % MAX_READER_SLOTS;
+#ifndef SM_NO_THREADS
+            if(slot == 0)
+            {
+                sched_yield();// more than MAX_READER_SLOTS readers at once
+            }
+#endif
+        }
+        readerSlot = slot;
+    }
+}
+void endRead(void)
+{
+    if(--readerDepth == 0)
+    {
+        atomic_store(&readerSlots[readerSlot].epoch, 0);
+    }
+}
+// a registry matrix to be used read only until endRead: the current snapshot
+// when it is shared, else the live matrix, which then must not be changed by
+// another thread meanwhile. NULL when the name is free; endRead is then not called.
+SparseMatrix* beginRead(char name)
+{
+    int index = name - 'A';
+    SharedMatrix* shared = NULL;
+    SparseMatrix* matrix = NULL;
+    if(index >= 0 && index < MAX_MATRICES)
+    {
+        enterReadSection();
+        shared = atomic_load(&registry[index].shared);
+        if(shared)
+        {
+            matrix = &atomic_load(&shared->current)->matrix;
+        }
+        else if(registry[index].isOccupied)
+        {
+            matrix = &registry[index].matrix;
+        }
+        else
+        {
+            endRead();
+        }
+    }
+    return matrix;
+}
+unsigned long oldestReader(void)
+{
+    unsigned long oldest = ULONG_MAX;
+    for(int s = 0; s < MAX_READER_SLOTS; s++)
+    {
+        unsigned long epoch = atomic_load(&readerSlots[s].epoch);
+        if(epoch && epoch < oldest)
+        {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+void waitForReaders(void)// returns once every reader that started before the call has left
+{
+    unsigned long epoch = atomic_fetch_add(&readEpoch, 1) + 1;
+    while(oldestReader() < epoch)
+    {
+#ifndef SM_NO_THREADS
+        sched_yield();
+#endif
+    }
+}
+void freeSnapshot(MatrixSnapshot* snapshot)
+{
+    releaseMatrix(&snapshot->matrix);
+    free(snapshot);
+}
+void reclaimSnapshots(SharedMatrix* shared)// with the writer lock held
+{
+    unsigned long oldest = oldestReader();
+    MatrixSnapshot** link = &shared->retired;
+    while(*link)
+    {
+        MatrixSnapshot* snapshot = *link;
+        if(snapshot->retiredAt <= oldest)
+        {
+            *link = snapshot->nextRetired;
+            freeSnapshot(snapshot);
+        }
+        else
+        {
+            link = &snapshot->nextRetired;
+        }
+    }
+}
+status_code publishSnapshot(SharedMatrix* shared)// with the writer lock held
+{
+    status_code sc = FAILURE;
+    MatrixSnapshot* snapshot = (MatrixSnapshot*)malloc(sizeof(MatrixSnapshot));
+    if(snapshot && cloneMatrix(shared->live, &snapshot->matrix) == SUCCESS)
+    {
+        MatrixSnapshot* old;
+        snapshot->version = ++shared->version;
+        old = atomic_exchange(&shared->current, snapshot);
+        if(old)
+        {
+            old->retiredAt = atomic_fetch_add(&readEpoch, 1) + 1;
+            old->nextRetired = shared->retired;
+            shared->retired = old;
+        }
+        shared->stale = FALSE;
+        reclaimSnapshots(shared);
+        sc = SUCCESS;
+    }
+    else if(snapshot)
+    {
+        freeSnapshot(snapshot);
+    }
+    return sc;
+}
+void lockWriter(SharedMatrix* shared)
+{
+#ifndef SM_NO_THREADS
+    pthread_mutex_lock(&shared->writer);
+#else
+    (void)shared;
+#endif
+}
+void unlockWriter(SharedMatrix* shared)
+{
+#ifndef SM_NO_THREADS
+    pthread_mutex_unlock(&shared->writer);
+#else
+    (void)shared;
+#endif
+}
+// writers: beginWrite returns the live matrix, with the writer lock held when
+// it is shared, and endWrite publishes it and releases the lock. Readers keep
+// the old snapshot throughout, so a burst of inserts is published once, as a
+// whole. The writer still calls matrixChanged for what it changes. NULL when
+// the name is free; endWrite is then not called.
+SparseMatrix* beginWrite(char name)
+{
+    int index = name - 'A';
+    SharedMatrix* shared = NULL;
+    SparseMatrix* matrix = NULL;
+    if(index >= 0 && index < MAX_MATRICES && registry[index].isOccupied)
+    {
+        shared = atomic_load(&registry[index].shared);
+        if(shared)
+        {
+            lockWriter(shared);
+        }
+        matrix = &registry[index].matrix;
+    }
+    return matrix;
+}
+status_code endWrite(char name)
+{
+    status_code sc = SUCCESS;
+    SharedMatrix* shared = atomic_load(&registry[name - 'A'].shared);
+    if(shared)
+    {
+        sc = publishSnapshot(shared);
+        unlockWriter(shared);
+    }
+    return sc;
+}
+status_code shareMatrix(char name)
+{
+    status_code sc = FAILURE;
+    int index = name - 'A';
+    SharedMatrix* shared = (SharedMatrix*)calloc(1, sizeof(SharedMatrix));
+    if(shared && registry[index].isOccupied && atomic_load(&registry[index].shared) == NULL)
+    {
+        shared->live = &registry[index].matrix;
+#ifndef SM_NO_THREADS
+        pthread_mutex_init(&shared->writer, NULL);
+#endif
+        sc = publishSnapshot(shared);
+    }
+    if(sc == SUCCESS)
+    {
+        atomic_store(&registry[index].shared, shared);
+    }
+    else
+    {
+        free(shared);
+    }
+    return sc;
+}
+void unshareMatrix(char name)// waits until no reader can still hold a snapshot
+{
+    SharedMatrix* shared = atomic_exchange(&registry[name - 'A'].shared, NULL);
+    if(shared)
+    {
+        lockWriter(shared);
+        waitForReaders();
+        reclaimSnapshots(shared);
+        freeSnapshot(atomic_load(&shared->current));
+        unlockWriter(shared);
+#ifndef SM_NO_THREADS
+        pthread_mutex_destroy(&shared->writer);
+#endif
+        free(shared);
+    }
+}
+// changes made outside beginWrite (menus, commands) are published afterwards
+void publishStaleMatrices(void)
+{
+    for(int i = 0; i < MAX_MATRICES; i++)
+    {
+        SharedMatrix* shared = atomic_load(&registry[i].shared);
+        if(shared && !registry[i].isOccupied)
+        {
+            unshareMatrix('A' + i);
+        }
+        else if(shared && shared->stale)
+        {
+            lockWriter(shared);
+            publishSnapshot(shared);
+            unlockWriter(shared);
+        }
+    }
+}
+// derived storage forms attached to registry matrices. They are copies, so
+// every path that modifies a registry matrix calls matrixChanged.
+NamedMatrix* registryEntry(const SparseMatrix* matrix)
+{
+    NamedMatrix* entry = NULL;
+    for(int i = 0; i < MAX_MATRICES; i++)
+    {
+        if(&registry[i].matrix == matrix)
+        {
+            entry = &registry[i];
+        }
+    }
+    return entry;
+}
+void dropBlockForm(NamedMatrix* entry)
+{
+    if(entry->blockForm)
+    {
+        freeBsrMatrix(entry->blockForm);
+        free(entry->blockForm);
+        entry->blockForm = NULL;
+    }
+}
+void dropSliceForm(NamedMatrix* entry)
+{
+    if(entry->sliceForm)
+    {
+        freeSellMatrix(entry->sliceForm);
+        free(entry->sliceForm);
+        entry->sliceForm = NULL;
+    }
+}
+void dropDerivedForms(NamedMatrix* entry)
+{
+    dropBlockForm(entry);
+    dropSliceForm(entry);
+}
+void matrixChanged(const SparseMatrix* matrix)
+{
+    NamedMatrix* entry = registryEntry(matrix);
+    if(entry)
+    {
+        SharedMatrix* shared = atomic_load(&entry->shared);
+        dropDerivedForms(entry);
+        if(shared)
+        {
+            shared->stale = TRUE;
+        }
+    }
+    for(int i = 0; i < MAX_MATRICES; i++)
+    {
+        MaintainedProduct* maintained = registry[i].maintained;
+        if(maintained && (maintained->left == matrix || maintained->right == matrix || maintained->product == matrix))
+        {
+            maintained->stale = TRUE;
+        }
+    }
+}
+// maintained products in the registry: every batch given to updateRegistryMatrix
+// refreshes the products that read the changed matrix
+void stopMaintaining(char name)
+{
+    NamedMatrix* entry = &registry[name - 'A'];
+    free(entry->maintained);
+    entry->maintained = NULL;
+}
+status_code maintainProduct(char name, SparseMatrix* left, SparseMatrix* right)
+{
+    status_code sc = FAILURE;
+    NamedMatrix* entry = &registry[name - 'A'];
+    MaintainedProduct* maintained = (MaintainedProduct*)malloc(sizeof(MaintainedProduct));
+
+    if(maintained)
+    {
+        if(!entry->isOccupied)
+        {
+            initializeMatrix(&entry->matrix);
+        }
+        sc = beginMaintainedProduct(maintained, left, right, &entry->matrix);
+    }
+    if(sc == SUCCESS)
+    {
+        stopMaintaining(name);
+        matrixChanged(&entry->matrix);
+        maintained->stale = FALSE;
+        entry->name = name;
+        entry->isOccupied = TRUE;
+        entry->maintained = maintained;
+    }
+    else
+    {
+        free(maintained);
+    }
+    return sc;
+}
+// products that were current are refreshed incrementally; those changed some
+// other way since their last refresh are recomputed in full
+status_code updateRegistryMatrix(SparseMatrix* matrix, const MatrixUpdate* updates, int count)
+{
+    status_code sc;
+    boolean current[MAX_MATRICES];
+
+    for(int i = 0; i < MAX_MATRICES; i++)
+    {
+        current[i] = registry[i].maintained && !registry[i].maintained->stale;
+    }
+    sc = applyUpdates(matrix, updates, count);
+    if(sc == SUCCESS)
+    {
+        matrixChanged(matrix);
+    }
+    for(int i = 0; sc == SUCCESS && i < MAX_MATRICES; i++)
+    {
+        MaintainedProduct* maintained = registry[i].maintained;
+        if(maintained && (maintained->left == matrix || maintained->right == matrix))
+        {
+            status_code refreshed = current[i] ? refreshMaintainedProduct(maintained, matrix, updates, count)
+                                               : recomputeMaintainedProduct(maintained);
+            matrixChanged(maintained->product);
+            maintained->stale = FALSE;
+            if(refreshed == FAILURE)
+            {
+                printf("Could not refresh %c, it is no longer maintained.\n", 'A' + i);
+                stopMaintaining('A' + i);
+            }
+        }
+    }
+    return sc;
+}
+// results of repeated commands, keyed on the operation with its options, the
+// operand names and the operand versions. Versions are never reused, so an
+// entry can only match unchanged operands and nothing has to be invalidated;
+// entries for old versions simply age out. The least recently used entry is
+// evicted once there are RESULT_CACHE_ENTRIES or RESULT_CACHE_BYTES of nodes.
+#define RESULT_CACHE_ENTRIES 16
+#define RESULT_CACHE_BYTES (64 * 1024 * 1024)
+
+typedef struct Cache_Entry_Tag
+{
+    char op[24];                    // e.g. "multiply hash", "determinant"
+    char names[2];                  // '\0' for the missing operand of a unary op
+    unsigned long versions[2];
+    boolean scalar;                 // the result is value rather than matrix
+    SparseMatrix matrix;
+    float value;
+    size_t bytes;
+    unsigned long lastUse;          // 0 marks a free entry
+} CacheEntry;
+
+typedef struct Result_Cache_Tag
+{
+    CacheEntry entries[RESULT_CACHE_ENTRIES];
+    unsigned long clock;
+    size_t bytes;
+    long hits, misses, evictions;
+} ResultCache;
+
+ResultCache resultCache;
+size_t resultCacheBudget = RESULT_CACHE_BYTES;// lowered by the self test to reach the byte bound cheaply
+
+boolean cacheKeyMatches(const CacheEntry* entry, const char* op, char name1, const SparseMatrix* m1, char name2, const SparseMatrix* m2)
+{
+    return entry->lastUse && strcmp(entry->op, op) == 0 && entry->names[0] == name1 && entry->names[1] == name2
+        && entry->versions[0] == m1->version && entry->versions[1] == (m2 ? m2->version : 0);
+}
+void evictCacheEntry(CacheEntry* entry)
+{
+    resultCache.bytes -= entry->bytes;
+    releaseMatrix(&entry->matrix);
+    entry->lastUse = 0;
+}
+// m2 is NULL for unary operations
+CacheEntry* lookupResult(const char* op, char name1, const SparseMatrix* m1, char name2, const SparseMatrix* m2)
+{
+    CacheEntry* found = NULL;
+    for(int i = 0; !found && i < RESULT_CACHE_ENTRIES; i++)
+    {
+        if(cacheKeyMatches(&resultCache.entries[i], op, name1, m1, name2, m2))
+        {
+            found = &resultCache.entries[i];
+            found->lastUse = ++resultCache.clock;
+        }
+    }
+    if(found)
+    {
+        resultCache.hits++;
+    }
+    else
+    {
+        resultCache.misses++;
+    }
+    return found;
+}
+// keeps a copy of result (or value when result is NULL); results too large for the cache are skipped
+void cacheResult(const char* op, char name1, const SparseMatrix* m1, char name2, const SparseMatrix* m2,
+                 const SparseMatrix* result, float value)
+{
+    size_t bytes = result ? (size_t)countElements(result) * sizeof(Sm_Node) : 0;
+    CacheEntry* slot = NULL;
+
+    if(bytes > resultCacheBudget)
+    {
+        return;
+    }
+    while(slot == NULL)
+    {
+        CacheEntry* oldest = NULL;
+        for(int i = 0; i < RESULT_CACHE_ENTRIES; i++)
+        {
+            CacheEntry* entry = &resultCache.entries[i];
+            if(entry->lastUse && (oldest == NULL || entry->lastUse < oldest->lastUse))
+            {
+                oldest = entry;
+            }
+            if(!entry->lastUse && !slot)
+            {
+                slot = entry;
+            }
+        }
+        if(slot == NULL || resultCache.bytes + bytes > resultCacheBudget)
+        {
+            evictCacheEntry(oldest);
+            resultCache.evictions++;
+            slot = NULL;
+        }
+    }
+    initializeMatrix(&slot->matrix);
+    if(result && cloneMatrix(result, &slot->matrix) == FAILURE)
+    {
+        releaseMatrix(&slot->matrix);
+        return;
+    }
+    snprintf(slot->op, sizeof(slot->op), "%s", op);
+    slot->names[0] = name1;
+    slot->names[1] = name2;
+    slot->versions[0] = m1->version;
+    slot->versions[1] = m2 ? m2->version : 0;
+    slot->scalar = (result == NULL);
+    slot->value = value;
+    slot->bytes = bytes;
+    slot->lastUse = ++resultCache.clock;
+    resultCache.bytes += bytes;
+}
+void clearResultCache(void)
+{
+    for(int i = 0; i < RESULT_CACHE_ENTRIES; i++)
+    {
+        if(resultCache.entries[i].lastUse)
+        {
+            evictCacheEntry(&resultCache.entries[i]);
+        }
+    }
+}
+void printCacheStats()
+{
+    int entries = 0;
+    for(int i = 0; i < RESULT_CACHE_ENTRIES; i++)
+    {
+        entries += (resultCache.entries[i].lastUse != 0);
+    }
+    printf("Result cache: %ld hits, %ld misses, %ld evictions, %d/%d entries, %.1f KB\n", resultCache.hits, resultCache.misses,
+           resultCache.evictions, entries, RESULT_CACHE_ENTRIES, resultCache.bytes / 1024.0);
+}
+// plans kept by "add A B plan" and "multiply A B plan", one per operation and
+// pair of operand names. A repeat whose operands kept their patterns only runs
+// the numeric phase; a changed pattern is planned again.
+typedef struct Plan_Slot_Tag
+{
+    MultiplyPlan multiply;
+    AddPlan add;
+    boolean hasMultiply, hasAdd;
+} PlanSlot;
+
+PlanSlot planSlots[MAX_MATRICES][MAX_MATRICES];
+
+status_code plannedOperation(boolean multiply, char name1, SparseMatrix* matrix1, char name2, SparseMatrix* matrix2,
+                             SparseMatrix* result)
+{
+    PlanSlot* slot = &planSlots[name1 - 'A'][name2 - 'A'];
+    boolean* ready = multiply ? &slot->hasMultiply : &slot->hasAdd;
+    status_code sc = FAILURE;
+
+    initializeMatrix(result);
+    if(*ready)
+    {
+        sc = multiply ? numericMultiply(matrix1, matrix2, &slot->multiply) : numericAdd(matrix1, matrix2, &slot->add);
+        if(sc == FAILURE)
+        {
+            printf("Operand pattern changed, planning again.\n");
+            if(multiply)
+            {
+                freeMultiplyPlan(&slot->multiply);
+            }
+            else
+            {
+                freeAddPlan(&slot->add);
+            }
+            *ready = FALSE;
+        }
+    }
+    if(!*ready)
+    {
+        sc = multiply ? symbolicMultiply(matrix1, matrix2, &slot->multiply) : symbolicAdd(matrix1, matrix2, &slot->add);
+        *ready = (sc == SUCCESS);
+        if(sc == SUCCESS)
+        {
+            sc = multiply ? numericMultiply(matrix1, matrix2, &slot->multiply) : numericAdd(matrix1, matrix2, &slot->add);
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        sc = cloneMatrix(multiply ? &slot->multiply.result : &slot->add.result, result);
+    }
+    return sc;
+}
+void freePlans(void)
+{
+    for(int i = 0; i < MAX_MATRICES; i++)
+    {
+        for(int j = 0; j < MAX_MATRICES; j++)
+        {
+            if(planSlots[i][j].hasMultiply)
+            {
+                freeMultiplyPlan(&planSlots[i][j].multiply);
+            }
+            if(planSlots[i][j].hasAdd)
+            {
+                freeAddPlan(&planSlots[i][j].add);
+            }
+            planSlots[i][j].hasMultiply = planSlots[i][j].hasAdd = FALSE;
+        }
+    }
+}
+status_code attachBlockForm(const SparseMatrix* matrix, int blockSize)
+{
+    status_code sc = FAILURE;
+    NamedMatrix* entry = registryEntry(matrix);
+    BsrMatrix* bsr = (BsrMatrix*)malloc(sizeof(BsrMatrix));
+    if(entry && bsr && sparseMatrixToBsr(matrix, blockSize, bsr) == SUCCESS)
+    {
+        dropBlockForm(entry);
+        entry->blockForm = bsr;
+        sc = SUCCESS;
+    }
+    else
+    {
+        free(bsr);
+    }
+    return sc;
+}
+const BsrMatrix* blockFormOf(const SparseMatrix* matrix)
+{
+    NamedMatrix* entry = registryEntry(matrix);
+    return entry ? entry->blockForm : NULL;
+}
+boolean sameBlockForms(const SparseMatrix* matrix1, const SparseMatrix* matrix2)
+{
+    const BsrMatrix *b1 = blockFormOf(matrix1), *b2 = blockFormOf(matrix2);
+    return (b1 && b2 && b1->blockSize == b2->blockSize) ? TRUE : FALSE;
+}
+status_code blockOperation(const SparseMatrix* matrix1, const SparseMatrix* matrix2, boolean multiply, SparseMatrix* result)
+{
+    BsrMatrix c;
+    status_code sc = multiply ? bsrMultiply(blockFormOf(matrix1), blockFormOf(matrix2), &c)
+                              : bsrAdd(blockFormOf(matrix1), blockFormOf(matrix2), &c);
+    initializeMatrix(result);
+    if(sc == SUCCESS)
+    {
+        sc = bsrToSparseMatrix(&c, result);
+        freeBsrMatrix(&c);
+    }
+    return sc;
+}
+status_code attachSliceForm(const SparseMatrix* matrix, int chunkSize, int sigma)
+{
+    status_code sc = FAILURE;
+    NamedMatrix* entry = registryEntry(matrix);
+    SellMatrix* sell = (SellMatrix*)malloc(sizeof(SellMatrix));
+    if(entry && sell && sparseMatrixToSell(matrix, chunkSize, sigma, sell) == SUCCESS)
+    {
+        dropSliceForm(entry);
+        entry->sliceForm = sell;
+        sc = SUCCESS;
+    }
+    else
+    {
+        free(sell);
+    }
+    return sc;
+}
+const SellMatrix* sliceFormOf(const SparseMatrix* matrix)
+{
+    NamedMatrix* entry = registryEntry(matrix);
+    return entry ? entry->sliceForm : NULL;
+}
+LinearOperator matrixOperator(const SparseMatrix* matrix)// the fastest attached form for y = A x
+{
+    if(sliceFormOf(matrix))
+    {
+        return sellOperator(sliceFormOf(matrix));
+    }
+    if(blockFormOf(matrix))
+    {
+        return bsrOperator(blockFormOf(matrix));
+    }
+    return sparseMatrixOperator(matrix);
+}
+// hypersparse (doubly compressed) rows. Indices are 64 bit and only the
+// non-empty rows are stored: rowIds lists them in increasing order and row
+// rowIds[r] owns entries rowPtr[r] .. rowPtr[r+1]. No array is sized by the
+// dimensions, so memory and time follow nnz even for 2^40 x 2^40 graphs.
+typedef int64_t sm_index;
+
+typedef struct Dcsr_Matrix_Tag
+{
+    sm_index rowCount, colCount;
+    int64_t rowsStored, nnz;
+    int64_t rowCapacity, entryCapacity;
+    sm_index* rowIds;
+    int64_t* rowPtr;
+    sm_index* colIdx;
+    double* values;
+} DcsrMatrix;
+
+typedef struct Triplet_Tag
+{
+    sm_index row, col;
+    double value;
+} Triplet;
+
+void freeDcsrMatrix(DcsrMatrix* dcsr)
+{
+    free(dcsr->rowIds);
+    free(dcsr->rowPtr);
+    free(dcsr->colIdx);
+    free(dcsr->values);
+    memset(dcsr, 0, sizeof(DcsrMatrix));
+}
+status_code beginDcsrMatrix(DcsrMatrix* dcsr, sm_index rows, sm_index cols)
+{
+    memset(dcsr, 0, sizeof(DcsrMatrix));
+    dcsr->rowCount = rows;
+    dcsr->colCount = cols;
+    dcsr->rowCapacity = dcsr->entryCapacity = 16;
+    dcsr->rowIds = (sm_index*)malloc(dcsr->rowCapacity * sizeof(sm_index));
+    dcsr->rowPtr = (int64_t*)calloc(dcsr->rowCapacity + 1, sizeof(int64_t));
+    dcsr->colIdx = (sm_index*)malloc(dcsr->entryCapacity * sizeof(sm_index));
+    dcsr->values = (double*)malloc(dcsr->entryCapacity * sizeof(double));
+    if(!dcsr->rowIds || !dcsr->rowPtr || !dcsr->colIdx || !dcsr->values)
+    {
+        freeDcsrMatrix(dcsr);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+// rows must arrive in increasing order and columns in increasing order within a row
+status_code appendDcsrEntry(DcsrMatrix* dcsr, sm_index row, sm_index col, double value)
+{
+    if(dcsr->rowsStored == 0 || dcsr->rowIds[dcsr->rowsStored - 1] != row)
+    {
+        if(dcsr->rowsStored == dcsr->rowCapacity)
+        {
+            sm_index* ids = (sm_index*)realloc(dcsr->rowIds, 2 * dcsr->rowCapacity * sizeof(sm_index));
+            int64_t* ptr = ids ? (int64_t*)realloc(dcsr->rowPtr, (2 * dcsr->rowCapacity + 1) * sizeof(int64_t)) : NULL;
+            if(ids)
+            {
+                dcsr->rowIds = ids;
+            }
+            if(!ptr)
+            {
+                return FAILURE;
+            }
+            dcsr->rowPtr = ptr;
+            dcsr->rowCapacity *= 2;
+        }
+        dcsr->rowIds[dcsr->rowsStored++] = row;
+        dcsr->rowPtr[dcsr->rowsStored] = dcsr->nnz;
+    }
+    if(dcsr->nnz == dcsr->entryCapacity)
+    {
+        sm_index* cols = (sm_index*)realloc(dcsr->colIdx, 2 * dcsr->entryCapacity * sizeof(sm_index));
+        double* values = cols ? (double*)realloc(dcsr->values, 2 * dcsr->entryCapacity * sizeof(double)) : NULL;
+        if(cols)
+        {
+            dcsr->colIdx = cols;
+        }
+        if(!values)
+        {
+            return FAILURE;
+        }
+        dcsr->values = values;
+        dcsr->entryCapacity *= 2;
+    }
+    dcsr->colIdx[dcsr->nnz] = col;
+    dcsr->values[dcsr->nnz++] = value;
+    dcsr->rowPtr[dcsr->rowsStored] = dcsr->nnz;
+    return SUCCESS;
+}
+size_t dcsrBytes(const DcsrMatrix* dcsr)
+{
+    return sizeof(DcsrMatrix) + dcsr->rowsStored * (sizeof(sm_index) + sizeof(int64_t)) + sizeof(int64_t)
+        + dcsr->nnz * (sizeof(sm_index) + sizeof(double));
+}
+int compareTriplets(const void* a, const void* b)
+{
+    const Triplet *x = (const Triplet*)a, *y = (const Triplet*)b;
+    if(x->row != y->row)
+    {
+        return (x->row > y->row) - (x->row < y->row);
+    }
+    return (x->col > y->col) - (x->col < y->col);
+}
+// sorts the triplets in place, duplicates are summed
+status_code dcsrFromTriplets(sm_index rows, sm_index cols, Triplet* triplets, int64_t count, DcsrMatrix* result)
+{
+    status_code sc = beginDcsrMatrix(result, rows, cols);
+    for(int64_t t = 0; sc == SUCCESS && t < count; t++)
+    {
+        if(triplets[t].row < 0 || triplets[t].row >= rows || triplets[t].col < 0 || triplets[t].col >= cols)
+        {
+            printf("Entry (%lld, %lld) is outside the %lld x %lld matrix.\n", (long long)triplets[t].row,
+                (long long)triplets[t].col, (long long)rows, (long long)cols);
+            sc = FAILURE;
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        qsort(triplets, count, sizeof(Triplet), compareTriplets);
+    }
+    for(int64_t t = 0; sc == SUCCESS && t < count; t++)
+    {
+        if(t > 0 && triplets[t].row == triplets[t-1].row && triplets[t].col == triplets[t-1].col)
+        {
+            result->values[result->nnz - 1] += triplets[t].value;
+        }
+        else
+        {
+            sc = appendDcsrEntry(result, triplets[t].row, triplets[t].col, triplets[t].value);
+        }
+    }
+    if(sc == FAILURE)
+    {
+        freeDcsrMatrix(result);
+    }
+    return sc;
+}
+// walks the stored rows only. A symmetric matrix keeps the part of row i right
+// of the diagonal as column i below it, so its column headers are merged in:
+// a row whose entries are all mirrored has a column header but no row header.
+status_code sparseMatrixToDcsr(const SparseMatrix* matrix, DcsrMatrix* dcsr)
+{
+    status_code sc = beginDcsrMatrix(dcsr, matrix->rowCount, matrix->colCount);
+    Row_Node* rowPos = matrix->rowHead;
+    Col_Node* colPos = matrix->symmetric ? matrix->colHead : NULL;
+    while(sc == SUCCESS && (rowPos || colPos))
+    {
+        int i = (!colPos || (rowPos && rowPos->row <= colPos->col)) ? rowPos->row : colPos->col;
+        if(rowPos && rowPos->row == i)
+        {
+            for(Sm_Node* e = rowPos->rowlist; sc == SUCCESS && e; e = e->right)
+            {
+                sc = appendDcsrEntry(dcsr, i, e->col, e->data);
+            }
+            rowPos = rowPos->next;
+        }
+        if(colPos && colPos->col == i)
+        {
+            for(Sm_Node* e = colPos->collist; sc == SUCCESS && e; e = e->down)
+            {
+                sc = (e->row != i) ? appendDcsrEntry(dcsr, i, e->row, e->data) : SUCCESS;
+            }
+            colPos = colPos->next;
+        }
+    }
+    if(sc == FAILURE)
+    {
+        freeDcsrMatrix(dcsr);
+    }
+    return sc;
+}
+status_code dcsrToSparseMatrix(const DcsrMatrix* dcsr, SparseMatrix* result)
+{
+    MatrixBuilder builder;
+    status_code sc = FAILURE;
+    if(dcsr->rowCount > INT_MAX || dcsr->colCount > INT_MAX)
+    {
+        printf("A %lld x %lld matrix does not fit the linked list storage.\n", (long long)dcsr->rowCount, (long long)dcsr->colCount);
+        initializeMatrix(result);
+    }
+    else if(beginMatrixBuilder(&builder, result, (int)dcsr->rowCount, (int)dcsr->colCount) == SUCCESS)
+    {
+        sc = SUCCESS;
+        for(int64_t r = 0; sc == SUCCESS && r < dcsr->rowsStored; r++)
+        {
+            for(int64_t k = dcsr->rowPtr[r]; sc == SUCCESS && k < dcsr->rowPtr[r+1]; k++)
+            {
+                sc = appendElement(&builder, (int)dcsr->rowIds[r], (int)dcsr->colIdx[k], (matrix_entry)dcsr->values[k]);
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    return sc;
+}
+int64_t findDcsrRow(const DcsrMatrix* dcsr, sm_index row)// position of row in rowIds, -1 if it is empty
+{
+    int64_t low = 0, high = dcsr->rowsStored - 1, found = -1;
+    while(found < 0 && low <= high)
+    {
+        int64_t mid = low + (high - low) / 2;
+        if(dcsr->rowIds[mid] == row)
+        {
+            found = mid;
+        }
+        else if(dcsr->rowIds[mid] < row)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid - 1;
+        }
+    }
+    return found;
+}
+status_code dcsrAdd(const DcsrMatrix* a, const DcsrMatrix* b, DcsrMatrix* c)// merges the stored rows, then their columns
+{
+    int64_t ra = 0, rb = 0;
+    status_code sc = (a->rowCount == b->rowCount && a->colCount == b->colCount) ? SUCCESS : FAILURE;
+    memset(c, 0, sizeof(DcsrMatrix));
+    if(sc == FAILURE)
+    {
+        printf("Matrices have different dimensions, cannot add.\n");
+    }
+    else
+    {
+        sc = beginDcsrMatrix(c, a->rowCount, a->colCount);
+    }
+    while(sc == SUCCESS && (ra < a->rowsStored || rb < b->rowsStored))
+    {
+        sm_index row = (rb == b->rowsStored || (ra < a->rowsStored && a->rowIds[ra] < b->rowIds[rb])) ? a->rowIds[ra] : b->rowIds[rb];
+        int64_t ka = 0, ea = 0, kb = 0, eb = 0;
+        if(ra < a->rowsStored && a->rowIds[ra] == row)
+        {
+            ka = a->rowPtr[ra];
+            ea = a->rowPtr[++ra];
+        }
+        if(rb < b->rowsStored && b->rowIds[rb] == row)
+        {
+            kb = b->rowPtr[rb];
+            eb = b->rowPtr[++rb];
+        }
+        while(sc == SUCCESS && (ka < ea || kb < eb))
+        {
+            if(kb == eb || (ka < ea && a->colIdx[ka] < b->colIdx[kb]))
+            {
+                sc = appendDcsrEntry(c, row, a->colIdx[ka], a->values[ka]);
+                ka++;
+            }
+            else if(ka == ea || b->colIdx[kb] < a->colIdx[ka])
+            {
+                sc = appendDcsrEntry(c, row, b->colIdx[kb], b->values[kb]);
+                kb++;
+            }
+            else
+            {
+                sc = appendDcsrEntry(c, row, a->colIdx[ka], a->values[ka] + b->values[kb]);
+                ka++;
+                kb++;
+            }
+        }
+    }
+    if(sc == FAILURE)
+    {
+        freeDcsrMatrix(c);
+    }
+    return sc;
+}
+// open addressing on 64 bit column indexes, the hypersparse counterpart of
+// HashAccumulator: no dense accumulator can be sized by a 2^40 column count
+typedef struct Wide_Accumulator_Tag
+{
+    int64_t capacity, count;   // capacity is a power of two
+    sm_index* keys;            // -1 marks an empty slot
+    double* values;
+    int64_t* slots;            // slots filled since the last reset
+} WideAccumulator;
+
+status_code initializeWideAccumulator(WideAccumulator* acc, int64_t entries)
+{
+    acc->capacity = 16;
+    while(acc->capacity < 2 * entries)
+    {
+        acc->capacity <<= 1;
+    }
+    acc->count = 0;
+    acc->keys = (sm_index*)malloc(acc->capacity * sizeof(sm_index));
+    acc->values = (double*)malloc(acc->capacity * sizeof(double));
+    acc->slots = (int64_t*)malloc(acc->capacity * sizeof(int64_t));
+    if(acc->keys)
+    {
+        memset(acc->keys, -1, acc->capacity * sizeof(sm_index));
+    }
+    return (acc->keys && acc->values && acc->slots) ? SUCCESS : FAILURE;
+}
+int64_t wideSlot(const WideAccumulator* acc, sm_index key)// linear probing, stops at the key or an empty slot
+{
+    int64_t slot = (int64_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 17) & (acc->capacity - 1);
+    while(acc->keys[slot] != -1 && acc->keys[slot] != key)
+    {
+        slot = (slot + 1) & (acc->capacity - 1);
+    }
+    return slot;
+}
+void wideAccumulate(WideAccumulator* acc, sm_index key, double value)
+{
+    int64_t slot = wideSlot(acc, key);
+    if(acc->keys[slot] == -1)
+    {
+        acc->keys[slot] = key;
+        acc->values[slot] = value;
+        acc->slots[acc->count++] = slot;
+    }
+    else
+    {
+        acc->values[slot] += value;
+    }
+}
+void freeWideAccumulator(WideAccumulator* acc)
+{
+    free(acc->keys);
+    free(acc->values);
+    free(acc->slots);
+}
+int compareWideIndexes(const void* a, const void* b)
+{
+    sm_index x = *(const sm_index*)a, y = *(const sm_index*)b;
+    return (x > y) - (x < y);
+}
+// Gustavson over the stored rows of A. Each entry (i, k) of A is matched
+// once to row k of B by binary search on B's row ids; rows of A with no
+// match produce nothing and cost nothing beyond that lookup.
+status_code dcsrMultiply(const DcsrMatrix* a, const DcsrMatrix* b, DcsrMatrix* c)
+{
+    WideAccumulator acc;
+    int64_t maxFlops = 0;
+    int64_t* match = (int64_t*)malloc((a->nnz + 1) * sizeof(int64_t));
+    sm_index* keys = NULL;
+    status_code sc = (a->colCount == b->rowCount) ? SUCCESS : FAILURE;
+
+    memset(c, 0, sizeof(DcsrMatrix));
+    memset(&acc, 0, sizeof(WideAccumulator));
+    if(sc == FAILURE)
+    {
+        printf("Matrices have incompatible dimensions, cannot multiply.\n");
+    }
+    sc = match ? sc : FAILURE;
+    for(int64_t r = 0; sc == SUCCESS && r < a->rowsStored; r++)
+    {
+        int64_t flops = 0;
+        for(int64_t k = a->rowPtr[r]; k < a->rowPtr[r+1]; k++)
+        {
+            match[k] = findDcsrRow(b, a->colIdx[k]);
+            flops += (match[k] >= 0) ? b->rowPtr[match[k] + 1] - b->rowPtr[match[k]] : 0;
+        }
+        maxFlops = (flops > maxFlops) ? flops : maxFlops;
+    }
+    if(sc == SUCCESS)
+    {
+        sc = initializeWideAccumulator(&acc, maxFlops);
+        keys = (sm_index*)malloc((maxFlops + 1) * sizeof(sm_index));
+        sc = keys ? sc : FAILURE;
+    }
+    if(sc == SUCCESS)
+    {
+        sc = beginDcsrMatrix(c, a->rowCount, b->colCount);
+    }
+    for(int64_t r = 0; sc == SUCCESS && r < a->rowsStored; r++)
+    {
+        for(int64_t k = a->rowPtr[r]; k < a->rowPtr[r+1]; k++)
+        {
+            for(int64_t p = (match[k] >= 0) ? b->rowPtr[match[k]] : 0; match[k] >= 0 && p < b->rowPtr[match[k] + 1]; p++)
+            {
+                wideAccumulate(&acc, b->colIdx[p], a->values[k] * b->values[p]);
+            }
+        }
+        for(int64_t t = 0; t < acc.count; t++)
+        {
+            keys[t] = acc.keys[acc.slots[t]];
+        }
+        qsort(keys, acc.count, sizeof(sm_index), compareWideIndexes);
+        for(int64_t t = 0; sc == SUCCESS && t < acc.count; t++)
+        {
+            sc = appendDcsrEntry(c, a->rowIds[r], keys[t], acc.values[wideSlot(&acc, keys[t])]);
+        }
+        for(int64_t t = 0; t < acc.count; t++)
+        {
+            acc.keys[acc.slots[t]] = -1;
+        }
+        acc.count = 0;
+    }
+    freeWideAccumulator(&acc);
+    free(keys);
+    free(match);
+    if(sc == FAILURE)
+    {
+        freeDcsrMatrix(c);
+    }
+    return sc;
+}
+// add and multiply for list operands that store few of their rows: only the
+// stored rows are converted, and no accumulator is sized by the column count
+#define HYPERSPARSE_RATIO 16   // auto multiply uses DCSR when fewer than 1 in 16 rows are stored
+
+boolean isHypersparse(const SparseMatrix* matrix)
+{
+    long stored = 0;
+    for(Row_Node* rptr = matrix->rowHead; rptr && stored * HYPERSPARSE_RATIO < matrix->rowCount; rptr = rptr->next)
+    {
+        stored++;
+    }
+    for(Col_Node* cptr = matrix->symmetric ? matrix->colHead : NULL; cptr && stored * HYPERSPARSE_RATIO < matrix->rowCount; cptr = cptr->next)
+    {
+        stored++;// mirrored rows, counted twice at worst
+    }
+    return (stored * HYPERSPARSE_RATIO < matrix->rowCount) ? TRUE : FALSE;
+}
+status_code hypersparseOperation(const SparseMatrix* matrix1, const SparseMatrix* matrix2, boolean multiply, SparseMatrix* result)
+{
+    DcsrMatrix a, b, c;
+    status_code sc = sparseMatrixToDcsr(matrix1, &a);
+    initializeMatrix(result);
+    if(sc == SUCCESS)
+    {
+        sc = sparseMatrixToDcsr(matrix2, &b);
+        if(sc == SUCCESS)
+        {
+            sc = multiply ? dcsrMultiply(&a, &b, &c) : dcsrAdd(&a, &b, &c);
+            if(sc == SUCCESS)
+            {
+                sc = dcsrToSparseMatrix(&c, result);
+                freeDcsrMatrix(&c);
+            }
+            freeDcsrMatrix(&b);
+        }
+        freeDcsrMatrix(&a);
+    }
+    return sc;
+}
+// coordinate files with 64 bit indexes: "rows cols" on the first line, then
+// one "row col value" per line. They carry shapes the linked lists cannot.
+status_code readCoordinateFile(const char* path, DcsrMatrix* dcsr)
+{
+    FILE* fp = fopen(path, "r");
+    long long rows, cols, row, col;
+    double value;
+    Triplet* triplets = NULL;
+    int64_t count = 0, capacity = 0;
+    status_code sc = (fp && fscanf(fp, "%lld %lld", &rows, &cols) == 2 && rows > 0 && cols > 0) ? SUCCESS : FAILURE;
+
+    memset(dcsr, 0, sizeof(DcsrMatrix));
+    while(sc == SUCCESS && fscanf(fp, "%lld %lld %lf", &row, &col, &value) == 3)
+    {
+        if(count == capacity)
+        {
+            Triplet* grown = (Triplet*)realloc(triplets, (capacity ? 2 * capacity : 1024) * sizeof(Triplet));
+            sc = grown ? SUCCESS : FAILURE;
+            triplets = grown ? grown : triplets;
+            capacity = grown ? (capacity ? 2 * capacity : 1024) : capacity;
+        }
+        if(sc == SUCCESS)
+        {
+            triplets[count].row = row;
+            triplets[count].col = col;
+            triplets[count++].value = value;
+        }
+    }
+    if(sc == SUCCESS && !feof(fp))
+    {
+        printf("%s: expected row col value after entry %lld.\n", path, (long long)count);
+        sc = FAILURE;
+    }
+    if(sc == SUCCESS)
+    {
+        sc = dcsrFromTriplets(rows, cols, triplets, count, dcsr);
+    }
+    else
+    {
+        printf("Cannot read %s as a coordinate file.\n", path);
+    }
+    if(fp)
+    {
+        fclose(fp);
+    }
+    free(triplets);
+    return sc;
+}
+status_code writeCoordinateFile(const char* path, const DcsrMatrix* dcsr)
+{
+    FILE* fp = fopen(path, "w");
+    status_code sc = (fp && fprintf(fp, "%lld %lld\n", (long long)dcsr->rowCount, (long long)dcsr->colCount) > 0) ? SUCCESS : FAILURE;
+    for(int64_t r = 0; sc == SUCCESS && r < dcsr->rowsStored; r++)
+    {
+        for(int64_t k = dcsr->rowPtr[r]; sc == SUCCESS && k < dcsr->rowPtr[r+1]; k++)
+        {
+            sc = (fprintf(fp, "%lld %lld %.17g\n", (long long)dcsr->rowIds[r], (long long)dcsr->colIdx[k], dcsr->values[k]) > 0)
+                 ? SUCCESS : FAILURE;
+        }
+    }
+    if(fp && fclose(fp) != 0)
+    {
+        sc = FAILURE;
+    }
+    return sc;
+}
+// out-of-core storage. A chunked file holds a matrix as a grid of tiles, each
+// a compressed row block with global column indexes, followed by an index of
+// tile offsets and nonzero counts. Streaming operations keep a few groups of
+// tiles in memory, sized from a byte budget, and read the next group on a
+// helper thread while the current one is multiplied or added.
+#define CHUNK_MAGIC "SMC1"
+#define DEFAULT_CHUNK_TILE 1024
+#define DEFAULT_STREAM_BUDGET (64 * 1024 * 1024)
+
+#ifdef _WIN32
+#define seekFile _fseeki64
+#define tellFile _ftelli64
+#else
+#define seekFile fseeko
+#define tellFile ftello
+#endif
+
+typedef struct Chunked_File_Tag
+{
+    FILE* fp;
+    boolean writing;
+    int rowCount, colCount;
+    int tileRows, tileCols;     // grid shape
+    int* rowBounds;             // tile row ti covers rows rowBounds[ti] .. rowBounds[ti+1]
+    int* colBounds;
+    int64_t* offsets;           // tile (ti, tj) is entry ti * tileCols + tj
+    int64_t* counts;
+    int written;                // tiles are written in row major order
+    int64_t bytesRead;
+} ChunkedFile;
+
+typedef struct Stream_Stats_Tag
+{
+    int tiles;
+    int64_t nnz, bytesRead;
+    size_t peakBytes;           // largest total of the blocks held at once
+} StreamStats;
+
+size_t csrBytes(const CsrMatrix* csr)
+{
+    return (csr->rowCount + 1) * sizeof(int) + (size_t)csr->rowPtr[csr->rowCount] * (sizeof(int) + sizeof(double));
+}
+status_code allocateChunkIndex(ChunkedFile* file)
+{
+    size_t tiles = (size_t)file->tileRows * file->tileCols;
+    file->rowBounds = (int*)malloc((file->tileRows + 1) * sizeof(int));
+    file->colBounds = (int*)malloc((file->tileCols + 1) * sizeof(int));
+    file->offsets = (int64_t*)calloc(tiles + 1, sizeof(int64_t));
+    file->counts = (int64_t*)calloc(tiles + 1, sizeof(int64_t));
+    return (file->rowBounds && file->colBounds && file->offsets && file->counts) ? SUCCESS : FAILURE;
+}
+status_code writeChunkHeader(ChunkedFile* file, int64_t indexOffset)
+{
+    int shape[4] = {file->rowCount, file->colCount, file->tileRows, file->tileCols};
+    boolean ok = seekFile(file->fp, 0, SEEK_SET) == 0 && fwrite(CHUNK_MAGIC, 1, 4, file->fp) == 4
+        && fwrite(shape, sizeof(int), 4, file->fp) == 4 && fwrite(&indexOffset, sizeof(int64_t), 1, file->fp) == 1;
+    return ok ? SUCCESS : FAILURE;
+}
+// a file being written gets its index and final header here
+status_code closeChunkedFile(ChunkedFile* file)
+{
+    status_code sc = SUCCESS;
+    if(file->fp && file->writing)
+    {
+        size_t tiles = (size_t)file->tileRows * file->tileCols;
+        int64_t indexOffset;
+        seekFile(file->fp, 0, SEEK_END);
+        indexOffset = tellFile(file->fp);
+        if(file->written != (int)tiles
+            || fwrite(file->rowBounds, sizeof(int), file->tileRows + 1, file->fp) != (size_t)file->tileRows + 1
+            || fwrite(file->colBounds, sizeof(int), file->tileCols + 1, file->fp) != (size_t)file->tileCols + 1
+            || fwrite(file->offsets, sizeof(int64_t), tiles, file->fp) != tiles
+            || fwrite(file->counts, sizeof(int64_t), tiles, file->fp) != tiles
+            || writeChunkHeader(file, indexOffset) == FAILURE)
+        {
+            sc = FAILURE;
+        }
+    }
+    if(file->fp && fclose(file->fp) != 0)
+    {
+        sc = FAILURE;
+    }
+    free(file->rowBounds);
+    free(file->colBounds);
+    free(file->offsets);
+    free(file->counts);
+    memset(file, 0, sizeof(ChunkedFile));
+    return sc;
+}
+status_code createChunkedFile(ChunkedFile* file, const char* path, int rows, int cols,
+    const int* rowBounds, int tileRows, const int* colBounds, int tileCols)
+{
+    status_code sc;
+    memset(file, 0, sizeof(ChunkedFile));
+    file->writing = TRUE;
+    file->rowCount = rows;
+    file->colCount = cols;
+    file->tileRows = tileRows;
+    file->tileCols = tileCols;
+    sc = allocateChunkIndex(file);
+    if(sc == SUCCESS)
+    {
+        memcpy(file->rowBounds, rowBounds, (tileRows + 1) * sizeof(int));
+        memcpy(file->colBounds, colBounds, (tileCols + 1) * sizeof(int));
+        file->fp = fopen(path, "w+b");
+        sc = (file->fp && writeChunkHeader(file, 0) == SUCCESS) ? SUCCESS : FAILURE;
+    }
+    if(sc == FAILURE)
+    {
+        printf("Cannot create %s.\n", path);
+        file->writing = FALSE;
+        closeChunkedFile(file);
+    }
+    return sc;
+}
+status_code writeTile(ChunkedFile* file, const CsrMatrix* tile)// next tile in row major order
+{
+    int nnz = tile->rowPtr[tile->rowCount];
+    int t = file->written;
+    boolean ok = t < file->tileRows * file->tileCols
+        && tile->rowCount == file->rowBounds[t / file->tileCols + 1] - file->rowBounds[t / file->tileCols];
+    if(ok)
+    {
+        seekFile(file->fp, 0, SEEK_END);
+        file->offsets[t] = tellFile(file->fp);
+        file->counts[t] = nnz;
+        ok = fwrite(tile->rowPtr, sizeof(int), tile->rowCount + 1, file->fp) == (size_t)tile->rowCount + 1
+            && fwrite(tile->colIdx, sizeof(int), nnz, file->fp) == (size_t)nnz
+            && fwrite(tile->values, sizeof(double), nnz, file->fp) == (size_t)nnz;
+        file->written++;
+    }
+    return ok ? SUCCESS : FAILURE;
+}
+status_code openChunkedFile(ChunkedFile* file, const char* path)
+{
+    char magic[4];
+    int shape[4];
+    int64_t indexOffset;
+    size_t tiles;
+    status_code sc = FAILURE;
+
+    memset(file, 0, sizeof(ChunkedFile));
+    file->fp = fopen(path, "rb");
+    if(file->fp && fread(magic, 1, 4, file->fp) == 4 && memcmp(magic, CHUNK_MAGIC, 4) == 0
+        && fread(shape, sizeof(int), 4, file->fp) == 4 && fread(&indexOffset, sizeof(int64_t), 1, file->fp) == 1
+        && indexOffset > 0)
+    {
+        file->rowCount = shape[0];
+        file->colCount = shape[1];
+        file->tileRows = shape[2];
+        file->tileCols = shape[3];
+        tiles = (size_t)file->tileRows * file->tileCols;
+        if(allocateChunkIndex(file) == SUCCESS && seekFile(file->fp, indexOffset, SEEK_SET) == 0
+            && fread(file->rowBounds, sizeof(int), file->tileRows + 1, file->fp) == (size_t)file->tileRows + 1
+            && fread(file->colBounds, sizeof(int), file->tileCols + 1, file->fp) == (size_t)file->tileCols + 1
+            && fread(file->offsets, sizeof(int64_t), tiles, file->fp) == tiles
+            && fread(file->counts, sizeof(int64_t), tiles, file->fp) == tiles)
+        {
+            sc = SUCCESS;
+        }
+    }
+    if(sc == FAILURE)
+    {
+        printf("%s is not a chunked matrix file.\n", path);
+        closeChunkedFile(file);
+    }
+    return sc;
+}
+status_code readTile(ChunkedFile* file, int ti, int tj, CsrMatrix* tile)
+{
+    int rows = file->rowBounds[ti+1] - file->rowBounds[ti];
+    int64_t t = (int64_t)ti * file->tileCols + tj;
+    int nnz = (int)file->counts[t];
+    status_code sc = allocateCsrMatrix(tile, rows, file->colCount, nnz);
+    if(sc == SUCCESS && (seekFile(file->fp, file->offsets[t], SEEK_SET) != 0
+        || fread(tile->rowPtr, sizeof(int), rows + 1, file->fp) != (size_t)rows + 1
+        || fread(tile->colIdx, sizeof(int), nnz, file->fp) != (size_t)nnz
+        || fread(tile->values, sizeof(double), nnz, file->fp) != (size_t)nnz))
+    {
+        sc = FAILURE;
+    }
+    file->bytesRead += (rows + 1) * sizeof(int) + (int64_t)nnz * (sizeof(int) + sizeof(double));
+    if(sc == FAILURE)
+    {
+        freeCsrMatrix(tile);
+    }
+    return sc;
+}
+// rows r0 .. r1 and columns c0 .. c1 as a compressed row block with global
+// column indexes. The tiles that overlap the block are read one tile row at a
+// time, and the index counts give an upper bound on the block's nonzeros.
+status_code loadBlock(ChunkedFile* file, int r0, int r1, int c0, int c1, CsrMatrix* block)
+{
+    int64_t bound = 0;
+    int k = 0;
+    CsrMatrix* tiles = (CsrMatrix*)calloc(file->tileCols + 1, sizeof(CsrMatrix));
+    status_code sc = tiles ? SUCCESS : FAILURE;
+
+    memset(block, 0, sizeof(CsrMatrix));
+    for(int ti = 0; ti < file->tileRows; ti++)
+    {
+        for(int tj = 0; tj < file->tileCols; tj++)
+        {
+            if(file->rowBounds[ti] < r1 && file->rowBounds[ti+1] > r0 && file->colBounds[tj] < c1 && file->colBounds[tj+1] > c0)
+            {
+                bound += file->counts[(int64_t)ti * file->tileCols + tj];
+            }
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        sc = allocateCsrMatrix(block, r1 - r0, file->colCount, (int)bound);
+    }
+    for(int ti = 0; sc == SUCCESS && ti < file->tileRows; ti++)
+    {
+        int first = (file->rowBounds[ti] > r0) ? file->rowBounds[ti] : r0;
+        int last = (file->rowBounds[ti+1] < r1) ? file->rowBounds[ti+1] : r1;
+        int tjFirst = file->tileCols, tjLast = 0;
+        for(int tj = 0; first < last && tj < file->tileCols; tj++)
+        {
+            if(file->colBounds[tj] < c1 && file->colBounds[tj+1] > c0)
+            {
+                tjFirst = (tj < tjFirst) ? tj : tjFirst;
+                tjLast = tj + 1;
+            }
+        }
+        for(int tj = tjFirst; sc == SUCCESS && tj < tjLast; tj++)
+        {
+            sc = readTile(file, ti, tj, &tiles[tj]);
+        }
+        for(int i = first; sc == SUCCESS && i < last; i++)
+        {
+            int local = i - file->rowBounds[ti];
+            for(int tj = tjFirst; tj < tjLast; tj++)
+            {
+                for(int p = tiles[tj].rowPtr[local]; p < tiles[tj].rowPtr[local+1]; p++)
+                {
+                    if(tiles[tj].colIdx[p] >= c0 && tiles[tj].colIdx[p] < c1)
+                    {
+                        block->colIdx[k] = tiles[tj].colIdx[p];
+                        block->values[k++] = tiles[tj].values[p];
+                    }
+                }
+            }
+            block->rowPtr[i - r0 + 1] = k;
+        }
+        for(int tj = tjFirst; tj < tjLast; tj++)
+        {
+            freeCsrMatrix(&tiles[tj]);
+        }
+    }
+    free(tiles);
+    if(sc == FAILURE)
+    {
+        freeCsrMatrix(block);
+    }
+    return sc;
+}
+status_code writeChunkedMatrix(const SparseMatrix* matrix, const char* path, int tileSize)
+{
+    ChunkedFile file;
+    MatrixView view;
+    int tileRows = (matrix->rowCount + tileSize - 1) / tileSize, tileCols = (matrix->colCount + tileSize - 1) / tileSize;
+    int* rowBounds = (int*)malloc((tileRows + 1) * sizeof(int));
+    int* colBounds = (int*)malloc((tileCols + 1) * sizeof(int));
+    CsrMatrix* tiles = (CsrMatrix*)calloc(tileCols + 1, sizeof(CsrMatrix));
+    int* counts = (int*)malloc((tileCols + 1) * sizeof(int));
+    status_code sc = (tileSize > 0 && rowBounds && colBounds && tiles && counts) ? SUCCESS : FAILURE;
+
+    for(int t = 0; sc == SUCCESS && t <= tileRows; t++)
+    {
+        rowBounds[t] = (t * tileSize < matrix->rowCount) ? t * tileSize : matrix->rowCount;
+    }
+    for(int t = 0; sc == SUCCESS && t <= tileCols; t++)
+    {
+        colBounds[t] = (t * tileSize < matrix->colCount) ? t * tileSize : matrix->colCount;
+    }
+    if(sc == SUCCESS && openMatrixView(&view, matrix, FALSE) == SUCCESS)
+    {
+        sc = createChunkedFile(&file, path, matrix->rowCount, matrix->colCount, rowBounds, tileRows, colBounds, tileCols);
+        for(int ti = 0; sc == SUCCESS && ti < tileRows; ti++)
+        {
+            memset(counts, 0, tileCols * sizeof(int));
+            for(int i = rowBounds[ti]; i < rowBounds[ti+1]; i++)
+            {
+                for(Sm_Node* e = view.lists[i]; e; e = viewNext(&view, i, e))
+                {
+                    counts[viewIndex(&view, i, e) / tileSize]++;
+                }
+            }
+            for(int tj = 0; tj < tileCols; tj++)
+            {
+                if(allocateCsrMatrix(&tiles[tj], rowBounds[ti+1] - rowBounds[ti], matrix->colCount, counts[tj]) == FAILURE)
+                {
+                    sc = FAILURE;
+                }
+                counts[tj] = 0;
+            }
+            for(int i = rowBounds[ti]; sc == SUCCESS && i < rowBounds[ti+1]; i++)
+            {
+                for(Sm_Node* e = view.lists[i]; e; e = viewNext(&view, i, e))
+                {
+                    int j = viewIndex(&view, i, e), tj = j / tileSize;
+                    tiles[tj].colIdx[counts[tj]] = j;
+                    tiles[tj].values[counts[tj]++] = e->data;
+                }
+                for(int tj = 0; tj < tileCols; tj++)
+                {
+                    tiles[tj].rowPtr[i - rowBounds[ti] + 1] = counts[tj];
+                }
+            }
+            for(int tj = 0; tj < tileCols; tj++)
+            {
+                if(sc == SUCCESS)
+                {
+                    sc = writeTile(&file, &tiles[tj]);
+                }
+                freeCsrMatrix(&tiles[tj]);
+            }
+        }
+        if(file.fp && closeChunkedFile(&file) == FAILURE)
+        {
+            sc = FAILURE;
+        }
+        closeMatrixView(&view);
+    }
+    else
+    {
+        sc = FAILURE;
+    }
+    free(rowBounds);
+    free(colBounds);
+    free(tiles);
+    free(counts);
+    return sc;
+}
+status_code loadChunkedMatrix(const char* path, SparseMatrix* result)
+{
+    ChunkedFile file;
+    MatrixBuilder builder;
+    CsrMatrix block;
+    status_code sc = openChunkedFile(&file, path);
+    initializeMatrix(result);
+    if(sc == SUCCESS && beginMatrixBuilder(&builder, result, file.rowCount, file.colCount) == SUCCESS)
+    {
+        for(int ti = 0; sc == SUCCESS && ti < file.tileRows; ti++)
+        {
+            sc = loadBlock(&file, file.rowBounds[ti], file.rowBounds[ti+1], 0, file.colCount, &block);
+            for(int i = 0; sc == SUCCESS && i < block.rowCount; i++)
+            {
+                for(int k = block.rowPtr[i]; sc == SUCCESS && k < block.rowPtr[i+1]; k++)
+                {
+                    sc = appendElement(&builder, file.rowBounds[ti] + i, block.colIdx[k], (matrix_entry)block.values[k]);
+                }
+            }
+            freeCsrMatrix(&block);
+        }
+        finishMatrixBuilder(&builder);
+    }
+    if(file.fp)
+    {
+        closeChunkedFile(&file);
+    }
+    return sc;
+}
+// one block read in the background. Without threads (-DSM_NO_THREADS) the
+// read happens when the block is collected.
+typedef struct Prefetch_Tag
+{
+    ChunkedFile* file;
+    int r0, r1, c0, c1;
+    CsrMatrix block;
+    status_code sc;
+    boolean pending, threaded;
+#ifndef SM_NO_THREADS
+    pthread_t thread;
+#endif
+} Prefetch;
+
+void* prefetchBody(void* data)
+{
+    Prefetch* p = (Prefetch*)data;
+    p->sc = loadBlock(p->file, p->r0, p->r1, p->c0, p->c1, &p->block);
+    return NULL;
+}
+void startPrefetch(Prefetch* p, ChunkedFile* file, int r0, int r1, int c0, int c1)
+{
+    p->file = file;
+    p->r0 = r0;
+    p->r1 = r1;
+    p->c0 = c0;
+    p->c1 = c1;
+    p->pending = TRUE;
+    p->threaded = FALSE;
+#ifndef SM_NO_THREADS
+    p->threaded = (pthread_create(&p->thread, NULL, prefetchBody, p) == 0) ? TRUE : FALSE;
+#endif
+}
+status_code collectPrefetch(Prefetch* p, CsrMatrix* block)
+{
+#ifndef SM_NO_THREADS
+    if(p->threaded)
+    {
+        pthread_join(p->thread, NULL);
+    }
+#endif
+    if(!p->threaded)
+    {
+        prefetchBody(p);
+    }
+    p->pending = FALSE;
+    *block = p->block;
+    return p->sc;
+}
+void cancelPrefetch(Prefetch* p)// waits for a read nobody will use and frees it
+{
+    CsrMatrix block;
+    if(p->pending && collectPrefetch(p, &block) == SUCCESS)
+    {
+        freeCsrMatrix(&block);
+    }
+}
+// splits the tile rows (or tile columns) of a file into runs whose blocks
+// fit in share bytes, counting perIndex bytes for every row (or column) of
+// a run. A tile too large on its own becomes a run by itself. Returns the
+// number of runs; bounds receives their limits in rows (or columns).
+int groupTiles(const ChunkedFile* file, boolean byRows, size_t share, size_t perIndex, int* bounds)
+{
+    int units = byRows ? file->tileRows : file->tileCols, other = byRows ? file->tileCols : file->tileRows;
+    const int* unitBounds = byRows ? file->rowBounds : file->colBounds;
+    int groups = 0;
+    size_t used = 0;
+    bounds[0] = 0;
+    for(int u = 0; u < units; u++)
+    {
+        size_t bytes = (size_t)(unitBounds[u+1] - unitBounds[u]) * perIndex;
+        for(int v = 0; v < other; v++)
+        {
+            bytes += file->counts[byRows ? (int64_t)u * file->tileCols + v : (int64_t)v * file->tileCols + u]
+                * (sizeof(int) + sizeof(double));
+        }
+        if(used > 0 && used + bytes > share)
+        {
+            bounds[++groups] = unitBounds[u];
+            used = 0;
+        }
+        used += bytes;
+    }
+    bounds[++groups] = unitBounds[units];
+    return (units == 0) ? 0 : groups;
+}
+// tile (I, J) of A * B from a row block of A and a column block of B. The
+// dense accumulator spans only the block's columns c0 .. c0 + width, and
+// marker must hold -1 for all of them on entry (it is left that way). A
+// symbolic pass counts the tile's nonzeros first, so the tile is allocated
+// once at its exact size and its footprint is known before it exists.
+status_code multiplyBlocks(const CsrMatrix* a, const CsrMatrix* b, int c0, int width,
+    double* acc, int* marker, int* pattern, CsrMatrix* tile)
+{
+    int nnz = 0, k = 0;
+    status_code sc;
+    for(int i = 0; i < a->rowCount; i++)
+    {
+        for(int p = a->rowPtr[i]; p < a->rowPtr[i+1]; p++)
+        {
+            int row = a->colIdx[p];
+            for(int q = b->rowPtr[row]; q < b->rowPtr[row+1]; q++)
+            {
+                int j = b->colIdx[q] - c0;
+                nnz += (marker[j] != i);
+                marker[j] = i;
+            }
+        }
+    }
+    for(int j = 0; j < width; j++)
+    {
+        marker[j] = -1;
+    }
+    sc = allocateCsrMatrix(tile, a->rowCount, b->colCount, nnz);
+    for(int i = 0; sc == SUCCESS && i < a->rowCount; i++)
+    {
+        int count = 0;
+        for(int p = a->rowPtr[i]; p < a->rowPtr[i+1]; p++)
+        {
+            int row = a->colIdx[p];
+            for(int q = b->rowPtr[row]; q < b->rowPtr[row+1]; q++)
+            {
+                int j = b->colIdx[q] - c0;
+                if(marker[j] != i)
+                {
+                    marker[j] = i;
+                    acc[j] = 0;
+                    pattern[count++] = j;
+                }
+                acc[j] += a->values[p] * b->values[q];
+            }
+        }
+        qsort(pattern, count, sizeof(int), compareIndexes);
+        for(int t = 0; t < count; t++)
+        {
+            tile->colIdx[k] = c0 + pattern[t];
+            tile->values[k++] = acc[pattern[t]];
+        }
+        tile->rowPtr[i+1] = k;
+    }
+    for(int j = 0; j < width; j++)
+    {
+        marker[j] = -1;
+    }
+    if(sc == FAILURE)
+    {
+        freeCsrMatrix(tile);
+    }
+    return sc;
+}
+status_code addBlocks(const CsrMatrix* a, const CsrMatrix* b, CsrMatrix* tile)// row by row merge, counted first
+{
+    int nnz = 0, k = 0;
+    status_code sc;
+    for(int i = 0; i < a->rowCount; i++)
+    {
+        int p = a->rowPtr[i], q = b->rowPtr[i];
+        while(p < a->rowPtr[i+1] && q < b->rowPtr[i+1])
+        {
+            int pa = a->colIdx[p], qb = b->colIdx[q];
+            p += (pa <= qb);
+            q += (qb <= pa);
+            nnz++;
+        }
+        nnz += (a->rowPtr[i+1] - p) + (b->rowPtr[i+1] - q);
+    }
+    sc = allocateCsrMatrix(tile, a->rowCount, a->colCount, nnz);
+    for(int i = 0; sc == SUCCESS && i < a->rowCount; i++)
+    {
+        int p = a->rowPtr[i], q = b->rowPtr[i];
+        while(p < a->rowPtr[i+1] || q < b->rowPtr[i+1])
+        {
+            if(q == b->rowPtr[i+1] || (p < a->rowPtr[i+1] && a->colIdx[p] < b->colIdx[q]))
+            {
+                tile->colIdx[k] = a->colIdx[p];
+                tile->values[k++] = a->values[p++];
+            }
+            else if(p == a->rowPtr[i+1] || b->colIdx[q] < a->colIdx[p])
+            {
+                tile->colIdx[k] = b->colIdx[q];
+                tile->values[k++] = b->values[q++];
+            }
+            else
+            {
+                tile->colIdx[k] = a->colIdx[p];
+                tile->values[k++] = a->values[p++] + b->values[q++];
+            }
+        }
+        tile->rowPtr[i+1] = k;
+    }
+    if(sc == FAILURE)
+    {
+        freeCsrMatrix(tile);
+    }
+    return sc;
+}
+void noteFootprint(StreamStats* stats, size_t bytes)
+{
+    if(bytes > stats->peakBytes)
+    {
+        stats->peakBytes = bytes;
+    }
+}
+// C = A * B between chunked files. The rows of A and the columns of B are
+// grouped so that two row blocks, two column blocks and the output tile each
+// get a fifth of the budget; the block after the current one is always being
+// read. A column block of B also carries a row pointer over all of B's rows,
+// which is taken off its share first. C gets one tile per (row group, column
+// group) pair, written as soon as it is done, and B is read once per row
+// group of A. The budget is a target, not a cap: a single input tile larger
+// than its share, or an output tile denser than its share, is still held
+// whole, and stats->peakBytes reports what was actually held.
+status_code streamMultiply(const char* pathA, const char* pathB, const char* pathC, size_t budget, StreamStats* stats)
+{
+    ChunkedFile a, b, c;
+    Prefetch nextA, nextB;
+    CsrMatrix blockA, blockB, tile;
+    int *rowGroups = NULL, *colGroups = NULL, *marker = NULL, *pattern = NULL;
+    double* acc = NULL;
+    int groupsI = 0, groupsJ = 0, width = 0;
+    size_t columnPointers, shareB;
+    status_code sc;
+
+    memset(stats, 0, sizeof(StreamStats));
+    memset(&b, 0, sizeof(ChunkedFile));
+    memset(&c, 0, sizeof(ChunkedFile));
+    nextA.pending = nextB.pending = FALSE;
+    sc = openChunkedFile(&a, pathA);
+    sc = (sc == SUCCESS) ? openChunkedFile(&b, pathB) : FAILURE;
+    if(sc == SUCCESS && a.colCount != b.rowCount)
+    {
+        printf("Matrices have incompatible dimensions, cannot multiply.\n");
+        sc = FAILURE;
+    }
+    else if(sc == SUCCESS)
+    {
+        rowGroups = (int*)malloc((a.tileRows + 2) * sizeof(int));
+        colGroups = (int*)malloc((b.tileCols + 2) * sizeof(int));
+        sc = (rowGroups && colGroups) ? SUCCESS : FAILURE;
+    }
+    if(sc == SUCCESS)
+    {
+        columnPointers = ((size_t)b.rowCount + 1) * sizeof(int);
+        shareB = (budget / 5 > columnPointers) ? budget / 5 - columnPointers : 0;// 0: one tile column per group
+        groupsI = groupTiles(&a, TRUE, budget / 5, sizeof(int), rowGroups);
+        groupsJ = groupTiles(&b, FALSE, shareB, sizeof(double) + 2 * sizeof(int), colGroups);
+        for(int J = 0; J < groupsJ; J++)
+        {
+            width = (colGroups[J+1] - colGroups[J] > width) ? colGroups[J+1] - colGroups[J] : width;
+        }
+        acc = (double*)malloc((width + 1) * sizeof(double));
+        marker = (int*)malloc((width + 1) * sizeof(int));
+        pattern = (int*)malloc((width + 1) * sizeof(int));
+        sc = (acc && marker && pattern) ? SUCCESS : FAILURE;
+        for(int j = 0; sc == SUCCESS && j < width; j++)
+        {
+            marker[j] = -1;
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        sc = createChunkedFile(&c, pathC, a.rowCount, b.colCount, rowGroups, groupsI, colGroups, groupsJ);
+    }
+    if(sc == SUCCESS && groupsI > 0 && groupsJ > 0)
+    {
+        startPrefetch(&nextA, &a, rowGroups[0], rowGroups[1], 0, a.colCount);
+        startPrefetch(&nextB, &b, 0, b.rowCount, colGroups[0], colGroups[1]);
+    }
+    for(int I = 0; sc == SUCCESS && I < groupsI && groupsJ > 0; I++)
+    {
+        sc = collectPrefetch(&nextA, &blockA);
+        if(sc == SUCCESS && I + 1 < groupsI)
+        {
+            startPrefetch(&nextA, &a, rowGroups[I+1], rowGroups[I+2], 0, a.colCount);
+        }
+        for(int J = 0; sc == SUCCESS && J < groupsJ; J++)
+        {
+            sc = collectPrefetch(&nextB, &blockB);
+            if(sc == SUCCESS && (J + 1 < groupsJ || I + 1 < groupsI))
+            {
+                int next = (J + 1) % groupsJ;
+                startPrefetch(&nextB, &b, 0, b.rowCount, colGroups[next], colGroups[next+1]);
+            }
+            if(sc == SUCCESS)
+            {
+                sc = multiplyBlocks(&blockA, &blockB, colGroups[J], colGroups[J+1] - colGroups[J], acc, marker, pattern, &tile);
+                if(sc == SUCCESS)
+                {
+                    noteFootprint(stats, 2 * csrBytes(&blockA) + 2 * csrBytes(&blockB) + csrBytes(&tile)
+                        + (size_t)width * (sizeof(double) + 2 * sizeof(int)));
+                    sc = writeTile(&c, &tile);
+                    stats->tiles++;
+                    stats->nnz += tile.rowPtr[tile.rowCount];
+                    freeCsrMatrix(&tile);
+                }
+                freeCsrMatrix(&blockB);
+            }
+        }
+        freeCsrMatrix(&blockA);
+    }
+    cancelPrefetch(&nextA);
+    cancelPrefetch(&nextB);
+    stats->bytesRead = a.bytesRead + b.bytesRead;
+    if(c.fp && closeChunkedFile(&c) == FAILURE)
+    {
+        sc = FAILURE;
+    }
+    closeChunkedFile(&a);// files that failed to open are already closed and zeroed
+    closeChunkedFile(&b);
+    free(rowGroups);
+    free(colGroups);
+    free(acc);
+    free(marker);
+    free(pattern);
+    return sc;
+}
+// C = A + B between chunked files, in row groups of A. Both operands' next
+// row blocks are read while the current ones are merged. Like streamMultiply
+// the budget sizes the groups and is exceeded only by single oversized tiles.
+status_code streamAdd(const char* pathA, const char* pathB, const char* pathC, size_t budget, StreamStats* stats)
+{
+    ChunkedFile a, b, c;
+    Prefetch nextA, nextB;
+    CsrMatrix blockA, blockB, tile;
+    int* rowGroups = NULL;
+    int colBounds[2], groups = 0;
+    status_code sc, scB;
+
+    memset(stats, 0, sizeof(StreamStats));
+    memset(&b, 0, sizeof(ChunkedFile));
+    memset(&c, 0, sizeof(ChunkedFile));
+    nextA.pending = nextB.pending = FALSE;
+    sc = openChunkedFile(&a, pathA);
+    sc = (sc == SUCCESS) ? openChunkedFile(&b, pathB) : FAILURE;
+    if(sc == SUCCESS && (a.rowCount != b.rowCount || a.colCount != b.colCount))
+    {
+        printf("Matrices have different dimensions, cannot add.\n");
+        sc = FAILURE;
+    }
+    else if(sc == SUCCESS)
+    {
+        rowGroups = (int*)malloc((a.tileRows + 2) * sizeof(int));
+        sc = rowGroups ? SUCCESS : FAILURE;
+    }
+    if(sc == SUCCESS)
+    {
+        groups = groupTiles(&a, TRUE, budget / 6, sizeof(int), rowGroups);
+        colBounds[0] = 0;
+        colBounds[1] = a.colCount;
+        sc = createChunkedFile(&c, pathC, a.rowCount, a.colCount, rowGroups, groups, colBounds, 1);
+    }
+    if(sc == SUCCESS && groups > 0)
+    {
+        startPrefetch(&nextA, &a, rowGroups[0], rowGroups[1], 0, a.colCount);
+        startPrefetch(&nextB, &b, rowGroups[0], rowGroups[1], 0, b.colCount);
+    }
+    for(int I = 0; sc == SUCCESS && I < groups; I++)
+    {
+        sc = collectPrefetch(&nextA, &blockA);
+        scB = collectPrefetch(&nextB, &blockB);
+        if(sc == SUCCESS && scB == SUCCESS)
+        {
+            if(I + 1 < groups)
+            {
+                startPrefetch(&nextA, &a, rowGroups[I+1], rowGroups[I+2], 0, a.colCount);
+                startPrefetch(&nextB, &b, rowGroups[I+1], rowGroups[I+2], 0, b.colCount);
+            }
+            sc = addBlocks(&blockA, &blockB, &tile);
+            if(sc == SUCCESS)
+            {
+                noteFootprint(stats, 2 * csrBytes(&blockA) + 2 * csrBytes(&blockB) + csrBytes(&tile));
+                sc = writeTile(&c, &tile);
+                stats->tiles++;
+                stats->nnz += tile.rowPtr[tile.rowCount];
+                freeCsrMatrix(&tile);
+            }
+        }
+        freeCsrMatrix(&blockA);
+        freeCsrMatrix(&blockB);
+        sc = (scB == SUCCESS) ? sc : FAILURE;
+    }
+    cancelPrefetch(&nextA);
+    cancelPrefetch(&nextB);
+    stats->bytesRead = a.bytesRead + b.bytesRead;
+    if(c.fp && closeChunkedFile(&c) == FAILURE)
+    {
+        sc = FAILURE;
+    }
+    closeChunkedFile(&a);
+    closeChunkedFile(&b);
+    free(rowGroups);
+    return sc;
+}
+// reference helpers for the self tests
+double csrMaxDifference(const CsrMatrix* a, const CsrMatrix* b)// both with sorted rows
+{
+    double diff = (a->rowCount == b->rowCount) ? 0 : HUGE_VAL;
+    for(int i = 0; diff < HUGE_VAL && i < a->rowCount; i++)
+    {
+        int p = a->rowPtr[i], q = b->rowPtr[i];
+        while(p < a->rowPtr[i+1] || q < b->rowPtr[i+1])
+        {
+            double d;
+            if(q == b->rowPtr[i+1] || (p < a->rowPtr[i+1] && a->colIdx[p] < b->colIdx[q]))
+            {
+                d = fabs(a->values[p++]);
+            }
+            else if(p == a->rowPtr[i+1] || b->colIdx[q] < a->colIdx[p])
+            {
+                d = fabs(b->values[q++]);
+            }
+            else
+            {
+                d = fabs(a->values[p++] - b->values[q++]);
+            }
+            diff = (d > diff) ? d : diff;
+        }
+    }
+    return diff;
+}
+void randomIntegerMatrix(SparseMatrix* matrix, int rows, int cols, int perRow, unsigned seed)// entries in -4 .. 4
+{
+    MatrixBuilder builder;
+    int* picked = (int*)malloc((perRow + 1) * sizeof(int));
+    srand(seed);
+    if(picked && beginMatrixBuilder(&builder, matrix, rows, cols) == SUCCESS)
+    {
+        for(int i = 0; i < rows; i++)
+        {
+            for(int k = 0; k < perRow; k++)
+            {
+                picked[k] = rand() % cols;
+            }
+            qsort(picked, perRow, sizeof(int), compareIndexes);
+            for(int k = 0; k < perRow; k++)
+            {
+                if((k == 0 || picked[k] != picked[k-1]) && rand() % 9 != 4)
+                {
+                    appendElement(&builder, i, picked[k], (matrix_entry)(rand() % 9 - 4));
+                }
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    free(picked);
+}
+#ifdef SM_USE_MPI
+// distributed matrices. Row partitioning gives each rank a contiguous band of
+// rows with global column indexes. Grid partitioning lays the ranks out as a
+// q x q grid and gives rank (i, j) the block of row band i and column band j,
+// with column indexes local to the band. Matrices are scattered from a root
+// rank that holds them in the registry and gathered back the same way.
+typedef enum{PARTITION_ROWS, PARTITION_GRID} PartitionKind;
+
+typedef struct Dist_Matrix_Tag
+{
+    PartitionKind kind;
+    MPI_Comm comm, rowComm, colComm;   // rowComm and colComm only exist for the grid
+    int rank, size, gridSize;          // gridSize * gridSize == size for the grid
+    int gridRow, gridCol;
+    int rowCount, colCount;            // global shape
+    int* rowBounds;                    // band b covers rows rowBounds[b] .. rowBounds[b+1]
+    int* colBounds;                    // rows: the slice of x each rank holds for SpMV
+    CsrMatrix local;
+    // SpMV halo plan (rows only), built by the first product
+    boolean haloReady;
+    int ghostCount;                    // remote x entries this rank reads, sorted by global index
+    int* ghostCols;
+    int *recvCounts, *recvDispls;
+    int *sendIdx, *sendCounts, *sendDispls, sendTotal;
+    int* localCols;                    // colIdx renumbered: own slice first, then the ghosts
+    double *sendBuffer, *xExtended;
+} DistMatrix;
+
+void splitBands(int n, int parts, int* bounds)
+{
+    for(int b = 0; b <= parts; b++)
+    {
+        bounds[b] = (int)((long long)n * b / parts);
+    }
+}
+status_code extractPiece(const MatrixView* view, int r0, int r1, int c0, int c1, boolean localCols, CsrMatrix* piece)
+{
+    int nnz = 0, k = 0;
+    status_code sc;
+    for(int i = r0; i < r1; i++)
+    {
+        for(Sm_Node* e = view->lists[i]; e; e = viewNext(view, i, e))
+        {
+            int j = viewIndex(view, i, e);
+            nnz += (j >= c0 && j < c1) ? 1 : 0;
+        }
+    }
+    sc = allocateCsrMatrix(piece, r1 - r0, localCols ? c1 - c0 : view->colCount, nnz);
+    for(int i = r0; sc == SUCCESS && i < r1; i++)
+    {
+        for(Sm_Node* e = view->lists[i]; e; e = viewNext(view, i, e))
+        {
+            int j = viewIndex(view, i, e);
+            if(j >= c0 && j < c1)
+            {
+                piece->colIdx[k] = localCols ? j - c0 : j;
+                piece->values[k++] = e->data;
+            }
+        }
+        piece->rowPtr[i - r0 + 1] = k;
+    }
+    return sc;
+}
+void sendPiece(const CsrMatrix* piece, int dest, MPI_Comm comm)
+{
+    int header[3] = {piece->rowCount, piece->colCount, piece->rowPtr[piece->rowCount]};
+    MPI_Send(header, 3, MPI_INT, dest, 0, comm);
+    MPI_Send(piece->rowPtr, header[0] + 1, MPI_INT, dest, 1, comm);
+    MPI_Send(piece->colIdx, header[2], MPI_INT, dest, 2, comm);
+    MPI_Send(piece->values, header[2], MPI_DOUBLE, dest, 3, comm);
+}
+status_code receivePiece(CsrMatrix* piece, int source, MPI_Comm comm)
+{
+    int header[3];
+    status_code sc;
+    MPI_Recv(header, 3, MPI_INT, source, 0, comm, MPI_STATUS_IGNORE);
+    sc = allocateCsrMatrix(piece, header[0], header[1], header[2]);
+    if(sc == SUCCESS)// a failed allocation would leave the sender blocked, so it aborts
+    {
+        MPI_Recv(piece->rowPtr, header[0] + 1, MPI_INT, source, 1, comm, MPI_STATUS_IGNORE);
+        MPI_Recv(piece->colIdx, header[2], MPI_INT, source, 2, comm, MPI_STATUS_IGNORE);
+        MPI_Recv(piece->values, header[2], MPI_DOUBLE, source, 3, comm, MPI_STATUS_IGNORE);
+    }
+    else
+    {
+        printf("Memory allocation failed on rank receiving from %d.\n", source);
+        MPI_Abort(comm, 1);
+    }
+    return sc;
+}
+// root's piece is sent as is; on the other ranks piece receives a copy
+status_code broadcastPiece(CsrMatrix* piece, int root, MPI_Comm comm)
+{
+    int rank, header[3] = {0, 0, 0};
+    status_code sc = SUCCESS;
+    MPI_Comm_rank(comm, &rank);
+    if(rank == root)
+    {
+        header[0] = piece->rowCount;
+        header[1] = piece->colCount;
+        header[2] = piece->rowPtr[piece->rowCount];
+    }
+    MPI_Bcast(header, 3, MPI_INT, root, comm);
+    if(rank != root && allocateCsrMatrix(piece, header[0], header[1], header[2]) == FAILURE)
+    {
+        printf("Memory allocation failed.\n");
+        MPI_Abort(comm, 1);
+    }
+    MPI_Bcast(piece->rowPtr, header[0] + 1, MPI_INT, root, comm);
+    MPI_Bcast(piece->colIdx, header[2], MPI_INT, root, comm);
+    MPI_Bcast(piece->values, header[2], MPI_DOUBLE, root, comm);
+    return sc;
+}
+status_code setupDistLayout(DistMatrix* dist, PartitionKind kind, MPI_Comm comm, int rows, int cols)
+{
+    status_code sc = SUCCESS;
+    int bands;
+    memset(dist, 0, sizeof(DistMatrix));
+    dist->kind = kind;
+    dist->comm = comm;
+    dist->rowComm = dist->colComm = MPI_COMM_NULL;
+    dist->rowCount = rows;
+    dist->colCount = cols;
+    MPI_Comm_rank(comm, &dist->rank);
+    MPI_Comm_size(comm, &dist->size);
+    if(kind == PARTITION_GRID)
+    {
+        dist->gridSize = (int)(sqrt((double)dist->size) + 0.5);
+        if(dist->gridSize * dist->gridSize != dist->size)
+        {
+            if(dist->rank == 0)
+            {
+                printf("A grid partition needs a square number of ranks, not %d.\n", dist->size);
+            }
+            sc = FAILURE;
+        }
+        else
+        {
+            dist->gridRow = dist->rank / dist->gridSize;
+            dist->gridCol = dist->rank % dist->gridSize;
+            MPI_Comm_split(comm, dist->gridRow, dist->gridCol, &dist->rowComm);// rank in rowComm is gridCol
+            MPI_Comm_split(comm, dist->gridCol, dist->gridRow, &dist->colComm);// rank in colComm is gridRow
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        bands = (kind == PARTITION_GRID) ? dist->gridSize : dist->size;
+        dist->rowBounds = (int*)malloc((bands + 1) * sizeof(int));
+        dist->colBounds = (int*)malloc((bands + 1) * sizeof(int));
+        sc = (dist->rowBounds && dist->colBounds) ? SUCCESS : FAILURE;
+    }
+    if(sc == SUCCESS)
+    {
+        splitBands(rows, bands, dist->rowBounds);
+        splitBands(cols, bands, dist->colBounds);
+    }
+    return sc;
+}
+void pieceBounds(const DistMatrix* dist, int rank, int* r0, int* r1, int* c0, int* c1)// the block rank owns
+{
+    int i = (dist->kind == PARTITION_GRID) ? rank / dist->gridSize : rank;
+    int j = (dist->kind == PARTITION_GRID) ? rank % dist->gridSize : 0;
+    *r0 = dist->rowBounds[i];
+    *r1 = dist->rowBounds[i+1];
+    *c0 = (dist->kind == PARTITION_GRID) ? dist->colBounds[j] : 0;
+    *c1 = (dist->kind == PARTITION_GRID) ? dist->colBounds[j+1] : dist->colCount;
+}
+void freeDistMatrix(DistMatrix* dist)
+{
+    free(dist->rowBounds);
+    free(dist->colBounds);
+    freeCsrMatrix(&dist->local);
+    free(dist->ghostCols);
+    free(dist->recvCounts);
+    free(dist->recvDispls);
+    free(dist->sendIdx);
+    free(dist->sendCounts);
+    free(dist->sendDispls);
+    free(dist->localCols);
+    free(dist->sendBuffer);
+    free(dist->xExtended);
+    if(dist->rowComm != MPI_COMM_NULL)
+    {
+        MPI_Comm_free(&dist->rowComm);
+        MPI_Comm_free(&dist->colComm);
+    }
+    memset(dist, 0, sizeof(DistMatrix));
+    dist->rowComm = dist->colComm = MPI_COMM_NULL;
+}
+// collective. matrix is only read on root.
+status_code distributeMatrix(const SparseMatrix* matrix, int root, PartitionKind kind, MPI_Comm comm, DistMatrix* dist)
+{
+    int shape[2] = {0, 0}, rank;
+    status_code sc;
+    MPI_Comm_rank(comm, &rank);
+    if(rank == root)
+    {
+        shape[0] = matrix->rowCount;
+        shape[1] = matrix->colCount;
+    }
+    MPI_Bcast(shape, 2, MPI_INT, root, comm);
+    sc = setupDistLayout(dist, kind, comm, shape[0], shape[1]);
+    if(sc == FAILURE)
+    {
+        freeDistMatrix(dist);
+        return sc;
+    }
+    if(rank == root)
+    {
+        MatrixView view;
+        if(openMatrixView(&view, matrix, FALSE) == FAILURE)
+        {
+            MPI_Abort(comm, 1);
+        }
+        for(int r = 0; r < dist->size; r++)
+        {
+            int r0, r1, c0, c1;
+            CsrMatrix piece;
+            pieceBounds(dist, r, &r0, &r1, &c0, &c1);
+            if(extractPiece(&view, r0, r1, c0, c1, kind == PARTITION_GRID, &piece) == FAILURE)
+            {
+                MPI_Abort(comm, 1);
+            }
+            if(r == root)
+            {
+                dist->local = piece;
+            }
+            else
+            {
+                sendPiece(&piece, r, comm);
+                freeCsrMatrix(&piece);
+            }
+        }
+        closeMatrixView(&view);
+    }
+    else
+    {
+        sc = receivePiece(&dist->local, root, comm);
+    }
+    return sc;
+}
+// collective. The pieces are appended in global row order on root; grid
+// rows are stitched together from the q blocks of their row band.
+status_code gatherDistMatrix(const DistMatrix* dist, int root, SparseMatrix* result)
+{
+    status_code sc = SUCCESS;
+    int bands = (dist->kind == PARTITION_GRID) ? dist->gridSize : dist->size;
+    int perBand = (dist->kind == PARTITION_GRID) ? dist->gridSize : 1;
+    CsrMatrix* pieces = NULL;
+    MatrixBuilder builder;
+    if(dist->rank != root)
+    {
+        sendPiece(&dist->local, root, dist->comm);
+    }
+    else
+    {
+        pieces = (CsrMatrix*)calloc(perBand, sizeof(CsrMatrix));
+        if(!pieces || beginMatrixBuilder(&builder, result, dist->rowCount, dist->colCount) == FAILURE)
+        {
+            MPI_Abort(dist->comm, 1);
+        }
+        for(int b = 0; b < bands; b++)
+        {
+            for(int j = 0; j < perBand; j++)
+            {
+                int r = b * perBand + j;
+                if(r == root)
+                {
+                    pieces[j] = dist->local;
+                }
+                else
+                {
+                    receivePiece(&pieces[j], r, dist->comm);
+                }
+            }
+            for(int i = 0; i < dist->rowBounds[b+1] - dist->rowBounds[b]; i++)
+            {
+                for(int j = 0; j < perBand; j++)
+                {
+                    int offset = (dist->kind == PARTITION_GRID) ? dist->colBounds[j] : 0;
+                    for(int k = pieces[j].rowPtr[i]; sc == SUCCESS && k < pieces[j].rowPtr[i+1]; k++)
+                    {
+                        sc = appendElement(&builder, dist->rowBounds[b] + i, offset + pieces[j].colIdx[k], (matrix_entry)pieces[j].values[k]);
+                    }
+                }
+            }
+            for(int j = 0; j < perBand; j++)
+            {
+                if(b * perBand + j != root)
+                {
+                    freeCsrMatrix(&pieces[j]);
+                }
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    free(pieces);
+    return sc;
+}
+int findGhost(const DistMatrix* dist, int col)// position of col in the sorted ghost list
+{
+    int low = 0, high = dist->ghostCount - 1;
+    while(low < high)
+    {
+        int mid = (low + high) / 2;
+        if(dist->ghostCols[mid] < col)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
+// the x entries a rank's rows need from other ranks. Each rank lists its
+// remote columns per owner, one all-to-all tells the owners what to send,
+// and the local column indexes are renumbered to point into [own x | ghosts].
+status_code buildHaloPlan(DistMatrix* dist)
+{
+    int c0 = dist->colBounds[dist->rank], c1 = dist->colBounds[dist->rank + 1], own = c1 - c0;
+    int nnz = dist->local.rowPtr[dist->local.rowCount], owner = 0, count = 0;
+    status_code sc = SUCCESS;
+
+    dist->ghostCols = (int*)malloc((nnz + 1) * sizeof(int));
+    dist->recvCounts = (int*)calloc(dist->size, sizeof(int));
+    dist->recvDispls = (int*)calloc(dist->size, sizeof(int));
+    dist->sendCounts = (int*)calloc(dist->size, sizeof(int));
+    dist->sendDispls = (int*)calloc(dist->size, sizeof(int));
+    dist->localCols = (int*)malloc((nnz + 1) * sizeof(int));
+    if(!dist->ghostCols || !dist->recvCounts || !dist->recvDispls || !dist->sendCounts || !dist->sendDispls || !dist->localCols)
+    {
+        MPI_Abort(dist->comm, 1);
+    }
+    for(int k = 0; k < nnz; k++)
+    {
+        if(dist->local.colIdx[k] < c0 || dist->local.colIdx[k] >= c1)
+        {
+            dist->ghostCols[count++] = dist->local.colIdx[k];
+        }
+    }
+    qsort(dist->ghostCols, count, sizeof(int), compareIndexes);
+    dist->ghostCount = 0;
+    for(int g = 0; g < count; g++)
+    {
+        if(g == 0 || dist->ghostCols[g] != dist->ghostCols[g-1])
+        {
+            int col = dist->ghostCols[g];
+            while(col >= dist->colBounds[owner + 1])
+            {
+                owner++;
+            }
+            dist->ghostCols[dist->ghostCount++] = col;
+            dist->recvCounts[owner]++;
+        }
+    }
+    MPI_Alltoall(dist->recvCounts, 1, MPI_INT, dist->sendCounts, 1, MPI_INT, dist->comm);
+    dist->sendTotal = dist->sendCounts[0];
+    for(int r = 1; r < dist->size; r++)
+    {
+        dist->recvDispls[r] = dist->recvDispls[r-1] + dist->recvCounts[r-1];
+        dist->sendDispls[r] = dist->sendDispls[r-1] + dist->sendCounts[r-1];
+        dist->sendTotal += dist->sendCounts[r];
+    }
+    dist->sendIdx = (int*)malloc((dist->sendTotal + 1) * sizeof(int));
+    dist->sendBuffer = (double*)malloc((dist->sendTotal + 1) * sizeof(double));
+    dist->xExtended = (double*)malloc((own + dist->ghostCount + 1) * sizeof(double));
+    if(!dist->sendIdx || !dist->sendBuffer || !dist->xExtended)
+    {
+        MPI_Abort(dist->comm, 1);
+    }
+    MPI_Alltoallv(dist->ghostCols, dist->recvCounts, dist->recvDispls, MPI_INT,
+                  dist->sendIdx, dist->sendCounts, dist->sendDispls, MPI_INT, dist->comm);
+    for(int k = 0; k < dist->sendTotal; k++)
+    {
+        dist->sendIdx[k] -= c0;
+    }
+    for(int k = 0; k < nnz; k++)
+    {
+        int col = dist->local.colIdx[k];
+        dist->localCols[k] = (col >= c0 && col < c1) ? col - c0 : own + findGhost(dist, col);
+    }
+    dist->haloReady = TRUE;
+    return sc;
+}
+// collective. x holds this rank's slice colBounds[rank] .. colBounds[rank+1]
+// of the input vector, y receives its band of rows.
+status_code distMultiplyVector(DistMatrix* dist, const double* x, double* y)
+{
+    int own;
+    status_code sc = (dist->kind == PARTITION_ROWS) ? SUCCESS : FAILURE;
+    if(sc == SUCCESS && !dist->haloReady)
+    {
+        sc = buildHaloPlan(dist);
+    }
+    if(sc == SUCCESS)
+    {
+        own = dist->colBounds[dist->rank + 1] - dist->colBounds[dist->rank];
+        for(int k = 0; k < dist->sendTotal; k++)
+        {
+            dist->sendBuffer[k] = x[dist->sendIdx[k]];
+        }
+        MPI_Alltoallv(dist->sendBuffer, dist->sendCounts, dist->sendDispls, MPI_DOUBLE,
+                      dist->xExtended + own, dist->recvCounts, dist->recvDispls, MPI_DOUBLE, dist->comm);
+        memcpy(dist->xExtended, x, own * sizeof(double));
+        for(int i = 0; i < dist->local.rowCount; i++)
+        {
+            double sum = 0;
+            for(int k = dist->local.rowPtr[i]; k < dist->local.rowPtr[i+1]; k++)
+            {
+                sum += dist->local.values[k] * dist->xExtended[dist->localCols[k]];
+            }
+            y[i] = sum;
+        }
+    }
+    return sc;
+}
+// the result layout of an operation: same partition and communicators as
+// model (duplicated), with the given column count
+status_code copyDistLayout(const DistMatrix* model, int rows, int cols, DistMatrix* dist)
+{
+    status_code sc = setupDistLayout(dist, model->kind, model->comm, rows, cols);
+    if(sc == FAILURE)
+    {
+        freeDistMatrix(dist);
+    }
+    return sc;
+}
+// collective, no communication: both operands have the same layout
+status_code distAdd(const DistMatrix* a, const DistMatrix* b, DistMatrix* c)
+{
+    status_code sc = (a->kind == b->kind && a->rowCount == b->rowCount && a->colCount == b->colCount) ? SUCCESS : FAILURE;
+    if(sc == FAILURE)
+    {
+        if(a->rank == 0)
+        {
+            printf("Matrices have different dimensions or partitions, cannot add.\n");
+        }
+        memset(c, 0, sizeof(DistMatrix));
+        c->rowComm = c->colComm = MPI_COMM_NULL;
+    }
+    else
+    {
+        sc = copyDistLayout(a, a->rowCount, a->colCount, c);
+    }
+    if(sc == SUCCESS)
+    {
+        sc = addBlocks(&a->local, &b->local, &c->local);
+    }
+    return sc;
+}
+// collective. C = A * B on the grid by SUMMA: at stage s the ranks of grid
+// column s broadcast their A blocks along their grid rows, the ranks of grid
+// row s broadcast their B blocks down their grid columns, and every rank adds
+// A(i, s) B(s, j) to its block of C. Block s of A's columns and block s of
+// B's rows are the same band because both split the inner dimension in q.
+status_code distMultiply(const DistMatrix* a, const DistMatrix* b, DistMatrix* c)
+{
+    int width = 0;
+    double* acc = NULL;
+    int *marker = NULL, *pattern = NULL;
+    status_code sc = (a->kind == PARTITION_GRID && b->kind == PARTITION_GRID && a->colCount == b->rowCount) ? SUCCESS : FAILURE;
+
+    if(sc == FAILURE)
+    {
+        if(a->rank == 0)
+        {
+            printf("SUMMA needs two grid partitioned matrices with matching inner dimensions.\n");
+        }
+        memset(c, 0, sizeof(DistMatrix));
+        c->rowComm = c->colComm = MPI_COMM_NULL;
+    }
+    else
+    {
+        sc = copyDistLayout(a, a->rowCount, b->colCount, c);// fails alike on every rank
+    }
+    if(sc == SUCCESS)
+    {
+        width = c->colBounds[c->gridCol + 1] - c->colBounds[c->gridCol];
+        acc = (double*)malloc((width + 1) * sizeof(double));
+        marker = (int*)malloc((width + 1) * sizeof(int));
+        pattern = (int*)malloc((width + 1) * sizeof(int));
+        if(!acc || !marker || !pattern || allocateCsrMatrix(&c->local, c->rowBounds[c->gridRow + 1] - c->rowBounds[c->gridRow], width, 0) == FAILURE)
+        {
+            MPI_Abort(a->comm, 1);
+        }
+        for(int j = 0; j < width; j++)
+        {
+            marker[j] = -1;
+        }
+    }
+    for(int s = 0; sc == SUCCESS && s < a->gridSize; s++)
+    {
+        CsrMatrix blockA, blockB, product, sum;
+        blockA = a->local;
+        blockB = b->local;
+        broadcastPiece(&blockA, s, a->rowComm);
+        broadcastPiece(&blockB, s, b->colComm);
+        if(multiplyBlocks(&blockA, &blockB, 0, width, acc, marker, pattern, &product) == FAILURE
+            || addBlocks(&c->local, &product, &sum) == FAILURE)
+        {
+            MPI_Abort(a->comm, 1);
+        }
+        freeCsrMatrix(&product);
+        freeCsrMatrix(&c->local);
+        c->local = sum;
+        if(a->gridCol != s)
+        {
+            freeCsrMatrix(&blockA);
+        }
+        if(b->gridRow != s)
+        {
+            freeCsrMatrix(&blockB);
+        }
+    }
+    free(acc);
+    free(marker);
+    free(pattern);
+    return sc;
+}
+// compares the distributed operations against the single process kernels
+// on rank 0. Run with mpirun -np N; the SUMMA part needs N to be a square.
+status_code distributedSelfTest(MPI_Comm comm)
+{
+    int rank, size, rows = 301, inner = 277, cols = 259;
+    double errors[4] = {0, 0, 0, 0};
+    const char* names[] = {"row partitioned SpMV", "row partitioned add", "grid add", "SUMMA multiply"};
+    boolean grid;
+    SparseMatrix A, A2, B, R, expected;
+    DistMatrix dA, dA2, dB, dC;
+    CsrMatrix got, want;
+    status_code sc = SUCCESS;
+
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    grid = ((int)(sqrt((double)size) + 0.5) * (int)(sqrt((double)size) + 0.5) == size) ? TRUE : FALSE;
+    initializeMatrix(&A);
+    initializeMatrix(&A2);
+    initializeMatrix(&B);
+    if(rank == 0)
+    {
+        randomIntegerMatrix(&A, rows, inner, 6, 11);
+        randomIntegerMatrix(&A2, rows, inner, 4, 12);
+        randomIntegerMatrix(&B, inner, cols, 5, 13);
+    }
+
+    // SpMV: every rank fills its own slice of x
+    distributeMatrix(&A, 0, PARTITION_ROWS, comm, &dA);
+    {
+        int c0 = dA.colBounds[rank], c1 = dA.colBounds[rank + 1], r0 = dA.rowBounds[rank], r1 = dA.rowBounds[rank + 1];
+        double* x = (double*)malloc((c1 - c0 + 1) * sizeof(double));
+        double* y = (double*)malloc((r1 - r0 + 1) * sizeof(double));
+        double* yAll = (double*)malloc((rows + 1) * sizeof(double));
+        int* counts = (int*)malloc(size * sizeof(int));
+        for(int j = c0; j < c1; j++)
+        {
+            x[j - c0] = sin(j + 1.0);
+        }
+        for(int repeat = 0; repeat < 2; repeat++)// the second product reuses the halo plan
+        {
+            distMultiplyVector(&dA, x, y);
+        }
+        for(int r = 0; r < size; r++)
+        {
+            counts[r] = dA.rowBounds[r + 1] - dA.rowBounds[r];
+        }
+        MPI_Gatherv(y, r1 - r0, MPI_DOUBLE, yAll, counts, dA.rowBounds, MPI_DOUBLE, 0, comm);
+        if(rank == 0)
+        {
+            double* xAll = (double*)malloc((inner + 1) * sizeof(double));
+            double* yRef = (double*)malloc((rows + 1) * sizeof(double));
+            for(int j = 0; j < inner; j++)
+            {
+                xAll[j] = sin(j + 1.0);
+            }
+            multiplyVector(&A, xAll, yRef);
+            for(int i = 0; i < rows; i++)
+            {
+                errors[0] = fmax(errors[0], fabs(yRef[i] - yAll[i]));
+            }
+            free(xAll);
+            free(yRef);
+        }
+        free(x);
+        free(y);
+        free(yAll);
+        free(counts);
+    }
+
+    // row partitioned add
+    distributeMatrix(&A2, 0, PARTITION_ROWS, comm, &dA2);
+    distAdd(&dA, &dA2, &dC);
+    gatherDistMatrix(&dC, 0, &R);
+    if(rank == 0)
+    {
+        addMatrix(&A, &A2, &expected);
+        sparseMatrixToCsr(&R, &got);
+        sparseMatrixToCsr(&expected, &want);
+        errors[1] = csrMaxDifference(&got, &want);
+        freeCsrMatrix(&got);
+        freeCsrMatrix(&want);
+        clearMatrix(&R);
+        clearMatrix(&expected);
+    }
+    freeDistMatrix(&dA);
+    freeDistMatrix(&dA2);
+    freeDistMatrix(&dC);
+
+    if(grid)
+    {
+        distributeMatrix(&A, 0, PARTITION_GRID, comm, &dA);
+        distributeMatrix(&A2, 0, PARTITION_GRID, comm, &dA2);
+        distributeMatrix(&B, 0, PARTITION_GRID, comm, &dB);
+        for(int t = 2; t < 4; t++)
+        {
+            if(t == 2)
+            {
+                distAdd(&dA, &dA2, &dC);
+            }
+            else
+            {
+                distMultiply(&dA, &dB, &dC);
+            }
+            gatherDistMatrix(&dC, 0, &R);
+            if(rank == 0)
+            {
+                if(t == 2)
+                {
+                    addMatrix(&A, &A2, &expected);
+                }
+                else
+                {
+                    multiplyMatrix(&A, &B, &expected);
+                }
+                sparseMatrixToCsr(&R, &got);
+                sparseMatrixToCsr(&expected, &want);
+                errors[t] = csrMaxDifference(&got, &want);
+                freeCsrMatrix(&got);
+                freeCsrMatrix(&want);
+                clearMatrix(&R);
+                clearMatrix(&expected);
+            }
+            freeDistMatrix(&dC);
+        }
+        freeDistMatrix(&dA);
+        freeDistMatrix(&dA2);
+        freeDistMatrix(&dB);
+    }
+    if(rank == 0)
+    {
+        printf("MPI self test on %d rank(s):\n", size);
+        for(int t = 0; t < 4; t++)
+        {
+            if(t >= 2 && !grid)
+            {
+                printf("  %-22s skipped, %d is not a square\n", names[t], size);
+            }
+            else
+            {
+                printf("  %-22s max error %.3g %s\n", names[t], errors[t], errors[t] < 1e-9 ? "ok" : "FAILED");
+                sc = (errors[t] < 1e-9) ? sc : FAILURE;
+            }
+        }
+        clearMatrix(&A);
+        clearMatrix(&A2);
+        clearMatrix(&B);
+    }
+    MPI_Bcast(&sc, 1, MPI_INT, 0, comm);
+    return sc;
+}
+#endif
+// sparse LU with threshold partial pivoting, a row at a time: A = L U with L
+// unit lower triangular and U upper triangular once its columns are taken in
+// pivot order. Row i of A is reduced by the rows of U it reaches, in reverse
+// postorder of a depth first search (Gilbert-Peierls on rows), so the work
+// follows the fill, not n. The diagonal is kept as pivot while it is within
+// LU_PIVOT_THRESHOLD of the largest candidate, which preserves sparsity.
+// The factors are those of P A P^T in minimum degree order, which has the
+// same determinant and norm and far less fill. Everything is carried in
+// double; det(A) is kept as log|det| and a sign.
+#define LU_PIVOT_THRESHOLD 0.1
+#define CONDITION_ITERATIONS 5
+#define INVERSE_MIN_RCOND FLT_EPSILON   // below this not one digit of a float inverse is reliable
+
+typedef struct Lu_Factor_Tag
+{
+    int n;
+    int* order;         // row and column i of the factored matrix are order[i] of A
+    CsrMatrix lower;    // strictly lower part of L, row i holds the multipliers of step i
+    CsrMatrix upper;    // row k of U by original column, pivot included
+    int lowerCapacity, upperCapacity;
+    int* pivotCol;      // column of the pivot of step k
+    double* pivot;
+    int* step;          // step whose pivot is column j, -1 while it has none
+    int sign;           // of det(A), 0 when A is singular and the factors are incomplete
+    double logAbsDet;   // -INFINITY when singular
+    double norm1;       // max column sum of |A|
+    double* work;
+    double* permuted;
+} LuFactor;
+
+void freeLuFactor(LuFactor* lu)
+{
+    freeCsrMatrix(&lu->lower);
+    freeCsrMatrix(&lu->upper);
+    free(lu->pivotCol);
+    free(lu->pivot);
+    free(lu->step);
+    free(lu->work);
+    free(lu->permuted);
+    free(lu->order);
+    lu->pivotCol = lu->step = lu->order = NULL;
+    lu->pivot = lu->work = lu->permuted = NULL;
+}
+status_code reserveCsr(CsrMatrix* csr, int* capacity, int needed)
+{
+    status_code sc = SUCCESS;
+    if(needed > *capacity)
+    {
+        int grown = (needed > 2 * *capacity) ? needed : 2 * *capacity;
+        int* colIdx = (int*)realloc(csr->colIdx, (grown + 1) * sizeof(int));
+        double* values = colIdx ? (double*)realloc(csr->values, (grown + 1) * sizeof(double)) : NULL;
+        csr->colIdx = colIdx ? colIdx : csr->colIdx;
+        csr->values = values ? values : csr->values;
+        sc = (colIdx && values) ? SUCCESS : FAILURE;
+        *capacity = (sc == SUCCESS) ? grown : *capacity;
+    }
+    return sc;
+}
+void accumulateLog(double value, double* logAbsDet, int* sign)// one factor of a determinant
+{
+    if(value == 0)
+    {
+        *sign = 0;
+    }
+    else
+    {
+        *logAbsDet += log(fabs(value));
+        *sign *= (value < 0) ? -1 : 1;
+    }
+}
+// sign of the permutation k -> target[k]; target is overwritten
+int permutationSign(int* target, int n)
+{
+    int sign = 1;
+    for(int i = 0; i < n; i++)// a cycle of even length flips the sign
+    {
+        int length = 0;
+        for(int k = i; target[k] >= 0; length++)
+        {
+            int next = target[k];
+            target[k] = -1;
+            k = next;
+        }
+        if(length > 0 && length % 2 == 0)
+        {
+            sign = -sign;
+        }
+    }
+    return sign;
+}
+typedef struct Lu_Row_Tag
+{
+    const CsrMatrix* a;
+    double* x;          // row being reduced, by column
+    int* colMark;       // i when column j is in the pattern of row i
+    int* pattern;
+    int* stepMark;      // i when step k was reached from row i
+    int* stack;
+    int* cursor;
+    int* order;
+} LuRow;
+
+// reduces row i of A by the steps it reaches and appends it to L and U;
+// sets lu->sign to 0 when no pivot is left
+status_code factorLURow(LuFactor* lu, LuRow* w, int i)
+{
+    status_code sc = SUCCESS;
+    const CsrMatrix* a = w->a;
+    CsrMatrix *lower = &lu->lower, *upper = &lu->upper;
+    int count = 0, top = i, pick = -1;
+    long rowFlops = 0;
+    double largest = 0;
+    for(int k = a->rowPtr[i]; k < a->rowPtr[i+1]; k++)
+    {
+        int col = a->colIdx[k];
+        w->x[col] = a->values[k];
+        w->colMark[col] = i;
+        w->pattern[count++] = col;
+    }
+    for(int p = 0; p < count; p++)// steps are numbered by row, so at most i of them
+    {
+        int root = lu->step[w->pattern[p]], depth = 0;
+        if(root < 0 || w->stepMark[root] == i)
+        {
+            continue;
+        }
+        w->stack[depth] = root;
+        w->cursor[depth++] = upper->rowPtr[root];
+        w->stepMark[root] = i;
+        while(depth > 0)
+        {
+            int k = w->stack[depth - 1], q = w->cursor[depth - 1], next = -1;
+            for(; q < upper->rowPtr[k+1] && next < 0; q++)
+            {
+                int t = lu->step[upper->colIdx[q]];
+                if(t >= 0 && w->stepMark[t] != i)
+                {
+                    next = t;
+                }
+            }
+            w->cursor[depth - 1] = q;
+            if(next >= 0)
+            {
+                w->stepMark[next] = i;
+                w->stack[depth] = next;
+                w->cursor[depth++] = upper->rowPtr[next];
+            }
+            else
+            {
+                w->order[--top] = k;
+                depth--;
+            }
+        }
+    }
+    lower->rowPtr[i+1] = lower->rowPtr[i];
+    for(int p = top; sc == SUCCESS && p < i; p++)
+    {
+        int k = w->order[p];
+        double l = (w->colMark[lu->pivotCol[k]] == i) ? w->x[lu->pivotCol[k]] / lu->pivot[k] : 0;// a reached step may find its column still empty
+        if(l != 0)
+        {
+            sc = reserveCsr(lower, &lu->lowerCapacity, lower->rowPtr[i+1] + 1);
+            if(sc == SUCCESS)
+            {
+                lower->colIdx[lower->rowPtr[i+1]] = k;
+                lower->values[lower->rowPtr[i+1]++] = l;
+            }
+            for(int q = upper->rowPtr[k]; q < upper->rowPtr[k+1]; q++)
+            {
+                int col = upper->colIdx[q];
+                if(w->colMark[col] != i)
+                {
+                    w->colMark[col] = i;
+                    w->x[col] = 0;
+                    w->pattern[count++] = col;
+                }
+                w->x[col] -= l * upper->values[q];
+            }
+            rowFlops += 1 + 2 * (upper->rowPtr[k+1] - upper->rowPtr[k]);
+        }
+        w->x[lu->pivotCol[k]] = 0;
+    }
+    for(int p = 0; p < count; p++)
+    {
+        int col = w->pattern[p];
+        if(lu->step[col] < 0 && fabs(w->x[col]) > largest)
+        {
+            largest = fabs(w->x[col]);
+            pick = col;
+        }
+    }
+    if(lu->step[i] < 0 && w->colMark[i] == i && fabs(w->x[i]) >= LU_PIVOT_THRESHOLD * largest)
+    {
+        pick = i;
+    }
+    upper->rowPtr[i+1] = upper->rowPtr[i];
+    if(sc == SUCCESS && (pick < 0 || largest == 0))
+    {
+        lu->sign = 0;
+    }
+    else if(sc == SUCCESS)
+    {
+        sc = reserveCsr(upper, &lu->upperCapacity, upper->rowPtr[i] + count);
+        for(int p = 0; sc == SUCCESS && p < count; p++)
+        {
+            int col = w->pattern[p];
+            if(lu->step[col] < 0 && w->x[col] != 0)
+            {
+                upper->colIdx[upper->rowPtr[i+1]] = col;
+                upper->values[upper->rowPtr[i+1]++] = w->x[col];
+            }
+        }
+        lu->pivotCol[i] = pick;
+        lu->pivot[i] = w->x[pick];
+        lu->step[pick] = i;
+        accumulateLog(lu->pivot[i], &lu->logAbsDet, &lu->sign);
+    }
+    PROFILE_COUNT(flops, rowFlops);
+    addProgress(activeProgress, 1, rowFlops);
+    return sc;
+}
+// result = P A P^T with result(i, j) = a(order[i], order[j]); rows keep a's column order
+status_code permuteCsr(const CsrMatrix* a, const int* order, CsrMatrix* result)
+{
+    int n = a->rowCount;
+    int* position = (int*)malloc((n + 1) * sizeof(int));
+    status_code sc = (position && allocateCsrMatrix(result, n, n, a->rowPtr[n]) == SUCCESS) ? SUCCESS : FAILURE;
+    for(int i = 0; sc == SUCCESS && i < n; i++)
+    {
+        position[order[i]] = i;
+    }
+    for(int i = 0; sc == SUCCESS && i < n; i++)
+    {
+        int next = result->rowPtr[i];
+        for(int k = a->rowPtr[order[i]]; k < a->rowPtr[order[i]+1]; k++)
+        {
+            result->colIdx[next] = position[a->colIdx[k]];
+            result->values[next++] = a->values[k];
+        }
+        result->rowPtr[i+1] = next;
+    }
+    free(position);
+    return sc;
+}
+// FAILURE for a non-square matrix, out of memory or a cancelled job. A singular
+// matrix factors with SUCCESS and sign 0; its factors must not be used to solve.
+status_code factorLU(const SparseMatrix* matrix, LuFactor* lu)
+{
+    status_code sc;
+    CsrMatrix a, original;
+    LuRow w;
+    int n = matrix->rowCount;
+    Progress* progress = activeProgress;
+    double* colSum = (double*)calloc(n + 1, sizeof(double));
+
+    memset(lu, 0, sizeof(LuFactor));
+    memset(&w, 0, sizeof(LuRow));
+    lu->n = n;
+    lu->sign = 1;
+    a.rowPtr = a.colIdx = original.rowPtr = original.colIdx = NULL;
+    a.values = original.values = NULL;
+    lu->order = (int*)malloc((n + 1) * sizeof(int));
+    sc = (matrix->rowCount == matrix->colCount && colSum && lu->order) ? SUCCESS : FAILURE;
+    if(sc == SUCCESS)
+    {
+        sc = (computeOrdering(matrix, ORDER_AMD, lu->order) == SUCCESS
+            && sparseMatrixToCsr(matrix, &original) == SUCCESS
+            && permuteCsr(&original, lu->order, &a) == SUCCESS) ? SUCCESS : FAILURE;
+    }
+    if(sc == SUCCESS)
+    {
+        int nnz = a.rowPtr[n];
+        lu->lowerCapacity = lu->upperCapacity = nnz + n;
+        lu->pivotCol = (int*)malloc((n + 1) * sizeof(int));
+        lu->pivot = (double*)malloc((n + 1) * sizeof(double));
+        lu->step = (int*)malloc((n + 1) * sizeof(int));
+        lu->work = (double*)malloc((n + 1) * sizeof(double));
+        lu->permuted = (double*)malloc((n + 1) * sizeof(double));
+        w.a = &a;
+        w.x = (double*)malloc((n + 1) * sizeof(double));
+        w.colMark = (int*)malloc((n + 1) * sizeof(int));
+        w.pattern = (int*)malloc((n + 1) * sizeof(int));
+        w.stepMark = (int*)malloc((n + 1) * sizeof(int));
+        w.stack = (int*)malloc((n + 1) * sizeof(int));
+        w.cursor = (int*)malloc((n + 1) * sizeof(int));
+        w.order = (int*)malloc((n + 1) * sizeof(int));
+        if(allocateCsrMatrix(&lu->lower, n, n, lu->lowerCapacity) == FAILURE
+            || allocateCsrMatrix(&lu->upper, n, n, lu->upperCapacity) == FAILURE
+            || !lu->pivotCol || !lu->pivot || !lu->step || !lu->work || !lu->permuted || !w.x || !w.colMark
+            || !w.pattern || !w.stepMark || !w.stack || !w.cursor || !w.order)
+        {
+            sc = FAILURE;
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        PROFILE_BEGIN(PROF_DETERMINANT);
+        for(int j = 0; j < n; j++)
+        {
+            lu->step[j] = w.colMark[j] = w.stepMark[j] = -1;
+        }
+        for(int k = 0; k < a.rowPtr[n]; k++)
+        {
+            colSum[a.colIdx[k]] += fabs(a.values[k]);
+        }
+        for(int j = 0; j < n; j++)
+        {
+            lu->norm1 = (colSum[j] > lu->norm1) ? colSum[j] : lu->norm1;
+        }
+        beginProgress(progress, n);
+        for(int i = 0; sc == SUCCESS && lu->sign != 0 && i < n; i++)
+        {
+            sc = progressCancelled(progress) ? FAILURE : factorLURow(lu, &w, i);
+        }
+        if(sc == SUCCESS && lu->sign != 0)
+        {
+            memcpy(w.order, lu->pivotCol, n * sizeof(int));
+            lu->sign *= permutationSign(w.order, n);
+        }
+        if(lu->sign == 0)
+        {
+            lu->logAbsDet = -INFINITY;
+        }
+        PROFILE_END();
+    }
+    if(sc == FAILURE)
+    {
+        freeLuFactor(lu);
+    }
+    freeCsrMatrix(&a);
+    freeCsrMatrix(&original);
+    free(colSum);
+    free(w.x);
+    free(w.colMark);
+    free(w.pattern);
+    free(w.stepMark);
+    free(w.stack);
+    free(w.cursor);
+    free(w.order);
+    return sc;
+}
+void solveFactors(const LuFactor* lu, const double* b, double* x)// x = (L U)^-1 b, b and x may be the same
+{
+    const CsrMatrix *lower = &lu->lower, *upper = &lu->upper;
+    double* y = lu->work;
+    for(int i = 0; i < lu->n; i++)
+    {
+        double sum = b[i];
+        for(int k = lower->rowPtr[i]; k < lower->rowPtr[i+1]; k++)
+        {
+            sum -= lower->values[k] * y[lower->colIdx[k]];
+        }
+        y[i] = sum;
+    }
+    for(int k = lu->n - 1; k >= 0; k--)// the other columns of row k are pivots of later steps
+    {
+        double sum = y[k];
+        for(int q = upper->rowPtr[k]; q < upper->rowPtr[k+1]; q++)
+        {
+            if(upper->colIdx[q] != lu->pivotCol[k])
+            {
+                sum -= upper->values[q] * x[upper->colIdx[q]];
+            }
+        }
+        x[lu->pivotCol[k]] = sum / lu->pivot[k];
+    }
+}
+void solveTransposedFactors(const LuFactor* lu, const double* b, double* x)// x = (L U)^-T b, b and x may be the same
+{
+    const CsrMatrix *lower = &lu->lower, *upper = &lu->upper;
+    double* r = lu->work;
+    memcpy(r, b, lu->n * sizeof(double));
+    for(int k = 0; k < lu->n; k++)// U^T w = b, pushing each w[k] into the columns of row k
+    {
+        double w = r[lu->pivotCol[k]] / lu->pivot[k];
+        for(int q = upper->rowPtr[k]; q < upper->rowPtr[k+1]; q++)
+        {
+            r[upper->colIdx[q]] -= upper->values[q] * w;
+        }
+        x[k] = w;
+    }
+    for(int i = lu->n - 1; i >= 0; i--)// L^T x = w, in place
+    {
+        for(int k = lower->rowPtr[i]; k < lower->rowPtr[i+1]; k++)
+        {
+            x[lower->colIdx[k]] -= lower->values[k] * x[i];
+        }
+    }
+}
+void solveLU(const LuFactor* lu, const double* b, double* x)// x = A^-1 b
+{
+    for(int i = 0; i < lu->n; i++)
+    {
+        lu->permuted[i] = b[lu->order[i]];
+    }
+    solveFactors(lu, lu->permuted, lu->permuted);
+    for(int i = 0; i < lu->n; i++)
+    {
+        x[lu->order[i]] = lu->permuted[i];
+    }
+}
+void solveTransposedLU(const LuFactor* lu, const double* b, double* x)// x = A^-T b
+{
+    for(int i = 0; i < lu->n; i++)
+    {
+        lu->permuted[i] = b[lu->order[i]];
+    }
+    solveTransposedFactors(lu, lu->permuted, lu->permuted);
+    for(int i = 0; i < lu->n; i++)
+    {
+        x[lu->order[i]] = lu->permuted[i];
+    }
+}
+// ||A^-1||_1 by Hager's method with Higham's refinements: a few solves with A
+// and A^T climb towards the column of A^-1 with the largest sum, and an
+// alternating vector guards against the rare matrices that fool the climb.
+// The result is a lower bound, almost always within a factor of 3.
+double estimateInverseNorm1(const LuFactor* lu)
+{
+    int n = lu->n;
+    double estimate = 0;
+    double* x = (double*)malloc((n + 1) * sizeof(double));
+    double* y = (double*)malloc((n + 1) * sizeof(double));
+    double* z = (double*)malloc((n + 1) * sizeof(double));
+    if(!x || !y || !z || lu->sign == 0)
+    {
+        estimate = INFINITY;
+    }
+    else
+    {
+        boolean done = FALSE;
+        for(int i = 0; i < n; i++)
+        {
+            x[i] = 1.0 / n;
+        }
+        for(int iteration = 0; iteration < CONDITION_ITERATIONS && !done; iteration++)
+        {
+            double norm = 0, zx = 0, zmax = -1;
+            int j = 0;
+            solveLU(lu, x, y);
+            for(int i = 0; i < n; i++)
+            {
+                norm += fabs(y[i]);
+                y[i] = (y[i] < 0) ? -1 : 1;
+            }
+            done = (iteration > 0 && norm <= estimate);
+            estimate = (norm > estimate) ? norm : estimate;
+            solveTransposedLU(lu, y, z);
+            for(int i = 0; i < n; i++)
+            {
+                zx += z[i] * x[i];
+                if(fabs(z[i]) > zmax)
+                {
+                    zmax = fabs(z[i]);
+                    j = i;
+                }
+            }
+            done = done || zmax <= zx;
+            for(int i = 0; i < n; i++)
+            {
+                x[i] = (i == j);
+            }
+        }
+        if(n > 1)
+        {
+            double norm = 0;
+            for(int i = 0; i < n; i++)
+            {
+                x[i] = ((i % 2) ? -1 : 1) * (1 + (double)i / (n - 1));
+            }
+            solveLU(lu, x, y);
+            for(int i = 0; i < n; i++)
+            {
+                norm += fabs(y[i]);
+            }
+            norm = 2 * norm / (3 * n);
+            estimate = (norm > estimate) ? norm : estimate;
+        }
+    }
+    free(x);
+    free(y);
+    free(z);
+    return estimate;
+}
+// structure of a square matrix, found in one pass over the rows and, when that
+// finds nothing, a connected components search of the symmetrized pattern.
+// Determinant and inverse dispatch on it; only STRUCTURE_GENERAL is left to the
+// LU factors. Explicit zeros count as entries, like everywhere else.
+typedef enum{STRUCTURE_GENERAL, STRUCTURE_DIAGONAL, STRUCTURE_LOWER, STRUCTURE_UPPER,
+             STRUCTURE_PERMUTATION, STRUCTURE_BLOCK_DIAGONAL} MatrixStructure;
+
+const char* structureName(MatrixStructure structure)
+{
+    const char* names[] = {"general", "diagonal", "lower triangular", "upper triangular",
+                           "permutation", "block diagonal"};
+    return names[structure];
+}
+// labels the connected components of the symmetrized pattern 0..count-1 in order
+// of their smallest index. Returns the count, -1 when out of memory.
+int matrixComponents(const SparseMatrix* matrix, int* component)
+{
+    int *adjPtr, *adj, count = 0, n = matrix->rowCount;
+    int* queue = (int*)malloc((n + 1) * sizeof(int));
+    if(!queue || buildAdjacency(matrix, &adjPtr, &adj) == FAILURE)
+    {
+        free(queue);
+        return -1;
+    }
+    for(int i = 0; i < n; i++)
+    {
+        component[i] = -1;
+    }
+    for(int root = 0; root < n; root++)
+    {
+        if(component[root] < 0)
+        {
+            int head = 0, tail = 0;
+            queue[tail++] = root;
+            component[root] = count;
+            while(head < tail)
+            {
+                int v = queue[head++];
+                for(int k = adjPtr[v]; k < adjPtr[v+1]; k++)
+                {
+                    if(component[adj[k]] < 0)
+                    {
+                        component[adj[k]] = count;
+                        queue[tail++] = adj[k];
+                    }
+                }
+            }
+            count++;
+        }
+    }
+    free(adjPtr);
+    free(adj);
+    free(queue);
+    return count;
+}
+// a permutation here is any matrix with exactly one entry in every row and column.
+// Symmetric storage holds only the lower triangle, so it can only be found
+// diagonal or block diagonal.
+MatrixStructure classifyMatrix(const SparseMatrix* matrix)
+{
+    MatrixStructure structure = STRUCTURE_GENERAL;
+    int n = matrix->rowCount, rows = 0;
+    boolean diagonal = TRUE, lower = TRUE, upper = TRUE, permutation = !matrix->symmetric;
+    char* columnSeen = (char*)calloc(n + 1, sizeof(char));
+    if(matrix->rowCount != matrix->colCount || !columnSeen)
+    {
+        free(columnSeen);
+        return STRUCTURE_GENERAL;
+    }
+    for(Row_Node* rowPos = matrix->rowHead; rowPos; rowPos = rowPos->next)
+    {
+        int length = 0;
+        for(Sm_Node* element = rowPos->rowlist; element; element = element->right)
+        {
+            if(element->col > element->row)
+            {
+                lower = diagonal = FALSE;
+            }
+            else if(element->col < element->row)
+            {
+                upper = diagonal = FALSE;
+            }
+            if(columnSeen[element->col])
+            {
+                permutation = FALSE;
+            }
+            columnSeen[element->col] = 1;
+            length++;
+        }
+        if(length != 1)
+        {
+            permutation = FALSE;
+        }
+        rows += (length > 0);
+    }
+    free(columnSeen);
+    if(diagonal)
+    {
+        structure = STRUCTURE_DIAGONAL;
+    }
+    else if(permutation && rows == n)
+    {
+        structure = STRUCTURE_PERMUTATION;
+    }
+    else if(lower && !matrix->symmetric)
+    {
+        structure = STRUCTURE_LOWER;
+    }
+    else if(upper)
+    {
+        structure = STRUCTURE_UPPER;
+    }
+    else
+    {
+        int* component = (int*)malloc((n + 1) * sizeof(int));
+        if(component && matrixComponents(matrix, component) > 1)
+        {
+            structure = STRUCTURE_BLOCK_DIAGONAL;
+        }
+        free(component);
+    }
+    return structure;
+}
+// the components of a block diagonal matrix as index lists. Each list is
+// ascending, so renumbering a block by position keeps its rows and columns sorted.
+typedef struct Matrix_Blocks_Tag
+{
+    int count;
+    int* start;     // block b holds members[start[b]] .. members[start[b+1]-1]
+    int* members;
+    int* block;     // block of every index
+    int* local;     // position of every index inside its block
+    Row_Node** rows;// row header of every index, NULL for an empty row
+} MatrixBlocks;
+
+void freeBlocks(MatrixBlocks* blocks)
+{
+    free(blocks->start);
+    free(blocks->members);
+    free(blocks->block);
+    free(blocks->local);
+    free(blocks->rows);
+}
+status_code findBlocks(const SparseMatrix* matrix, MatrixBlocks* blocks)
+{
+    int n = matrix->rowCount;
+    status_code sc = SUCCESS;
+    blocks->start = NULL;
+    blocks->members = (int*)malloc((n + 1) * sizeof(int));
+    blocks->block = (int*)malloc((n + 1) * sizeof(int));
+    blocks->local = (int*)malloc((n + 1) * sizeof(int));
+    blocks->rows = (Row_Node**)calloc(n + 1, sizeof(Row_Node*));
+    if(!blocks->members || !blocks->block || !blocks->local || !blocks->rows)
+    {
+        sc = FAILURE;
+    }
+    else
+    {
+        blocks->count = matrixComponents(matrix, blocks->block);
+        if(blocks->count < 0 || !(blocks->start = (int*)calloc(blocks->count + 2, sizeof(int))))
+        {
+            sc = FAILURE;
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        for(int i = 0; i < n; i++)
+        {
+            blocks->start[blocks->block[i] + 2]++;
+        }
+        for(int b = 0; b < blocks->count; b++)
+        {
+            blocks->start[b + 2] += blocks->start[b + 1];
+        }
+        for(int i = 0; i < n; i++)// start[b+1] serves as fill cursor and ends as start of b+1
+        {
+            blocks->members[blocks->start[blocks->block[i] + 1]++] = i;
+        }
+        for(int b = 0; b < blocks->count; b++)
+        {
+            for(int k = blocks->start[b]; k < blocks->start[b + 1]; k++)
+            {
+                blocks->local[blocks->members[k]] = k - blocks->start[b];
+            }
+        }
+        for(Row_Node* rowPos = matrix->rowHead; rowPos; rowPos = rowPos->next)
+        {
+            blocks->rows[rowPos->row] = rowPos;
+        }
+    }
+    else
+    {
+        freeBlocks(blocks);
+    }
+    return sc;
+}
+status_code extractBlock(const MatrixBlocks* blocks, int b, SparseMatrix* result)
+{
+    MatrixBuilder builder;
+    int size = blocks->start[b + 1] - blocks->start[b];
+    status_code sc = beginMatrixBuilder(&builder, result, size, size);
+    if(sc == SUCCESS)
+    {
+        for(int k = 0; sc == SUCCESS && k < size; k++)
+        {
+            Row_Node* rowPos = blocks->rows[blocks->members[blocks->start[b] + k]];
+            for(Sm_Node* element = rowPos ? rowPos->rowlist : NULL; sc == SUCCESS && element; element = element->right)
+            {
+                sc = appendNode(&builder, k, blocks->local[element->col], element->data) ? SUCCESS : FAILURE;
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    return sc;
+}
+matrix_entry diagonalEntry(const Row_Node* rowPos)
+{
+    Sm_Node* element = rowPos ? rowPos->rowlist : NULL;
+    while(element && element->col < element->row)
+    {
+        element = element->right;
+    }
+    return (element && element->col == element->row) ? element->data : 0;
+}
+// log|det| and sign by structure: the diagonal for diagonal and triangular
+// matrices, the entries and the cycle signs for permutations, the sum over the
+// blocks for block diagonal matrices, and the pivots of the LU factors for
+// general ones. sign is 0 and logAbsDet -INFINITY for a singular matrix.
+status_code structuredLogDeterminant(SparseMatrix* matrix, double* logAbsDet, int* sign)
+{
+    status_code sc = SUCCESS;
+    MatrixStructure structure = classifyMatrix(matrix);
+    Progress* progress = activeProgress;
+    *logAbsDet = 0;
+    *sign = 1;
+    if(structure == STRUCTURE_GENERAL)
+    {
+        LuFactor lu;
+        sc = factorLU(matrix, &lu);
+        if(sc == SUCCESS)
+        {
+            *logAbsDet = lu.logAbsDet;
+            *sign = lu.sign;
+            freeLuFactor(&lu);
+        }
+        return sc;
+    }
+    PROFILE_BEGIN(PROF_DETERMINANT);
+    double flops = 0;
+    if(structure == STRUCTURE_DIAGONAL || structure == STRUCTURE_LOWER || structure == STRUCTURE_UPPER)
+    {
+        int found = 0;
+        for(Row_Node* rowPos = matrix->rowHead; rowPos; rowPos = rowPos->next)
+        {
+            matrix_entry value = diagonalEntry(rowPos);
+            accumulateLog(value, logAbsDet, sign);
+            found += (value != 0);
+            flops++;
+        }
+        if(found < matrix->rowCount)
+        {
+            *sign = 0;
+        }
+    }
+    else if(structure == STRUCTURE_PERMUTATION)
+    {
+        int n = matrix->rowCount;
+        int* target = (int*)malloc((n + 1) * sizeof(int));
+        sc = target ? SUCCESS : FAILURE;
+        for(Row_Node* rowPos = matrix->rowHead; sc == SUCCESS && rowPos; rowPos = rowPos->next)
+        {
+            target[rowPos->row] = rowPos->rowlist->col;
+            accumulateLog(rowPos->rowlist->data, logAbsDet, sign);
+            flops++;
+        }
+        if(sc == SUCCESS)
+        {
+            *sign *= permutationSign(target, n);
+        }
+        free(target);
+    }
+    else
+    {
+        MatrixBlocks blocks;
+        sc = findBlocks(matrix, &blocks);
+        if(sc == SUCCESS)
+        {
+            beginProgress(progress, blocks.count);
+            for(int b = 0; sc == SUCCESS && b < blocks.count && *sign != 0 && !progressCancelled(progress); b++)
+            {
+                if(blocks.start[b + 1] - blocks.start[b] == 1)
+                {
+                    accumulateLog(diagonalEntry(blocks.rows[blocks.members[blocks.start[b]]]), logAbsDet, sign);
+                    flops++;
+                }
+                else
+                {
+                    SparseMatrix block;
+                    double blockLog = 0;
+                    int blockSign = 0;
+                    sc = extractBlock(&blocks, b, &block);
+                    enterProgressStep(progress);
+                    if(sc == SUCCESS)
+                    {
+                        sc = structuredLogDeterminant(&block, &blockLog, &blockSign);
+                    }
+                    leaveProgressStep(progress);
+                    *logAbsDet += blockLog;
+                    *sign *= blockSign;
+                    releaseMatrix(&block);
+                }
+                addProgress(progress, 1, 1);
+            }
+            freeBlocks(&blocks);
+        }
+    }
+    if(*sign == 0)
+    {
+        *logAbsDet = -INFINITY;
+    }
+    PROFILE_COUNT(flops, flops);
+    PROFILE_END();
+    return sc;
+}
+// det(A) = sign * exp(logAbsDet), without the overflow of the product itself
+status_code logDeterminant(SparseMatrix* matrix, double* logAbsDet, int* sign)
+{
+    status_code sc = SUCCESS;
+
+    if(matrix->symmetric)// the structure tests need both halves
+    {
+        SparseMatrix full;
+        sc = expandSymmetric(matrix, &full);
+        if(sc == SUCCESS)
+        {
+            sc = structuredLogDeterminant(&full, logAbsDet, sign);
+        }
+        clearMatrix(&full);
+    }
+    else if(matrix->rowCount == matrix->colCount)
+    {
+        sc = structuredLogDeterminant(matrix, logAbsDet, sign);
+    }
+    else
+    {
+        printf("Determinant undefined: Matrix is not square.\n");
+        sc = FAILURE;
+    }
+    return sc;
+}
+status_code determinantOfMatrix(SparseMatrix* matrix, float* result)// +-inf or 0 once out of float range
+{
+    double logAbsDet;
+    int sign;
+    status_code sc = logDeterminant(matrix, &logAbsDet, &sign);
+    if(sc == SUCCESS)
+    {
+        *result = (sign == 0) ? 0 : (float)(sign * exp(logAbsDet));
+    }
+    return sc;
+}
+// estimate of ||A||_1 ||A^-1||_1, INFINITY for a singular matrix
+status_code conditionEstimate(const SparseMatrix* matrix, double* condition)
+{
+    status_code sc = FAILURE;
+    LuFactor lu;
+    if(matrix->rowCount != matrix->colCount)
+    {
+        printf("Condition number undefined: Matrix is not square.\n");
+    }
+    else if(factorLU(matrix, &lu) == SUCCESS)
+    {
+        *condition = (lu.sign == 0) ? INFINITY : lu.norm1 * estimateInverseNorm1(&lu);
+        freeLuFactor(&lu);
+        sc = SUCCESS;
+    }
+    return sc;
+}
+
+void scalarMultiplyMatrix(SparseMatrix* matrix, float scalar)
+{
+    Row_Node* rowPos = matrix->rowHead;
+    bumpVersion(matrix);
+    PROFILE_BEGIN(PROF_SCALAR);
+    double flops = 0;
+    while(rowPos)
+    {
+        Sm_Node* element = rowPos->rowlist;
+        while(element)
+        {
+            element->data = element->data * scalar;
+            element = element->right;
+            flops++;
+        }
+        rowPos = rowPos->next;
+    }
+    PROFILE_COUNT(flops, flops);
+    PROFILE_END();
+}
+// A^-1 a row at a time: row i solves A^T y = e_i with the LU factors
+status_code luInverse(const LuFactor* lu, SparseMatrix* result)
+{
+    MatrixBuilder builder;
+    int n = lu->n;
+    Progress* progress = activeProgress;
+    double* e = (double*)calloc(n + 1, sizeof(double));
+    double* y = (double*)malloc((n + 1) * sizeof(double));
+    status_code sc = (e && y && lu->sign != 0) ? beginMatrixBuilder(&builder, result, n, n) : FAILURE;
+    if(sc == SUCCESS)
+    {
+        long rowFlops = 2 * (long)(lu->lower.rowPtr[n] + lu->upper.rowPtr[n]) + n;
+        beginProgress(progress, n);
+        for(int i = 0; sc == SUCCESS && i < n && !progressCancelled(progress); i++)
+        {
+            e[i] = 1;
+            solveTransposedLU(lu, e, y);
+            e[i] = 0;
+            for(int j = 0; sc == SUCCESS && j < n; j++)
+            {
+                sc = appendElement(&builder, i, j, (matrix_entry)y[j]);
+            }
+            PROFILE_COUNT(flops, rowFlops);
+            addProgress(progress, 1, rowFlops);
+        }
+        finishMatrixBuilder(&builder);
+        if(progressCancelled(progress))
+        {
+            sc = FAILURE;
+        }
+    }
+    free(e);
+    free(y);
+    return sc;
+}
+// one entry per row and column: the inverse puts 1/a at the transposed position
+status_code permutationInverse(SparseMatrix* matrix, SparseMatrix* result)
+{
+    MatrixBuilder builder;
+    int rows = 0;
+    status_code sc = beginMatrixBuilder(&builder, result, matrix->rowCount, matrix->colCount);
+    if(sc == SUCCESS)
+    {
+        for(Row_Node* rowPos = matrix->rowHead; sc == SUCCESS && rowPos; rowPos = rowPos->next)
+        {
+            Sm_Node* element = rowPos->rowlist;
+            if(element->right || element->data == 0)// singular
+            {
+                sc = FAILURE;
+            }
+            else
+            {
+                sc = appendElement(&builder, element->col, element->row, 1 / element->data);
+                rows++;
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    if(rows < matrix->rowCount)// an empty row
+    {
+        sc = FAILURE;
+    }
+    PROFILE_COUNT(flops, rows);
+    return sc;
+}
+// one row of the inverse of a triangular matrix, see triangularInverse
+status_code inverseRow(int i, int n, Row_Node** rows, const double* diagonal, double* work, Sm_Node** cursor,
+                       int* stack, int* order, int* mark, MatrixBuilder* builder)
+{
+    status_code sc = SUCCESS;
+    int depth = 1, top = n;
+    long rowFlops = 0;
+    stack[0] = i;
+    cursor[0] = rows[i] ? rows[i]->rowlist : NULL;
+    mark[i] = i;
+    while(depth > 0)
+    {
+        int k = stack[depth - 1];
+        Sm_Node* element = cursor[depth - 1];
+        while(element && (element->col == k || mark[element->col] == i))
+        {
+            element = element->right;
+        }
+        if(element)
+        {
+            cursor[depth - 1] = element->right;
+            mark[element->col] = i;
+            stack[depth] = element->col;
+            cursor[depth] = rows[element->col] ? rows[element->col]->rowlist : NULL;
+            depth++;
+        }
+        else
+        {
+            order[--top] = k;
+            depth--;
+        }
+    }
+    for(int p = top; p < n; p++)
+    {
+        work[order[p]] = (order[p] == i);
+    }
+    for(int p = top; p < n; p++)
+    {
+        int k = order[p];
+        double x = work[k] / diagonal[k];
+        work[k] = x;
+        rowFlops++;
+        for(Sm_Node* element = rows[k]->rowlist; element; element = element->right)
+        {
+            if(element->col != k)
+            {
+                work[element->col] -= x * element->data;
+                rowFlops += 2;
+            }
+        }
+    }
+    PROFILE_COUNT(flops, rowFlops);
+    qsort(order + top, n - top, sizeof(int), compareIndexes);
+    for(int p = top; sc == SUCCESS && p < n; p++)
+    {
+        sc = appendElement(builder, i, order[p], (matrix_entry)work[order[p]]);
+    }
+    addProgress(activeProgress, 1, rowFlops);
+    return sc;
+}
+// row i of the inverse solves x A = e_i. For triangular A, x[m] needs every x[k]
+// whose row k has an entry in column m, so the rows reached from i through the
+// off-diagonal entries are solved in reverse postorder of a depth first search,
+// and each row of the inverse costs only the entries of its reach.
+status_code triangularInverse(SparseMatrix* matrix, SparseMatrix* result)
+{
+    MatrixBuilder builder;
+    int n = matrix->rowCount;
+    Progress* progress = activeProgress;
+    Row_Node** rows = (Row_Node**)calloc(n + 1, sizeof(Row_Node*));
+    Sm_Node** cursor = (Sm_Node**)malloc((n + 1) * sizeof(Sm_Node*));
+    double* diagonal = (double*)calloc(n + 1, sizeof(double));
+    double* work = (double*)malloc((n + 1) * sizeof(double));
+    int* stack = (int*)malloc((n + 1) * sizeof(int));
+    int* order = (int*)malloc((n + 1) * sizeof(int));
+    int* mark = (int*)malloc((n + 1) * sizeof(int));
+    status_code sc = (rows && cursor && diagonal && work && stack && order && mark) ? SUCCESS : FAILURE;
+
+    if(sc == SUCCESS)
+    {
+        for(Row_Node* rowPos = matrix->rowHead; rowPos; rowPos = rowPos->next)
+        {
+            rows[rowPos->row] = rowPos;
+            diagonal[rowPos->row] = diagonalEntry(rowPos);
+        }
+        for(int i = 0; i < n; i++)
+        {
+            mark[i] = -1;
+            if(diagonal[i] == 0)// singular
+            {
+                sc = FAILURE;
+            }
+        }
+    }
+    if(sc == SUCCESS && beginMatrixBuilder(&builder, result, n, n) == SUCCESS)
+    {
+        beginProgress(progress, n);
+        for(int i = 0; sc == SUCCESS && i < n && !progressCancelled(progress); i++)
+        {
+            sc = inverseRow(i, n, rows, diagonal, work, cursor, stack, order, mark, &builder);
+        }
+        finishMatrixBuilder(&builder);
+    }
+    else
+    {
+        sc = FAILURE;
+    }
+    free(rows);
+    free(cursor);
+    free(diagonal);
+    free(work);
+    free(stack);
+    free(order);
+    free(mark);
+    return sc;
+}
+// min |a| / max |a| over the diagonal, or over the entries of a permutation:
+// the reciprocal 1-norm condition number of a diagonal or scaled permutation
+// matrix, and an upper bound on it for a triangular one. 0 when singular.
+double diagonalRcond(const SparseMatrix* matrix, MatrixStructure structure)
+{
+    double smallest = INFINITY, largest = 0;
+    int found = 0;
+    for(Row_Node* rowPos = matrix->rowHead; rowPos; rowPos = rowPos->next)
+    {
+        double value = fabs((structure == STRUCTURE_PERMUTATION) ? rowPos->rowlist->data : diagonalEntry(rowPos));
+        smallest = fmin(smallest, value);
+        largest = fmax(largest, value);
+        found++;
+    }
+    return (found < matrix->rowCount || largest == 0) ? 0 : smallest / largest;
+}
+// inverse for any structure but STRUCTURE_BLOCK_DIAGONAL. Only a general matrix
+// is factored, for both its condition estimate and its inverse. FAILURE with
+// *rcond below INVERSE_MIN_RCOND when the matrix is singular or nearly so.
+status_code structuredInverse(SparseMatrix* matrix, MatrixStructure structure, SparseMatrix* result, double* rcond)
+{
+    status_code sc = SUCCESS;
+    boolean factored = FALSE;
+    LuFactor lu;
+    *rcond = 1;
+    if(structure == STRUCTURE_GENERAL)
+    {
+        enterProgressStep(activeProgress);// the factorization only adds flops
+        sc = factorLU(matrix, &lu);
+        leaveProgressStep(activeProgress);
+        factored = (sc == SUCCESS);
+        if(factored)
+        {
+            *rcond = (lu.sign == 0) ? 0 : 1 / (lu.norm1 * estimateInverseNorm1(&lu));
+        }
+    }
+    else
+    {
+        *rcond = diagonalRcond(matrix, structure);
+    }
+    if(sc == SUCCESS && *rcond < INVERSE_MIN_RCOND)
+    {
+        sc = FAILURE;
+    }
+    else if(sc == SUCCESS && structure == STRUCTURE_GENERAL)
+    {
+        sc = luInverse(&lu, result);
+    }
+    else if(sc == SUCCESS && (structure == STRUCTURE_DIAGONAL || structure == STRUCTURE_PERMUTATION))
+    {
+        sc = permutationInverse(matrix, result);
+    }
+    else if(sc == SUCCESS)
+    {
+        sc = triangularInverse(matrix, result);
+    }
+    if(factored)
+    {
+        freeLuFactor(&lu);
+    }
+    return sc;
+}
+// every block is inverted on its own and the inverses are scattered back into
+// the rows and columns of their block; a single index is a 1 x 1 block. Each
+// block is checked on its own, and *rcond is the smallest block estimate.
+status_code blockInverse(SparseMatrix* matrix, SparseMatrix* result, double* rcond)
+{
+    MatrixBlocks blocks;
+    MatrixBuilder builder;
+    Progress* progress = activeProgress;
+    SparseMatrix* inverses = NULL;
+    Row_Node** cursor = NULL;
+    status_code sc = findBlocks(matrix, &blocks);
+    *rcond = 1;
+    if(sc == SUCCESS)
+    {
+        inverses = (SparseMatrix*)calloc(blocks.count + 1, sizeof(SparseMatrix));
+        cursor = (Row_Node**)calloc(blocks.count + 1, sizeof(Row_Node*));
+        sc = (inverses && cursor) ? SUCCESS : FAILURE;
+        beginProgress(progress, blocks.count);
+    }
+    for(int b = 0; sc == SUCCESS && b < blocks.count && !progressCancelled(progress); b++)
+    {
+        if(blocks.start[b + 1] - blocks.start[b] == 1)
+        {
+            if(diagonalEntry(blocks.rows[blocks.members[blocks.start[b]]]) == 0)// singular
+            {
+                *rcond = 0;
+                sc = FAILURE;
+            }
+        }
+        else
+        {
+            SparseMatrix block;
+            double blockRcond = 1;
+            sc = extractBlock(&blocks, b, &block);
+            enterProgressStep(progress);
+            if(sc == SUCCESS)
+            {
+                sc = structuredInverse(&block, classifyMatrix(&block), &inverses[b], &blockRcond);
+            }
+            *rcond = fmin(*rcond, blockRcond);
+            leaveProgressStep(progress);
+            releaseMatrix(&block);
+            cursor[b] = inverses[b].rowHead;
+        }
+        addProgress(progress, 1, 0);
+    }
+    if(progressCancelled(progress))
+    {
+        sc = FAILURE;
+    }
+    if(sc == SUCCESS && beginMatrixBuilder(&builder, result, matrix->rowCount, matrix->colCount) == SUCCESS)
+    {
+        for(int i = 0; sc == SUCCESS && i < matrix->rowCount; i++)// rows in order, each block's rows in order
+        {
+            int b = blocks.block[i];
+            if(blocks.start[b + 1] - blocks.start[b] == 1)
+            {
+                sc = appendElement(&builder, i, i, 1 / diagonalEntry(blocks.rows[i]));
+            }
+            else if(cursor[b] && cursor[b]->row == blocks.local[i])
+            {
+                for(Sm_Node* element = cursor[b]->rowlist; sc == SUCCESS && element; element = element->right)
+                {
+                    sc = appendElement(&builder, i, blocks.members[blocks.start[b] + element->col], element->data);
+                }
+                cursor[b] = cursor[b]->next;
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    else
+    {
+        sc = FAILURE;
+    }
+    if(inverses)
+    {
+        for(int b = 0; b < blocks.count; b++)
+        {
+            releaseMatrix(&inverses[b]);
+        }
+    }
+    free(inverses);
+    free(cursor);
+    if(blocks.start)
+    {
+        freeBlocks(&blocks);
+    }
+    return sc;
+}
+// classifies the matrix and inverts it by structure, refusing it when the
+// reciprocal condition estimate of its structure is below INVERSE_MIN_RCOND
+status_code inverseOfMatrix(SparseMatrix* matrix, SparseMatrix* result)
+{
+    status_code sc = SUCCESS;
+    SparseMatrix full;
+    SparseMatrix* square = matrix;
+    double rcond = 1;
+
+    initializeMatrix(&full);
+    if(matrix->symmetric)// the structure tests need both halves
+    {
+        sc = expandSymmetric(matrix, &full);
+        square = &full;
+    }
+    if(sc == SUCCESS && matrix->rowCount != matrix->colCount)
+    {
+        printf("Inverse undefined: Matrix is not square.\n");
+        sc = FAILURE;
+    }
+    else if(sc == SUCCESS)
+    {
+        MatrixStructure structure = classifyMatrix(square);
+        PROFILE_BEGIN(PROF_INVERSE);
+        if(structure == STRUCTURE_BLOCK_DIAGONAL)
+        {
+            sc = blockInverse(square, result, &rcond);
+        }
+        else
+        {
+            sc = structuredInverse(square, structure, result, &rcond);
+        }
+        PROFILE_END();
+        if(rcond < INVERSE_MIN_RCOND)
+        {
+            printf("Matrix is singular or nearly so (reciprocal condition estimate %.2e).\n", rcond);
+        }
+    }
+    clearMatrix(&full);
+    return sc;
+}
+// asynchronous jobs. submitJob copies the operands, queues the operation and
+// returns a handle at once; JOB_THREADS job threads take queued jobs in
+// submission order. While a job runs, its kernels report rows and flops to
+// the job's Progress and stop early once it is cancelled; awaitJob blocks
+// until the job has ended. A job's loops still use the thread pool whenever
+// no other loop holds it. -DSM_NO_THREADS runs every job inside submitJob.
+#define JOB_THREADS 2
+
+typedef enum{JOB_MULTIPLY, JOB_INVERSE, JOB_DETERMINANT} JobKind;
+typedef enum{JOB_QUEUED, JOB_RUNNING, JOB_DONE, JOB_FAILED, JOB_CANCELLED} JobState;
+
+typedef struct Job_Tag
+{
+    int id;
+    JobKind kind;
+    char target;                        // registry name for the result, chosen by the caller
+    unsigned long targetVersion;        // of the target when submitted, 0 when the name was free
+    SparseMatrix operand1, operand2;    // private copies taken at submission
+    SparseMatrix result;
+    float value;                        // JOB_DETERMINANT
+    Progress progress;
+    atomic_int state;
+    double seconds;
+    struct Job_Tag* next;               // every job not yet freed, in submission order
+} Job;
+
+typedef struct Job_Queue_Tag
+{
+    Job* head;
+    Job* tail;
+    int nextId;
+#ifndef SM_NO_THREADS
+    pthread_mutex_t lock;               // guards the list and the stopping flag
+    pthread_cond_t work, ended;
+    pthread_t threads[JOB_THREADS];
+    int threadCount;
+    boolean stopping;
+#endif
+} JobQueue;
+
+JobQueue jobs;
+#ifndef SM_NO_THREADS
+pthread_once_t jobsStarted = PTHREAD_ONCE_INIT;
+#endif
+
+const char* jobKindName(JobKind kind)
+{
+    const char* names[] = {"multiply", "inverse", "determinant"};
+    return names[kind];
+}
+const char* jobStateName(JobState state)
+{
+    const char* names[] = {"queued", "running", "done", "failed", "cancelled"};
+    return names[state];
+}
+boolean jobEnded(const Job* job)
+{
+    return atomic_load(&job->state) >= JOB_DONE;
+}
+void runJob(Job* job)
+{
+    status_code sc = FAILURE;
+    struct timespec start, end;
+    int expected = JOB_QUEUED;
+    if(!atomic_compare_exchange_strong(&job->state, &expected, JOB_RUNNING))
+    {
+        return;// cancelled while queued
+    }
+    timespec_get(&start, TIME_UTC);
+    activeProgress = &job->progress;
+    switch(job->kind)
+    {
+        case JOB_MULTIPLY: sc = multiplyMatrix(&job->operand1, &job->operand2, &job->result); break;
+        case JOB_INVERSE: sc = inverseOfMatrix(&job->operand1, &job->result); break;
+        case JOB_DETERMINANT: sc = determinantOfMatrix(&job->operand1, &job->value); break;
+    }
+    activeProgress = NULL;
+    timespec_get(&end, TIME_UTC);
+    job->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    releaseMatrix(&job->operand1);
+    releaseMatrix(&job->operand2);
+    if(sc == FAILURE)
+    {
+        releaseMatrix(&job->result);
+    }
+#ifndef SM_NO_THREADS
+    pthread_mutex_lock(&jobs.lock);
+#endif
+    atomic_store(&job->state, progressCancelled(&job->progress) ? JOB_CANCELLED : (sc == SUCCESS) ? JOB_DONE : JOB_FAILED);
+#ifndef SM_NO_THREADS
+    pthread_cond_broadcast(&jobs.ended);
+    pthread_mutex_unlock(&jobs.lock);
+#endif
+}
+#ifndef SM_NO_THREADS
+void* jobThreadMain(void* data)
+{
+    pthread_mutex_lock(&jobs.lock);
+    while(!jobs.stopping)
+    {
+        Job* job = jobs.head;
+        while(job && atomic_load(&job->state) != JOB_QUEUED)
+        {
+            job = job->next;
+        }
+        if(job)
+        {
+            pthread_mutex_unlock(&jobs.lock);
+            runJob(job);
+            pthread_mutex_lock(&jobs.lock);
+        }
+        else
+        {
+            pthread_cond_wait(&jobs.work, &jobs.lock);
+        }
+    }
+    pthread_mutex_unlock(&jobs.lock);
+    return data;
+}
+void stopJobs(void)// cancels what is left and joins the job threads
+{
+    pthread_mutex_lock(&jobs.lock);
+    jobs.stopping = TRUE;
+    for(Job* job = jobs.head; job; job = job->next)
+    {
+        atomic_store(&job->progress.cancelled, 1);
+    }
+    pthread_cond_broadcast(&jobs.work);
+    pthread_mutex_unlock(&jobs.lock);
+    for(int t = 0; t < jobs.threadCount; t++)
+    {
+        pthread_join(jobs.threads[t], NULL);
+    }
+    jobs.threadCount = 0;
+}
+void startJobThreads(void)
+{
+    pthread_mutex_init(&jobs.lock, NULL);
+    pthread_cond_init(&jobs.work, NULL);
+    pthread_cond_init(&jobs.ended, NULL);
+    poolThreadCount();// the pool's atexit handler must run after stopJobs
+    for(int t = 0; t < JOB_THREADS && pthread_create(&jobs.threads[t], NULL, jobThreadMain, NULL) == 0; t++)
+    {
+        jobs.threadCount = t + 1;
+    }
+    atexit(stopJobs);
+}
+#endif
+// NULL when the copies cannot be made or the operation is undefined for the operands
+Job* submitJob(JobKind kind, const SparseMatrix* matrix1, const SparseMatrix* matrix2)
+{
+    Job* job = (Job*)calloc(1, sizeof(Job));
+    status_code sc = job ? SUCCESS : FAILURE;
+    boolean defined = (kind == JOB_MULTIPLY) ? matrix1->colCount == matrix2->rowCount : matrix1->rowCount == matrix1->colCount;
+
+#ifndef SM_NO_THREADS
+    pthread_once(&jobsStarted, startJobThreads);
+#endif
+    if(sc == SUCCESS)
+    {
+        job->kind = kind;
+        initializeMatrix(&job->operand1);
+        initializeMatrix(&job->operand2);
+        initializeMatrix(&job->result);
+        sc = (defined && cloneMatrix(matrix1, &job->operand1) == SUCCESS
+              && (kind != JOB_MULTIPLY || cloneMatrix(matrix2, &job->operand2) == SUCCESS)) ? SUCCESS : FAILURE;
+        if(sc == FAILURE)
+        {
+            releaseMatrix(&job->operand1);
+            releaseMatrix(&job->operand2);
+            free(job);
+            job = NULL;
+        }
+    }
+    if(sc == SUCCESS)
+    {
+        atomic_init(&job->state, JOB_QUEUED);
+#ifndef SM_NO_THREADS
+        pthread_mutex_lock(&jobs.lock);
+#endif
+        job->id = ++jobs.nextId;
+        if(jobs.tail)
+        {
+            jobs.tail->next = job;
+        }
+        else
+        {
+            jobs.head = job;
+        }
+        jobs.tail = job;
+#ifndef SM_NO_THREADS
+        pthread_cond_signal(&jobs.work);
+        pthread_mutex_unlock(&jobs.lock);
+#else
+        runJob(job);
+#endif
+    }
+    return job;
+}
+Job* findJob(int id)
+{
+    Job* job;
+#ifndef SM_NO_THREADS
+    pthread_mutex_lock(&jobs.lock);
+#endif
+    for(job = jobs.head; job && job->id != id; job = job->next)
+    {
+    }
+#ifndef SM_NO_THREADS
+    pthread_mutex_unlock(&jobs.lock);
+#endif
+    return job;
+}
+// a queued job is cancelled at once, a running one at its next progress check
+void cancelJob(Job* job)
+{
+    int expected = JOB_QUEUED;
+    atomic_store(&job->progress.cancelled, 1);
+#ifndef SM_NO_THREADS
+    pthread_mutex_lock(&jobs.lock);
+#endif
+    if(atomic_compare_exchange_strong(&job->state, &expected, JOB_CANCELLED))
+    {
+#ifndef SM_NO_THREADS
+        pthread_cond_broadcast(&jobs.ended);
+#endif
+    }
+#ifndef SM_NO_THREADS
+    pthread_mutex_unlock(&jobs.lock);
+#endif
+}
+JobState awaitJob(Job* job)
+{
+#ifndef SM_NO_THREADS
+    pthread_mutex_lock(&jobs.lock);
+    while(!jobEnded(job))
+    {
+        pthread_cond_wait(&jobs.ended, &jobs.lock);
+    }
+    pthread_mutex_unlock(&jobs.lock);
+#endif
+    return atomic_load(&job->state);
+}
+// takes an ended job off the list; its result, if kept, belongs to the caller
+void freeJob(Job* job)
+{
+    Job* prev = NULL;
+#ifndef SM_NO_THREADS
+    pthread_mutex_lock(&jobs.lock);
+#endif
+    for(Job* pos = jobs.head; pos && pos != job; pos = pos->next)
+    {
+        prev = pos;
+    }
+    if(prev)
+    {
+        prev->next = job->next;
+    }
+    else
+    {
+        jobs.head = job->next;
+    }
+    if(jobs.tail == job)
+    {
+        jobs.tail = prev;
+    }
+#ifndef SM_NO_THREADS
+    pthread_mutex_unlock(&jobs.lock);
+#endif
+    releaseMatrix(&job->result);
+    free(job);
+}
+// memory and shape statistics. Byte counts are payload sizes of the nodes;
+// MALLOC_OVERHEAD is the allocator's per-block bookkeeping added on top.
+#define HISTOGRAM_BUCKETS 8
+#define MALLOC_OVERHEAD 16
+
+typedef struct Matrix_Stats_Tag
+{
+    int rowCount, colCount;
+    long nnz;
+    double density;
+    int rowHeaders, colHeaders;
+    size_t elementBytes, headerBytes, indexBytes, overheadBytes, totalBytes;
+    int lowerBandwidth, upperBandwidth;
+    int maxRowLength;
+    long rowHistogram[HISTOGRAM_BUCKETS];   // rows of length 0, 1, 2-3, 4-7, ..., 64+
+    const char* backend;
+    const char* structure;
+} MatrixStats;
+
+int histogramBucket(int length)
+{
+    int bucket = 0;
+    while(length > 0 && bucket < HISTOGRAM_BUCKETS - 1)
+    {
+        bucket++;
+        length >>= 1;
+    }
+    return bucket;
+}
+void computeMatrixStats(const SparseMatrix* matrix, MatrixStats* stats)
+{
+    long diagonal = 0;
+    memset(stats, 0, sizeof(MatrixStats));
+    stats->rowCount = matrix->rowCount;
+    stats->colCount = matrix->colCount;
+    stats->backend = matrix->symmetric ? "dual linked list, symmetric (lower triangle)" : "dual linked list";
+    stats->structure = (matrix->rowCount == matrix->colCount) ? structureName(classifyMatrix(matrix)) : "rectangular";
+
+    for(Row_Node* rowPos = matrix->rowHead; rowPos; rowPos = rowPos->next)
+    {
+        int length = 0;
+        for(Sm_Node* element = rowPos->rowlist; element; element = element->right)
+        {
+            int offset = element->row - element->col;
+            if(offset > stats->lowerBandwidth)
+            {
+                stats->lowerBandwidth = offset;
+            }
+            if(-offset > stats->upperBandwidth)
+            {
+                stats->upperBandwidth = -offset;
+            }
+            diagonal += (offset == 0);
+            length++;
+        }
+        stats->nnz += length;
+        stats->rowHeaders++;
+        stats->rowHistogram[histogramBucket(length)]++;
+        if(length > stats->maxRowLength)
+        {
+            stats->maxRowLength = length;
+        }
+    }
+    for(Col_Node* colPos = matrix->colHead; colPos; colPos = colPos->next)
+    {
+        stats->colHeaders++;
+    }
+    stats->rowHistogram[0] = matrix->rowCount - stats->rowHeaders;
+
+    if(matrix->symmetric)
+    {
+        stats->upperBandwidth = stats->lowerBandwidth;
+    }
+    if(matrix->rowCount > 0 && matrix->colCount > 0)// density of the full matrix, mirrored entries included
+    {
+        long logical = matrix->symmetric ? 2 * stats->nnz - diagonal : stats->nnz;
+        stats->density = (double)logical / ((double)matrix->rowCount * matrix->colCount);
+    }
+    stats->elementBytes = stats->nnz * sizeof(Sm_Node);
+    stats->headerBytes = stats->rowHeaders * sizeof(Row_Node) + stats->colHeaders * sizeof(Col_Node);
+    stats->indexBytes = sizeof(SparseMatrix);
+    stats->overheadBytes = (stats->nnz + stats->rowHeaders + stats->colHeaders) * MALLOC_OVERHEAD;
+    stats->totalBytes = stats->elementBytes + stats->headerBytes + stats->indexBytes + stats->overheadBytes;
+}
+void printMatrixStats(const MatrixStats* stats, char name)
+{
+    printf("Statistics of matrix %c [%d x %d]\n", name, stats->rowCount, stats->colCount);
+    printf("  backend        : %s\n", stats->backend);
+    printf("  nonzeros       : %ld (density %.4f%%)\n", stats->nnz, stats->density * 100);
+    printf("  element nodes  : %zu bytes (%zu per node)\n", stats->elementBytes, sizeof(Sm_Node));
+    printf("  headers        : %zu bytes (%d rows, %d columns)\n", stats->headerBytes, stats->rowHeaders, stats->colHeaders);
+    printf("  indexes        : %zu bytes (descriptor and index arrays)\n", stats->indexBytes);
+    printf("  malloc overhead: %zu bytes (estimated)\n", stats->overheadBytes);
+    printf("  total          : %zu bytes (%.2f per nonzero)\n", stats->totalBytes,
+        stats->nnz ? (double)stats->totalBytes / stats->nnz : 0.0);
+    printf("  structure      : %s\n", stats->structure);
+    printf("  bandwidth      : %d lower, %d upper\n", stats->lowerBandwidth, stats->upperBandwidth);
+    printf("  row lengths    : max %d\n", stats->maxRowLength);
+    for(int b = 0; b < HISTOGRAM_BUCKETS; b++)
+    {
+        int lo = (b == 0) ? 0 : 1 << (b - 1);
+        int hi = (1 << b) - 1;
+        if(b == HISTOGRAM_BUCKETS - 1)
+        {
+            printf("    %5d+      : %ld\n", lo, stats->rowHistogram[b]);
+        }
+        else
+        {
+            printf("    %5d-%-5d : %ld\n", lo, hi, stats->rowHistogram[b]);
+        }
+    }
+}
+#ifdef SM_PROFILE
+// counters of all threads, the main thread, pool workers and job threads alike.
+// Jobs still running may be partly counted.
+void sumProfile(ProfileCounter* total)
+{
+    memset(total, 0, PROF_OP_COUNT * sizeof(ProfileCounter));
+    for(ProfileThread* block = atomic_load(&profileThreads); block; block = block->next)
+    {
+        for(int op = 0; op < PROF_OP_COUNT; op++)
+        {
+            total[op].calls += block->counters[op].calls;
+            total[op].nodesAllocated += block->counters[op].nodesAllocated;
+            total[op].nodesFreed += block->counters[op].nodesFreed;
+            total[op].hops += block->counters[op].hops;
+            total[op].flops += block->counters[op].flops;
+            total[op].seconds += block->counters[op].seconds;
+        }
+    }
+}
+#endif
+void printProfile()
+{
+#ifdef SM_PROFILE
+    ProfileCounter total[PROF_OP_COUNT];
+    sumProfile(total);
+    printf("%-22s %10s %10s %10s %12s %14s %12s\n", "operation", "calls", "allocated", "freed", "hops", "flops", "ms");
+    for(int op = 0; op < PROF_OP_COUNT; op++)
+    {
+        const ProfileCounter* c = &total[op];
+        if(c->calls || c->nodesAllocated || c->nodesFreed || c->hops)
+        {
+            printf("%-22s %10ld %10ld %10ld %12ld %14.0f %12.3f\n", profileOpNames[op], c->calls,
+                c->nodesAllocated, c->nodesFreed, c->hops, c->flops, c->seconds * 1000);
+        }
+    }
+    printPoolStats();
+#else
+    printf("Profiling was compiled out (SM_NO_PROFILE).\n");
+#endif
+    printCacheStats();
+}
+void resetProfile()
+{
+#ifdef SM_PROFILE
+    for(ProfileThread* block = atomic_load(&profileThreads); block; block = block->next)
+    {
+        memset(block->counters, 0, sizeof(block->counters));
+    }
+#endif
+}
+void writeProfileJson()// registered with atexit when SM_PROFILE_JSON is set
+{
+#ifdef SM_PROFILE
+    FILE* fp = fopen(getenv(PROFILE_JSON_ENV), "w");
+    ProfileCounter total[PROF_OP_COUNT];
+    sumProfile(total);
+    if(fp != NULL)
+    {
+        fprintf(fp, "{\n");
+        for(int op = 0; op < PROF_OP_COUNT; op++)
+        {
+            const ProfileCounter* c = &total[op];
+            fprintf(fp, "  \"%s\": {\"calls\": %ld, \"nodesAllocated\": %ld, \"nodesFreed\": %ld, \"hops\": %ld, "
+                "\"flops\": %.0f, \"seconds\": %.9f}%s\n", profileOpNames[op], c->calls, c->nodesAllocated,
+                c->nodesFreed, c->hops, c->flops, c->seconds, (op == PROF_OP_COUNT - 1) ? "" : ",");
+        }
+        fprintf(fp, "}\n");
+        fclose(fp);
+    }
+#endif
+}
+//supportive functions
+status_code createMatrix()
+{
+    status_code sc = SUCCESS;
+    char name;
+    int rows, cols;
+
+    printf("Enter matrix name (A-J): ");
+    scanf(" %c", &name);
+
+    int index = name - 'A';
+    if(index < 0 || index >= MAX_MATRICES)
+    {
+        printf("Invalid matrix name.\n");
+        sc = FAILURE;
+    }
+    else
+    {
+        if(registry[index].isOccupied)
+        {
+            printf("Matrix %c already exists. Overwriting...\n", name);
+            matrixChanged(&registry[index].matrix);
+            clearMatrix(&registry[index].matrix);
+        }
+
+        printf("Enter number of rows: ");
+        scanf("%d", &rows);
+        printf("Enter number of columns: ");
+        scanf("%d", &cols);
+
+        initializeMatrixWithSize(&registry[index].matrix, rows, cols);
+        registry[index].name = name;
+        registry[index].isOccupied = TRUE;
+
+        printf("Matrix %c created [%d x %d].\n", name, rows, cols);
+
+        printf("Enter non-zero elements (row col value), or -1 to finish:\n");
+
+        // entries are collected and applied as one batch; a repeated entry keeps its last value
+        int count = 0, capacity = 0;
+        MatrixUpdate* batch = NULL;
+        status_code done = FALSE;
+        while(done == FALSE)
+        {
+            int r, c;
+            float val;
+            printf("> ");
+            scanf("%d", &r);
+
+            if(r == -1)
+            {
+                done = TRUE;
+            }
+            else
+            {
+                scanf("%d %f", &c, &val);
+
+                if(r < 0 || r >= rows || c < 0 || c >= cols)
+                {
+                    printf("Invalid row/column. Please try again.\n");
+                }
+                else
+                {
+                    if(count == capacity)
+                    {
+                        MatrixUpdate* grown = (MatrixUpdate*)realloc(batch, (capacity ? 2 * capacity : 64) * sizeof(MatrixUpdate));
+                        if(grown)
+                        {
+                            batch = grown;
+                            capacity = capacity ? 2 * capacity : 64;
+                        }
+                    }
+                    if(count < capacity)
+                    {
+                        batch[count].row = r;
+                        batch[count].col = c;
+                        batch[count].value = val;
+                        batch[count++].op = UPDATE_UPSERT;
+                    }
+                    else
+                    {
+                        printf("Insertion failed.\n");
+                    }
+                }
+            }
+        }
+        if(applyUpdates(&registry[index].matrix, batch, count) != SUCCESS)
+        {
+            printf("Insertion failed.\n");
+        }
+        free(batch);
+
+        printf("Matrix %c created and initialized.\n", name);
+    }
+    return sc;
+}
+void resizeMatrix(SparseMatrix* matrix, int newRowCount, int newColCount)
+{
+    Row_Node* row;
+    Row_Node* prevRow = NULL;
+    bumpVersion(matrix);
+    if(matrix->symmetric && newRowCount != newColCount)
+    {
+        setSymmetricStorage(matrix, FALSE);// a rectangular matrix cannot stay symmetric
+    }
+    row = matrix->rowHead;
+    PROFILE_BEGIN(PROF_RESIZE);
+
+    while(row)// rows past the end go first, through deleteElement, while every column list is intact
+    {
+        Row_Node* nextRow = row->next;// deleting the last element frees and unlinks the row header
+        if(row->row >= newRowCount)
+        {
+            Sm_Node* sptr = row->rowlist;
+            matrix_entry d;
+            while(sptr) 
+            {
+                Sm_Node* next = sptr->right;
+                deleteElement(sptr->row, sptr->col, matrix, &d);
+                sptr = next;
+            }
+        }
+        row = nextRow;
+    }
+    row = matrix->rowHead;
+    while(row)
+    {
+        Sm_Node* ele = row->rowlist;
+        Sm_Node* prev = NULL;
+        while(ele)
+        {
+            if(ele->col >= newColCount)
+            {
+                Sm_Node* temp = ele;
+                ele = ele->right;
+                if(prev)
+                {
+                    prev->right = ele;
+                }
+                else
+                {
+                    row->rowlist = ele;
+                }
+                free(temp);
+                PROFILE_COUNT(nodesFreed, 1);
+            }
+            else
+            {
+                prev = ele;
+                ele = ele->right;
+            }
+        }
+        if(row->rowlist == NULL)// every entry was cut off, drop the empty header
+        {
+            Row_Node* tempRow = row;
+            row = row->next;
+            if(prevRow)
+            {
+                prevRow->next = row;
+            }
+            else
+            {
+                matrix->rowHead = row;
+            }
+            free(tempRow);
+            PROFILE_COUNT(nodesFreed, 1);
+        }
+        else
+        {
+            prevRow = row;
+            row = row->next;
+        }
+    }
+
+    Col_Node* col = matrix->colHead;
+    Col_Node* prevCol = NULL;
+
+    while(col)
+    {
+        if(col->col >= newColCount)
+        {
+            Col_Node* tempCol = col;
+            col = col->next;
+            if(prevCol)
+            {
+                prevCol->next = col;
+            }
+            else
+            {
+                matrix->colHead = col;
+            }
+            free(tempCol);
+            PROFILE_COUNT(nodesFreed, 1);
+        }
+        else//just in case
+        {
+            Sm_Node* ele = col->collist;
+            Sm_Node* prev = NULL;
+            while(ele)
+            {
+                if(ele->row >= newRowCount)
+                {
+                    Sm_Node* temp = ele;
+                    ele = ele->down;
+                    if (prev) prev->down = ele;
+                    else col->collist = ele;
+                    free(temp);
+                    PROFILE_COUNT(nodesFreed, 1);
+                }
+                else
+                {
+                    prev = ele;
+                    ele = ele->down;
+                }
+            }
+            prevCol = col;
+            col = col->next;
+        }
+    }
+
+    matrix->rowCount = newRowCount;
+    matrix->colCount = newColCount;
+    PROFILE_END();
+}
+void resizeMatrixUI()
+{
+    char name;
+    int newRows, newCols;
+
+    printf("Enter matrix name to resize: ");
+    scanf(" %c", &name);
+
+    int index = name - 'A';
+    if(!registry[index].isOccupied)
+    {
+        printf("Matrix %c not found.\n", name);
+    }
+    else
+    {
+        printf("Enter new row count: ");
+        scanf("%d", &newRows);
+        printf("Enter new column count: ");
+        scanf("%d", &newCols);
+
+        SparseMatrix* matrix = beginWrite(name);
+        resizeMatrix(matrix, newRows, newCols);
+        matrixChanged(matrix);
+        endWrite(name);
+
+        printf("Matrix %c resized to [%d x %d].\n", name, newRows, newCols);
+    }
+}
+void insertElementUI()
+{
+    char name;
+    int row, col;
+    matrix_entry val;
+
+    printf("Enter matrix name to insert into: ");
+    scanf(" %c", &name);
+
+    int index = name - 'A';
+    if(index < 0 || index >= MAX_MATRICES || !registry[index].isOccupied)
+    {
+        printf("Matrix %c does not exist.\n", name);
+    }
+    else
+    {
+        printf("Enter row index (0-based): ");
+        scanf("%d", &row);
+        printf("Enter column index (0-based): ");
+        scanf("%d", &col);
+        printf("Enter value: ");
+        scanf("%f", &val);
+
+        SparseMatrix* matrix = beginWrite(name);
+        matrixChanged(matrix);
+        if(insertElement(row, col, val, matrix) == SUCCESS)
+        {
+            printf("Inserted value %.2f at (%d, %d) in matrix %c.\n", val, row, col, name);
+        }
+        else
+        {
+            printf("Failed to insert: Check bounds or memory.\n");
+        }
+        endWrite(name);
+    }
+}
+void deleteElementUI()
+{
+    char name;
+    int row, col;
+    float deletedVal;
+
+    printf("Enter matrix name to delete from: ");
+    scanf(" %c", &name);
+
+    int idx = name - 'A';
+    if(idx < 0 || idx >= MAX_MATRICES || !registry[idx].isOccupied)
+    {
+        printf("Matrix %c does not exist.\n", name);
+    }
+    else
+    {
+        printf("Enter row index (0-based): ");
+        scanf("%d", &row);
+        printf("Enter column index (0-based): ");
+        scanf("%d", &col);
+
+        SparseMatrix* matrix = beginWrite(name);
+        matrixChanged(matrix);
+        if(deleteElement(row, col, matrix, &deletedVal) == SUCCESS)
+        {
+            printf("Deleted value %.2f from (%d, %d) in matrix %c.\n", deletedVal, row, col, name);
+        }
+        else
+        {
+            printf("Element not found or failed to delete.\n");
+        }
+        endWrite(name);
+    }
+}
+void clearMatrixUI()
+{
+    char name;
+    printf("Enter matrix name to clear: ");
+    scanf(" %c", &name);
+
+    int idx = name - 'A';
+    if(idx < 0 || idx >= MAX_MATRICES || !registry[idx].isOccupied)
+    {
+        printf("Matrix %c does not exist.\n", name);
+    }
+    else
+    {
+        SparseMatrix* matrix = beginWrite(name);
+        matrixChanged(matrix);
+        clearMatrix(matrix);
+        endWrite(name);
+        printf("Matrix %c cleared.\n", name);
+    }
+}
+
+void matrixManagementMenu()
+{
+    int choice;
+
+    do
+    {
+        printf("\n===== MATRIX MANAGEMENT =====\n");
+        printf("1. Create Matrix\n");
+        printf("2. Resize Matrix\n");
+        printf("3. Insert/Update Element\n");//should enter non zero element
+        printf("4. Delete Element\n");
+        printf("5. Clear Matrix\n");
+        printf("6. Back to Main Menu\n");
+        printf("Enter your choice: ");
+        scanf("%d", &choice);
+
+        switch(choice)
+        {
+            case 1: createMatrix(); break;
+            case 2: resizeMatrixUI(); break;
+            case 3: insertElementUI(); break;
+            case 4: deleteElementUI(); break;
+            case 5: clearMatrixUI(); break;
+            case 6: break;
+            default: printf("Invalid choice.\n"); break;
+        }
+    }while(choice != 6);
+}
+SparseMatrix* getMatrixByName(char name)
+{
+    SparseMatrix* ans = NULL;
+    int idx = name - 'A';
+    if(!(idx < 0 || idx >= MAX_MATRICES || !registry[idx].isOccupied))
+    {
+        ans = &registry[idx].matrix;
+    }
+    return ans;
+}
+void copyMatrix(char destName, SparseMatrix* source)
+{
+    int index = destName - 'A';
+    if(index < 0 || index >= MAX_MATRICES)
+    {
+        printf("Invalid destination name.\n");
+    }
+    else
+    {
+        SparseMatrix *dest = &registry[index].matrix;
+
+        if(registry[index].isOccupied)
+        {
+            printf("Matrix %c already exists. Overwriting...\n", destName);
+            stopMaintaining(destName);
+            matrixChanged(dest);
+            clearMatrix(dest);
+        }
+
+        initializeMatrixWithSize(dest, source->rowCount, source->colCount);
+        dest->symmetric = source->symmetric;
+        registry[index].name = destName;
+        registry[index].isOccupied = TRUE;
+
+        Row_Node* rptr = source->rowHead;
+        while(rptr)
+        {
+            Sm_Node* sptr = rptr->rowlist;
+            while(sptr)
+            {
+                insertElement(sptr->row, sptr->col, sptr->data, dest);
+                sptr = sptr->right;
+            }
+            rptr = rptr->next;
+        }
+
+        printf("Matrix copied to '%c'\n", destName);
+    }
+}
+void storeMatrix(char destName, SparseMatrix* source)// moves source into the registry
+{
+    int index = destName - 'A';
+    if(registry[index].isOccupied)
+    {
+        stopMaintaining(destName);
+        matrixChanged(&registry[index].matrix);
+        clearMatrix(&registry[index].matrix);
+    }
+    registry[index].matrix = *source;
+    registry[index].name = destName;
+    registry[index].isOccupied = TRUE;
+    initializeMatrix(source);
+
+    printf("Result stored in '%c'\n", destName);
+}
+void promptSaveResult(SparseMatrix* result, const char* label)
+{
+    char choice, name;
+    status_code sc = FAILURE;
+
+    printf("Do you want to save the %s matrix before deleting? (y/n): ", label);
+    scanf(" %c", &choice);
+
+    if(choice == 'y' || choice == 'Y')
+    {
+        while(sc == FAILURE)
+        {
+            printf("Enter a destination matrix name (A-J): ");
+            scanf(" %c", &name);
+            if(name >= 'A' && name <= 'J')
+            {
+                copyMatrix(name, result);
+                sc = SUCCESS;
+            }
+            else
+            {
+                printf("Invalid matrix name.\n");
+            }
+        }
+    }
+}
+
+// expression engine: "R = 2*A*B + C'" is parsed into a DAG (one shared leaf per
+// matrix), rewritten into a sum of scaled products with the transposes pushed
+// down to the operands, and evaluated row by row into the result. Sums inside
+// products are evaluated first into temporaries.
+#define MAX_EXPR_NODES 64
+#define MAX_EXPR_TERMS 16
+#define MAX_TERM_FACTORS 8
+#define MAX_EXPR_TEMPS 16
+
+typedef enum{EXPR_MATRIX, EXPR_SCALAR, EXPR_ADD, EXPR_SUBTRACT, EXPR_MULTIPLY, EXPR_NEGATE, EXPR_TRANSPOSE} ExprOp;
+
+typedef struct Expr_Node_Tag
+{
+    ExprOp op;
+    char name;
+    matrix_entry value;
+    int left, right;
+} ExprNode;
+typedef struct Expr_Parser_Tag
+{
+    const char* pos;
+    status_code sc;
+    int nodeCount;
+    ExprNode nodes[MAX_EXPR_NODES];
+} ExprParser;
+
+typedef struct Expr_Factor_Tag
+{
+    char name;
+    int temp;           // materialised subexpression, -1 for a named matrix
+    boolean transposed;
+} ExprFactor;
+typedef struct Expr_Term_Tag   // scale * op(F0) * op(F1) * ...
+{
+    matrix_entry scale;
+    int factorCount;
+    ExprFactor factors[MAX_TERM_FACTORS];
+} ExprTerm;
+typedef struct Expression_Tag  // sum of terms
+{
+    int termCount;
+    ExprTerm terms[MAX_EXPR_TERMS];
+} Expression;
+typedef struct Expr_Program_Tag  // temporaries, each may use the ones before it
+{
+    int tempCount;
+    Expression temps[MAX_EXPR_TEMPS];
+    SparseMatrix values[MAX_EXPR_TEMPS];
+} ExprProgram;
+
+int addExprNode(ExprParser* parser, ExprOp op, int left, int right)
+{
+    int idx = -1;
+    if(parser->nodeCount < MAX_EXPR_NODES)
+    {
+        idx = parser->nodeCount++;
+        parser->nodes[idx].op = op;
+        parser->nodes[idx].name = '\0';
+        parser->nodes[idx].value = 0;
+        parser->nodes[idx].left = left;
+        parser->nodes[idx].right = right;
+    }
+    else
+    {
+        parser->sc = FAILURE;
+    }
+    return idx;
+}
+void skipExprSpaces(ExprParser* parser)
+{
+    while(isspace((unsigned char)*parser->pos))
+    {
+        parser->pos++;
+    }
+}
+int parseExprSum(ExprParser* parser);
+
+int parseExprPrimary(ExprParser* parser)
+{
+    int node = -1;
+    char c;
+
+    skipExprSpaces(parser);
+    c = *parser->pos;
+    if(c == '(')
+    {
+        parser->pos++;
+        node = parseExprSum(parser);
+        skipExprSpaces(parser);
+        if(*parser->pos == ')')
+        {
+            parser->pos++;
+        }
+        else
+        {
+            parser->sc = FAILURE;
+        }
+    }
+    else if(c >= 'A' && c <= 'Z')
+    {
+        for(int k = 0; k < parser->nodeCount && node < 0; k++)// reuse the leaf
+        {
+            if(parser->nodes[k].op == EXPR_MATRIX && parser->nodes[k].name == c)
+            {
+                node = k;
+            }
+        }
+        if(node < 0)
+        {
+            node = addExprNode(parser, EXPR_MATRIX, -1, -1);
+            if(node >= 0)
+            {
+                parser->nodes[node].name = c;
+            }
+        }
+        parser->pos++;
+    }
+    else if(isdigit((unsigned char)c) || c == '.')
+    {
+        char* end;
+        double value = strtod(parser->pos, &end);
+        node = addExprNode(parser, EXPR_SCALAR, -1, -1);
+        if(node >= 0)
+        {
+            parser->nodes[node].value = value;
+        }
+        parser->pos = end;
+    }
+    else
+    {
+        parser->sc = FAILURE;
+    }
+
+    skipExprSpaces(parser);
+    while(parser->sc == SUCCESS && *parser->pos == '\'')
+    {
+        parser->pos++;
+        node = addExprNode(parser, EXPR_TRANSPOSE, node, -1);
+        skipExprSpaces(parser);
+    }
+    return node;
+}
+int parseExprUnary(ExprParser* parser)
+{
+    int node;
+    skipExprSpaces(parser);
+    if(*parser->pos == '-')
+    {
+        parser->pos++;
+        node = addExprNode(parser, EXPR_NEGATE, parseExprUnary(parser), -1);
+    }
+    else
+    {
+        node = parseExprPrimary(parser);
+    }
+    return node;
+}
+int parseExprProduct(ExprParser* parser)
+{
+    int node = parseExprUnary(parser);
+    skipExprSpaces(parser);
+    while(parser->sc == SUCCESS && *parser->pos == '*')
+    {
+        parser->pos++;
+        node = addExprNode(parser, EXPR_MULTIPLY, node, parseExprUnary(parser));
+        skipExprSpaces(parser);
+    }
+    return node;
+}
+int parseExprSum(ExprParser* parser)
+{
+    int node = parseExprProduct(parser);
+    skipExprSpaces(parser);
+    while(parser->sc == SUCCESS && (*parser->pos == '+' || *parser->pos == '-'))
+    {
+        ExprOp op = (*parser->pos == '+') ? EXPR_ADD : EXPR_SUBTRACT;
+        parser->pos++;
+        node = addExprNode(parser, op, node, parseExprProduct(parser));
+        skipExprSpaces(parser);
+    }
+    return node;
+}
+boolean sameFactors(const ExprTerm* a, const ExprTerm* b)
+{
+    boolean same = (a->factorCount == b->factorCount);
+    for(int f = 0; same && f < a->factorCount; f++)
+    {
+        same = (a->factors[f].name == b->factors[f].name && a->factors[f].temp == b->factors[f].temp &&
+                a->factors[f].transposed == b->factors[f].transposed);
+    }
+    return same;
+}
+void simplifyExpression(Expression* expr)// merges terms with equal factors, A + 2*A -> 3*A
+{
+    int kept = 0;
+    for(int t = 0; t < expr->termCount; t++)
+    {
+        int k = 0;
+        while(k < kept && !sameFactors(&expr->terms[k], &expr->terms[t]))
+        {
+            k++;
+        }
+        if(k < kept)
+        {
+            // zero scaled terms are kept, they still fix the result dimensions
+            expr->terms[k].scale += expr->terms[t].scale;
+        }
+        else
+        {
+            expr->terms[kept++] = expr->terms[t];
+        }
+    }
+    expr->termCount = kept;
+}
+// moves expr into the program as a temporary and leaves a single factor that
+// names it in its place
+status_code materialiseExpression(ExprProgram* program, Expression* expr)
+{
+    status_code sc = SUCCESS;
+    if(program->tempCount == MAX_EXPR_TEMPS)
+    {
+        sc = FAILURE;
+    }
+    else
+    {
+        int k = program->tempCount++;
+        program->temps[k] = *expr;
+        expr->termCount = 1;
+        expr->terms[0].scale = 1;
+        expr->terms[0].factorCount = 1;
+        expr->terms[0].factors[0].name = '\0';
+        expr->terms[0].factors[0].temp = k;
+        expr->terms[0].factors[0].transposed = FALSE;
+    }
+    return sc;
+}
+// rewrites the DAG below node into a sum of products: scalars are folded into
+// the term scale and transposes reverse the factor order and flip each factor.
+// A sum that is a factor of a product is materialised instead of distributed,
+// so (A+B)*(C+D) costs two adds and one multiply rather than four multiplies.
+status_code expandExpression(const ExprParser* parser, int node, ExprProgram* program, Expression* out)
+{
+    status_code sc = SUCCESS;
+    const ExprNode* n = &parser->nodes[node];
+    Expression other;
+    ExprTerm* term;
+
+    out->termCount = 0;
+    switch(n->op)
+    {
+        case EXPR_MATRIX:
+        case EXPR_SCALAR:
+        {
+            term = &out->terms[out->termCount++];
+            term->scale = (n->op == EXPR_SCALAR) ? n->value : 1;
+            term->factorCount = 0;
+            if(n->op == EXPR_MATRIX)
+            {
+                term->factors[term->factorCount].name = n->name;
+                term->factors[term->factorCount].temp = -1;
+                term->factors[term->factorCount++].transposed = FALSE;
+            }
+            break;
+        }
+        case EXPR_ADD:
+        case EXPR_SUBTRACT:
+        {
+            sc = expandExpression(parser, n->left, program, out);
+            if(sc == SUCCESS)
+            {
+                sc = expandExpression(parser, n->right, program, &other);
+            }
+            if(sc == SUCCESS && out->termCount + other.termCount > MAX_EXPR_TERMS)// long flat sums are cut into pieces
+            {
+                sc = materialiseExpression(program, out);
+                if(sc == SUCCESS && out->termCount + other.termCount > MAX_EXPR_TERMS)
+                {
+                    sc = materialiseExpression(program, &other);
+                }
+            }
+            for(int t = 0; sc == SUCCESS && t < other.termCount; t++)
+            {
+                term = &out->terms[out->termCount++];
+                *term = other.terms[t];
+                if(n->op == EXPR_SUBTRACT)
+                {
+                    term->scale = -term->scale;
+                }
+            }
+            break;
+        }
+        case EXPR_NEGATE:
+        {
+            sc = expandExpression(parser, n->left, program, out);
+            for(int t = 0; t < out->termCount; t++)
+            {
+                out->terms[t].scale = -out->terms[t].scale;
+            }
+            break;
+        }
+        case EXPR_MULTIPLY:
+        {
+            Expression left;
+            sc = expandExpression(parser, n->left, program, &left);
+            if(sc == SUCCESS)
+            {
+                sc = expandExpression(parser, n->right, program, &other);
+            }
+            if(sc == SUCCESS)
+            {
+                simplifyExpression(&left);// (2+3)*A stays a single scaled term
+                simplifyExpression(&other);
+                if(left.termCount > 1)
+                {
+                    sc = materialiseExpression(program, &left);
+                }
+                if(sc == SUCCESS && other.termCount > 1)
+                {
+                    sc = materialiseExpression(program, &other);
+                }
+            }
+            if(sc == SUCCESS && left.terms[0].factorCount + other.terms[0].factorCount > MAX_TERM_FACTORS)
+            {
+                sc = materialiseExpression(program, &left);
+                if(sc == SUCCESS && 1 + other.terms[0].factorCount > MAX_TERM_FACTORS)
+                {
+                    sc = materialiseExpression(program, &other);
+                }
+            }
+            if(sc == SUCCESS)
+            {
+                const ExprTerm *lt = &left.terms[0], *rt = &other.terms[0];
+                term = &out->terms[out->termCount++];
+                *term = *lt;
+                term->scale = lt->scale * rt->scale;
+                for(int f = 0; f < rt->factorCount; f++)
+                {
+                    term->factors[term->factorCount++] = rt->factors[f];
+                }
+            }
+            break;
+        }
+        case EXPR_TRANSPOSE:
+        {
+            sc = expandExpression(parser, n->left, program, out);
+            for(int t = 0; t < out->termCount; t++)
+            {
+                term = &out->terms[t];
+                for(int f = 0; f < term->factorCount / 2; f++)
+                {
+                    ExprFactor temp = term->factors[f];
+                    term->factors[f] = term->factors[term->factorCount - 1 - f];
+                    term->factors[term->factorCount - 1 - f] = temp;
+                }
+                for(int f = 0; f < term->factorCount; f++)
+                {
+                    term->factors[f].transposed = !term->factors[f].transposed;
+                }
+            }
+            break;
+        }
+    }
+    return sc;
+}
+// evaluates all terms in one sweep over the output rows. Row i of a product is
+// pushed through the factors as a sparse vector, every term lands in the same
+// row accumulator and the finished row is appended to the result, so no
+// intermediate matrix is ever built.
+status_code evaluateExpression(const Expression* expr, const ExprProgram* program, SparseMatrix* result)
+{
+    status_code sc = SUCCESS;
+    MatrixView views[MAX_MATRICES + MAX_EXPR_TEMPS][2];
+    boolean opened[MAX_MATRICES + MAX_EXPR_TEMPS][2] = {{FALSE}};
+    MatrixView* termViews[MAX_EXPR_TERMS][MAX_TERM_FACTORS];
+    SparseAccumulator levels[MAX_TERM_FACTORS], rowAcc;
+    int levelSize[MAX_TERM_FACTORS] = {0};
+    int rows = -1, cols = -1;
+    MatrixBuilder builder;
+    boolean built = FALSE;
+    PROFILE_BEGIN(PROF_EXPRESSION);
+    double flops = 0;
+
+    memset(levels, 0, sizeof(levels));
+    memset(&rowAcc, 0, sizeof(rowAcc));
+    initializeMatrix(result);
+    for(int t = 0; sc == SUCCESS && t < expr->termCount; t++)
+    {
+        const ExprTerm* term = &expr->terms[t];
+        if(term->factorCount == 0)
+        {
+            printf("Scalars can only scale a matrix term.\n");
+            sc = FAILURE;
+        }
+        for(int f = 0; sc == SUCCESS && f < term->factorCount; f++)
+        {
+            const ExprFactor* factor = &term->factors[f];
+            int idx = (factor->temp >= 0) ? MAX_MATRICES + factor->temp : factor->name - 'A', tr = factor->transposed;
+            boolean read = (factor->temp < 0 && !opened[idx][tr]);// registry operands stay pinned until their views close
+            const SparseMatrix* operand = (factor->temp >= 0) ? &program->values[factor->temp]
+                                        : read ? beginRead(factor->name) : getMatrixByName(factor->name);
+            if(operand == NULL)
+            {
+                printf("Matrix %c does not exist.\n", term->factors[f].name);
+                sc = FAILURE;
+            }
+            else
+            {
+                if(!opened[idx][tr])
+                {
+                    sc = openMatrixView(&views[idx][tr], operand, tr);
+                    opened[idx][tr] = (sc == SUCCESS);
+                }
+                if(read && sc == FAILURE)
+                {
+                    endRead();
+                }
+                termViews[t][f] = &views[idx][tr];
+                if(sc == SUCCESS && f > 0 && termViews[t][f-1]->colCount != termViews[t][f]->rowCount)
+                {
+                    printf("Dimension mismatch in product.\n");
+                    sc = FAILURE;
+                }
+                if(sc == SUCCESS && termViews[t][f]->colCount > levelSize[f])
+                {
+                    levelSize[f] = termViews[t][f]->colCount;
+                }
+            }
+        }
+        if(sc == SUCCESS)
+        {
+            int termRows = termViews[t][0]->rowCount, termCols = termViews[t][term->factorCount-1]->colCount;
+            if(rows < 0)
+            {
+                rows = termRows;
+                cols = termCols;
+            }
+            else if(rows != termRows || cols != termCols)
+            {
+                printf("Dimension mismatch in sum.\n");
+                sc = FAILURE;
+            }
+        }
+    }
+
+    if(sc == SUCCESS)
+    {
+        for(int f = 0; f < MAX_TERM_FACTORS; f++)
+        {
+            if(initializeAccumulator(&levels[f], levelSize[f]) == FAILURE)
+            {
+                sc = FAILURE;
+            }
+        }
+        if(initializeAccumulator(&rowAcc, cols) == FAILURE)
+        {
+            sc = FAILURE;
+        }
+        else if(beginMatrixBuilder(&builder, result, rows, cols) == SUCCESS)
+        {
+            built = TRUE;
+        }
+        else
+        {
+            sc = FAILURE;
+        }
+    }
+
+    for(int i = 0; sc == SUCCESS && i < rows; i++)
+    {
+        for(int t = 0; t < expr->termCount; t++)
+        {
+            const ExprTerm* term = &expr->terms[t];
+            const MatrixView* first = termViews[t][0];
+            int last = term->factorCount - 1;
+            if(term->scale == 0 || first->lists[i] == NULL)
+            {
+                continue;
+            }
+            // the scale is folded into the last kernel instead of a separate pass
+            SparseAccumulator* target = (last == 0) ? &rowAcc : &levels[0];
+            matrix_entry mult = (last == 0) ? term->scale : 1;
+            for(Sm_Node* e = first->lists[i]; e; e = viewNext(first, i, e))
+            {
+                accumulate(target, viewIndex(first, i, e), mult * e->data);
+            }
+            for(int f = 1; f <= last; f++)
+            {
+                const MatrixView* view = termViews[t][f];
+                SparseAccumulator* source = &levels[f-1];
+                target = (f == last) ? &rowAcc : &levels[f];
+                mult = (f == last) ? term->scale : 1;
+                for(int k = 0; k < source->count; k++)
+                {
+                    int j = source->pattern[k];
+                    matrix_entry v = mult * source->values[j];
+                    for(Sm_Node* e = view->lists[j]; e; e = viewNext(view, j, e))
+                    {
+                        accumulate(target, viewIndex(view, j, e), v * e->data);
+                        flops += 2;
+                    }
+                }
+                resetAccumulator(source);
+            }
+        }
+        sortAccumulator(&rowAcc);
+        for(int k = 0; sc == SUCCESS && k < rowAcc.count; k++)
+        {
+            sc = appendElement(&builder, i, rowAcc.pattern[k], rowAcc.values[rowAcc.pattern[k]]);
+        }
+        resetAccumulator(&rowAcc);
+    }
+
+    if(built)
+    {
+        finishMatrixBuilder(&builder);
+        if(sc == FAILURE)
+        {
+            clearMatrix(result);
+        }
+    }
+    for(int f = 0; f < MAX_TERM_FACTORS; f++)
+    {
+        freeAccumulator(&levels[f]);
+    }
+    freeAccumulator(&rowAcc);
+    for(int idx = 0; idx < MAX_MATRICES + MAX_EXPR_TEMPS; idx++)
+    {
+        for(int tr = 0; tr < 2; tr++)
+        {
+            if(opened[idx][tr])
+            {
+                closeMatrixView(&views[idx][tr]);
+            }
+            if(opened[idx][tr] && idx < MAX_MATRICES)
+            {
+                endRead();
+            }
+        }
+    }
+    PROFILE_COUNT(flops, flops);
+    PROFILE_END();
+    return sc;
+}
+// evaluates the temporaries in order, then the main sum
+status_code evaluateProgram(ExprProgram* program, const Expression* expr, SparseMatrix* result)
+{
+    status_code sc = SUCCESS;
+    int done = 0;
+    while(sc == SUCCESS && done < program->tempCount)
+    {
+        sc = evaluateExpression(&program->temps[done], program, &program->values[done]);
+        done += (sc == SUCCESS);
+    }
+    if(sc == SUCCESS)
+    {
+        sc = evaluateExpression(expr, program, result);
+    }
+    for(int k = 0; k < done; k++)
+    {
+        clearMatrix(&program->values[k]);
+    }
+    return sc;
+}
+status_code computeExpression(const char* text, SparseMatrix* result)// the right hand side of a command
+{
+    ExprParser parser;
+    ExprProgram program;
+    Expression expr;
+    status_code sc = FAILURE;
+    int root;
+
+    parser.pos = text;
+    parser.sc = SUCCESS;
+    parser.nodeCount = 0;
+    program.tempCount = 0;
+
+    root = parseExprSum(&parser);
+    skipExprSpaces(&parser);
+    if(parser.sc == FAILURE || root < 0 || *parser.pos != '\0')
+    {
+        printf("Invalid expression near \"%s\".\n", parser.pos);
+    }
+    else if(expandExpression(&parser, root, &program, &expr) == FAILURE)
+    {
+        printf("Expression too large: at most %d intermediate results.\n", MAX_EXPR_TEMPS);
+    }
+    else
+    {
+        simplifyExpression(&expr);
+        sc = evaluateProgram(&program, &expr, result);
+        if(sc == FAILURE)
+        {
+            printf("Expression evaluation failed.\n");
+        }
+    }
+    return sc;
+}
+void executeExpressionCommand(const char* input)
+{
+    SparseMatrix result;
+    char destName;
+
+    while(isspace((unsigned char)*input))
+    {
+        input++;
+    }
+    destName = *input;
+    input += (destName != '\0');
+    while(isspace((unsigned char)*input))
+    {
+        input++;
+    }
+    if(destName < 'A' || destName > 'Z' || *input != '=')
+    {
+        printf("Invalid expression: expected '<name> = <expression>'.\n");
+    }
+    else if(computeExpression(input + 1, &result) == SUCCESS)
+    {
+        printNamedMatrix(&result, destName, FULL_VIEW);
+        if(destName - 'A' < MAX_MATRICES)
+        {
+            storeMatrix(destName, &result);
+        }
+        else
+        {
+            promptSaveResult(&result, "resultant");
+            clearMatrix(&result);
+        }
+    }
+}
+status_code parseSolverMethod(const char* name, SolverMethod* method)
+{
+    const char* names[] = {"auto", "cg", "bicgstab", "gmres"};
+    status_code sc = FAILURE;
+    for(int m = SOLVER_AUTO; m <= SOLVER_GMRES; m++)
+    {
+        if(strcmp(name, names[m]) == 0)
+        {
+            *method = (SolverMethod)m;
+            sc = SUCCESS;
+        }
+    }
+    return sc;
+}
+status_code matrixColumnToVector(const SparseMatrix* matrix, double* v)// first column, dense
+{
+    status_code sc = (matrix->colCount == 1) ? SUCCESS : FAILURE;
+    memset(v, 0, matrix->rowCount * sizeof(double));
+    if(sc == SUCCESS && matrix->colHead)
+    {
+        for(Sm_Node* element = matrix->colHead->collist; element; element = element->down)
+        {
+            v[element->row] = element->data;
+        }
+    }
+    return sc;
+}
+status_code vectorToMatrix(int n, const double* v, SparseMatrix* matrix)
+{
+    MatrixBuilder builder;
+    status_code sc = beginMatrixBuilder(&builder, matrix, n, 1);
+    if(sc == SUCCESS)
+    {
+        for(int i = 0; sc == SUCCESS && i < n; i++)
+        {
+            sc = appendElement(&builder, i, 0, (matrix_entry)v[i]);
+        }
+        finishMatrixBuilder(&builder);
+    }
+    return sc;
+}
+void printSolverResult(const SolverResult* result)
+{
+    int stride = result->iterations / 20 + 1;
+    printf("%s after %d iterations, relative residual %.3e\n",
+        result->converged ? "Converged" : "Not converged", result->iterations, result->residual);
+    printf("Residual history:\n");
+    for(int k = 0; k <= result->iterations; k++)
+    {
+        if(k % stride == 0 || k == result->iterations)
+        {
+            printf("  %5d  %.3e\n", k, result->residualHistory[k]);
+        }
+    }
+}
+void solveCommand(const char* input, SparseMatrix* A, SparseMatrix* B)
+{
+    char words[2][20];
+    SolverMethod method = SOLVER_AUTO;
+    PreconditionerKind kind = PRECOND_NONE;
+    FactorPreconditioner precond;
+    Preconditioner hook;
+    SolverOptions options;
+    SolverResult result;
+    LinearOperator op = matrixOperator(A);
+    double *b, *x;
+    int count = sscanf(input, "%*s %*c %*c %19s %19s", words[0], words[1]);
+
+    for(int w = 0; w < count; w++)// method and preconditioner, in either order
+    {
+        if(parseSolverMethod(words[w], &method) == FAILURE && parsePreconditionerKind(words[w], &kind) == FAILURE)
+        {
+            printf("Unknown option %s, ignored.\n", words[w]);
+        }
+    }
+    if(A->rowCount != A->colCount || B->rowCount != A->rowCount || B->colCount != 1)
+    {
+        printf("solve needs a square matrix and a column vector of matching size.\n");
+        return;
+    }
+    if(method == SOLVER_AUTO)
+    {
+        method = isSymmetricMatrix(A) ? SOLVER_CG : SOLVER_GMRES;
+    }
+    if(method == SOLVER_CG && kind == PRECOND_ILU0)
+    {
+        printf("ILU(0) is not symmetric, CG will use IC(0) instead.\n");
+        kind = PRECOND_IC0;
+    }
+    if(buildPreconditioner(A, kind, DEFAULT_JACOBI_BLOCK, &precond) == FAILURE)
+    {
+        printf("Preconditioner setup failed, solving without one.\n");
+        precond.kind = PRECOND_NONE;
+    }
+    hook = makePreconditioner(&precond);
+    b = (double*)malloc((A->rowCount + 1) * sizeof(double));
+    x = (double*)calloc(A->rowCount + 1, sizeof(double));
+    initializeSolverOptions(&options);
+    if(b && x && matrixColumnToVector(B, b) == SUCCESS
+        && solveLinearSystem(&op, (precond.kind == PRECOND_NONE) ? NULL : &hook, method, b, x, &options, &result) == SUCCESS)
+    {
+        SparseMatrix solution;
+        printSolverResult(&result);
+        freeSolverResult(&result);
+        if(vectorToMatrix(A->rowCount, x, &solution) == SUCCESS)
+        {
+            printNamedMatrix(&solution, 'X', FULL_VIEW);
+            promptSaveResult(&solution, "solution");
+        }
+        clearMatrix(&solution);
+    }
+    else
+    {
+        printf("Solve failed.\n");
+    }
+    freeFactorPreconditioner(&precond);
+    free(b);
+    free(x);
+}
+void preconditionCommand(const char* input, SparseMatrix* A)// prints the factors
+{
+    char kindName[20];
+    PreconditionerKind kind = PRECOND_ILU0;
+    FactorPreconditioner precond;
+    SparseMatrix factors;
+
+    if(sscanf(input, "%*s %*c %19s", kindName) == 1 && parsePreconditionerKind(kindName, &kind) == FAILURE)
+    {
+        printf("Unknown preconditioner %s, using ilu0.\n", kindName);
+    }
+    if(kind == PRECOND_NONE || buildPreconditioner(A, kind, DEFAULT_JACOBI_BLOCK, &precond) == FAILURE)
+    {
+        printf("Preconditioner setup failed.\n");
+    }
+    else
+    {
+        if(preconditionerToMatrix(&precond, &factors) == SUCCESS)
+        {
+            printNamedMatrix(&factors, 'R', FULL_VIEW);
+            promptSaveResult(&factors, "factor");
+        }
+        clearMatrix(&factors);
+        freeFactorPreconditioner(&precond);
+    }
+}
+void reorderCommand(const char* input, SparseMatrix* A)// symmetric permutation P A P^T
+{
+    char methodName[20] = "rcm";
+    OrderingMethod method = ORDER_RCM;
+    int* order = (int*)malloc((A->rowCount + 1) * sizeof(int));
+    SparseMatrix permuted;
+    MatrixStats before, after;
+
+    initializeMatrix(&permuted);
+    if(sscanf(input, "%*s %*c %19s", methodName) == 1 && strcmp(methodName, "amd") == 0)
+    {
+        method = ORDER_AMD;
+    }
+    else if(strcmp(methodName, "rcm") != 0)
+    {
+        printf("Unknown ordering %s, using rcm.\n", methodName);
+    }
+    if(A->rowCount != A->colCount)
+    {
+        printf("Reordering needs a square matrix.\n");
+    }
+    else if(!order || computeOrdering(A, method, order) == FAILURE)
+    {
+        printf("Out of memory computing the %s ordering.\n", (method == ORDER_AMD) ? "amd" : "rcm");
+    }
+    else if(symmetricPermute(A, order, &permuted) == FAILURE)
+    {
+        printf("Out of memory building the reordered matrix.\n");
+    }
+    else
+    {
+        computeMatrixStats(A, &before);
+        computeMatrixStats(&permuted, &after);
+        printf("Bandwidth: %d lower, %d upper -> %d lower, %d upper\n", before.lowerBandwidth, before.upperBandwidth,
+            after.lowerBandwidth, after.upperBandwidth);
+        printf("Order:");
+        for(int i = 0; i < A->rowCount; i++)
+        {
+            printf(" %d", order[i]);
+        }
+        printf("\n");
+        printNamedMatrix(&permuted, 'R', FULL_VIEW);
+        promptSaveResult(&permuted, "reordered");
+    }
+    clearMatrix(&permuted);
+    free(order);
+}
+void blockCommand(const char* input, SparseMatrix* A, char Aname)// attaches a BSR form, size 0 drops it
+{
+    int blockSize = 3;
+    const BsrMatrix* bsr;
+    MatrixStats stats;
+    sscanf(input, "%*s %*c %d", &blockSize);
+    if(blockSize == 0)
+    {
+        dropBlockForm(registryEntry(A));
+        printf("Block form of %c dropped.\n", Aname);
+    }
+    else if(attachBlockForm(A, blockSize) == FAILURE)
+    {
+        printf("Block size must be between 1 and %d.\n", MAX_BSR_BLOCK);
+    }
+    else
+    {
+        bsr = blockFormOf(A);
+        computeMatrixStats(A, &stats);
+        printf("Block form of %c: %d blocks of %dx%d, %.1f%% of the stored values are nonzero\n", Aname,
+            bsr->rowPtr[bsr->blockRows], blockSize, blockSize,
+            bsr->rowPtr[bsr->blockRows] ? 100.0 * stats.density * A->rowCount * A->colCount
+                / ((double)bsr->rowPtr[bsr->blockRows] * blockSize * blockSize) : 0.0);
+        printf("  %zu bytes as blocks, %zu bytes as linked lists\n", bsrBytes(bsr), stats.totalBytes);
+    }
+}
+void sliceCommand(const char* input, SparseMatrix* A, char Aname)// attaches a SELL-C-sigma form, C = 0 drops it
+{
+    int chunkSize = DEFAULT_SELL_CHUNK, sigma = DEFAULT_SELL_SIGMA;
+    const SellMatrix* sell;
+    MatrixStats stats;
+    sscanf(input, "%*s %*c %d %d", &chunkSize, &sigma);
+    if(chunkSize == 0)
+    {
+        dropSliceForm(registryEntry(A));
+        printf("Sliced form of %c dropped.\n", Aname);
+    }
+    else if(attachSliceForm(A, chunkSize, sigma) == FAILURE)
+    {
+        printf("Chunk size must be between 1 and %d.\n", MAX_SELL_CHUNK);
+    }
+    else
+    {
+        sell = sliceFormOf(A);
+        computeMatrixStats(A, &stats);
+        printf("Sliced form of %c: %d chunks of %d rows, sigma %d, %d stored slots (%.1f%% padding)\n", Aname,
+            sell->chunkCount, sell->chunkSize, sell->sigma, sell->chunkPtr[sell->chunkCount],
+            sell->chunkPtr[sell->chunkCount] ? 100.0 - 100.0 * stats.density * A->rowCount * A->colCount
+                / sell->chunkPtr[sell->chunkCount] : 0.0);
+        printf("  %zu bytes as slices, %zu bytes as linked lists\n", sellBytes(sell), stats.totalBytes);
+    }
+}
+void hypersparseCommand(SparseMatrix* A, char Aname)
+{
+    DcsrMatrix dcsr;
+    if(sparseMatrixToDcsr(A, &dcsr) == FAILURE)
+    {
+        printf("Memory allocation failed.\n");
+    }
+    else
+    {
+        size_t csrBytes = sizeof(CsrMatrix) + (A->rowCount + 1) * sizeof(int) + dcsr.nnz * (sizeof(int) + sizeof(double));
+        printf("Hypersparse form of %c: %lld of %d rows stored, %lld entries\n", Aname,
+            (long long)dcsr.rowsStored, A->rowCount, (long long)dcsr.nnz);
+        printf("  %zu bytes with 64 bit indexes, %zu bytes as compressed rows\n", dcsrBytes(&dcsr), csrBytes);
+        freeDcsrMatrix(&dcsr);
+    }
+}
+void hypersparseFileCommand(const char* input)// hypersparse add|multiply <a> <b> <c> on coordinate files
+{
+    char kind[20], pathA[256], pathB[256], pathC[256];
+    DcsrMatrix a, b, c;
+    status_code sc = FAILURE;
+    boolean valid = (sscanf(input, "%*s %19s %255s %255s %255s", kind, pathA, pathB, pathC) == 4
+                     && (strcmp(kind, "multiply") == 0 || strcmp(kind, "add") == 0)) ? TRUE : FALSE;
+
+    if(!valid)
+    {
+        printf("Usage: hypersparse add|multiply <file A> <file B> <result file>\n");
+    }
+    else if(readCoordinateFile(pathA, &a) == SUCCESS)
+    {
+        if(readCoordinateFile(pathB, &b) == SUCCESS)
+        {
+            sc = (kind[0] == 'm') ? dcsrMultiply(&a, &b, &c) : dcsrAdd(&a, &b, &c);
+            if(sc == SUCCESS)
+            {
+                sc = writeCoordinateFile(pathC, &c);
+                if(sc == SUCCESS)
+                {
+                    printf("%s written: %lld x %lld, %lld rows stored, %lld entries\n", pathC, (long long)c.rowCount,
+                        (long long)c.colCount, (long long)c.rowsStored, (long long)c.nnz);
+                }
+                freeDcsrMatrix(&c);
+            }
+            freeDcsrMatrix(&b);
+        }
+        freeDcsrMatrix(&a);
+    }
+    if(valid && sc == FAILURE)
+    {
+        printf("Hypersparse %s failed.\n", kind);
+    }
+}
+void chunkCommand(const char* input, SparseMatrix* A, char Aname)// chunk A <path> [tile]
+{
+    char path[256];
+    int tileSize = DEFAULT_CHUNK_TILE;
+    if(sscanf(input, "%*s %*c %255s %d", path, &tileSize) < 1)
+    {
+        printf("Usage: chunk A <file> [tile size]\n");
+    }
+    else if(tileSize < 1 || writeChunkedMatrix(A, path, tileSize) == FAILURE)
+    {
+        printf("Could not write %c to %s.\n", Aname, path);
+    }
+    else
+    {
+        printf("%c written to %s in %d x %d tiles.\n", Aname, path, tileSize, tileSize);
+    }
+}
+void loadCommand(const char* input)// load A <path>
+{
+    char path[256], name;
+    SparseMatrix result;
+    if(sscanf(input, "%*s %c %255s", &name, path) != 2 || name < 'A' || name >= 'A' + MAX_MATRICES)
+    {
+        printf("Usage: load A <file> (A-J)\n");
+    }
+    else if(loadChunkedMatrix(path, &result) == SUCCESS)
+    {
+        storeMatrix(name, &result);
+    }
+    else
+    {
+        clearMatrix(&result);
+    }
+}
+void streamCommand(const char* input)// stream multiply|add <a> <b> <c> [budget MB]
+{
+    char kind[20], pathA[256], pathB[256], pathC[256];
+    double budgetMB = DEFAULT_STREAM_BUDGET / (1024.0 * 1024.0);
+    StreamStats stats;
+    int count = sscanf(input, "%*s %19s %255s %255s %255s %lf", kind, pathA, pathB, pathC, &budgetMB);
+    size_t budget = (size_t)(budgetMB * 1024 * 1024);
+
+    if(count < 4 || budget == 0 || (strcmp(kind, "multiply") != 0 && strcmp(kind, "add") != 0))
+    {
+        printf("Usage: stream multiply|add <file A> <file B> <result file> [budget in MB]\n");
+    }
+    else if(((kind[0] == 'm') ? streamMultiply(pathA, pathB, pathC, budget, &stats)
+                              : streamAdd(pathA, pathB, pathC, budget, &stats)) == SUCCESS)
+    {
+        printf("%s written: %d tiles, %lld nonzeros\n", pathC, stats.tiles, (long long)stats.nnz);
+        printf("  %.1f MB read, at most %.1f MB of blocks in memory\n", stats.bytesRead / (1024.0 * 1024.0),
+            stats.peakBytes / (1024.0 * 1024.0));
+        if(stats.peakBytes > budget)
+        {
+            printf("  Over the %.1f MB budget: a single tile or an output tile was larger than its share.\n", budgetMB);
+        }
+    }
+    else
+    {
+        printf("Streaming %s failed.\n", kind);
+    }
+}
+// update A deltas.txt: one "set|add|del row col [value]" per line, applied as one batch
+void updateCommand(const char* input, SparseMatrix* A, char Aname)
+{
+    char path[256], line[128], op[8];
+    FILE* fp;
+    int count = 0, capacity = 0, lineNumber = 0;
+    MatrixUpdate* batch = NULL;
+    status_code sc = SUCCESS;
+
+    if(sscanf(input, "%*s %*c %255s", path) != 1 || (fp = fopen(path, "r")) == NULL)
+    {
+        printf("Usage: update A deltas.txt (file must exist)\n");
+        return;
+    }
+    while(sc == SUCCESS && fgets(line, sizeof(line), fp))
+    {
+        MatrixUpdate update;
+        int fields = sscanf(line, "%7s %d %d %f", op, &update.row, &update.col, &update.value);
+        lineNumber++;
+        if(fields <= 0)
+        {
+            continue;// blank line
+        }
+        update.op = (strcmp(op, "set") == 0) ? UPDATE_UPSERT : (strcmp(op, "add") == 0) ? UPDATE_ACCUMULATE : UPDATE_DELETE;
+        if(fields < 3 || (update.op != UPDATE_DELETE && fields < 4) || (update.op == UPDATE_DELETE && strcmp(op, "del") != 0))
+        {
+            printf("Line %d: expected set|add|del row col [value].\n", lineNumber);
+            sc = FAILURE;
+        }
+        else
+        {
+            if(count == capacity)
+            {
+                MatrixUpdate* grown = (MatrixUpdate*)realloc(batch, (capacity ? 2 * capacity : 1024) * sizeof(MatrixUpdate));
+                sc = grown ? SUCCESS : FAILURE;
+                batch = grown ? grown : batch;
+                capacity = grown ? (capacity ? 2 * capacity : 1024) : capacity;
+            }
+            if(sc == SUCCESS)
+            {
+                batch[count++] = update;
+            }
+        }
+    }
+    fclose(fp);
+    if(sc == SUCCESS)
+    {
+        clock_t start = clock();
+        sc = updateRegistryMatrix(A, batch, count);
+        if(sc == SUCCESS)
+        {
+            printf("Applied %d updates to %c in %.3f ms.\n", count, Aname, (clock() - start) * 1000.0 / CLOCKS_PER_SEC);
+        }
+        for(int i = 0; sc == SUCCESS && i < MAX_MATRICES; i++)
+        {
+            MaintainedProduct* maintained = registry[i].maintained;
+            if(maintained && (maintained->left == A || maintained->right == A))
+            {
+                printf("Refreshed %c: %d rows, %d columns recomputed.\n", 'A' + i, maintained->rowsRefreshed, maintained->colsRefreshed);
+            }
+        }
+    }
+    if(sc == FAILURE)
+    {
+        printf("No updates applied.\n");
+    }
+    free(batch);
+}
+unsigned long registryVersion(char name)// 0 when the name is free
+{
+    return registry[name - 'A'].isOccupied ? registry[name - 'A'].matrix.version : 0;
+}
+// reports ended jobs and moves their results into the registry, unless the
+// target has been written or reassigned since the job was submitted
+void collectJobs(void)
+{
+    Job* job = jobs.head;
+    while(job)
+    {
+        Job* next = job->next;
+        JobState state = atomic_load(&job->state);
+        if(state == JOB_DONE && job->kind == JOB_DETERMINANT)
+        {
+            printf("Job %d (determinant) done in %.3f s: %.2f\n", job->id, job->seconds, job->value);
+        }
+        else if(state == JOB_DONE)
+        {
+            printf("Job %d (%s) done in %.3f s. ", job->id, jobKindName(job->kind), job->seconds);
+            if(registryVersion(job->target) == job->targetVersion)
+            {
+                storeMatrix(job->target, &job->result);
+            }
+            else
+            {
+                printf("'%c' has changed since the job was submitted; result discarded.\n", job->target);
+            }
+        }
+        else if(state >= JOB_FAILED)
+        {
+            printf("Job %d (%s) %s.\n", job->id, jobKindName(job->kind), (state == JOB_FAILED) ? "failed" : "was cancelled");
+        }
+        if(state >= JOB_DONE)
+        {
+            freeJob(job);
+        }
+        job = next;
+    }
+}
+// submit multiply A B R | submit inverse A R | submit determinant A,
+// jobs, cancel N, wait [N]
+void jobCommand(const char* input, const char* op)
+{
+    char kind[20], Aname = 0, Bname = 0, Rname = 0;
+    int id = 0;
+    Job* job;
+
+    if(strcmp(op, "submit") == 0)
+    {
+        int fields = sscanf(input, "%*s %19s %c %c %c", kind, &Aname, &Bname, &Rname);
+        JobKind jobKind = (strcmp(kind, "multiply") == 0) ? JOB_MULTIPLY : (strcmp(kind, "inverse") == 0) ? JOB_INVERSE : JOB_DETERMINANT;
+        SparseMatrix* A = (fields >= 2) ? beginRead(Aname) : NULL;// a shared operand is copied from its snapshot
+        SparseMatrix* readB = (jobKind == JOB_MULTIPLY && fields >= 3) ? beginRead(Bname) : NULL;
+        SparseMatrix* B = (jobKind == JOB_MULTIPLY) ? readB : A;
+
+        Rname = (jobKind == JOB_MULTIPLY) ? Rname : Bname;
+        if(fields < 2 || (jobKind == JOB_DETERMINANT && strcmp(kind, "determinant") != 0)
+            || (jobKind != JOB_DETERMINANT && fields < ((jobKind == JOB_MULTIPLY) ? 4 : 3)))
+        {
+            printf("Usage: submit multiply A B R | submit inverse A R | submit determinant A\n");
+        }
+        else if(jobKind != JOB_DETERMINANT && (Rname < 'A' || Rname >= 'A' + MAX_MATRICES))
+        {
+            printf("Invalid matrix name.\n");
+        }
+        else if(!A || !B)
+        {
+            printf("Matrix %c does not exist.\n", A ? Bname : Aname);
+        }
+        else if((job = submitJob(jobKind, A, B)) == NULL)
+        {
+            printf("Could not submit: %s is undefined for these dimensions.\n", kind);
+        }
+        else
+        {
+            job->target = Rname;
+            job->targetVersion = (jobKind != JOB_DETERMINANT) ? registryVersion(Rname) : 0;
+            printf("Job %d submitted.\n", job->id);
+        }
+        if(readB)
+        {
+            endRead();
+        }
+        if(A)
+        {
+            endRead();
+        }
+    }
+    else if(strcmp(op, "jobs") == 0)
+    {
+        if(jobs.head == NULL)
+        {
+            printf("No jobs.\n");
+        }
+        for(job = jobs.head; job; job = job->next)
+        {
+            printf("Job %d %-12s %-10s %ld/%ld rows, %lld flops\n", job->id, jobKindName(job->kind), jobStateName(atomic_load(&job->state)),
+                   atomic_load(&job->progress.rowsDone), atomic_load(&job->progress.rowsTotal), atomic_load(&job->progress.flopsDone));
+        }
+    }
+    else if(sscanf(input, "%*s %d", &id) == 1 && (job = findJob(id)) != NULL)
+    {
+        if(op[0] == 'c')
+        {
+            cancelJob(job);
+            printf("Cancelling job %d.\n", id);
+        }
+        else
+        {
+            awaitJob(job);
+        }
+    }
+    else if(op[0] == 'w' && id == 0)
+    {
+        for(job = jobs.head; job; job = job->next)
+        {
+            awaitJob(job);
+        }
+    }
+    else
+    {
+        printf("No such job.\n");
+    }
+    collectJobs();
+}
+// maintain C A B: C = A * B, refreshed by every later update of A or B
+void maintainCommand(const char* input)
+{
+    char Cname, Aname, Bname;
+    int fields = sscanf(input, "%*s %c %c %c", &Cname, &Aname, &Bname);
+    char mode[8];
+    SparseMatrix *A, *B;
+
+    if(fields >= 1 && (Cname < 'A' || Cname >= 'A' + MAX_MATRICES))
+    {
+        printf("Invalid matrix name.\n");
+    }
+    else if(fields >= 1 && sscanf(input, "%*s %*c %7s", mode) == 1 && strcmp(mode, "off") == 0)
+    {
+        stopMaintaining(Cname);
+        printf("%c is no longer maintained.\n", Cname);
+    }
+    else if(fields != 3)
+    {
+        printf("Usage: maintain C A B | maintain C off\n");
+    }
+    else if((A = getMatrixByName(Aname)) == NULL || (B = getMatrixByName(Bname)) == NULL)
+    {
+        printf("Matrix %c does not exist.\n", getMatrixByName(Aname) ? Bname : Aname);
+    }
+    else if(Cname == Aname || Cname == Bname)
+    {
+        printf("The product cannot overwrite an operand.\n");
+    }
+    else if(maintainProduct(Cname, A, B) == FAILURE)
+    {
+        printf("Multiplication failed: %c is %dx%d and %c is %dx%d.\n", Aname, A->rowCount, A->colCount, Bname, B->rowCount, B->colCount);
+    }
+    else
+    {
+        printf("%c = %c * %c is maintained under updates of %c and %c.\n", Cname, Aname, Bname, Aname, Bname);
+    }
+}
+void shareCommand(const char* input, char Aname)// share A [off]
+{
+    char mode[8];
+    int index = Aname - 'A';
+    if(sscanf(input, "%*s %*c %7s", mode) == 1 && strcmp(mode, "off") == 0)
+    {
+        unshareMatrix(Aname);
+        printf("%c is no longer shared.\n", Aname);
+    }
+    else if(atomic_load(&registry[index].shared) || shareMatrix(Aname) == SUCCESS)
+    {
+        printf("%c is shared: readers see snapshot version %lu.\n", Aname, atomic_load(&registry[index].shared)->version);
+    }
+    else
+    {
+        printf("Could not share %c.\n", Aname);
+    }
+}
+void executeCommand(const char* input)
+{
+    status_code sc = SUCCESS;
+    char op[20], word[20], Aname, Bname;
+    float scalar;
+    int res;
+
+    if(strchr(input, '=') != NULL)
+    {
+        executeExpressionCommand(input);
+        return;
+    }
+    if(sscanf(input, "%19s", op) == 1 && strcmp(op, "profile") == 0)
+    {
+        char arg[20];
+        if(sscanf(input, "%*s %19s", arg) == 1 && strcmp(arg, "reset") == 0)
+        {
+            resetProfile();
+            printf("Profile counters reset.\n");
+        }
+        else
+        {
+            printProfile();
+        }
+        return;
+    }
+    if(sscanf(input, "%19s", op) == 1
+        && (strcmp(op, "submit") == 0 || strcmp(op, "jobs") == 0 || strcmp(op, "cancel") == 0 || strcmp(op, "wait") == 0))
+    {
+        jobCommand(input, op);
+        return;
+    }
+    if(sscanf(input, "%19s", op) == 1 && strcmp(op, "maintain") == 0)
+    {
+        maintainCommand(input);
+        return;
+    }
+    if(sscanf(input, "%19s %19s", op, word) == 2 && strcmp(op, "hypersparse") == 0
+       && (strcmp(word, "add") == 0 || strcmp(word, "multiply") == 0))
+    {
+        hypersparseFileCommand(input);
+        return;
+    }
+    if(sscanf(input, "%19s", op) == 1 && (strcmp(op, "stream") == 0 || strcmp(op, "load") == 0))
+    {
+        if(op[0] == 's')
+        {
+            streamCommand(input);
+        }
+        else
+        {
+            loadCommand(input);
+        }
+        return;
+    }
+
+    if(sscanf(input, "%19s %c", op, &Aname) == 2
+        && (strcmp(op, "precondition") == 0 || strcmp(op, "reorder") == 0 || strcmp(op, "block") == 0
+            || strcmp(op, "slice") == 0 || strcmp(op, "hypersparse") == 0 || strcmp(op, "chunk") == 0
+            || strcmp(op, "share") == 0 || strcmp(op, "update") == 0))
+    {
+        SparseMatrix* A = getMatrixByName(Aname);
+        if(!A)
+        {
+            printf("Matrix %c does not exist.\n", Aname);
+        }
+        else if(strcmp(op, "share") == 0)
+        {
+            shareCommand(input, Aname);
+        }
+        else if(strcmp(op, "update") == 0)
+        {
+            updateCommand(input, beginWrite(Aname), Aname);
+            endWrite(Aname);
+        }
+        else if(op[0] == 'p')
+        {
+            preconditionCommand(input, A);
+        }
+        else if(op[0] == 'b')
+        {
+            blockCommand(input, A, Aname);
+        }
+        else if(op[0] == 's')
+        {
+            sliceCommand(input, A, Aname);
+        }
+        else if(op[0] == 'h')
+        {
+            hypersparseCommand(A, Aname);
+        }
+        else if(op[0] == 'c')
+        {
+            chunkCommand(input, A, Aname);
+        }
+        else
+        {
+            reorderCommand(input, A);
+        }
+        return;
+    }
+
+    res = sscanf(input, "%s %c %f", op, &Aname, &scalar);
+    if(res == 3 && strcmp(op, "scalar") == 0)
+    {
+        SparseMatrix* A = beginWrite(Aname);
+        if(!A)
+        {
+            printf("Matrix %c does not exist.\n", Aname);
+            sc = FAILURE;
+        }
+        else
+        {
+            scalarMultiplyMatrix(A, scalar);
+            matrixChanged(A);
+            endWrite(Aname);
+            printNamedMatrix(A, Aname, FULL_VIEW);
+        }
+        return;
+    }
+
+    res = sscanf(input, "%s %c %c", op, &Aname, &Bname);
+    if(res == 3)
+    {
+        SparseMatrix *A = getMatrixByName(Aname);
+        SparseMatrix *B = getMatrixByName(Bname);
+        if(!A || !B)
+        {
+            printf("Invalid matrix name(s).\n");
+            sc = FAILURE;
+        }
+        else if(strcmp(op, "solve") == 0)
+        {
+            solveCommand(input, A, B);
+        }
+        else
+        {
+            SparseMatrix result;
+            char strategyName[20], key[24];
+            MultiplyStrategy strategy = MULTIPLY_AUTO;
+            boolean known = strcmp(op, "add") == 0 || strcmp(op, "subtract") == 0 || strcmp(op, "multiply") == 0
+                            || strcmp(op, "tmultiply") == 0 || strcmp(op, "multiplyt") == 0;
+            CacheEntry* cached = NULL;
+            initializeMatrixWithSize(&result, A->rowCount, B->colCount);
+
+            boolean blocked = sameBlockForms(A, B);// attached BSR forms take over add and auto multiply
+            boolean planned = FALSE;  // "add A B plan" and "multiply A B plan" reuse a two-phase plan
+            boolean hyper = FALSE;    // "add A B hypersparse", and auto multiply of two hypersparse operands, run on DCSR
+            if((strcmp(op, "multiply") == 0 || strcmp(op, "add") == 0)
+                && sscanf(input, "%*s %*c %*c %19s", strategyName) == 1)
+            {
+                planned = (strcmp(strategyName, "plan") == 0);
+                hyper = (strcmp(strategyName, "hypersparse") == 0);
+                if(!planned && !hyper && op[0] == 'm' && parseMultiplyStrategy(strategyName, &strategy) == FAILURE)
+                {
+                    printf("Unknown strategy %s, using auto.\n", strategyName);
+                }
+            }
+            blocked = blocked && !planned && !hyper && (strcmp(op, "add") == 0 || (strcmp(op, "multiply") == 0 && strategy == MULTIPLY_AUTO));
+            hyper = hyper || (!blocked && !planned && strcmp(op, "multiply") == 0 && strategy == MULTIPLY_AUTO
+                              && isHypersparse(A) && isHypersparse(B));
+            snprintf(key, sizeof(key), "%s %s", op, blocked ? "bsr" : planned ? "plan" : hyper ? "dcsr" : multiplyStrategyName(strategy));
+            if(known)
+            {
+                cached = lookupResult(key, Aname, A, Bname, B);
+            }
+            if(cached)
+            {
+                sc = cloneMatrix(&cached->matrix, &result);
+                printNamedMatrix(&result, 'R', FULL_VIEW);
+                printf("(cached result)\n");
+            }
+            else if(strcmp(op, "add") == 0)
+            {
+                if ((blocked ? blockOperation(A, B, FALSE, &result)
+                     : planned ? plannedOperation(FALSE, Aname, A, Bname, B, &result)
+                     : hyper ? hypersparseOperation(A, B, FALSE, &result) : addMatrix(A, B, &result)) == SUCCESS)
+                {
+                    printNamedMatrix(&result, 'R', FULL_VIEW);
+                }
+                else
+                {
+                    printf("Addition failed.\n");
+                    sc = FAILURE;
+                }
+            }
+            else if(strcmp(op, "subtract") == 0)
+            {
+                if (subtractMatrix(A, B, &result) == SUCCESS)
+                {
+                    printNamedMatrix(&result, 'R', FULL_VIEW);
+                }
+                else
+                {
+                    printf("Subtraction failed.\n");
+                    sc = FAILURE;
+                }
+            }
+            else if(strcmp(op, "multiply") == 0)
+            {
+                if ((blocked ? blockOperation(A, B, TRUE, &result)
+                     : planned ? plannedOperation(TRUE, Aname, A, Bname, B, &result)
+                     : hyper ? hypersparseOperation(A, B, TRUE, &result)
+                     : multiplyMatrixWithStrategy(A, B, &result, strategy)) == SUCCESS)
+                {
+                    printNamedMatrix(&result, 'R', FULL_VIEW);
+                }
+                else
+                {
+                    printf("Multiplication failed.\n");
+                    sc = FAILURE;
+                }
+            }
+            else if(strcmp(op, "tmultiply") == 0 || strcmp(op, "multiplyt") == 0)
+            {
+                status_code msc = (op[0] == 't') ? multiplyTransposeMatrix(A, B, &result)
+                                                 : multiplyMatrixTranspose(A, B, &result);
+                if(msc == SUCCESS)
+                {
+                    printNamedMatrix(&result, 'R', FULL_VIEW);
+                }
+                else
+                {
+                    printf("Multiplication failed.\n");
+                    sc = FAILURE;
+                }
+            }
+            else
+            {
+                printf("Unsupported binary operation: %s\n", op);
+                sc = FAILURE;
+            }
+            if(sc == SUCCESS && !cached)
+            {
+                cacheResult(key, Aname, A, Bname, B, &result, 0);
+            }
+            if(sc == SUCCESS)
+            {
+                promptSaveResult(&result, "resultant");
+            }
+            clearMatrix(&result);
+        }
+        return;
+    }
+
+    res = sscanf(input, "%s %c", op, &Aname);
+    if(res == 2)
+    {
+        SparseMatrix *A = getMatrixByName(Aname);
+        if(!A)
+        {
+            printf("Matrix %c does not exist.\n", Aname);
+        }
+        else
+        {
+            if(strcmp(op, "transpose") == 0)
+            {
+                SparseMatrix transposed;
+                A = beginWrite(Aname);
+                matrixChanged(A);
+                if(transposeMatrix(A, &transposed) == SUCCESS)
+                {
+                    clearMatrix(A);
+                    *A = transposed;
+                    endWrite(Aname);
+                    printNamedMatrix(A, Aname, FULL_VIEW);
+                }
+                else
+                {
+                    endWrite(Aname);
+                    printf("Transpose failed.\n");
+                }
+            }
+            else if(strcmp(op, "symmetric") == 0 || strcmp(op, "general") == 0)
+            {
+                boolean symmetric = (op[0] == 's');
+                A = beginWrite(Aname);
+                matrixChanged(A);
+                if(setSymmetricStorage(A, symmetric) == SUCCESS)
+                {
+                    printf("Matrix %c now stores %s.\n", Aname, symmetric ? "only its lower triangle" : "both triangles");
+                }
+                else
+                {
+                    printf("Matrix %c is not symmetric.\n", Aname);
+                }
+                endWrite(Aname);
+            }
+            else if(strcmp(op, "stats") == 0)
+            {
+                MatrixStats stats;
+                computeMatrixStats(A, &stats);
+                printMatrixStats(&stats, Aname);
+                printCacheStats();
+            }
+            else if(strcmp(op, "determinant") == 0)
+            {
+                float det;
+                CacheEntry* cached = lookupResult("determinant", Aname, A, '\0', NULL);
+                if(cached)
+                {
+                    printf("Determinant of %c = %.2f (cached)\n", Aname, cached->value);
+                }
+                else if(determinantOfMatrix(A, &det) == SUCCESS)
+                {
+                    cacheResult("determinant", Aname, A, '\0', NULL, NULL, det);
+                    printf("Determinant of %c = %.2f\n", Aname, det);
+                }
+                else
+                {
+                    printf("Failed to compute determinant.\n");
+                }
+            }
+            else if(strcmp(op, "logdet") == 0)
+            {
+                double logAbsDet;
+                int sign;
+                if(logDeterminant(A, &logAbsDet, &sign) == FAILURE)
+                {
+                    printf("Failed to compute determinant.\n");
+                }
+                else if(sign == 0)
+                {
+                    printf("Matrix %c is singular: det = 0\n", Aname);
+                }
+                else
+                {
+                    printf("log|det(%c)| = %.6f, sign %+d (det = %.6e)\n", Aname, logAbsDet, sign, sign * exp(logAbsDet));
+                }
+            }
+            else if(strcmp(op, "condition") == 0)
+            {
+                double condition;
+                if(conditionEstimate(A, &condition) == SUCCESS)
+                {
+                    printf("Condition number of %c (1-norm, estimated) = %.6e\n", Aname, condition);
+                }
+            }
+            else if(strcmp(op, "inverse") == 0)
+            {
+                SparseMatrix inv;
+                CacheEntry* cached = lookupResult("inverse", Aname, A, '\0', NULL);
+                initializeMatrix(&inv);
+                if(cached)
+                {
+                    sc = cloneMatrix(&cached->matrix, &inv);
+                    printNamedMatrix(&inv, 'R', FULL_VIEW);
+                    printf("(cached result)\n");
+                }
+                else if(inverseOfMatrix(A, &inv) == SUCCESS)
+                {
+                    cacheResult("inverse", Aname, A, '\0', NULL, &inv, 0);
+                    printNamedMatrix(&inv, 'R', FULL_VIEW);
+                }
+                else
+                {
+                    printf("Matrix not invertible.\n");
+                    sc = FAILURE;
+                }
+                if(sc == SUCCESS)
+                {
+                    promptSaveResult(&inv, "inverse");
+                }
+                clearMatrix(&inv);
+            }
+            else
+            {
+                printf("Unsupported unary operation: %s\n", op);
+            }
+        }
+        return;
+    }
+
+    printf("Invalid command format.\n");
+}
+void operationsMenu()
+{
+    char input[100];
+    status_code done = FALSE;
+    while(done == FALSE)
+    {
+        printf("\n===== OPERATION COMMAND MODE =====\n");
+        printf("Type operations like:\n");
+        printf("  add A B\n  transpose A\n  determinant A\n  scalar A 2.5\n  R = 2*A*B + C'\n  submit inverse A R\n  jobs\n  profile\n  exit\n");
+        printf("> Operation: ");
+
+        fgets(input, sizeof(input), stdin);
+
+        if(strncmp(input, "exit", 4) == 0)
+        {
+            done = TRUE;
+        }
+        else
+        {
+            executeCommand(input);
+            collectJobs();
+            publishStaleMatrices();
+        }
+    }
+}
+void displayOptionsMenu() {
+    int choice;
+
+    do
+    {
+        printf("\n===== DISPLAY OPTIONS =====\n");
+        printf("1. List All Matrices\n");
+        printf("2. Print Matrix (Full View)\n");
+        printf("3. Print Matrix (Sparse View)\n");
+        printf("4. Print Dimensions Only\n");
+        printf("5. Matrix Statistics\n");
+        printf("6. Back to Main Menu\n");
+        printf("Enter your choice: ");
+        scanf("%d", &choice);
+
+        switch(choice)
+        {
+            case 1:
+            {
+                printf("\n=== Matrix Registry ===\n");
+                for(int i = 0; i < MAX_MATRICES; ++i)
+                {
+                    if(registry[i].isOccupied)
+                    {
+                        printf("%c : [%d x %d] \n",
+                            registry[i].name,
+                            registry[i].matrix.rowCount,
+                            registry[i].matrix.colCount
+                        );
+                    }
+                    else
+                    {
+                        printf("%c : (empty)\n", 'A' + i);
+                    }
+                }
+                break;
+            }
+            case 2: //Full View
+            case 3:
+            {
+                char name;
+                int mode = (choice == 2) ? FULL_VIEW : SPARSE_VIEW;
+
+                printf("Enter matrix name to print: ");
+                scanf(" %c", &name);
+
+                int idx = name - 'A';
+                if(idx < 0 || idx >= MAX_MATRICES || !registry[idx].isOccupied)
+                {
+                    printf("Matrix %c does not exist.\n", name);
+                }
+                else
+                {
+                    printNamedMatrix(&registry[idx].matrix, name, mode);
+                }
+                break;
+            }
+            case 4:
+            {
+                char name;
+                printf("Enter matrix name: ");
+                scanf(" %c", &name);
+
+                int idx = name - 'A';
+                if(idx < 0 || idx >= MAX_MATRICES || !registry[idx].isOccupied)
+                {
+                    printf("Matrix %c does not exist.\n", name);
+                }
+                else
+                {
+                    printf("Matrix %c: %d rows x %d columns\n",
+                        name,
+                        registry[idx].matrix.rowCount,
+                        registry[idx].matrix.colCount
+                    );
+                }
+                break;
+            }
+            case 5:
+            {
+                char name;
+                printf("Enter matrix name: ");
+                scanf(" %c", &name);
+
+                SparseMatrix* matrix = getMatrixByName(name);
+                if(matrix == NULL)
+                {
+                    printf("Matrix %c does not exist.\n", name);
+                }
+                else
+                {
+                    MatrixStats stats;
+                    computeMatrixStats(matrix, &stats);
+                    printMatrixStats(&stats, name);
+                }
+                break;
+            }
+            case 6: break;
+            default: printf("Invalid choice.\n"); break;
+        }
+    }while(choice != 6);
+}
+// self test: every check runs a fast path and the plain kernel it stands in
+// for on small random integer matrices, and reports the largest difference
+// relative to the largest reference entry. Run with --selftest.
+#define SELF_TEST_TOLERANCE 1e-4
+
+typedef double (*SelfTestCheck)(void);   // HUGE_VAL when a path fails outright
+
+typedef struct Self_Test_Tag
+{
+    const char* name;
+    SelfTestCheck check;
+} SelfTest;
+
+double matrixDifference(const SparseMatrix* a, const SparseMatrix* b)// relative to the largest entry of b
+{
+    CsrMatrix ca, cb;
+    double diff = HUGE_VAL, scale = 1;
+    if(a->rowCount == b->rowCount && a->colCount == b->colCount && sparseMatrixToCsr(a, &ca) == SUCCESS)
+    {
+        if(sparseMatrixToCsr(b, &cb) == SUCCESS)
+        {
+            for(int k = 0; k < cb.rowPtr[cb.rowCount]; k++)
+            {
+                scale = fmax(scale, fabs(cb.values[k]));
+            }
+            diff = csrMaxDifference(&ca, &cb) / scale;
+            freeCsrMatrix(&cb);
+        }
+        freeCsrMatrix(&ca);
+    }
+    return diff;
+}
+SparseMatrix* testOperand(char name, int rows, int cols, int perRow, unsigned seed)// stored in the registry quietly
+{
+    NamedMatrix* entry = &registry[name - 'A'];
+    if(entry->isOccupied)
+    {
+        stopMaintaining(name);
+        matrixChanged(&entry->matrix);
+        clearMatrix(&entry->matrix);
+    }
+    randomIntegerMatrix(&entry->matrix, rows, cols, perRow, seed);
+    entry->name = name;
+    entry->isOccupied = TRUE;
+    return &entry->matrix;
+}
+double compareExpression(const char* text, const SparseMatrix* expected)
+{
+    SparseMatrix got;
+    double diff = HUGE_VAL;
+    if(computeExpression(text, &got) == SUCCESS)
+    {
+        diff = matrixDifference(&got, expected);
+        clearMatrix(&got);
+    }
+    return diff;
+}
+double checkExpression(void)// fused and materialised expressions against explicit add and multiply
+{
+    SparseMatrix* A = testOperand('A', 30, 20, 3, 1);
+    SparseMatrix* B = testOperand('B', 30, 20, 3, 2);
+    SparseMatrix* C = testOperand('C', 20, 30, 3, 3);
+    SparseMatrix* D = testOperand('D', 20, 30, 3, 4);
+    SparseMatrix sumAB, sumCD, diffAB, left, right, expected;
+    double diff;
+
+    addMatrix(A, B, &sumAB);
+    addMatrix(C, D, &sumCD);
+    subtractMatrix(A, B, &diffAB);
+    multiplyMatrix(&sumAB, &sumCD, &left);
+    multiplyMatrix(&left, &sumAB, &right);
+    clearMatrix(&left);
+    multiplyMatrix(&right, &sumCD, &left);
+    clearMatrix(&right);
+    multiplyMatrix(&left, &diffAB, &expected);
+    diff = compareExpression("(A+B)*(C+D)*(A+B)*(C+D)*(A-B)", &expected);
+    clearMatrix(&left);
+    clearMatrix(&expected);
+
+    multiplyMatrix(A, C, &left);
+    scalarMultiplyMatrix(&left, 2);
+    multiplyMatrix(B, D, &right);
+    transpose(&right);
+    subtractMatrix(&left, &right, &expected);
+    diff = fmax(diff, compareExpression("2*A*C - (B*D)'", &expected));
+    clearMatrix(&left);
+    clearMatrix(&right);
+    clearMatrix(&expected);
+
+    multiplyMatrix(&sumAB, &sumCD, &left);
+    addMatrix(&left, &left, &expected);
+    diff = fmax(diff, compareExpression("(A+B)*(C+D) + ((C'+D')*(A'+B'))'", &expected));
+    clearMatrix(&left);
+    clearMatrix(&expected);
+    clearMatrix(&sumAB);
+    clearMatrix(&sumCD);
+    clearMatrix(&diffAB);
+    return diff;
+}
+double vectorDifference(int n, const double* got, const double* expected)// relative to the largest expected entry
+{
+    double diff = 0, scale = 1;
+    for(int i = 0; i < n; i++)
+    {
+        scale = fmax(scale, fabs(expected[i]));
+    }
+    for(int i = 0; i < n; i++)
+    {
+        diff = fmax(diff, fabs(got[i] - expected[i]));
+    }
+    return diff / scale;
+}
+double checkTransposeProducts(void)// out-of-place transpose and transposed products against the in-place transpose
+{
+    SparseMatrix *A = testOperand('A', 40, 25, 4, 5), *B = testOperand('B', 40, 30, 4, 6), *C = testOperand('C', 35, 25, 4, 7);
+    SparseMatrix *tall = testOperand('D', 3000, 200, 6, 8), *wide = testOperand('E', 20, 5000, 3, 9);
+    SparseMatrix* shapes[] = {A, C, tall, wide};
+    SparseMatrix At, Ct, got, expected;
+    double x[40], y[25], yRef[25];
+    double diff = HUGE_VAL;
+
+    initializeMatrix(&At);
+    initializeMatrix(&Ct);
+    if(cloneMatrix(A, &At) == SUCCESS && transpose(&At) == SUCCESS && cloneMatrix(C, &Ct) == SUCCESS &&
+       transpose(&Ct) == SUCCESS)
+    {
+        diff = 0;
+        for(int m = 0; m < 4; m++)// many rows give several bands, many columns cap them
+        {
+            if(cloneMatrix(shapes[m], &expected) == SUCCESS && transpose(&expected) == SUCCESS
+               && transposeMatrix(shapes[m], &got) == SUCCESS)
+            {
+                diff = fmax(diff, matrixDifference(&got, &expected));
+                clearMatrix(&got);
+            }
+            else
+            {
+                diff = HUGE_VAL;
+            }
+            clearMatrix(&expected);
+        }
+        multiplyTransposeMatrix(A, B, &got);
+        multiplyMatrix(&At, B, &expected);
+        diff = fmax(diff, matrixDifference(&got, &expected));
+        clearMatrix(&got);
+        clearMatrix(&expected);
+        multiplyMatrixTranspose(A, C, &got);
+        multiplyMatrix(A, &Ct, &expected);
+        diff = fmax(diff, matrixDifference(&got, &expected));
+        clearMatrix(&got);
+        clearMatrix(&expected);
+        for(int i = 0; i < 40; i++)
+        {
+            x[i] = sin(i + 1.0);
+        }
+        transposeMultiplyVector(A, x, y);
+        multiplyVector(&At, x, yRef);
+        diff = fmax(diff, vectorDifference(25, y, yRef));
+    }
+    clearMatrix(&At);
+    clearMatrix(&Ct);
+    return diff;
+}
+double productDifference(const SparseMatrix* A, const SparseMatrix* B, const SparseMatrix* C)// C against A (B e_j) column by column
+{
+    double diff = HUGE_VAL;
+    double* e = (double*)calloc(B->colCount + 1, sizeof(double));
+    double* column = (double*)malloc((B->rowCount + 1) * sizeof(double));
+    double* expected = (double*)malloc((A->rowCount + 1) * sizeof(double));
+    double* got = (double*)malloc(((size_t)A->rowCount * B->colCount + 1) * sizeof(double));
+    if(e && column && expected && got && C->rowCount == A->rowCount && C->colCount == B->colCount)
+    {
+        memset(got, 0, (size_t)A->rowCount * B->colCount * sizeof(double));
+        for(Row_Node* rptr = C->rowHead; rptr; rptr = rptr->next)
+        {
+            for(Sm_Node* sptr = rptr->rowlist; sptr; sptr = sptr->right)
+            {
+                got[(size_t)sptr->row * B->colCount + sptr->col] = sptr->data;
+            }
+        }
+        diff = 0;
+        for(int j = 0; j < B->colCount; j++)
+        {
+            e[j] = 1;
+            multiplyVector(B, e, column);
+            multiplyVector(A, column, expected);
+            e[j] = 0;
+            for(int i = 0; i < A->rowCount; i++)
+            {
+                diff = fmax(diff, fabs(got[(size_t)i * B->colCount + j] - expected[i]));
+            }
+        }
+    }
+    free(e);
+    free(column);
+    free(expected);
+    free(got);
+    return diff;
+}
+double checkMultiplyStrategies(void)// every SpGEMM strategy against products with one column of B at a time
+{
+    SparseMatrix *A = testOperand('A', 60, 50, 5, 8), *B = testOperand('B', 50, 1500, 5, 9);
+    SparseMatrix *wide = testOperand('C', 50, 60000, 5, 10), *empty = testOperand('D', 3, 4, 0, 11);
+    SparseMatrix* shaped = testOperand('E', 4, 6, 2, 12);
+    SparseMatrix* tall = testOperand('F', 40000, 50, 5, 13);// enough rows to flush the row buffers several times
+    SparseMatrix* narrow = testOperand('G', 50, 40, 5, 14);
+    SparseMatrix C;
+    double diff = 0;
+
+    for(int s = MULTIPLY_AUTO; s <= MULTIPLY_BLOCKED; s++)
+    {
+        for(int w = 0; w < 3; w++)
+        {
+            SparseMatrix* left = (w == 2) ? tall : A;
+            SparseMatrix* right = (w == 1) ? wide : (w == 2) ? narrow : B;
+            if(multiplyMatrixWithStrategy(left, right, &C, (MultiplyStrategy)s) == SUCCESS)
+            {
+                diff = fmax(diff, productDifference(left, right, &C));
+                clearMatrix(&C);
+            }
+            else
+            {
+                diff = HUGE_VAL;
+            }
+        }
+    }
+    // an empty operand gives an empty product of the right shape, mismatched shapes still fail
+    if(multiplyMatrix(empty, A, &C) == SUCCESS)
+    {
+        clearMatrix(&C);
+        diff = HUGE_VAL;
+    }
+    if(multiplyMatrix(empty, shaped, &C) == FAILURE || C.rowCount != 3 || C.colCount != 6 || C.rowHead != NULL)
+    {
+        diff = HUGE_VAL;
+    }
+    clearMatrix(&C);
+    return diff;
+}
+double checkPlans(void)// numeric phases after value changes against fresh products and sums
+{
+    SparseMatrix *A = testOperand('A', 40, 30, 4, 13), *B = testOperand('B', 30, 35, 4, 14), *C = testOperand('C', 40, 30, 4, 15);
+    SparseMatrix expected, got;
+    matrix_entry removed;
+    double diff = 0;
+
+    for(int round = 0; round < 3; round++)
+    {
+        if(round > 0)// same pattern, new values
+        {
+            scalarMultiplyMatrix(A, round + 1.5f);
+            scalarMultiplyMatrix(C, -0.5f);
+        }
+        for(int multiply = 0; multiply < 2; multiply++)
+        {
+            SparseMatrix* right = multiply ? B : C;
+            status_code sc = multiply ? multiplyMatrix(A, right, &expected) : addMatrix(A, right, &expected);
+            if(sc == SUCCESS && plannedOperation(multiply, 'A', A, multiply ? 'B' : 'C', right, &got) == SUCCESS)
+            {
+                diff = fmax(diff, matrixDifference(&got, &expected));
+                clearMatrix(&got);
+            }
+            else
+            {
+                diff = HUGE_VAL;
+            }
+            clearMatrix(&expected);
+        }
+    }
+    // plans refuse operands they were not built from and changed patterns
+    if(!planSlots[0][1].hasMultiply || numericMultiply(C, B, &planSlots[0][1].multiply) == SUCCESS
+        || numericAdd(C, A, &planSlots[0][2].add) == SUCCESS)
+    {
+        diff = HUGE_VAL;
+    }
+    deleteElement(A->rowHead->rowlist->row, A->rowHead->rowlist->col, A, &removed);
+    if(numericMultiply(A, B, &planSlots[0][1].multiply) == SUCCESS || numericAdd(A, C, &planSlots[0][2].add) == SUCCESS)
+    {
+        diff = HUGE_VAL;
+    }
+    // the command path plans again
+    if(multiplyMatrix(A, B, &expected) == SUCCESS && plannedOperation(TRUE, 'A', A, 'B', B, &got) == SUCCESS)
+    {
+        diff = fmax(diff, matrixDifference(&got, &expected));
+        clearMatrix(&got);
+    }
+    else
+    {
+        diff = HUGE_VAL;
+    }
+    clearMatrix(&expected);
+    return diff;
+}
+SparseMatrix* dominantOperand(char name, int n, int perRow, unsigned seed, boolean symmetric)// strictly diagonally dominant
+{
+    SparseMatrix* A = testOperand(name, n, n, perRow, seed);
+    SparseMatrix At, diagonal, sum;
+    MatrixBuilder builder;
+    double* rowSum = (double*)calloc(n, sizeof(double));
+
+    initializeMatrix(&At);
+    if(symmetric && cloneMatrix(A, &At) == SUCCESS && transpose(&At) == SUCCESS && addMatrix(A, &At, &sum) == SUCCESS)
+    {
+        clearMatrix(A);
+        *A = sum;
+    }
+    clearMatrix(&At);
+    if(rowSum && beginMatrixBuilder(&builder, &diagonal, n, n) == SUCCESS)
+    {
+        for(Row_Node* rptr = A->rowHead; rptr; rptr = rptr->next)
+        {
+            for(Sm_Node* sptr = rptr->rowlist; sptr; sptr = sptr->right)
+            {
+                rowSum[sptr->row] += fabs(sptr->data) * ((sptr->row == sptr->col) ? 2 : 1);
+            }
+        }
+        for(int i = 0; i < n; i++)
+        {
+            appendElement(&builder, i, i, (matrix_entry)(rowSum[i] + 1));
+        }
+        finishMatrixBuilder(&builder);
+        if(addMatrix(A, &diagonal, &sum) == SUCCESS)
+        {
+            clearMatrix(A);
+            *A = sum;
+        }
+        clearMatrix(&diagonal);
+    }
+    free(rowSum);
+    return A;
+}
+double solveDifference(const SparseMatrix* A, const Preconditioner* M, SolverMethod method)// A x against b after a solve
+{
+    LinearOperator op = sparseMatrixOperator(A);
+    SolverOptions options;
+    SolverResult result;
+    int n = A->rowCount;
+    double *b = (double*)malloc(n * sizeof(double)), *x = (double*)calloc(n, sizeof(double));
+    double* Ax = (double*)malloc(n * sizeof(double));
+    double diff = HUGE_VAL;
+
+    initializeSolverOptions(&options);
+    if(b && x && Ax)
+    {
+        for(int i = 0; i < n; i++)
+        {
+            b[i] = cos(i + 1.0);
+        }
+        if(solveLinearSystem(&op, M, method, b, x, &options, &result) == SUCCESS)
+        {
+            multiplyVector(A, x, Ax);
+            diff = result.converged ? vectorDifference(n, Ax, b) : HUGE_VAL;
+            freeSolverResult(&result);
+        }
+    }
+    free(b);
+    free(x);
+    free(Ax);
+    return diff;
+}
+double checkSolvers(void)// residuals of CG, BiCGSTAB and GMRES solutions, and BiCGSTAB breakdown
+{
+    SparseMatrix* spd = dominantOperand('A', 80, 4, 16, TRUE);
+    SparseMatrix* general = dominantOperand('B', 80, 4, 17, FALSE);
+    SparseMatrix* skew = testOperand('C', 20, 20, 0, 18);
+    LinearOperator op;
+    SolverOptions options;
+    SolverResult result;
+    double b[20] = {1}, x[20] = {0};
+    double diff = solveDifference(spd, NULL, SOLVER_CG);
+
+    diff = fmax(diff, solveDifference(general, NULL, SOLVER_BICGSTAB));
+    diff = fmax(diff, solveDifference(general, NULL, SOLVER_GMRES));
+    // r . A r vanishes for a skew-symmetric A: BiCGSTAB must stop without NaN iterates
+    for(int i = 0; i + 1 < 20; i++)
+    {
+        insertElement(i, i + 1, 1, skew);
+        insertElement(i + 1, i, -1, skew);
+    }
+    op = sparseMatrixOperator(skew);
+    initializeSolverOptions(&options);
+    if(solveBiCGSTAB(&op, NULL, b, x, &options, &result) == SUCCESS)
+    {
+        diff = (result.converged || !isfinite(result.residual)) ? HUGE_VAL : diff;
+        for(int i = 0; i < 20; i++)
+        {
+            diff = isfinite(x[i]) ? diff : HUGE_VAL;
+        }
+        freeSolverResult(&result);
+    }
+    else
+    {
+        diff = HUGE_VAL;
+    }
+    return diff;
+}
+double checkPreconditioners(void)// preconditioned solves against b, and the Jacobi diagonal against the entries
+{
+    SparseMatrix* spd = dominantOperand('A', 80, 4, 19, TRUE);
+    SparseMatrix* general = dominantOperand('B', 80, 4, 20, FALSE);
+    const PreconditionerKind kinds[] = {PRECOND_NONE, PRECOND_JACOBI, PRECOND_BLOCK_JACOBI, PRECOND_ILU0, PRECOND_IC0};
+    FactorPreconditioner precond;
+    Preconditioner hook;
+    double diff = 0;
+
+    for(int k = 0; k < 5; k++)
+    {
+        boolean symmetric = (kinds[k] == PRECOND_IC0) ? TRUE : FALSE;
+        SparseMatrix* A = symmetric ? spd : general;
+        if(buildPreconditioner(A, kinds[k], DEFAULT_JACOBI_BLOCK, &precond) == SUCCESS)
+        {
+            hook = makePreconditioner(&precond);
+            diff = fmax(diff, solveDifference(A, (kinds[k] == PRECOND_NONE) ? NULL : &hook, symmetric ? SOLVER_CG : SOLVER_GMRES));
+            if(kinds[k] == PRECOND_JACOBI)
+            {
+                for(Row_Node* rptr = A->rowHead; rptr; rptr = rptr->next)
+                {
+                    for(Sm_Node* sptr = rptr->rowlist; sptr; sptr = sptr->right)
+                    {
+                        diff = (sptr->row != sptr->col || fabs(precond.diagonal[sptr->row] * sptr->data - 1) < 1e-12) ? diff : HUGE_VAL;
+                    }
+                }
+            }
+            diff = (kinds[k] == PRECOND_NONE && precond.diagonal) ? HUGE_VAL : diff;
+            freeFactorPreconditioner(&precond);
+        }
+        else
+        {
+            diff = HUGE_VAL;
+        }
+    }
+    return diff;
+}
+double checkBlockForms(void)// BSR SpMV, multiply and add against the list kernels, whole and ragged shapes
+{
+    double diff = 0;
+    for(int bs = 1; bs <= 6; bs++)
+    {
+        int rows = 12 * bs + (bs > 1 && bs % 2), inner = 10 * bs + (bs == 5), cols = 8 * bs + (bs == 3);
+        SparseMatrix *A = testOperand('A', rows, inner, 6, 21 + bs), *B = testOperand('B', inner, cols, 6, 31 + bs);
+        SparseMatrix *C = testOperand('C', rows, inner, 6, 41 + bs);
+        SparseMatrix expected, got;
+        BsrMatrix ba, bb = {0}, bc = {0}, result;
+        double *x = (double*)malloc(inner * sizeof(double)), *y = (double*)malloc(rows * sizeof(double));
+        double* yRef = (double*)malloc(rows * sizeof(double));
+
+        if(x && y && yRef && sparseMatrixToBsr(A, bs, &ba) == SUCCESS)
+        {
+            for(int i = 0; i < inner; i++)
+            {
+                x[i] = sin(i + 1.0);
+            }
+            bsrMultiplyVector(&ba, x, y);
+            multiplyVector(A, x, yRef);
+            diff = fmax(diff, vectorDifference(rows, y, yRef));
+            if(sparseMatrixToBsr(B, bs, &bb) == SUCCESS && bsrMultiply(&ba, &bb, &result) == SUCCESS)
+            {
+                multiplyMatrix(A, B, &expected);
+                diff = (bsrToSparseMatrix(&result, &got) == SUCCESS) ? fmax(diff, matrixDifference(&got, &expected)) : HUGE_VAL;
+                clearMatrix(&got);
+                clearMatrix(&expected);
+                freeBsrMatrix(&result);
+            }
+            else
+            {
+                diff = HUGE_VAL;
+            }
+            if(sparseMatrixToBsr(C, bs, &bc) == SUCCESS && bsrAdd(&ba, &bc, &result) == SUCCESS)
+            {
+                addMatrix(A, C, &expected);
+                diff = (bsrToSparseMatrix(&result, &got) == SUCCESS) ? fmax(diff, matrixDifference(&got, &expected)) : HUGE_VAL;
+                clearMatrix(&got);
+                clearMatrix(&expected);
+                freeBsrMatrix(&result);
+            }
+            else
+            {
+                diff = HUGE_VAL;
+            }
+            freeBsrMatrix(&ba);
+            freeBsrMatrix(&bb);
+            freeBsrMatrix(&bc);
+        }
+        else
+        {
+            diff = HUGE_VAL;
+        }
+        free(x);
+        free(y);
+        free(yRef);
+    }
+    return diff;
+}
+double checkSlicedForms(void)// SELL-C-sigma SpMV against the list kernel for every chunk size and sorting window
+{
+    const int chunks[] = {1, 4, 5, 8, 16}, sigmas[] = {1, 8, 64};
+    SparseMatrix* A = testOperand('A', 203, 150, 9, 51);
+    SparseMatrix longRows, sum;
+    MatrixBuilder builder;
+    SellMatrix sell;
+    double x[150], y[203], yRef[203];
+    double diff = 0;
+
+    for(int i = 0; i < 150; i++)
+    {
+        x[i] = cos(i + 0.5);
+    }
+    if(beginMatrixBuilder(&builder, &longRows, 203, 150) == SUCCESS)// uneven row lengths, so sorting and padding matter
+    {
+        for(int i = 0; i < 203; i += 7)
+        {
+            for(int j = i % 3; j < 150; j += 3)
+            {
+                appendElement(&builder, i, j, (matrix_entry)(j % 5 + 1));
+            }
+        }
+        finishMatrixBuilder(&builder);
+        if(addMatrix(A, &longRows, &sum) == SUCCESS)
+        {
+            clearMatrix(A);
+            *A = sum;
+        }
+        clearMatrix(&longRows);
+    }
+    multiplyVector(A, x, yRef);
+    for(int c = 0; c < 5; c++)
+    {
+        for(int w = 0; w < 3; w++)
+        {
+            if(sparseMatrixToSell(A, chunks[c], sigmas[w], &sell) == SUCCESS)
+            {
+                sellMultiplyVector(&sell, x, y);
+                diff = fmax(diff, vectorDifference(203, y, yRef));
+                freeSellMatrix(&sell);
+            }
+            else
+            {
+                diff = HUGE_VAL;
+            }
+        }
+    }
+    return diff;
+}
+#define SELF_TEST_FILE "sm_selftest"   // scratch files in the working directory, removed afterwards
+
+SparseMatrix* fewRowsOperand(char name, int rows, int cols, int stride, unsigned seed)// only every stride-th row stored
+{
+    SparseMatrix* A = testOperand(name, rows, cols, 0, seed);
+    MatrixBuilder builder;
+    clearMatrix(A);
+    if(beginMatrixBuilder(&builder, A, rows, cols) == SUCCESS)
+    {
+        for(int i = seed % stride; i < rows; i += stride)
+        {
+            for(int j = (i * 7 + seed) % 5; j < cols; j += 5 + i % 11)
+            {
+                appendElement(&builder, i, j, (matrix_entry)((i + j + seed) % 9 - 4));
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    return A;
+}
+double dcsrDifference(const DcsrMatrix* dcsr, const SparseMatrix* expected)
+{
+    SparseMatrix got;
+    double diff = HUGE_VAL;
+    if(dcsrToSparseMatrix(dcsr, &got) == SUCCESS)
+    {
+        diff = matrixDifference(&got, expected);
+    }
+    clearMatrix(&got);
+    return diff;
+}
+double checkHypersparse(void)// DCSR conversions, add and multiply against the list kernels, and 2^40 indexes
+{
+    SparseMatrix *A = fewRowsOperand('A', 2000, 1500, 50, 1), *B = fewRowsOperand('B', 1500, 1800, 30, 2);
+    SparseMatrix *C = fewRowsOperand('C', 2000, 1500, 40, 3), *upper = fewRowsOperand('D', 60, 60, 3, 4);
+    SparseMatrix strict, lower, full, packed, expected, got;
+    MatrixBuilder builder;
+    DcsrMatrix dcsr, a, b, c;
+    const sm_index big = (sm_index)1 << 40;
+    Triplet left[] = {{big - 1, 5, 2}, {7, big / 2, 3}, {7, big / 2, 1}}, right[] = {{5, big / 4, 4}, {big / 2, 1, 5}, {big / 2, big - 2, -1}};
+    Triplet product[] = {{7, 1, 20}, {7, big - 2, -4}, {big - 1, big / 4, 8}};
+    double diff = 0;
+
+    // a symmetric matrix whose first rows are stored only as mirrored columns
+    if(beginMatrixBuilder(&builder, &strict, 60, 60) == SUCCESS)
+    {
+        for(Row_Node* rptr = upper->rowHead; rptr; rptr = rptr->next)
+        {
+            for(Sm_Node* sptr = rptr->rowlist; sptr; sptr = sptr->right)
+            {
+                appendElement(&builder, sptr->row, sptr->col, (sptr->col > sptr->row) ? sptr->data : 0);
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    initializeMatrix(&lower);
+    initializeMatrix(&packed);
+    if(cloneMatrix(&strict, &lower) == SUCCESS && transpose(&lower) == SUCCESS && addMatrix(&strict, &lower, &full) == SUCCESS)
+    {
+        if(cloneMatrix(&full, &packed) == SUCCESS && setSymmetricStorage(&packed, TRUE) == SUCCESS
+           && sparseMatrixToDcsr(&packed, &dcsr) == SUCCESS)
+        {
+            diff = fmax(diff, dcsrDifference(&dcsr, &full));
+            freeDcsrMatrix(&dcsr);
+        }
+        else
+        {
+            diff = HUGE_VAL;
+        }
+        clearMatrix(&full);
+    }
+    clearMatrix(&strict);
+    clearMatrix(&lower);
+    clearMatrix(&packed);
+
+    diff = (isHypersparse(A) && isHypersparse(B) && !isHypersparse(upper)) ? diff : HUGE_VAL;
+    for(int multiply = 0; multiply < 2; multiply++)
+    {
+        SparseMatrix* right = multiply ? B : C;
+        if((multiply ? multiplyMatrix(A, right, &expected) : addMatrix(A, right, &expected)) == SUCCESS
+           && hypersparseOperation(A, right, multiply, &got) == SUCCESS)
+        {
+            diff = fmax(diff, matrixDifference(&got, &expected));
+        }
+        else
+        {
+            diff = HUGE_VAL;
+        }
+        clearMatrix(&got);
+        clearMatrix(&expected);
+    }
+
+    // shapes beyond int go through coordinate files; duplicates are summed on input
+    if(dcsrFromTriplets(big, big, left, 3, &a) == SUCCESS && dcsrFromTriplets(big, big, right, 3, &b) == SUCCESS
+       && writeCoordinateFile(SELF_TEST_FILE ".coo", &b) == SUCCESS)
+    {
+        freeDcsrMatrix(&b);
+        if(readCoordinateFile(SELF_TEST_FILE ".coo", &b) == SUCCESS && dcsrMultiply(&a, &b, &c) == SUCCESS)
+        {
+            diff = (c.nnz == 3 && c.rowsStored == 2 && c.rowCount == big && c.colCount == big) ? diff : HUGE_VAL;
+            for(int k = 0; diff == 0 && k < 3; k++)
+            {
+                sm_index row = c.rowIds[(k < 2) ? 0 : 1];
+                diff = (row == product[k].row && c.colIdx[k] == product[k].col) ? fabs(c.values[k] - product[k].value) : HUGE_VAL;
+            }
+            freeDcsrMatrix(&c);
+        }
+        else
+        {
+            diff = HUGE_VAL;
+        }
+        if(dcsrAdd(&a, &a, &c) == SUCCESS)
+        {
+            diff = (c.nnz == 2 && c.values[0] == 8 && c.values[1] == 4) ? diff : HUGE_VAL;
+            freeDcsrMatrix(&c);
+        }
+        freeDcsrMatrix(&b);
+    }
+    else
+    {
+        diff = HUGE_VAL;
+    }
+    freeDcsrMatrix(&a);
+    remove(SELF_TEST_FILE ".coo");
+    return diff;
+}
+double streamedDifference(const char* path, const SparseMatrix* expected)
+{
+    SparseMatrix got;
+    double diff = (loadChunkedMatrix(path, &got) == SUCCESS) ? matrixDifference(&got, expected) : HUGE_VAL;
+    clearMatrix(&got);
+    return diff;
+}
+double checkStreaming(void)// out-of-core multiply and add under tight and loose budgets against in-memory results
+{
+    SparseMatrix *A = testOperand('A', 90, 70, 6, 61), *B = testOperand('B', 70, 80, 6, 62), *C = testOperand('C', 90, 70, 6, 63);
+    const char *fileA = SELF_TEST_FILE "_a.smc", *fileB = SELF_TEST_FILE "_b.smc", *fileC = SELF_TEST_FILE "_c.smc";
+    const char* fileR = SELF_TEST_FILE "_r.smc";
+    const size_t budgets[] = {2048, DEFAULT_STREAM_BUDGET};
+    SparseMatrix product, sum;
+    StreamStats stats;
+    double diff = HUGE_VAL;
+
+    initializeMatrix(&product);
+    initializeMatrix(&sum);
+    if(writeChunkedMatrix(A, fileA, 16) == SUCCESS && writeChunkedMatrix(B, fileB, 9) == SUCCESS
+       && writeChunkedMatrix(C, fileC, 25) == SUCCESS && multiplyMatrix(A, B, &product) == SUCCESS)
+    {
+        diff = streamedDifference(fileA, A);
+        if(addMatrix(A, C, &sum) == SUCCESS)
+        {
+            for(int k = 0; k < 2; k++)
+            {
+                diff = (streamMultiply(fileA, fileB, fileR, budgets[k], &stats) == SUCCESS)
+                       ? fmax(diff, streamedDifference(fileR, &product)) : HUGE_VAL;
+                diff = (k == 1 || stats.tiles > 1) ? diff : HUGE_VAL;// the tight budget must split the work
+                diff = (streamAdd(fileA, fileC, fileR, budgets[k], &stats) == SUCCESS)
+                       ? fmax(diff, streamedDifference(fileR, &sum)) : HUGE_VAL;
+            }
+            diff = (streamMultiply(fileA, fileC, fileR, budgets[1], &stats) == FAILURE) ? diff : HUGE_VAL;
+        }
+        else
+        {
+            diff = HUGE_VAL;
+        }
+        clearMatrix(&sum);
+    }
+    clearMatrix(&product);
+    remove(fileA);
+    remove(fileB);
+    remove(fileC);
+    remove(fileR);
+    return diff;
+}
+// readers pin snapshots of a shared matrix while a writer rewrites its whole
+// diagonal in bursts; every snapshot must show one burst, never a mix
+#define READER_THREADS 4
+#define WRITER_BURSTS 100
+
+typedef struct Reader_Check_Tag
+{
+    char name;
+    atomic_int done;
+    atomic_int torn;
+    atomic_long reads;
+} ReaderCheck;
+
+boolean uniformDiagonal(const SparseMatrix* matrix)
+{
+    int count = 0;
+    boolean uniform = TRUE;
+    for(Row_Node* rptr = matrix->rowHead; rptr; rptr = rptr->next)
+    {
+        for(Sm_Node* sptr = rptr->rowlist; sptr; sptr = sptr->right)
+        {
+            uniform = uniform && sptr->row == sptr->col && sptr->data == matrix->rowHead->rowlist->data;
+            count++;
+        }
+    }
+    return uniform && count == matrix->rowCount;
+}
+void readSnapshot(ReaderCheck* check)
+{
+    SparseMatrix* snapshot = beginRead(check->name);
+    if(snapshot == NULL || !uniformDiagonal(snapshot) || !search(0, 0, snapshot))// search is profiled on this thread
+    {
+        atomic_store(&check->torn, 1);
+    }
+    if(snapshot)
+    {
+        endRead();
+    }
+    atomic_fetch_add(&check->reads, 1);
+}
+#ifndef SM_NO_THREADS
+void* readSnapshots(void* context)
+{
+    ReaderCheck* check = (ReaderCheck*)context;
+    while(!atomic_load(&check->done))
+    {
+        readSnapshot(check);
+        sched_yield();
+    }
+    return NULL;
+}
+#endif
+status_code writeDiagonal(char name, int n, matrix_entry value)// one entry at a time, giving readers a chance to see a mix
+{
+    status_code sc = FAILURE;
+    SparseMatrix* live = beginWrite(name);
+    if(live)
+    {
+        sc = SUCCESS;
+        matrixChanged(live);
+        for(int i = 0; sc == SUCCESS && i < n; i++)
+        {
+            MatrixUpdate update = {i, i, value, UPDATE_UPSERT};
+            sc = applyUpdates(live, &update, 1);
+#ifndef SM_NO_THREADS
+            sched_yield();
+#endif
+        }
+        sc = (endWrite(name) == SUCCESS) ? sc : FAILURE;
+    }
+    return sc;
+}
+double checkConcurrentReaders(void)// snapshots under write bursts, and profile counts summed over the reader threads
+{
+    ReaderCheck check;
+    double diff = HUGE_VAL;
+    status_code sc;
+#ifndef SM_NO_THREADS
+    pthread_t readers[READER_THREADS];
+    int started = 0;
+#endif
+
+    testOperand('G', 60, 60, 0, 1);
+    check.name = 'G';
+    atomic_init(&check.done, 0);
+    atomic_init(&check.torn, 0);
+    atomic_init(&check.reads, 0);
+    resetProfile();
+    sc = (writeDiagonal('G', 60, 1) == SUCCESS && shareMatrix('G') == SUCCESS) ? SUCCESS : FAILURE;
+#ifndef SM_NO_THREADS
+    while(sc == SUCCESS && started < READER_THREADS && pthread_create(&readers[started], NULL, readSnapshots, &check) == 0)
+    {
+        started++;
+    }
+#endif
+    for(int burst = 2; sc == SUCCESS && burst <= WRITER_BURSTS; burst++)
+    {
+        sc = writeDiagonal('G', 60, (matrix_entry)burst);
+        readSnapshot(&check);
+    }
+    atomic_store(&check.done, 1);
+#ifndef SM_NO_THREADS
+    for(int t = 0; t < started; t++)
+    {
+        pthread_join(readers[t], NULL);
+    }
+#endif
+    if(sc == SUCCESS && !atomic_load(&check.torn))
+    {
+        diff = 0;
+#ifdef SM_PROFILE
+        ProfileCounter total[PROF_OP_COUNT];
+        sumProfile(total);
+        diff = (total[PROF_SEARCH].calls >= atomic_load(&check.reads)) ? 0 : HUGE_VAL;
+#endif
+    }
+    unshareMatrix('G');
+    return diff;
+}
+double denseDifference(const SparseMatrix* matrix, const double* dense)// entries and both link directions against a dense array
+{
+    double diff = 0, scale = 1;
+    long stored = 0, nonzeros = 0, linked = 0;
+    for(long k = 0; k < (long)matrix->rowCount * matrix->colCount; k++)
+    {
+        scale = fmax(scale, fabs(dense[k]));
+        nonzeros += (dense[k] != 0);
+    }
+    for(Row_Node* rptr = matrix->rowHead; rptr; rptr = rptr->next)
+    {
+        for(Sm_Node* sptr = rptr->rowlist; sptr; sptr = sptr->right)
+        {
+            boolean ordered = sptr->row == rptr->row && (!sptr->right || sptr->right->col > sptr->col);
+            diff = (ordered && sptr->data != 0) ? fmax(diff, fabs(sptr->data - dense[(long)sptr->row * matrix->colCount + sptr->col]))
+                                                : HUGE_VAL;
+            stored++;
+        }
+    }
+    for(Col_Node* cptr = matrix->colHead; cptr; cptr = cptr->next)
+    {
+        for(Sm_Node* sptr = cptr->collist; sptr; sptr = sptr->down)
+        {
+            diff = (sptr->col == cptr->col && (!sptr->down || sptr->down->row > sptr->row)) ? diff : HUGE_VAL;
+            linked++;
+        }
+    }
+    return (stored == nonzeros && linked == nonzeros) ? diff / scale : HUGE_VAL;
+}
+double checkBatchedUpdates(void)// applyUpdates against the same updates done one at a time with insert and delete
+{
+    enum{ROWS = 60, COLS = 50, UPDATES = 3000};
+    SparseMatrix* A = testOperand('A', ROWS, COLS, 5, 21);
+    SparseMatrix B;
+    MatrixUpdate* updates = (MatrixUpdate*)malloc(UPDATES * sizeof(MatrixUpdate));
+    double* dense = (double*)calloc(ROWS * COLS, sizeof(double));
+    double diff = HUGE_VAL;
+    unsigned long version;
+    matrix_entry removed;
+
+    initializeMatrix(&B);
+    if(updates && dense && cloneMatrix(A, &B) == SUCCESS)
+    {
+        for(Row_Node* rptr = A->rowHead; rptr; rptr = rptr->next)
+        {
+            for(Sm_Node* sptr = rptr->rowlist; sptr; sptr = sptr->right)
+            {
+                dense[sptr->row * COLS + sptr->col] = sptr->data;
+            }
+        }
+        srand(22);
+        for(int k = 0; k < UPDATES; k++)// few distinct values, so sums often cancel to zero
+        {
+            MatrixUpdate* u = &updates[k];
+            double* entry;
+            u->row = rand() % ROWS;
+            u->col = (k % 7 == 0) ? u->row % COLS : rand() % COLS;
+            u->value = (matrix_entry)(rand() % 5 - 2);
+            u->op = (UpdateOp)(rand() % 3);
+            entry = &dense[u->row * COLS + u->col];
+            *entry = (u->op == UPDATE_UPSERT) ? u->value : (u->op == UPDATE_ACCUMULATE) ? *entry + u->value : 0;
+            if(search(u->row, u->col, &B))
+            {
+                deleteElement(u->row, u->col, &B, &removed);
+            }
+            if(*entry != 0)
+            {
+                insertElement(u->row, u->col, (matrix_entry)*entry, &B);
+            }
+        }
+        diff = (applyUpdates(A, updates, UPDATES) == SUCCESS) ? denseDifference(A, dense) : HUGE_VAL;
+        diff = fmax(diff, denseDifference(&B, dense));
+        // a batch with an index out of bounds changes nothing
+        updates[UPDATES - 1].row = ROWS;
+        version = A->version;
+        if(applyUpdates(A, updates, UPDATES) == SUCCESS || denseDifference(A, dense) != 0 || A->version == version)
+        {
+            diff = HUGE_VAL;
+        }
+    }
+    clearMatrix(&B);
+    free(updates);
+    free(dense);
+    return diff;
+}
+void randomUpdateBatch(MatrixUpdate* updates, int count, int rows, int cols)// entries in -2 .. 2, any operation
+{
+    for(int k = 0; k < count; k++)
+    {
+        updates[k].row = rand() % rows;
+        updates[k].col = rand() % cols;
+        updates[k].value = (matrix_entry)(rand() % 5 - 2);
+        updates[k].op = (UpdateOp)(rand() % 3);
+    }
+}
+double maintainedDifference(const MaintainedProduct* maintained)// the kept product against a fresh one
+{
+    SparseMatrix fresh;
+    double diff = HUGE_VAL;
+    if(multiplyMatrix(maintained->left, maintained->right, &fresh) == SUCCESS)
+    {
+        diff = matrixDifference(maintained->product, &fresh);
+        clearMatrix(&fresh);
+    }
+    return diff;
+}
+double checkMaintainedProducts(void)// incremental refreshes against fresh products after each batch
+{
+    SparseMatrix *A = testOperand('A', 40, 30, 4, 31), *B = testOperand('B', 30, 35, 4, 32), *S = testOperand('C', 30, 30, 3, 33);
+    SparseMatrix *D = testOperand('D', 30, 35, 4, 35);// the products below share no operand, so each stays current
+    SparseMatrix *H, AB, SS, sym, SD, St;
+    MaintainedProduct products[3];
+    MatrixUpdate updates[12];
+    double diff = HUGE_VAL;
+    int started = 0;
+
+    initializeMatrix(&AB);
+    initializeMatrix(&SS);
+    initializeMatrix(&SD);
+    initializeMatrix(&sym);
+    initializeMatrix(&St);
+    // A * B, S * S and a symmetric operand stored as its lower triangle times D
+    if(cloneMatrix(S, &St) == SUCCESS && transpose(&St) == SUCCESS && addMatrix(S, &St, &sym) == SUCCESS
+       && setSymmetricStorage(&sym, TRUE) == SUCCESS && beginMaintainedProduct(&products[0], A, B, &AB) == SUCCESS
+       && beginMaintainedProduct(&products[1], S, S, &SS) == SUCCESS && beginMaintainedProduct(&products[2], &sym, D, &SD) == SUCCESS)
+    {
+        srand(34);
+        diff = 0;
+        for(int round = 0; round < 24; round++)
+        {
+            MaintainedProduct* maintained = &products[round % 3];
+            SparseMatrix* operand = (round % 6 < 3) ? maintained->left : maintained->right;
+            randomUpdateBatch(updates, 12, operand->rowCount, operand->colCount);
+            if(updateMaintainedProduct(maintained, operand, updates, 12) == SUCCESS
+               && maintained->rowsRefreshed + maintained->colsRefreshed <= 2 * 2 * 12)// only the touched lines
+            {
+                diff = fmax(diff, maintainedDifference(maintained));
+            }
+            else
+            {
+                diff = HUGE_VAL;
+            }
+        }
+    }
+    // through the registry: refreshed after batches, recomputed after any other change
+    if(maintainProduct('H', A, B) == SUCCESS && (H = getMatrixByName('H')) != NULL)
+    {
+        started = 1;
+        for(int round = 0; round < 4; round++)
+        {
+            SparseMatrix fresh;
+            if(round == 2)
+            {
+                scalarMultiplyMatrix(A, 2);
+                matrixChanged(A);
+            }
+            randomUpdateBatch(updates, 12, (round % 2) ? B->rowCount : A->rowCount, (round % 2) ? B->colCount : A->colCount);
+            if(updateRegistryMatrix((round % 2) ? B : A, updates, 12) == SUCCESS && multiplyMatrix(A, B, &fresh) == SUCCESS)
+            {
+                diff = fmax(diff, matrixDifference(H, &fresh));
+                clearMatrix(&fresh);
+            }
+            else
+            {
+                diff = HUGE_VAL;
+            }
+        }
+        stopMaintaining('H');
+    }
+    diff = started ? diff : HUGE_VAL;
+    clearMatrix(&AB);
+    clearMatrix(&SS);
+    clearMatrix(&SD);
+    clearMatrix(&sym);
+    clearMatrix(&St);
+    return diff;
+}
+// an n x n integer matrix of the given structure, entries in -4 .. 4. The diagonal,
+// a neighbour of every index and the entries of a permutation are nonzero, so
+// classifyMatrix finds the structure again: blocks are the even and the odd indexes.
+void structuredDense(double* dense, int n, MatrixStructure structure, unsigned seed)
+{
+    int perm[8];
+    boolean identity = TRUE;
+    srand(seed);
+    for(int i = 0; i < n; i++)
+    {
+        int k = rand() % (i + 1);
+        perm[i] = perm[k];
+        perm[k] = i;
+    }
+    for(int i = 0; i < n; i++)
+    {
+        identity = identity && perm[i] == i;
+    }
+    if(identity && n > 1)
+    {
+        perm[0] = 1;
+        perm[1] = 0;
+    }
+    for(int i = 0; i < n; i++)
+    {
+        for(int j = 0; j < n; j++)
+        {
+            boolean kept = (structure == STRUCTURE_GENERAL) || (structure == STRUCTURE_DIAGONAL && j == i)
+                           || (structure == STRUCTURE_LOWER && j <= i) || (structure == STRUCTURE_UPPER && j >= i)
+                           || (structure == STRUCTURE_PERMUTATION && j == perm[i])
+                           || (structure == STRUCTURE_BLOCK_DIAGONAL && (i - j) % 2 == 0);
+            boolean forced = kept && (structure == STRUCTURE_PERMUTATION || i == j
+                                      || abs(i - j) == ((structure == STRUCTURE_BLOCK_DIAGONAL) ? 2 : 1));
+            int sign = (rand() % 2) ? 1 : -1;// one rand() per statement, so the order is fixed
+            int magnitude = rand() % 4 + 1;
+            int value = rand() % 9 - 4;
+            dense[i * n + j] = forced ? sign * magnitude : (kept && rand() % 2) ? value : 0;
+        }
+    }
+}
+status_code denseToMatrix(const double* dense, int n, SparseMatrix* result)
+{
+    MatrixBuilder builder;
+    status_code sc = beginMatrixBuilder(&builder, result, n, n);
+    if(sc == SUCCESS)
+    {
+        for(int k = 0; sc == SUCCESS && k < n * n; k++)
+        {
+            sc = appendElement(&builder, k / n, k % n, (matrix_entry)dense[k]);
+        }
+        finishMatrixBuilder(&builder);
+    }
+    return sc;
+}
+double cofactorDeterminant(const double* dense, int n)// Laplace expansion along the first row
+{
+    double det = (n == 0) ? 1 : 0;
+    double minor[7 * 7];
+    for(int j = 0; j < n; j++)
+    {
+        if(dense[j] != 0)
+        {
+            for(int r = 1; r < n; r++)
+            {
+                for(int c = 0, m = 0; c < n; c++)
+                {
+                    if(c != j)
+                    {
+                        minor[(r - 1) * (n - 1) + m++] = dense[r * n + c];
+                    }
+                }
+            }
+            det += ((j % 2) ? -1 : 1) * dense[j] * cofactorDeterminant(minor, n - 1);
+        }
+    }
+    return det;
+}
+// |det - expected| relative to the product of the row lengths, Hadamard's bound on |det|
+double determinantDifference(double logAbsDet, int sign, const double* dense, int n)
+{
+    double expected = cofactorDeterminant(dense, n), bound = 1;
+    for(int i = 0; i < n; i++)
+    {
+        double length = 0;
+        for(int j = 0; j < n; j++)
+        {
+            length += dense[i * n + j] * dense[i * n + j];
+        }
+        bound *= fmax(sqrt(length), 1);
+    }
+    return fabs(((sign == 0) ? 0 : sign * exp(logAbsDet)) - expected) / bound;
+}
+double checkDeterminants(void)// structured and LU determinants against cofactor expansion, every structure
+{
+    const MatrixStructure structures[] = {STRUCTURE_GENERAL, STRUCTURE_DIAGONAL, STRUCTURE_LOWER, STRUCTURE_UPPER,
+                                          STRUCTURE_PERMUTATION, STRUCTURE_BLOCK_DIAGONAL};
+    const double singular[] = {2, 0, 1, 0, 0, 1, 0, 2, 1, 0, 3, 0, 0, 2, 0, 4};// block diagonal, odd block singular
+    double dense[7 * 7], diff = 0, logAbsDet = 0;
+    int sign = 1;
+    SparseMatrix matrix;
+    LuFactor lu;
+
+    for(int n = 1; n <= 7; n++)
+    {
+        for(int s = 0; s < 7; s++)// the last pass stores a symmetric general matrix as its lower triangle; 1 x 1 is diagonal
+        {
+            MatrixStructure structure = structures[(s < 6) ? s : 0];
+            if(n < 4 && structure != STRUCTURE_GENERAL)
+            {
+                continue;
+            }
+            structuredDense(dense, n, structure, 40 + 7 * n + s);
+            for(int k = 0; s == 6 && k < n * n; k++)
+            {
+                dense[k] = dense[(k / n >= k % n) ? k : (k % n) * n + k / n];
+            }
+            if(denseToMatrix(dense, n, &matrix) == SUCCESS && (s == 6 || n == 1 || classifyMatrix(&matrix) == structure)
+               && factorLU(&matrix, &lu) == SUCCESS)
+            {
+                diff = fmax(diff, determinantDifference(lu.logAbsDet, lu.sign, dense, n));
+                freeLuFactor(&lu);
+                diff = (s < 6 || setSymmetricStorage(&matrix, TRUE) == SUCCESS) ? diff : HUGE_VAL;
+                diff = (logDeterminant(&matrix, &logAbsDet, &sign) == SUCCESS) ? fmax(diff, determinantDifference(logAbsDet, sign, dense, n))
+                                                                              : HUGE_VAL;
+            }
+            else
+            {
+                diff = HUGE_VAL;
+            }
+            clearMatrix(&matrix);
+        }
+    }
+    if(denseToMatrix(singular, 4, &matrix) == FAILURE || logDeterminant(&matrix, &logAbsDet, &sign) == FAILURE || sign != 0)
+    {
+        diff = HUGE_VAL;
+    }
+    clearMatrix(&matrix);
+    return diff;
+}
+// inverseOfMatrix of a matrix built from dense against the inverse from its LU
+// factors, or HUGE_VAL when only one of them exists
+double inverseDifference(const double* dense, int n, boolean symmetric)
+{
+    SparseMatrix matrix, inverse, expected;
+    LuFactor lu;
+    double diff = HUGE_VAL;
+    status_code found, factored;
+
+    initializeMatrix(&inverse);
+    initializeMatrix(&expected);
+    if(denseToMatrix(dense, n, &matrix) == SUCCESS && factorLU(&matrix, &lu) == SUCCESS)
+    {
+        factored = luInverse(&lu, &expected);
+        freeLuFactor(&lu);
+        found = (!symmetric || setSymmetricStorage(&matrix, TRUE) == SUCCESS) ? inverseOfMatrix(&matrix, &inverse) : FAILURE;
+        diff = (found == SUCCESS && factored == SUCCESS) ? matrixDifference(&inverse, &expected) : HUGE_VAL;
+    }
+    clearMatrix(&matrix);
+    clearMatrix(&inverse);
+    clearMatrix(&expected);
+    return diff;
+}
+double checkStructuredInverses(void)// inverses by structure against LU inverses, and the refusals of singular ones
+{
+    const MatrixStructure structures[] = {STRUCTURE_DIAGONAL, STRUCTURE_LOWER, STRUCTURE_UPPER, STRUCTURE_PERMUTATION,
+                                          STRUCTURE_BLOCK_DIAGONAL};
+    const double singular[][16] = {
+        {2, 0, 1, 0, 0, 1, 0, 2, 1, 0, 3, 0, 0, 2, 0, 4},      // block diagonal, odd block singular
+        {1, 0, 0, 0, 2, 0, 0, 0, 3, 1, 2, 0, 1, 0, 4, 5},      // lower triangular, zero on the diagonal
+        {1, 0, 0, 0, 0, 1e-9, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1},   // diagonal, min / max |a| below FLT_EPSILON
+    };
+    double dense[7 * 7], diff = 0;
+
+    for(int n = 4; n <= 7; n++)
+    {
+        for(int s = 0; s < 6; s++)// the last pass stores a symmetric block diagonal matrix as its lower triangle
+        {
+            structuredDense(dense, n, structures[(s < 5) ? s : 4], 60 + 6 * n + s);
+            for(int k = 0; s == 5 && k < n * n; k++)
+            {
+                dense[k] = dense[(k / n >= k % n) ? k : (k % n) * n + k / n];
+            }
+            for(int i = 0; s != 3 && i < n; i++)// a dominant diagonal keeps the random blocks invertible
+            {
+                double length = 0;
+                for(int j = 0; j < n; j++)
+                {
+                    length += fabs(dense[i * n + j]);
+                }
+                dense[i * n + i] = (dense[i * n + i] < 0) ? -length : length;
+            }
+            diff = fmax(diff, inverseDifference(dense, n, (s == 5) ? TRUE : FALSE));
+        }
+    }
+    for(int t = 0; t < 3; t++)
+    {
+        SparseMatrix matrix, inverse;
+        initializeMatrix(&inverse);
+        diff = (denseToMatrix(singular[t], 4, &matrix) == SUCCESS && inverseOfMatrix(&matrix, &inverse) == FAILURE) ? diff : HUGE_VAL;
+        clearMatrix(&matrix);
+        clearMatrix(&inverse);
+    }
+    return diff;
+}
+// "multiply A B" the way executeCommand runs it: a cached product, or a fresh one
+// that is then cached. 0 when the lookup hit exactly as expected and the
+// result matches a fresh product, HUGE_VAL otherwise.
+double cachedProductDifference(SparseMatrix* A, SparseMatrix* B, boolean expectHit)
+{
+    char key[48];
+    SparseMatrix fresh;
+    CacheEntry* cached;
+    double diff = HUGE_VAL;
+
+    snprintf(key, sizeof(key), "multiply %s", multiplyStrategyName(MULTIPLY_AUTO));
+    cached = lookupResult(key, 'A', A, 'B', B);
+    if(multiplyMatrix(A, B, &fresh) == SUCCESS && (cached != NULL) == expectHit)
+    {
+        diff = cached ? matrixDifference(&cached->matrix, &fresh) : 0;
+        if(!cached)
+        {
+            cacheResult(key, 'A', A, 'B', B, &fresh, 0);
+        }
+    }
+    clearMatrix(&fresh);
+    return diff;
+}
+double checkResultCache(void)// hits on unchanged operands, misses after every kind of change, and both eviction bounds
+{
+    SparseMatrix *A = testOperand('A', 30, 30, 4, 71), *B = testOperand('B', 30, 30, 4, 72);
+    SparseMatrix small;
+    long hits, evictions;
+    matrix_entry d;
+    double diff = 0;
+    size_t bytes;
+    int entries = 0, row = 0, col = 0;
+
+    clearResultCache();
+    diff = fmax(diff, cachedProductDifference(A, B, FALSE));
+    diff = fmax(diff, cachedProductDifference(A, B, TRUE));
+    hits = resultCache.hits;
+    executeCommand("determinant A");
+    executeCommand("determinant A");
+    diff = (resultCache.hits == hits + 1) ? diff : HUGE_VAL;
+    // every change renews the version, so the next lookup misses and the repeat after it hits
+    for(int change = 0; change < 5; change++)
+    {
+        switch(change)
+        {
+            case 0:
+            {
+                row = A->rowHead->row;
+                col = A->rowHead->rowlist->col;
+                deleteElement(row, col, A, &d);
+                break;
+            }
+            case 1: insertElement(row, col, 5, A); break;// the position emptied above
+            case 2: scalarMultiplyMatrix(A, 2); break;
+            case 3: resizeMatrix(A, 30, 20); resizeMatrix(A, 30, 30); break;
+            default: transpose(A); break;
+        }
+        diff = fmax(diff, cachedProductDifference(A, B, FALSE));
+        diff = fmax(diff, cachedProductDifference(A, B, TRUE));
+    }
+    // entry bound: of RESULT_CACHE_ENTRIES + 4 small results, the four least recently used go
+    clearResultCache();
+    evictions = resultCache.evictions;
+    randomIntegerMatrix(&small, 8, 8, 3, 73);
+    bytes = (size_t)countElements(&small) * sizeof(Sm_Node);
+    for(int k = 0; k < RESULT_CACHE_ENTRIES + 4; k++)
+    {
+        char op[24];
+        snprintf(op, sizeof(op), "test %d", k);
+        cacheResult(op, 'A', A, '\0', NULL, &small, 0);
+        if(k == 0 || (k >= 2 && k < RESULT_CACHE_ENTRIES))
+        {
+            lookupResult("test 0", 'A', A, '\0', NULL);// keeps entry 0 the most recently used
+        }
+    }
+    for(int i = 0; i < RESULT_CACHE_ENTRIES; i++)
+    {
+        entries += (resultCache.entries[i].lastUse != 0);
+    }
+    diff = (entries == RESULT_CACHE_ENTRIES && resultCache.evictions == evictions + 4 && lookupResult("test 0", 'A', A, '\0', NULL)
+            && !lookupResult("test 1", 'A', A, '\0', NULL) && !lookupResult("test 4", 'A', A, '\0', NULL)
+            && lookupResult("test 5", 'A', A, '\0', NULL)) ? diff : HUGE_VAL;
+    // byte bound: room for three results, so a fourth evicts one and a larger one is not kept
+    clearResultCache();
+    resultCacheBudget = 3 * bytes;
+    for(int k = 0; k < 4; k++)
+    {
+        char op[24];
+        snprintf(op, sizeof(op), "test %d", k);
+        cacheResult(op, 'A', A, '\0', NULL, &small, 0);
+        diff = (resultCache.bytes <= resultCacheBudget) ? diff : HUGE_VAL;
+    }
+    diff = (resultCache.bytes == 3 * bytes && !lookupResult("test 0", 'A', A, '\0', NULL) && lookupResult("test 3", 'A', A, '\0', NULL))
+           ? diff : HUGE_VAL;
+    resultCacheBudget = 2 * bytes;
+    cacheResult("test large", 'A', A, '\0', NULL, B, 0);// B holds more than 2 x 8 x 3 entries
+    diff = (!lookupResult("test large", 'A', A, '\0', NULL) && resultCache.bytes == 3 * bytes) ? diff : HUGE_VAL;
+    resultCacheBudget = RESULT_CACHE_BYTES;
+    clearResultCache();
+    clearMatrix(&small);
+    return diff;
+}
+boolean isPermutation(const int* order, int n)
+{
+    char* seen = (char*)calloc(n + 1, sizeof(char));
+    boolean valid = seen ? TRUE : FALSE;
+    for(int i = 0; valid && i < n; i++)
+    {
+        valid = (order[i] >= 0 && order[i] < n && !seen[order[i]]) ? TRUE : FALSE;
+        if(valid)
+        {
+            seen[order[i]] = 1;
+        }
+    }
+    free(seen);
+    return valid;
+}
+void randomPermutation(int* order, int n, unsigned seed)
+{
+    srand(seed);
+    for(int i = 0; i < n; i++)
+    {
+        int k = rand() % (i + 1);
+        order[i] = order[k];
+        order[k] = i;
+    }
+}
+// P A Q^T against the dense array: result(i, j) = A(rowOrder[i], colOrder[j]),
+// built from a dense copy of A in full storage
+double permutedDifference(const SparseMatrix* result, const SparseMatrix* full, const int* rowOrder, const int* colOrder)
+{
+    int rows = full->rowCount, cols = full->colCount;
+    double* dense = (double*)calloc((size_t)rows * cols + 1, sizeof(double));
+    double* expected = (double*)calloc((size_t)rows * cols + 1, sizeof(double));
+    double diff = HUGE_VAL;
+    if(dense && expected && result->rowCount == rows && result->colCount == cols)
+    {
+        for(Row_Node* rptr = full->rowHead; rptr; rptr = rptr->next)
+        {
+            for(Sm_Node* sptr = rptr->rowlist; sptr; sptr = sptr->right)
+            {
+                dense[(long)sptr->row * cols + sptr->col] = sptr->data;
+            }
+        }
+        for(int i = 0; i < rows; i++)
+        {
+            for(int j = 0; j < cols; j++)
+            {
+                expected[(long)i * cols + j] = dense[(long)rowOrder[i] * cols + colOrder[j]];
+            }
+        }
+        diff = denseDifference(result, expected);
+    }
+    free(dense);
+    free(expected);
+    return diff;
+}
+double checkOrderings(void)// RCM and AMD permutations, RCM bandwidth, and both permutation routines against P A Q^T
+{
+    enum{BAND_N = 300, BAND = 3};
+    SparseMatrix band, scrambled, reordered, sym, St, full, permuted;
+    SparseMatrix* general = testOperand('A', 60, 60, 3, 81);
+    SparseMatrix* sparse = testOperand('B', 50, 50, 1, 82);// empty rows and many components
+    SparseMatrix* rect = testOperand('C', 40, 30, 4, 83);
+    MatrixBuilder builder;
+    MatrixStats before, after;
+    int scramble[BAND_N], order[BAND_N], rowOrder[40], colOrder[30];
+    double diff = HUGE_VAL;
+
+    initializeMatrix(&band);
+    initializeMatrix(&scrambled);
+    initializeMatrix(&reordered);
+    initializeMatrix(&sym);
+    initializeMatrix(&St);
+    initializeMatrix(&full);
+    initializeMatrix(&permuted);
+    srand(84);
+    if(beginMatrixBuilder(&builder, &band, BAND_N, BAND_N) == SUCCESS)
+    {
+        for(int i = 0; i < BAND_N; i++)
+        {
+            for(int j = (i > BAND) ? i - BAND : 0; j < BAND_N && j <= i + BAND; j++)
+            {
+                appendElement(&builder, i, j, (matrix_entry)(rand() % 4 + 1));
+            }
+        }
+        finishMatrixBuilder(&builder);
+    }
+    randomPermutation(scramble, BAND_N, 85);
+    // the scrambled band must come back to a band no wider than twice the original
+    if(symmetricPermute(&band, scramble, &scrambled) == SUCCESS && computeOrdering(&scrambled, ORDER_RCM, order) == SUCCESS
+       && isPermutation(order, BAND_N) && symmetricPermute(&scrambled, order, &reordered) == SUCCESS)
+    {
+        computeMatrixStats(&scrambled, &before);
+        computeMatrixStats(&reordered, &after);
+        diff = (after.lowerBandwidth <= 2 * BAND && after.upperBandwidth <= 2 * BAND && before.lowerBandwidth > 2 * BAND) ? 0 : HUGE_VAL;
+    }
+    // both orderings on general, disconnected and symmetric-storage patterns
+    if(cloneMatrix(general, &St) == SUCCESS && transpose(&St) == SUCCESS && addMatrix(general, &St, &sym) == SUCCESS
+       && setSymmetricStorage(&sym, TRUE) == SUCCESS)
+    {
+        const SparseMatrix* patterns[] = {&scrambled, general, sparse, &sym};
+        for(int m = 0; m < 4; m++)
+        {
+            for(int method = ORDER_RCM; method <= ORDER_AMD; method++)
+            {
+                diff = (computeOrdering(patterns[m], (OrderingMethod)method, order) == SUCCESS && isPermutation(order, patterns[m]->rowCount))
+                       ? diff : HUGE_VAL;
+            }
+        }
+    }
+    else
+    {
+        diff = HUGE_VAL;
+    }
+    // permuteMatrix on a rectangular matrix and symmetricPermute on symmetric storage
+    randomPermutation(rowOrder, 40, 86);
+    randomPermutation(colOrder, 30, 87);
+    diff = (permuteMatrix(rect, rowOrder, colOrder, &permuted) == SUCCESS) ? fmax(diff, permutedDifference(&permuted, rect, rowOrder, colOrder))
+                                                                           : HUGE_VAL;
+    clearMatrix(&permuted);
+    randomPermutation(order, 60, 88);
+    if(symmetricPermute(&sym, order, &permuted) == SUCCESS && permuted.symmetric && expandSymmetric(&sym, &full) == SUCCESS
+       && setSymmetricStorage(&permuted, FALSE) == SUCCESS)
+    {
+        diff = fmax(diff, permutedDifference(&permuted, &full, order, order));
+    }
+    else
+    {
+        diff = HUGE_VAL;
+    }
+    clearMatrix(&band);
+    clearMatrix(&scrambled);
+    clearMatrix(&reordered);
+    clearMatrix(&sym);
+    clearMatrix(&St);
+    clearMatrix(&full);
+    clearMatrix(&permuted);
+    return diff;
+}
+status_code runSelfTests(void)
+{
+    const SelfTest tests[] = {
+        {"expression vs explicit ops", checkExpression},
+        {"transposed products", checkTransposeProducts},
+        {"multiply strategies", checkMultiplyStrategies},
+        {"two-phase plans", checkPlans},
+        {"iterative solvers", checkSolvers},
+        {"preconditioners", checkPreconditioners},
+        {"block forms", checkBlockForms},
+        {"sliced forms", checkSlicedForms},
+        {"hypersparse forms", checkHypersparse},
+        {"out-of-core streaming", checkStreaming},
+        {"concurrent readers", checkConcurrentReaders},
+        {"batched updates", checkBatchedUpdates},
+        {"maintained products", checkMaintainedProducts},
+        {"determinants", checkDeterminants},
+        {"structured inverses", checkStructuredInverses},
+        {"result cache", checkResultCache},
+        {"orderings", checkOrderings},
+    };
+    int count = sizeof(tests) / sizeof(tests[0]);
+    status_code sc = SUCCESS;
+
+    printf("Self test:\n");
+    for(int t = 0; t < count; t++)
+    {
+        double error = tests[t].check();
+        boolean ok = (error <= SELF_TEST_TOLERANCE) ? TRUE : FALSE;
+        printf("  %-34s max error %.3g %s\n", tests[t].name, error, ok ? "ok" : "FAILED");
+        sc = ok ? sc : FAILURE;
+    }
+    return sc;
+}
+void initializeRegistry()
+{
+    for(int i = 0; i < MAX_MATRICES; i++)
+    {
+        registry[i].name = '\0';
+        initializeMatrix(&registry[i].matrix);
+        registry[i].isOccupied = FALSE;
+        registry[i].blockForm = NULL;
+        registry[i].sliceForm = NULL;
+        atomic_init(&registry[i].shared, NULL);
+        registry[i].maintained = NULL;
+    }
+}
+void freeAllMatrices()
+{
+    for(int i = 0; i < MAX_MATRICES; i++)
+    {
+        unshareMatrix('A' + i);
+        stopMaintaining('A' + i);
+        if(registry[i].isOccupied)
+        {
+            dropDerivedForms(&registry[i]);
+            clearMatrix(&registry[i].matrix);
+        }
+    }
+    clearResultCache();
+    freePlans();
+}
+int main(int argc, char** argv)
+{
+    int status = 0, choice = 0;   // choice 4 skips the menu
+#ifdef SM_USE_MPI
+    int ranks;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+    if(ranks > 1 || (argc > 1 && strcmp(argv[1], "--mpi-selftest") == 0))// the interactive registry is single process
+    {
+        status = (distributedSelfTest(MPI_COMM_WORLD) == SUCCESS) ? 0 : 1;
+        choice = 4;
+    }
+#endif
+    initializeRegistry();
+    if(choice != 4 && argc > 1 && strcmp(argv[1], "--selftest") == 0)
+    {
+        status = (runSelfTests() == SUCCESS) ? 0 : 1;
+        freeAllMatrices();
+        choice = 4;
+    }
+    if(choice != 4 && getenv(PROFILE_JSON_ENV) != NULL)
+    {
+        atexit(writeProfileJson);
+    }
+
+    while(choice != 4)
+    {
+        printf("\n===== MATRIX CALCULATOR =====\n");
+        printf("1. Matrix Management\n");
+        printf("2. Matrix Operations\n");
+        printf("3. Display Options\n");
+        printf("4. Exit\n");
+        printf("Enter your choice: ");
+        scanf("%d", &choice);
+
+        switch (choice)
+        {
+            case 1:
+                matrixManagementMenu();
+                publishStaleMatrices();
+                break;
+            case 2:
+                operationsMenu();
+                break;
+            case 3:
+                displayOptionsMenu();
+                break;
+            case 4:
+                freeAllMatrices();
+                printf("Exiting Matrix Calculator. Goodbye!\n");
+                break;
+            default:
+                printf("Invalid choice. Please try again.\n");
+        }
+    }
+
+#ifdef SM_USE_MPI
+    MPI_Finalize();
+#endif
+    return status;
 }
\ No newline at end of file